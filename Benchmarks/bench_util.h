@@ -0,0 +1,93 @@
+//
+//  bench_util.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Helpers shared by the benchmarks, each benchmark includes this header in its single source file
+
+#import <Foundation/Foundation.h>
+#include <time.h>
+
+static inline double currentTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// the best time of a run, with the throughput in bytes and in items of some kind
+static inline void printResult(const char *name, double elapsed, NSUInteger length, NSUInteger count, const char *items) {
+    printf("%-22s %8.1f ms, %7.1f MB/s, %9.0f %s/s, %.1f MB\n", name, 1e3 * elapsed, length / elapsed / 1048576.0, count / elapsed, items, length / 1048576.0);
+}
+
+#pragma mark Notes
+
+// synthetic notes spread over the pages like notes on text, 20 on each page
+
+static inline NSUInteger notePageIndex(NSUInteger i) {
+    return i / 20;
+}
+
+static inline NSRect noteBounds(NSUInteger i) {
+    return NSMakeRect(72.0 + (i * 37) % 400, 72.0 + (i * 53) % 600, 120.0, 14.0);
+}
+
+static inline NSString *noteContents(NSUInteger i) {
+    return [NSString stringWithFormat:@"Note %lu on page %lu, with some comments about the text at this place", (unsigned long)i, (unsigned long)(notePageIndex(i) + 1)];
+}
+
+static inline NSDate *noteModificationDate(NSUInteger i) {
+    return [NSDate dateWithTimeIntervalSinceReferenceDate:600000000.0 + i];
+}
+
+// the quadrilateral points of a single line highlight covering the bounds, as the point strings of a Skim note
+static inline NSArray *noteQuadrilateralPointStrings(NSRect bounds) {
+    return [NSArray arrayWithObjects:NSStringFromPoint(NSMakePoint(NSMinX(bounds), NSMaxY(bounds))), NSStringFromPoint(NSMakePoint(NSMaxX(bounds), NSMaxY(bounds))), NSStringFromPoint(NSMakePoint(NSMinX(bounds), NSMinY(bounds))), NSStringFromPoint(NSMakePoint(NSMaxX(bounds), NSMinY(bounds))), nil];
+}
+
+// the keys Skim writes for every note, and the quadrilateral points for a highlight
+static inline NSMutableDictionary *noteProperties(NSUInteger i, NSString *type) {
+    NSRect bounds = noteBounds(i);
+    NSMutableDictionary *note = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+        type, @"type",
+        [NSNumber numberWithUnsignedInteger:notePageIndex(i)], @"pageIndex",
+        NSStringFromRect(bounds), @"bounds",
+        noteContents(i), @"contents",
+        noteModificationDate(i), @"modificationDate",
+        @"Reviewer", @"userName", nil];
+    if ([type isEqualToString:@"Highlight"])
+        [note setObject:noteQuadrilateralPointStrings(bounds) forKey:@"quadrilateralPoints"];
+    return note;
+}
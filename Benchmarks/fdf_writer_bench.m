@@ -0,0 +1,157 @@
+//
+//  fdf_writer_bench.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ Measures exporting a large set of highlight notes as FDF through the real Skim code path, both in memory with
+ -[NSDocument notesFDFDataForFile:fileIDStrings:] and to a file with -[NSDocument
+ writeNotesFDFForFile:fileIDStrings:toURL:error:], which call -[PDFAnnotation writeFDFToWriter:] for each note.
+ 
+ The FDF methods live in categories that depend on much of Skim, so this benchmark links the objects of a Skim
+ build rather than compiling the sources it measures, see the Makefile.
+ 
+ Usage: fdf_writer_bench [number of notes [runs]]
+*/
+
+#import <Foundation/Foundation.h>
+#import <Quartz/Quartz.h>
+#import <SkimNotes/SkimNotes.h>
+#import "NSDocument_SKExtensions.h"
+#import "PDFAnnotation_SKExtensions.h"
+#import "PDFAnnotationMarkup_SKExtensions.h"
+#import "bench_util.h"
+
+// only provides the notes, the FDF methods come from NSDocument (SKExtensions)
+@interface SKBenchDocument : NSDocument {
+    NSArray *notes;
+}
+- (id)initWithNotes:(NSArray *)newNotes;
+@end
+
+@implementation SKBenchDocument
+
+- (id)initWithNotes:(NSArray *)newNotes {
+    self = [super init];
+    if (self) {
+        notes = [newNotes copy];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [notes release];
+    [super dealloc];
+}
+
+- (NSArray *)notes { return notes; }
+
+@end
+
+// highlights on pages of a document, as Skim exports them the notes need a page for their page index
+static NSArray *createNotes(PDFDocument *pdfDocument, NSUInteger count) {
+    NSMutableArray *notes = [[NSMutableArray alloc] initWithCapacity:count];
+    NSUInteger i;
+    for (i = 0; i < count; i++) {
+        NSAutoreleasePool *notePool = [[NSAutoreleasePool alloc] init];
+        NSRect bounds = noteBounds(i);
+        PDFAnnotationMarkup *note = [[PDFAnnotationMarkup alloc] initSkimNoteWithBounds:bounds markupType:kPDFMarkupTypeHighlight];
+        PDFPage *page;
+        while ([pdfDocument pageCount] <= notePageIndex(i)) {
+            page = [[PDFPage alloc] init];
+            [pdfDocument insertPage:page atIndex:[pdfDocument pageCount]];
+            [page release];
+        }
+        page = [pdfDocument pageAtIndex:notePageIndex(i)];
+        [note setQuadrilateralPoints:[NSArray arrayWithObjects:[NSValue valueWithPoint:NSMakePoint(0.0, NSHeight(bounds))], [NSValue valueWithPoint:NSMakePoint(NSWidth(bounds), NSHeight(bounds))], [NSValue valueWithPoint:NSZeroPoint], [NSValue valueWithPoint:NSMakePoint(NSWidth(bounds), 0.0)], nil]];
+        [note setColor:[NSColor colorWithDeviceRed:1.0 green:(i % 3) / 3.0 blue:0.0 alpha:1.0]];
+        [note setContents:noteContents(i)];
+        [note setModificationDate:noteModificationDate(i)];
+        [note setUserName:@"Reviewer"];
+        [page addAnnotation:note];
+        [notes addObject:note];
+        [note release];
+        [notePool release];
+    }
+    return notes;
+}
+
+int main(int argc, char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger noteCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    NSInteger i, runs = argc > 2 ? atol(argv[2]) : 5;
+    PDFDocument *pdfDocument = [[PDFDocument alloc] init];
+    NSArray *notes = createNotes(pdfDocument, noteCount);
+    SKBenchDocument *document = [[SKBenchDocument alloc] initWithNotes:notes];
+    NSURL *url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"fdf_writer_bench-%d.fdf", getpid()]]];
+    NSUInteger length = 0;
+    double start, best;
+    int status = 0;
+    
+    printf("%lu highlight notes\n", (unsigned long)noteCount);
+    
+    best = HUGE_VAL;
+    for (i = 0; i < runs; i++) {
+        NSAutoreleasePool *runPool = [[NSAutoreleasePool alloc] init];
+        start = currentTime();
+        length = [[document notesFDFDataForFile:@"document.pdf" fileIDStrings:nil] length];
+        best = fmin(best, currentTime() - start);
+        [runPool release];
+    }
+    printResult("FDF data", best, length, noteCount, "notes");
+    
+    best = HUGE_VAL;
+    for (i = 0; i < runs && status == 0; i++) {
+        NSAutoreleasePool *runPool = [[NSAutoreleasePool alloc] init];
+        NSError *error = nil;
+        start = currentTime();
+        if ([document writeNotesFDFForFile:@"document.pdf" fileIDStrings:nil toURL:url error:&error] == NO) {
+            fprintf(stderr, "%s: cannot write %s: %s\n", argv[0], [[url path] fileSystemRepresentation], [[error localizedDescription] UTF8String]);
+            status = 1;
+        }
+        best = fmin(best, currentTime() - start);
+        [runPool release];
+    }
+    if (status == 0)
+        printResult("FDF file", best, length, noteCount, "notes");
+    unlink([[url path] fileSystemRepresentation]);
+    
+    [document release];
+    [notes release];
+    [pdfDocument release];
+    [pool release];
+    return status;
+}
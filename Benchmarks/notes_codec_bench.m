@@ -0,0 +1,178 @@
+//
+//  notes_codec_bench.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ Measures the round trip of a large set of synthetic Skim notes through the compact binary format, the keyed archive,
+ and the plist format. Decoding is timed both without and with reading the rich text, because the binary format only
+ parses the RTF data of a note when its text is used.
+ 
+ Usage: notes_codec_bench [number of notes [runs]]
+*/
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+#import "SKNUtilities.h"
+#import "bench_util.h"
+
+enum {
+    SKBenchFormatBinary,
+    SKBenchFormatArchive,
+    SKBenchFormatPlist
+};
+
+// a mix of the note types Skim writes, with the keys it uses for each of them
+static NSArray *createNotes(NSUInteger count) {
+    NSMutableArray *notes = [[NSMutableArray alloc] initWithCapacity:count];
+    NSArray *colors = [NSArray arrayWithObjects:[NSColor colorWithCalibratedRed:1.0 green:1.0 blue:0.0 alpha:1.0], [NSColor colorWithCalibratedRed:0.0 green:0.5 blue:1.0 alpha:0.5], [NSColor colorWithCalibratedRed:1.0 green:0.0 blue:0.0 alpha:1.0], nil];
+    NSFont *font = [NSFont fontWithName:@"Helvetica" size:12.0] ?: [NSFont userFontOfSize:12.0];
+    NSArray *types = [NSArray arrayWithObjects:@"Highlight", @"Highlight", @"Note", @"FreeText", @"Ink", nil];
+    NSUInteger i;
+    
+    for (i = 0; i < count; i++) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        NSMutableDictionary *note = noteProperties(i, [types objectAtIndex:i % 5]);
+        NSString *contents = [note objectForKey:@"contents"];
+        NSRect bounds = noteBounds(i);
+        
+        [note setObject:[colors objectAtIndex:i % 3] forKey:@"color"];
+        
+        // highlights only have the common keys
+        switch (i % 5) {
+            case 2:
+            {
+                NSDictionary *attrs = [NSDictionary dictionaryWithObjectsAndKeys:font, NSFontAttributeName, nil];
+                NSMutableAttributedString *text = [[NSMutableAttributedString alloc] initWithString:[contents stringByAppendingString:@"\nA second paragraph of the anchored note with more detail."] attributes:attrs];
+                [text addAttribute:NSForegroundColorAttributeName value:[colors objectAtIndex:2] range:NSMakeRange(0, 4)];
+                [note setObject:text forKey:@"text"];
+                [note setObject:@"Comment" forKey:@"iconType"];
+                [text release];
+                break;
+            }
+            case 3:
+                [note setObject:font forKey:@"font"];
+                [note setObject:[colors objectAtIndex:1] forKey:@"fontColor"];
+                [note setObject:[NSNumber numberWithDouble:1.0] forKey:@"lineWidth"];
+                break;
+            case 4:
+            {
+                NSMutableArray *path = [NSMutableArray array];
+                NSUInteger j;
+                for (j = 0; j < 24; j++)
+                    [path addObject:NSStringFromPoint(NSMakePoint(NSMinX(bounds) + 5.0 * j, NSMinY(bounds) + (j % 2 ? 4.0 : 0.0)))];
+                [note setObject:[NSArray arrayWithObject:path] forKey:@"pointLists"];
+                [note setObject:[NSNumber numberWithDouble:2.0] forKey:@"lineWidth"];
+                break;
+            }
+        }
+        [notes addObject:note];
+        [pool release];
+    }
+    return notes;
+}
+
+static NSData *encodeNotes(NSArray *notes, NSInteger format) {
+    switch (format) {
+        case SKBenchFormatBinary:  return SKNBinaryDataFromSkimNotes(notes);
+        case SKBenchFormatArchive: return SKNDataFromSkimNotes(notes, NO);
+        default:                   return SKNDataFromSkimNotes(notes, YES);
+    }
+}
+
+// the lengths of the contents and of the rich text when requested, to check the round trip
+static NSUInteger decodeNotes(NSData *data, BOOL readText, NSUInteger *countPtr) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSArray *notes = SKNSkimNotesFromData(data);
+    NSUInteger checksum = 0;
+    for (NSDictionary *note in notes) {
+        checksum += [[note objectForKey:@"contents"] length];
+        if (readText)
+            checksum += [[[note objectForKey:@"text"] string] length];
+    }
+    *countPtr = [notes count];
+    [pool release];
+    return checksum;
+}
+
+int main(int argc, char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger noteCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    NSInteger i, format, runs = argc > 2 ? atol(argv[2]) : 5;
+    const char *names[] = {"binary", "archive", "plist"};
+    NSArray *notes = createNotes(noteCount);
+    NSUInteger count = 0, checksum = 0, expectedChecksum = 0;
+    double start, encodeTime, decodeTime, textTime;
+    int status = 0;
+    
+    for (NSDictionary *note in notes)
+        expectedChecksum += [[note objectForKey:@"contents"] length] + [[[note objectForKey:@"text"] string] length];
+    
+    printf("%lu notes\n", (unsigned long)noteCount);
+    
+    for (format = SKBenchFormatBinary; format <= SKBenchFormatPlist; format++) {
+        NSData *data = nil;
+        
+        encodeTime = decodeTime = textTime = HUGE_VAL;
+        for (i = 0; i < runs; i++) {
+            NSAutoreleasePool *runPool = [[NSAutoreleasePool alloc] init];
+            [data release];
+            start = currentTime();
+            data = [encodeNotes(notes, format) retain];
+            encodeTime = fmin(encodeTime, currentTime() - start);
+            [runPool release];
+        }
+        for (i = 0; i < runs; i++) {
+            start = currentTime();
+            decodeNotes(data, NO, &count);
+            decodeTime = fmin(decodeTime, currentTime() - start);
+        }
+        for (i = 0; i < runs; i++) {
+            start = currentTime();
+            checksum = decodeNotes(data, YES, &count);
+            textTime = fmin(textTime, currentTime() - start);
+        }
+        
+        printf("%-8s %9.1f KB, encode %7.1f ms, decode %7.1f ms, decode with text %7.1f ms%s\n", names[format], [data length] / 1024.0, 1e3 * encodeTime, 1e3 * decodeTime, 1e3 * textTime, count == noteCount && checksum == expectedChecksum ? "" : ", round trip FAILED");
+        if (count != noteCount || checksum != expectedChecksum)
+            status = 1;
+        [data release];
+    }
+    
+    [notes release];
+    [pool release];
+    return status;
+}
@@ -0,0 +1,186 @@
+//
+//  pdfsync_bench.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ Measures the throughput of the pdfsync tokenizer on a synthetic pdfsync file, and compares it with scanning the same
+ file using NSScanner, as the synchronizer did before.
+ 
+ Usage: pdfsync_bench [number of lines [runs]]
+*/
+
+#import <Foundation/Foundation.h>
+#import "SKPDFSyncParser.h"
+#import "bench_util.h"
+
+// roughly what pdfsync writes, a line and a point record for each record index, with page starts and nested files
+static NSData *createPdfsyncData(NSUInteger lineCount) {
+    NSMutableData *data = [[NSMutableData alloc] initWithCapacity:20 * lineCount];
+    char buffer[128];
+    NSUInteger i = 0, recordIndex = 0, page = 0;
+    int len;
+    
+    len = snprintf(buffer, sizeof(buffer), "main\nversion 1\n");
+    [data appendBytes:buffer length:len];
+    while (i < lineCount) {
+        if (recordIndex % 2000 == 0) {
+            len = snprintf(buffer, sizeof(buffer), "s %lu\n", (unsigned long)++page);
+            [data appendBytes:buffer length:len];
+            i++;
+        }
+        if (recordIndex % 5000 == 0) {
+            len = snprintf(buffer, sizeof(buffer), recordIndex % 10000 ? ")\n" : "(chapter%lu.tex\n", (unsigned long)(recordIndex / 10000));
+            [data appendBytes:buffer length:len];
+            i++;
+        }
+        len = snprintf(buffer, sizeof(buffer), "l %lu %lu\np %lu %lu.%02lu %lu.%03lu\n", (unsigned long)recordIndex, (unsigned long)(recordIndex % 3000 + 1), (unsigned long)recordIndex, (unsigned long)(recordIndex * 7919 % 40000000), (unsigned long)(recordIndex % 100), (unsigned long)(recordIndex * 104729 % 50000000), (unsigned long)(recordIndex % 1000));
+        [data appendBytes:buffer length:len];
+        i += 2;
+        recordIndex++;
+    }
+    return data;
+}
+
+static double checksumUsingTokenizer(NSData *data, NSUInteger *lineCountPtr) {
+    SKPDFSyncScanner scanner;
+    SKPDFSyncToken token;
+    const char *name;
+    NSUInteger nameLength, lineCount = 0;
+    double checksum = 0.0;
+    
+    SKPDFSyncScannerInit(&scanner, [data bytes], [data length]);
+    if (SKPDFSyncScanHeader(&scanner, &name, &nameLength) == NO)
+        return -1.0;
+    while (SKPDFSyncScanToken(&scanner, &token)) {
+        lineCount++;
+        switch (token.type) {
+            case SKPDFSyncTokenLine:  checksum += token.line; break;
+            case SKPDFSyncTokenPoint: checksum += token.x + token.y; break;
+            case SKPDFSyncTokenPage:  checksum += token.pageNumber; break;
+            case SKPDFSyncTokenOpenFile:
+                // only file names are materialized
+                [[[NSString alloc] initWithBytes:token.name length:token.nameLength encoding:NSUTF8StringEncoding] release];
+                break;
+            default: break;
+        }
+    }
+    *lineCountPtr = lineCount;
+    return checksum;
+}
+
+static double checksumUsingScanner(NSData *data, NSUInteger *lineCountPtr) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSString *string = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    NSScanner *sc = [[NSScanner alloc] initWithString:string];
+    NSCharacterSet *newlines = [NSCharacterSet newlineCharacterSet];
+    NSString *file;
+    NSInteger recordIndex, line, pageIndex;
+    NSUInteger lineCount = 0;
+    double x, y, checksum = 0.0;
+    unichar ch;
+    
+    [sc setCharactersToBeSkipped:[NSCharacterSet whitespaceCharacterSet]];
+    if ([sc scanUpToCharactersFromSet:newlines intoString:&file] && [sc scanCharactersFromSet:newlines intoString:NULL] &&
+        [sc scanString:@"version" intoString:NULL] && [sc scanInteger:NULL]) {
+        [sc scanCharactersFromSet:newlines intoString:NULL];
+        while ([sc scanCharacter:&ch]) {
+            lineCount++;
+            switch (ch) {
+                case 'l':
+                    if ([sc scanInteger:&recordIndex] && [sc scanInteger:&line]) {
+                        [sc scanInteger:NULL];
+                        checksum += line;
+                    }
+                    break;
+                case 'p':
+                    if ([sc scanString:@"*" intoString:NULL] == NO)
+                        [sc scanString:@"+" intoString:NULL];
+                    if ([sc scanInteger:&recordIndex] && [sc scanDouble:&x] && [sc scanDouble:&y])
+                        checksum += x + y;
+                    break;
+                case 's':
+                    if ([sc scanInteger:&pageIndex])
+                        checksum += pageIndex;
+                    break;
+                case '(':
+                    [sc scanUpToCharactersFromSet:newlines intoString:&file];
+                    break;
+                default:
+                    break;
+            }
+            [sc scanUpToCharactersFromSet:newlines intoString:NULL];
+            [sc scanCharactersFromSet:newlines intoString:NULL];
+        }
+    }
+    [sc release];
+    [string release];
+    [pool release];
+    *lineCountPtr = lineCount;
+    return checksum;
+}
+
+int main(int argc, char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger lineCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+    NSInteger i, runs = argc > 2 ? atol(argv[2]) : 5;
+    NSData *data = createPdfsyncData(lineCount);
+    double megabytes = [data length] / 1048576.0;
+    double best, start, checksum = 0.0;
+    NSUInteger scannedLines = 0;
+    
+    printf("pdfsync file: %lu lines, %.1f MB\n", (unsigned long)lineCount, megabytes);
+    
+    best = HUGE_VAL;
+    for (i = 0; i < runs; i++) {
+        start = currentTime();
+        checksum = checksumUsingTokenizer(data, &scannedLines);
+        best = fmin(best, currentTime() - start);
+    }
+    printf("tokenizer: %.3f s, %.0f MB/s, %.1f M lines/s, checksum %.6g\n", best, megabytes / best, scannedLines / best / 1e6, checksum);
+    
+    best = HUGE_VAL;
+    for (i = 0; i < runs; i++) {
+        start = currentTime();
+        checksum = checksumUsingScanner(data, &scannedLines);
+        best = fmin(best, currentTime() - start);
+    }
+    printf("NSScanner: %.3f s, %.0f MB/s, %.1f M lines/s, checksum %.6g\n", best, megabytes / best, scannedLines / best / 1e6, checksum);
+    
+    [data release];
+    [pool release];
+    return 0;
+}
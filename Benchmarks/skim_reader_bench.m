@@ -0,0 +1,156 @@
+//
+//  skim_reader_bench.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ Measures reading the notes of all PDF files in a directory through the skimnotes agent, with a message per file and
+ with the batch methods of SKNSkimReader, for the Skim notes and for the text notes.
+ 
+ The reader launches the skimnotes tool as its agent. In a command line tool the main bundle is the directory of the
+ executable, so a skimnotes tool next to skim_reader_bench is used first. Otherwise the reader uses the tool in the
+ SharedSupport folder of the installed Skim application.
+ 
+ Usage: skim_reader_bench directory [runs]
+*/
+
+#import <Foundation/Foundation.h>
+#import "SKNSkimReader.h"
+#import "bench_util.h"
+
+static NSArray *fileURLsInDirectory(NSString *directory) {
+    NSMutableArray *fileURLs = [NSMutableArray array];
+    NSDirectoryEnumerator *dirEnum = [[NSFileManager defaultManager] enumeratorAtPath:directory];
+    NSString *file;
+    while ((file = [dirEnum nextObject])) {
+        NSString *extension = [[file pathExtension] lowercaseString];
+        if ([extension isEqualToString:@"pdf"] || [extension isEqualToString:@"pdfd"] || [extension isEqualToString:@"skim"]) {
+            [fileURLs addObject:[NSURL fileURLWithPath:[directory stringByAppendingPathComponent:file]]];
+            // the contents of a PDF bundle are not separate files
+            if ([extension isEqualToString:@"pdfd"])
+                [dirEnum skipDescendents];
+        }
+    }
+    return fileURLs;
+}
+
+static NSUInteger resultLength(id result) {
+    return [result isKindOfClass:[NSData class]] || [result isKindOfClass:[NSString class]] ? [result length] : 0;
+}
+
+int main(int argc, char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSArray *fileURLs = argc > 1 ? fileURLsInDirectory([[NSString stringWithUTF8String:argv[1]] stringByStandardizingPath]) : nil;
+    NSInteger i, runs = argc > 2 ? atol(argv[2]) : 3;
+    NSUInteger fileCount = [fileURLs count], found, length, mismatches = 0;
+    SKNSkimReader *reader = [SKNSkimReader sharedReader];
+    NSMutableArray *singleResults = [NSMutableArray array];
+    NSArray *batchResults = nil;
+    NSMutableArray *textResults = [NSMutableArray array];
+    double start, singleTime, batchTime, textSingleTime, textBatchTime;
+    
+    if (fileCount == 0) {
+        fprintf(stderr, "usage: %s directory [runs]\nthe directory should contain PDF files\n", argv[0]);
+        return 1;
+    }
+    
+    // the first request launches the agent
+    start = currentTime();
+    [reader SkimNotesAtURL:[fileURLs objectAtIndex:0]];
+    printf("%lu files, launching the agent: %.1f ms\n", (unsigned long)fileCount, 1e3 * (currentTime() - start));
+    
+    singleTime = batchTime = textSingleTime = textBatchTime = HUGE_VAL;
+    for (i = 0; i < runs; i++) {
+        NSAutoreleasePool *runPool = [[NSAutoreleasePool alloc] init];
+        
+        [singleResults removeAllObjects];
+        start = currentTime();
+        for (NSURL *fileURL in fileURLs)
+            [singleResults addObject:[reader SkimNotesAtURL:fileURL] ?: [NSNull null]];
+        singleTime = fmin(singleTime, currentTime() - start);
+        
+        [batchResults release];
+        start = currentTime();
+        batchResults = [[reader SkimNotesAtURLs:fileURLs] retain];
+        batchTime = fmin(batchTime, currentTime() - start);
+        
+        [textResults removeAllObjects];
+        start = currentTime();
+        for (NSURL *fileURL in fileURLs)
+            [textResults addObject:[reader textNotesAtURL:fileURL] ?: [NSNull null]];
+        textSingleTime = fmin(textSingleTime, currentTime() - start);
+        
+        start = currentTime();
+        [reader textNotesAtURLs:fileURLs];
+        textBatchTime = fmin(textBatchTime, currentTime() - start);
+        
+        [runPool release];
+    }
+    
+    found = length = 0;
+    for (id result in singleResults) {
+        if (resultLength(result)) {
+            found++;
+            length += resultLength(result);
+        }
+    }
+    printResult("Skim notes, single", singleTime, length, fileCount, "files");
+    printf("%lu files with notes\n", (unsigned long)found);
+    
+    found = length = 0;
+    for (i = 0; i < (NSInteger)fileCount; i++) {
+        id result = [batchResults objectAtIndex:i];
+        if (resultLength(result)) {
+            found++;
+            length += resultLength(result);
+        }
+        if ([result isEqual:[singleResults objectAtIndex:i]] == NO)
+            mismatches++;
+    }
+    printResult("Skim notes, batch", batchTime, length, fileCount, "files");
+    
+    length = 0;
+    for (id result in textResults)
+        length += resultLength(result);
+    printResult("text notes, single", textSingleTime, length, fileCount, "files");
+    printResult("text notes, batch", textBatchTime, length, fileCount, "files");
+    if (mismatches)
+        printf("%lu files with different batch results\n", (unsigned long)mismatches);
+    
+    [batchResults release];
+    [pool release];
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,287 @@
+//
+//  synctex_grid_bench.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ Measures the latency of inverse search on a pathologically dense page, a table with one box per cell, using the SyncTeX
+ index. The first click on the page includes building its grid. The clicks are compared with the linear scan over the
+ records of the page that the index used before, which must give the same results, and with synctex_edit_query.
+ 
+ Usage: synctex_grid_bench [rows [columns [clicks]]]
+*/
+
+#import <Foundation/Foundation.h>
+#import "SKSyncTeXIndex.h"
+#import "bench_util.h"
+
+#define PAGE_WIDTH 612.0
+#define PAGE_HEIGHT 792.0
+#define BOX_H 4736286L
+#define BOX_V 49361166L
+#define BOX_WIDTH 30583320L
+#define BOX_HEIGHT 45114153L
+
+// a reproducible sequence of clicks
+static NSPoint randomPoint(uint64_t *state) {
+    NSPoint point;
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    point.x = PAGE_WIDTH * (*state >> 11) / 9007199254740992.0;
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    point.y = PAGE_HEIGHT * (*state >> 11) / 9007199254740992.0;
+    return point;
+}
+
+static void writeTextPage(FILE *file, long page, long lines) {
+    long line, item;
+    fprintf(file, "{%ld\n[1,%ld:%ld,%ld:%ld,%ld,0\n", page, page * 100, BOX_H, BOX_V, BOX_WIDTH, BOX_HEIGHT);
+    for (line = 0; line < lines; line++) {
+        long v = 1000000 + line * 800000;
+        fprintf(file, "(1,%ld:%ld,%ld:%ld,655360,0\n", page * 100 + line, BOX_H, v, BOX_WIDTH);
+        for (item = 0; item < 10; item++)
+            fprintf(file, "x1,%ld:%ld,%ld\ng1,%ld:%ld,%ld\n", page * 100 + line, BOX_H + item * 2000000, v, page * 100 + line, BOX_H + item * 2000000 + 100000, v);
+        fprintf(file, ")\n");
+    }
+    fprintf(file, "]\n}%ld\n", page);
+}
+
+// a text page, the dense table page, and another text page
+static BOOL writeSyncTeXFile(NSString *path, long rows, long columns) {
+    FILE *file = fopen([path fileSystemRepresentation], "w");
+    long row, column, cellWidth = BOX_WIDTH / columns, rowHeight = BOX_HEIGHT / rows, count = 0;
+    if (file == NULL)
+        return NO;
+    fprintf(file, "SyncTeX Version:1\nInput:1:table.tex\nOutput:pdf\nMagnification:1000\nUnit:1\nX Offset:0\nY Offset:0\nContent:\n");
+    writeTextPage(file, 1, 60);
+    fprintf(file, "{2\n[1,10:%ld,%ld:%ld,%ld,0\n", BOX_H, BOX_V, BOX_WIDTH, BOX_HEIGHT);
+    for (row = 0; row < rows; row++) {
+        long v = BOX_V - BOX_HEIGHT + (row + 1) * rowHeight - rowHeight / 5;
+        for (column = 0; column < columns; column++) {
+            long h = BOX_H + column * cellWidth, line = 1000 + row * columns + column;
+            fprintf(file, "(1,%ld:%ld,%ld:%ld,%ld,%ld\n", line, h, v, cellWidth - cellWidth / 10, rowHeight * 3 / 5, rowHeight / 5);
+            fprintf(file, "x1,%ld:%ld,%ld\ng1,%ld:%ld,%ld\n)\n", line, h, v, line, h + cellWidth / 2, v);
+            count += 3;
+        }
+    }
+    fprintf(file, "]\n}2\n");
+    writeTextPage(file, 3, 60);
+    fprintf(file, "Postamble:\nCount:%ld\nPost scriptum:\n", count + 2 * 60 * 21);
+    return fclose(file) == 0;
+}
+
+#pragma mark Linear scan
+
+static inline BOOL pointInRecord(NSPoint point, const SKSyncTeXRecord *record) {
+    return point.x >= record->h && point.x <= record->h + record->width &&
+           point.y >= record->v - record->height && point.y <= record->v + record->depth;
+}
+
+static inline CGFloat horizontalDistance(NSPoint point, const SKSyncTeXRecord *record) {
+    if (point.x < record->h)
+        return record->h - point.x;
+    else if (point.x > record->h + record->width)
+        return record->h + record->width - point.x;
+    else
+        return 0.0;
+}
+
+static inline CGFloat squaredDistance(NSPoint point, const SKSyncTeXRecord *record) {
+    CGFloat dx = horizontalDistance(point, record), dy = 0.0;
+    if (point.y < record->v - record->height)
+        dy = record->v - record->height - point.y;
+    else if (point.y > record->v + record->depth)
+        dy = point.y - record->v - record->depth;
+    return dx * dx + dy * dy;
+}
+
+// the search the index did for every page before it had grids
+static BOOL linearFindLine(SKSyncTeXIndex *index, NSInteger *linePtr, NSPoint point, NSUInteger pageIndex) {
+    NSRange range = [index rangeOfRecordsForPageAtIndex:pageIndex];
+    const SKSyncTeXRecord *records = [index recordAtIndex:0];
+    NSUInteger i, start = range.location, end = NSMaxRange(range);
+    NSUInteger container = NSNotFound, found = NSNotFound;
+    CGFloat area, distance, containerArea = CGFLOAT_MAX;
+    const SKSyncTeXRecord *record;
+    
+    for (i = start; i < end; i++) {
+        record = records + i;
+        if (record->type == SKSyncTeXRecordTypeLeaf || pointInRecord(point, record) == NO)
+            continue;
+        area = record->width * (record->height + record->depth);
+        if (container == NSNotFound ||
+            (record->type == SKSyncTeXRecordTypeHBox && records[container].type == SKSyncTeXRecordTypeVBox) ||
+            (record->type == records[container].type && area <= containerArea)) {
+            container = i;
+            containerArea = area;
+        }
+    }
+    
+    if (container != NSNotFound) {
+        NSUInteger left = NSNotFound, right = NSNotFound;
+        CGFloat leftDistance = CGFLOAT_MAX, rightDistance = CGFLOAT_MAX;
+        for (i = container + 1; i < end; i++) {
+            record = records + i;
+            if ((NSUInteger)record->parent != container)
+                continue;
+            distance = horizontalDistance(point, record);
+            if (distance <= 0.0 && -distance < leftDistance) {
+                left = i;
+                leftDistance = -distance;
+            } else if (distance > 0.0 && distance < rightDistance) {
+                right = i;
+                rightDistance = distance;
+            }
+        }
+        if (left != NSNotFound && right != NSNotFound) {
+            if (records[left].line != records[right].line)
+                found = records[left].line < records[right].line ? left : right;
+            else
+                found = leftDistance <= rightDistance ? left : right;
+        } else if (left != NSNotFound) {
+            found = left;
+        } else if (right != NSNotFound) {
+            found = right;
+        } else {
+            found = container;
+        }
+    } else {
+        CGFloat closestDistance = CGFLOAT_MAX;
+        for (i = start; i < end; i++) {
+            distance = squaredDistance(point, records + i);
+            if (distance < closestDistance) {
+                found = i;
+                closestDistance = distance;
+            }
+        }
+    }
+    
+    if (found == NSNotFound)
+        return NO;
+    *linePtr = records[found].line;
+    return YES;
+}
+
+#pragma mark Main
+
+int main(int argc, char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    long rows = argc > 1 ? strtol(argv[1], NULL, 10) : 300;
+    long columns = argc > 2 ? strtol(argv[2], NULL, 10) : 50;
+    NSUInteger i, clicks = argc > 3 ? strtoul(argv[3], NULL, 10) : 20000;
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"synctex_grid_bench-%d", getpid()]];
+    NSString *pdfFile = [directory stringByAppendingPathComponent:@"table.pdf"];
+    NSString *syncTeXFile = [directory stringByAppendingPathComponent:@"table.synctex"];
+    NSPoint *points;
+    NSInteger *lines, line;
+    int32_t tag;
+    NSUInteger found = 0, mismatches = 0;
+    SKSyncTeXFileSignature signature;
+    synctex_scanner_p scanner;
+    SKSyncTeXIndex *index;
+    uint64_t state = 1;
+    double start, elapsed;
+    int status = 1;
+    
+    if (rows < 1 || columns < 1 || clicks < 1) {
+        fprintf(stderr, "usage: %s [rows [columns [clicks]]]\n", argv[0]);
+        return 1;
+    }
+    
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    if (writeSyncTeXFile(syncTeXFile, rows, columns) == NO || [SKSyncTeXIndex getSignature:&signature forSyncTeXFile:syncTeXFile] == NO) {
+        fprintf(stderr, "%s: cannot write %s\n", argv[0], [syncTeXFile fileSystemRepresentation]);
+        [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+        return 1;
+    }
+    
+    scanner = synctex_scanner_new_with_output_file([pdfFile fileSystemRepresentation], NULL, 1);
+    index = scanner ? [[SKSyncTeXIndex alloc] initWithScanner:scanner syncTeXFile:syncTeXFile signature:signature] : nil;
+    
+    if (index && [index pageCount] == 3) {
+        points = (NSPoint *)malloc(clicks * sizeof(NSPoint));
+        lines = (NSInteger *)malloc(clicks * sizeof(NSInteger));
+        for (i = 0; i < clicks; i++)
+            points[i] = randomPoint(&state);
+        
+        printf("dense page: %ld x %ld table, %lu records\n", rows, columns, (unsigned long)[index rangeOfRecordsForPageAtIndex:1].length);
+        
+        start = currentTime();
+        [index findTag:&tag line:&line forLocation:points[0] atPageIndex:1];
+        printf("index, first click: %.1f us\n", 1e6 * (currentTime() - start));
+        
+        start = currentTime();
+        for (i = 0; i < clicks; i++) {
+            if ([index findTag:&tag line:lines + i forLocation:points[i] atPageIndex:1])
+                found++;
+            else
+                lines[i] = 0;
+        }
+        elapsed = currentTime() - start;
+        printf("index: %.2f us per click, %lu of %lu found\n", 1e6 * elapsed / clicks, (unsigned long)found, (unsigned long)clicks);
+        
+        start = currentTime();
+        for (i = 0; i < clicks; i++) {
+            if (linearFindLine(index, &line, points[i], 1) == NO)
+                line = 0;
+            if (line != lines[i])
+                mismatches++;
+        }
+        elapsed = currentTime() - start;
+        printf("linear scan: %.2f us per click, %lu mismatches\n", 1e6 * elapsed / clicks, (unsigned long)mismatches);
+        
+        found = 0;
+        start = currentTime();
+        for (i = 0; i < clicks; i++) {
+            if (synctex_edit_query(scanner, 2, points[i].x, points[i].y) > 0 && synctex_scanner_next_result(scanner))
+                found++;
+        }
+        elapsed = currentTime() - start;
+        printf("synctex_edit_query: %.2f us per click, %lu of %lu found\n", 1e6 * elapsed / clicks, (unsigned long)found, (unsigned long)clicks);
+        
+        free(points);
+        free(lines);
+        status = mismatches == 0 ? 0 : 1;
+    } else {
+        fprintf(stderr, "%s: cannot parse %s\n", argv[0], [syncTeXFile fileSystemRepresentation]);
+    }
+    
+    [index release];
+    if (scanner)
+        synctex_scanner_free(scanner);
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+    [pool release];
+    return status;
+}
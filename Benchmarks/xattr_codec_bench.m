@@ -0,0 +1,133 @@
+//
+//  xattr_codec_bench.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ Measures saving and loading a large set of notes in the extended attributes of a temporary file, with the default
+ bzip2 compression and small fragments, and with the fast LZ4 codec, with and without large fragments. The notes are
+ archived synthetic note dictionaries, so they compress like the archives Skim writes.
+ 
+ Usage: xattr_codec_bench [number of notes [runs]]
+*/
+
+#import <Foundation/Foundation.h>
+#import "SKNExtendedAttributeManager.h"
+#import "bench_util.h"
+#include <sys/xattr.h>
+
+#define NOTES_ATTRIBUTE @"net_sourceforge_skim-app_notes"
+
+static NSData *createNotesData(NSUInteger count) {
+    NSMutableArray *notes = [NSMutableArray arrayWithCapacity:count];
+    NSUInteger i;
+    for (i = 0; i < count; i++)
+        [notes addObject:noteProperties(i, i % 3 ? @"Highlight" : @"Note")];
+    return [NSKeyedArchiver archivedDataWithRootObject:notes];
+}
+
+// the space used by all attributes of the file, including fragments
+static size_t attributesSize(const char *path) {
+    ssize_t namesLength = listxattr(path, NULL, 0, 0);
+    size_t size = 0;
+    char *names, *name;
+    if (namesLength <= 0)
+        return 0;
+    names = (char *)malloc(namesLength);
+    namesLength = listxattr(path, names, namesLength, 0);
+    for (name = names; namesLength > 0 && name < names + namesLength; name += strlen(name) + 1) {
+        ssize_t length = getxattr(path, name, NULL, 0, 0, 0);
+        if (length > 0)
+            size += length;
+    }
+    free(names);
+    return size;
+}
+
+int main(int argc, char *argv[]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger noteCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+    NSInteger i, j, runs = argc > 2 ? atol(argv[2]) : 5;
+    const char *names[] = {"bzip2", "LZ4", "LZ4, large fragments"};
+    SKNXattrFlags options[] = {kSKNXattrDefault, kSKNXattrFastCompress, kSKNXattrFastCompress | kSKNXattrLargeFragments};
+    SKNExtendedAttributeManager *eam = [SKNExtendedAttributeManager sharedManager];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"xattr_codec_bench-%d.pdf", getpid()]];
+    NSData *data = createNotesData(noteCount);
+    NSError *error = nil;
+    double start, writeTime, readTime;
+    int status = 0;
+    
+    if ([[NSData data] writeToFile:path atomically:NO] == NO) {
+        fprintf(stderr, "%s: cannot create %s\n", argv[0], [path fileSystemRepresentation]);
+        return 1;
+    }
+    
+    printf("%lu notes, %.1f KB archived\n", (unsigned long)noteCount, [data length] / 1024.0);
+    
+    for (j = 0; j < 3; j++) {
+        BOOL matches = YES;
+        writeTime = readTime = HUGE_VAL;
+        for (i = 0; i < runs; i++) {
+            NSAutoreleasePool *runPool = [[NSAutoreleasePool alloc] init];
+            NSData *readData;
+            
+            [eam removeExtendedAttributeNamed:NOTES_ATTRIBUTE atPath:path traverseLink:YES error:NULL];
+            start = currentTime();
+            if ([eam setExtendedAttributeNamed:NOTES_ATTRIBUTE toValue:data atPath:path options:options[j] error:&error] == NO) {
+                fprintf(stderr, "%s: writing failed: %s\n", argv[0], [[error description] UTF8String]);
+                status = 1;
+                [runPool release];
+                break;
+            }
+            writeTime = fmin(writeTime, currentTime() - start);
+            
+            start = currentTime();
+            readData = [eam extendedAttributeNamed:NOTES_ATTRIBUTE atPath:path traverseLink:YES error:&error];
+            readTime = fmin(readTime, currentTime() - start);
+            if ([readData isEqualToData:data] == NO)
+                matches = NO;
+            [runPool release];
+        }
+        
+        printf("%-21s %9.1f KB stored, write %7.1f ms, read %7.1f ms%s\n", names[j], attributesSize([path fileSystemRepresentation]) / 1024.0, 1e3 * writeTime, 1e3 * readTime, matches ? "" : ", round trip FAILED");
+        if (matches == NO)
+            status = 1;
+    }
+    
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+    [pool release];
+    return status;
+}
@@ -0,0 +1,162 @@
+//
+//  fdf_parser_fuzzer.c
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ Fuzz target for the FDF object parser. It parses the input and reads the values Skim reads from each annotation,
+ walking nested arrays, so references get resolved through the accessors.
+ 
+ With libFuzzer, build with -fsanitize=fuzzer. Otherwise the file has a main that parses each file given as an
+ argument, or standard input, which works with AFL and for replaying crashes.
+*/
+
+#include "SKFDFObjectParser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_WALK_DEPTH 8
+
+static const char *annotationKeys[] = {"Type", "Subtype", "Rect", "Page", "F", "Contents", "C", "IC", "BS", "Border", "M", "T", "Q", "Name", "LE", "L", "InkList", "QuadPoints", "DA", "DS", "Popup", "Parent", NULL};
+
+static unsigned long checksumObject(SKFDFObjectRef object, int depth) {
+    unsigned long checksum = (unsigned long)SKFDFObjectGetType(object);
+    SKFDFObjectRef value;
+    SKFDFReal number;
+    SKFDFInteger integer;
+    const char *name;
+    size_t i, count;
+    
+    switch (SKFDFObjectGetType(object)) {
+        case kSKFDFObjectTypeName:
+            checksum += strlen(SKFDFNameGetString(object));
+            break;
+        case kSKFDFObjectTypeString:
+            count = SKFDFStringGetLength(object);
+            for (i = 0; i < count; i++)
+                checksum += SKFDFStringGetBytePtr(object)[i];
+            break;
+        case kSKFDFObjectTypeArray:
+            count = SKFDFArrayGetCount(object);
+            for (i = 0; i < count; i++) {
+                if (SKFDFArrayGetNumber(object, i, &number))
+                    checksum += number > 0.0;
+                if (SKFDFArrayGetName(object, i, &name))
+                    checksum += strlen(name);
+                if (depth < MAX_WALK_DEPTH)
+                    checksum += checksumObject(SKFDFArrayGetObject(object, i), depth + 1);
+            }
+            break;
+        case kSKFDFObjectTypeDictionary:
+            for (i = 0; annotationKeys[i]; i++) {
+                if (SKFDFDictionaryGetInteger(object, annotationKeys[i], &integer))
+                    checksum += (unsigned long)integer;
+                if (SKFDFDictionaryGetNumber(object, annotationKeys[i], &number))
+                    checksum += number > 0.0;
+                if (SKFDFDictionaryGetName(object, annotationKeys[i], &name))
+                    checksum += strlen(name);
+                if (SKFDFDictionaryGetString(object, annotationKeys[i], &value))
+                    checksum += SKFDFStringGetLength(value);
+                if (SKFDFDictionaryGetArray(object, annotationKeys[i], &value))
+                    checksum += SKFDFArrayGetCount(value);
+                if (depth < MAX_WALK_DEPTH && SKFDFDictionaryGetDictionary(object, annotationKeys[i], &value))
+                    checksum += checksumObject(value, depth + 1);
+                if (depth < MAX_WALK_DEPTH)
+                    checksum += checksumObject(SKFDFDictionaryGetObject(object, annotationKeys[i]), depth + 1);
+            }
+            break;
+        default:
+            break;
+    }
+    return checksum;
+}
+
+static bool readAnnotation(SKFDFObjectRef annotation, void *context) {
+    *(unsigned long *)context += checksumObject(annotation, 0);
+    return true;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    unsigned long checksum = 0;
+    SKFDFParseAnnotations(data, size, readAnnotation, &checksum);
+    return 0;
+}
+
+#ifndef SKFDF_LIBFUZZER
+
+static int parseFile(FILE *file) {
+    size_t length = 0, capacity = 65536, count;
+    uint8_t *data = (uint8_t *)malloc(capacity), *newData;
+    if (data == NULL)
+        return 1;
+    while ((count = fread(data + length, 1, capacity - length, file)) > 0) {
+        length += count;
+        if (length == capacity) {
+            newData = (uint8_t *)realloc(data, 2 * capacity);
+            if (newData == NULL) {
+                free(data);
+                return 1;
+            }
+            data = newData;
+            capacity *= 2;
+        }
+    }
+    LLVMFuzzerTestOneInput(data, length);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int i, status = 0;
+    if (argc < 2)
+        return parseFile(stdin);
+    for (i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[i]);
+            status = 1;
+            continue;
+        }
+        status |= parseFile(file);
+        fclose(file);
+    }
+    return status;
+}
+
+#endif
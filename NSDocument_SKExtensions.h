@@ -88,6 +88,7 @@ typedef NS_ENUM(NSInteger, SKInteractionMode) {
 
 - (NSString *)notesStringForTemplateType:(NSString *)typeName;
 - (NSData *)notesDataForTemplateType:(NSString *)typeName;
+- (BOOL)writeNotesForTemplateType:(NSString *)typeName toURL:(NSURL *)url error:(NSError **)outError;
 - (NSFileWrapper *)notesFileWrapperForTemplateType:(NSString *)typeName;
 
 - (NSString *)notesString;
@@ -95,6 +96,7 @@ typedef NS_ENUM(NSInteger, SKInteractionMode) {
 - (NSFileWrapper *)notesRTFDFileWrapper;
 
 - (NSData *)notesFDFDataForFile:(NSString *)filename fileIDStrings:(NSArray *)fileIDStrings;
+- (BOOL)writeNotesFDFForFile:(NSString *)filename fileIDStrings:(NSArray *)fileIDStrings toURL:(NSURL *)url error:(NSError **)outError;
 
 #pragma mark Outlines
 
@@ -44,6 +44,7 @@
 #import "SKAlias.h"
 #import "SKInfoWindowController.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 #import "PDFAnnotation_SKExtensions.h"
 #import "NSString_SKExtensions.h"
 #import "SKBookmarkSheetController.h"
@@ -55,12 +56,49 @@
 #import "NSWindow_SKExtensions.h"
 #import "SKStringConstants.h"
 #import <SkimNotes/SkimNotes.h>
+#import <fcntl.h>
 
 #define SKDisableExportAttributesKey @"SKDisableExportAttributes"
 
 NSString *SKDocumentFileURLDidChangeNotification = @"SKDocumentFileURLDidChangeNotification";
 
 
+static void writeNotesFDF(NSArray *notes, NSString *filename, NSArray *fileIDStrings, SKFDFWriter *writer) {
+    NSInteger i = 0, iMax = [notes count] + 1;
+    [writer appendCString:"%FDF-1.2\n%\xe2\xe3\xcf\xd3\n"];
+    for (PDFAnnotation *note in notes) {
+        [writer appendInteger:++i];
+        [writer appendCString:" 0 obj<<"];
+        [note writeFDFToWriter:writer];
+        [writer appendCString:">>\nendobj\n"];
+    }
+    [writer appendInteger:iMax];
+    [writer appendCString:" 0 obj<<"];
+    [writer appendName:SKFDFFDFKey];
+    [writer appendCString:"<<"];
+    [writer appendName:SKFDFAnnotationsKey];
+    [writer appendCString:"["];
+    for (i = 1; i < iMax; i++) {
+        [writer appendInteger:i];
+        [writer appendCString:" 0 R "];
+    }
+    [writer appendCString:"]"];
+    [writer appendName:SKFDFFileKey];
+    [writer appendString:filename ?: @""];
+    if ([fileIDStrings count] == 2) {
+        [writer appendName:SKFDFFileIDKey];
+        [writer appendCString:"[<"];
+        [writer appendCString:[[fileIDStrings objectAtIndex:0] UTF8String]];
+        [writer appendCString:"><"];
+        [writer appendCString:[[fileIDStrings objectAtIndex:1] UTF8String]];
+        [writer appendCString:">]"];
+    }
+    [writer appendCString:">>>>\nendobj\ntrailer\n<<"];
+    [writer appendName:SKFDFRootKey];
+    [writer appendInteger:iMax];
+    [writer appendCString:" 0 R>>\n%%EOF\n"];
+}
+
 @implementation NSDocument (SKExtensions)
 
 + (BOOL)isPDFDocument { return NO; }
@@ -214,14 +252,20 @@ enum { SKAddBookmarkTypeBookmark, SKAddBookmarkTypeSetup, SKAddBookmarkTypeSessi
     return SKNDataFromSkimNotes(array, [[NSUserDefaults standardUserDefaults] boolForKey:SKWriteSkimNotesAsPlistKey]);
 }
 
+- (NSDictionary *)notesDocumentAttributes:(NSDictionary *)docAttributes {
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:SKDisableExportAttributesKey] == NO) {
+        NSMutableDictionary *mutableAttributes = [[docAttributes mutableCopy] autorelease];
+        [mutableAttributes addEntriesFromDictionary:[NSDictionary dictionaryWithObjectsAndKeys:NSFullUserName(), NSAuthorDocumentAttribute, [NSDate date], NSCreationTimeDocumentAttribute, [[[[self fileURL] path] lastPathComponent] stringByDeletingPathExtension], NSTitleDocumentAttribute, nil]];
+        docAttributes = mutableAttributes;
+    }
+    return docAttributes;
+}
+
 - (NSString *)notesStringForTemplateType:(NSString *)typeName {
     NSString *string = nil;
     if ([[SKTemplateManager sharedManager] isRichTextTemplateType:typeName] == NO) {
-        NSURL *templateURL = [[SKTemplateManager sharedManager] URLForTemplateType:typeName];
-        NSError *error = nil;
-        NSString *templateString = [[NSString alloc] initWithContentsOfURL:templateURL encoding:NSUTF8StringEncoding error:&error];
-        string = [SKTemplateParser stringByParsingTemplateString:templateString usingObject:self];
-        [templateString release];
+        NSArray *template = [[SKTemplateManager sharedManager] templateForTemplateType:typeName documentAttributes:NULL];
+        string = [SKTemplateParser stringFromTemplateArray:template usingObject:self atIndex:0];
     }
     return string;
 }
@@ -229,38 +273,40 @@ enum { SKAddBookmarkTypeBookmark, SKAddBookmarkTypeSetup, SKAddBookmarkTypeSessi
 - (NSData *)notesDataForTemplateType:(NSString *)typeName {
     NSData *data = nil;
     if ([[SKTemplateManager sharedManager] isRichTextTemplateType:typeName]) {
-        NSURL *templateURL = [[SKTemplateManager sharedManager] URLForTemplateType:typeName];
         NSDictionary *docAttributes = nil;
         NSError *error = nil;
-        NSAttributedString *templateAttrString = [[NSAttributedString alloc] initWithURL:templateURL options:[NSDictionary dictionary] documentAttributes:&docAttributes error:NULL];
-        NSAttributedString *attrString = [SKTemplateParser attributedStringByParsingTemplateAttributedString:templateAttrString usingObject:self];
-        if ([[NSUserDefaults standardUserDefaults] boolForKey:SKDisableExportAttributesKey] == NO) {
-            NSMutableDictionary *mutableAttributes = [[docAttributes mutableCopy] autorelease];
-            [mutableAttributes addEntriesFromDictionary:[NSDictionary dictionaryWithObjectsAndKeys:NSFullUserName(), NSAuthorDocumentAttribute, [NSDate date], NSCreationTimeDocumentAttribute, [[[[self fileURL] path] lastPathComponent] stringByDeletingPathExtension], NSTitleDocumentAttribute, nil]];
-            docAttributes = mutableAttributes;
-        }
+        NSArray *template = [[SKTemplateManager sharedManager] templateForTemplateType:typeName documentAttributes:&docAttributes];
+        NSAttributedString *attrString = [SKTemplateParser attributedStringFromTemplateArray:template usingObject:self atIndex:0];
+        docAttributes = [self notesDocumentAttributes:docAttributes];
         data = [attrString dataFromRange:NSMakeRange(0, [attrString length]) documentAttributes:docAttributes error:&error];
-        [templateAttrString release];
     } else {
         data = [[self notesStringForTemplateType:typeName] dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:NO];
     }
     return data;
 }
 
+- (BOOL)writeNotesForTemplateType:(NSString *)typeName toURL:(NSURL *)url error:(NSError **)outError {
+    if ([[typeName pathExtension] isCaseInsensitiveEqual:@"rtf"]) {
+        NSDictionary *docAttributes = nil;
+        NSArray *template = [[SKTemplateManager sharedManager] templateForTemplateType:typeName documentAttributes:&docAttributes];
+        return [SKTemplateParser writeAttributedTemplateArray:template usingObject:self documentAttributes:[self notesDocumentAttributes:docAttributes] toURL:url error:outError];
+    } else if ([[SKTemplateManager sharedManager] isRichTextTemplateType:typeName]) {
+        NSData *data = [self notesDataForTemplateType:typeName];
+        return data && [data writeToURL:url options:0 error:outError];
+    } else {
+        NSArray *template = [[SKTemplateManager sharedManager] templateForTemplateType:typeName documentAttributes:NULL];
+        return [SKTemplateParser writeTemplateArray:template usingObject:self toURL:url error:outError];
+    }
+}
+
 - (NSFileWrapper *)notesFileWrapperForTemplateType:(NSString *)typeName {
     NSFileWrapper *fileWrapper = nil;
     if ([[SKTemplateManager sharedManager] isRichTextBundleTemplateType:typeName]) {
-        NSURL *templateURL = [[SKTemplateManager sharedManager] URLForTemplateType:typeName];
         NSDictionary *docAttributes = nil;
-        NSAttributedString *templateAttrString = [[NSAttributedString alloc] initWithURL:templateURL options:[NSDictionary dictionary] documentAttributes:&docAttributes error:NULL];
-        NSAttributedString *attrString = [SKTemplateParser attributedStringByParsingTemplateAttributedString:templateAttrString usingObject:self];
-        if ([[NSUserDefaults standardUserDefaults] boolForKey:SKDisableExportAttributesKey] == NO) {
-            NSMutableDictionary *mutableAttributes = [[docAttributes mutableCopy] autorelease];
-            [mutableAttributes addEntriesFromDictionary:[NSDictionary dictionaryWithObjectsAndKeys:NSFullUserName(), NSAuthorDocumentAttribute, [NSDate date], NSCreationTimeDocumentAttribute, [[[[self fileURL] path] lastPathComponent] stringByDeletingPathExtension], NSTitleDocumentAttribute, nil]];
-            docAttributes = mutableAttributes;
-        }
+        NSArray *template = [[SKTemplateManager sharedManager] templateForTemplateType:typeName documentAttributes:&docAttributes];
+        NSAttributedString *attrString = [SKTemplateParser attributedStringFromTemplateArray:template usingObject:self atIndex:0];
+        docAttributes = [self notesDocumentAttributes:docAttributes];
         fileWrapper = [attrString RTFDFileWrapperFromRange:NSMakeRange(0, [attrString length]) documentAttributes:docAttributes];
-        [templateAttrString release];
     }
     return fileWrapper;
 }
@@ -278,36 +324,41 @@ enum { SKAddBookmarkTypeBookmark, SKAddBookmarkTypeSetup, SKAddBookmarkTypeSessi
 }
 
 - (NSData *)notesFDFDataForFile:(NSString *)filename fileIDStrings:(NSArray *)fileIDStrings {
-    NSInteger i = 0;
-    NSMutableString *string = [NSMutableString stringWithFormat:@"%%FDF-1.2\n%%%C%C%C%C\n", (unichar)0xe2, (unichar)0xe3, (unichar)0xcf, (unichar)0xd3];
-    NSMutableString *annots = [NSMutableString string];
-    for (PDFAnnotation *note in [self notes]) {
-        [string appendFormat:@"%ld 0 obj<<%@>>\nendobj\n", (long)(++i), [note fdfString]];
-        [annots appendFormat:@"%ld 0 R ", (long)i];
+    SKFDFWriter *writer = [[SKFDFWriter alloc] init];
+    writeNotesFDF([self notes], filename, fileIDStrings, writer);
+    NSData *data = [[[writer data] retain] autorelease];
+    [writer release];
+    return data;
+}
+
+- (BOOL)writeNotesFDFForFile:(NSString *)filename fileIDStrings:(NSArray *)fileIDStrings toURL:(NSURL *)url error:(NSError **)outError {
+    const char *path = [[url path] fileSystemRepresentation];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int errorNumber = fd == -1 ? errno : 0;
+    BOOL didWrite = NO;
+    if (fd != -1) {
+        SKFDFWriter *writer = [[SKFDFWriter alloc] initWithFileDescriptor:fd];
+        writeNotesFDF([self notes], filename, fileIDStrings, writer);
+        didWrite = [writer flush];
+        errorNumber = [writer errorNumber];
+        [writer release];
+        if (close(fd) != 0 && didWrite) {
+            errorNumber = errno;
+            didWrite = NO;
+        }
+        // don't leave a partial file behind
+        if (didWrite == NO)
+            unlink(path);
     }
-    [string appendFormat:@"%ld 0 obj<<", (long)(++i)];
-    [string appendFDFName:SKFDFFDFKey];
-    [string appendString:@"<<"];
-    [string appendFDFName:SKFDFAnnotationsKey];
-    [string appendFormat:@"[%@]", annots];
-    [string appendFDFName:SKFDFFileKey];
-    [string appendString:@"("];
-    if (filename)
-        [string appendString:[[filename lossyStringUsingEncoding:NSISOLatin1StringEncoding] stringByEscapingParenthesis]];
-    [string appendString:@")"];
-    if ([fileIDStrings count] == 2) {
-        [string appendFDFName:SKFDFFileIDKey];
-        [string appendFormat:@"[<%@><%@>]", [fileIDStrings objectAtIndex:0], [fileIDStrings objectAtIndex:1]];
+    if (didWrite == NO && outError) {
+        if (errorNumber != 0)
+            *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errorNumber userInfo:[NSDictionary dictionaryWithObjectsAndKeys:url, NSURLErrorKey, nil]];
+        else
+            *outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:[NSDictionary dictionaryWithObjectsAndKeys:url, NSURLErrorKey, nil]];
     }
-    [string appendString:@">>"];
-    [string appendString:@">>\nendobj\n"];
-    [string appendString:@"trailer\n<<"];
-    [string appendFDFName:SKFDFRootKey];
-    [string appendFormat:@" %ld 0 R", (long)i];
-    [string appendString:@">>\n"];
-    [string appendString:@"%%EOF\n"];
-    return [string dataUsingEncoding:NSISOLatin1StringEncoding];
+    return didWrite;
 }
+
 #pragma mark Outlines
 
 - (BOOL)isOutlineExpanded:(PDFOutline *)outline { return NO; }
@@ -41,6 +41,7 @@
 #import "PDFAnnotation_SKExtensions.h"
 #import "SKStringConstants.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 #import "PDFSelection_SKExtensions.h"
 #import "NSUserDefaults_SKExtensions.h"
 
@@ -62,15 +63,18 @@ NSString *SKPDFAnnotationScriptingInteriorColorKey = @"scriptingInteriorColor";
     return self;
 }
 
-- (NSString *)fdfString {
-    NSMutableString *fdfString = [[[super fdfString] mutableCopy] autorelease];
+- (void)writeFDFToWriter:(SKFDFWriter *)writer {
+    [super writeFDFToWriter:writer];
     CGFloat r, g, b, a = 0.0;
     [[[self interiorColor] colorUsingColorSpaceName:NSDeviceRGBColorSpace] getRed:&r green:&g blue:&b alpha:&a];
     if (a > 0.0) {
-        [fdfString appendFDFName:SKFDFAnnotationInteriorColorKey];
-        [fdfString appendFormat:@"[%f %f %f]", r, g, b];
+        [writer appendName:SKFDFAnnotationInteriorColorKey];
+        [writer appendCString:"["];
+        [writer appendReal:r];
+        [writer appendReal:g];
+        [writer appendReal:b];
+        [writer appendCString:"]"];
     }
-    return fdfString;
 }
 
 - (BOOL)isResizable { return [self isSkimNote]; }
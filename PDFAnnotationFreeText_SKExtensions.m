@@ -41,6 +41,7 @@
 #import "PDFAnnotation_SKExtensions.h"
 #import "SKStringConstants.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 #import "NSUserDefaults_SKExtensions.h"
 
 
@@ -84,18 +85,17 @@ static inline NSString *alignmentStyleKeyword(NSTextAlignment alignment) {
     }
 }
 
-- (NSString *)fdfString {
-    NSMutableString *fdfString = [[[super fdfString] mutableCopy] autorelease];
+- (void)writeFDFToWriter:(SKFDFWriter *)writer {
+    [super writeFDFToWriter:writer];
     CGFloat r = 0.0, g = 0.0, b = 0.0, a;
     [[[self fontColor] colorUsingColorSpaceName:NSDeviceRGBColorSpace] getRed:&r green:&g blue:&b alpha:&a];
-    [fdfString appendFDFName:SKFDFDefaultAppearanceKey];
-    [fdfString appendFormat:@"(/%@ %f Tf %f %f %f rg)", [self fontName], [self fontSize], r, g, b];
-    [fdfString appendFDFName:SKFDFDefaultStyleKey];
+    [writer appendName:SKFDFDefaultAppearanceKey];
+    [writer appendString:[NSString stringWithFormat:@"/%@ %f Tf %f %f %f rg", [self fontName], [self fontSize], r, g, b]];
+    [writer appendName:SKFDFDefaultStyleKey];
     [[[self fontColor] colorUsingColorSpace:[NSColorSpace sRGBColorSpace]] getRed:&r green:&g blue:&b alpha:&a];
-    [fdfString appendFormat:@"(font: %@ %fpt; text-align:%@; color:#%.2x%.2x%.2x)", [self fontName], [self fontSize], alignmentStyleKeyword([self alignment]), (unsigned int)(255*r), (unsigned int)(255*g), (unsigned int)(255*b)];
-    [fdfString appendFDFName:SKFDFAnnotationAlignmentKey];
-    [fdfString appendFormat:@" %ld", (long)SKFDFFreeTextAnnotationAlignmentFromPDFFreeTextAnnotationAlignment([self alignment])];
-    return fdfString;
+    [writer appendString:[NSString stringWithFormat:@"font: %@ %fpt; text-align:%@; color:#%.2x%.2x%.2x", [self fontName], [self fontSize], alignmentStyleKeyword([self alignment]), (unsigned int)(255*r), (unsigned int)(255*g), (unsigned int)(255*b)]];
+    [writer appendName:SKFDFAnnotationAlignmentKey];
+    [writer appendInteger:SKFDFFreeTextAnnotationAlignmentFromPDFFreeTextAnnotationAlignment([self alignment])];
 }
 
 - (BOOL)isText { return YES; }
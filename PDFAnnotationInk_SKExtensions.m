@@ -41,6 +41,7 @@
 #import "PDFAnnotation_SKExtensions.h"
 #import "SKStringConstants.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 #import "NSUserDefaults_SKExtensions.h"
 #import "NSGeometry_SKExtensions.h"
 #import "NSData_SKExtensions.h"
@@ -142,24 +143,24 @@ static void (*original_drawWithBox_inContext)(id, SEL, PDFDisplayBox, CGContextR
     return paths;
 }
 
-- (NSString *)fdfString {
-    NSMutableString *fdfString = [[[super fdfString] mutableCopy] autorelease];
+- (void)writeFDFToWriter:(SKFDFWriter *)writer {
+    [super writeFDFToWriter:writer];
     NSPoint point;
     NSInteger i, iMax;
     NSRect bounds = [self bounds];
-    [fdfString appendFDFName:SKFDFAnnotationInkListKey];
-    [fdfString appendString:@"["];
+    [writer appendName:SKFDFAnnotationInkListKey];
+    [writer appendCString:"["];
     for (NSBezierPath *path in [self paths]) {
         iMax = [path elementCount];
-        [fdfString appendString:@"["];
+        [writer appendCString:"["];
         for (i = 0; i < iMax; i++) {
             point = [path associatedPointForElementAtIndex:i];
-            [fdfString appendFormat:@"%f %f ", point.x + NSMinX(bounds), point.y + NSMinY(bounds)];
+            [writer appendReal:point.x + NSMinX(bounds)];
+            [writer appendReal:point.y + NSMinY(bounds)];
         }
-        [fdfString appendString:@"]"];
+        [writer appendCString:"]"];
     }
-    [fdfString appendString:@"]"];
-    return fdfString;
+    [writer appendCString:"]"];
 }
 
 - (BOOL)isResizable { return NO; }
@@ -42,6 +42,7 @@
 #import "PDFAnnotationCircle_SKExtensions.h"
 #import "SKStringConstants.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 #import "NSUserDefaults_SKExtensions.h"
 #import "NSGeometry_SKExtensions.h"
 #import "NSGraphics_SKExtensions.h"
@@ -181,24 +182,32 @@ static inline void addLineTipToPath(CGMutablePathRef path, NSPoint point, CGFloa
     return self; 	 
 } 	 
 
-- (NSString *)fdfString {
-    NSMutableString *fdfString = [[[super fdfString] mutableCopy] autorelease];
-    [fdfString appendFDFName:SKFDFAnnotationLineStylesKey];
-    [fdfString appendString:@"["];
-    [fdfString appendFDFName:SKFDFLineStyleFromPDFLineStyle([self startLineStyle])];
-    [fdfString appendFDFName:SKFDFLineStyleFromPDFLineStyle([self endLineStyle])];
-    [fdfString appendString:@"]"];
+- (void)writeFDFToWriter:(SKFDFWriter *)writer {
+    [super writeFDFToWriter:writer];
+    [writer appendName:SKFDFAnnotationLineStylesKey];
+    [writer appendCString:"["];
+    [writer appendName:SKFDFLineStyleFromPDFLineStyle([self startLineStyle])];
+    [writer appendName:SKFDFLineStyleFromPDFLineStyle([self endLineStyle])];
+    [writer appendCString:"]"];
     NSPoint startPoint = SKAddPoints([self startPoint], [self bounds].origin);
     NSPoint endPoint = SKAddPoints([self endPoint], [self bounds].origin);
-    [fdfString appendFDFName:SKFDFAnnotationLinePointsKey];
-    [fdfString appendFormat:@"[%f %f %f %f]", startPoint.x, startPoint.y, endPoint.x, endPoint.y];
+    [writer appendName:SKFDFAnnotationLinePointsKey];
+    [writer appendCString:"["];
+    [writer appendReal:startPoint.x];
+    [writer appendReal:startPoint.y];
+    [writer appendReal:endPoint.x];
+    [writer appendReal:endPoint.y];
+    [writer appendCString:"]"];
     CGFloat r, g, b, a = 0.0;
     [[self interiorColor] getRed:&r green:&g blue:&b alpha:&a];
     if (a > 0.0) {
-        [fdfString appendFDFName:SKFDFAnnotationInteriorColorKey];
-        [fdfString appendFormat:@"[%f %f %f]", r, g, b];
+        [writer appendName:SKFDFAnnotationInteriorColorKey];
+        [writer appendCString:"["];
+        [writer appendReal:r];
+        [writer appendReal:g];
+        [writer appendReal:b];
+        [writer appendCString:"]"];
     }
-    return fdfString;
 }
 
 - (NSPoint)observedStartPoint {
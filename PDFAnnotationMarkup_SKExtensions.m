@@ -42,6 +42,7 @@
 #import "PDFAnnotationInk_SKExtensions.h"
 #import "SKStringConstants.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 #import "PDFSelection_SKExtensions.h"
 #import "NSUserDefaults_SKExtensions.h"
 #import "NSGeometry_SKExtensions.h"
@@ -225,18 +226,18 @@ static void (*original_dealloc)(id, SEL) = NULL;
     return [annotations count] > 0 ? annotations : nil;
 }
 
-- (NSString *)fdfString {
-    NSMutableString *fdfString = [[[super fdfString] mutableCopy] autorelease];
+- (void)writeFDFToWriter:(SKFDFWriter *)writer {
+    [super writeFDFToWriter:writer];
     NSPoint point;
     NSRect bounds = [self bounds];
-    [fdfString appendFDFName:SKFDFAnnotationQuadrilateralPointsKey];
-    [fdfString appendString:@"["];
+    [writer appendName:SKFDFAnnotationQuadrilateralPointsKey];
+    [writer appendCString:"["];
     for (NSValue *value in [self quadrilateralPoints]) {
         point = [value pointValue];
-        [fdfString appendFormat:@"%f %f ", point.x + NSMinX(bounds), point.y + NSMinY(bounds)];
+        [writer appendReal:point.x + NSMinX(bounds)];
+        [writer appendReal:point.y + NSMinY(bounds)];
     }
-    [fdfString appendString:@"]"];
-    return fdfString;
+    [writer appendCString:"]"];
 }
 
 - (NSPointerArray *)lineRects {
@@ -41,6 +41,7 @@
 #import "PDFAnnotation_SKExtensions.h"
 #import "SKNPDFAnnotationNote_SKExtensions.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 
 
 NSString *SKPDFAnnotationScriptingIconTypeKey = @"scriptingIconType";
@@ -58,11 +59,10 @@ NSString *SKPDFAnnotationScriptingIconTypeKey = @"scriptingIconType";
     return self;
 }
 
-- (NSString *)fdfString {
-    NSMutableString *fdfString = [[[super fdfString] mutableCopy] autorelease];
-    [fdfString appendFDFName:SKFDFAnnotationIconTypeKey];
-    [fdfString appendFDFName:SKFDFTextAnnotationIconTypeFromPDFTextAnnotationIconType([self iconType])];
-    return fdfString;
+- (void)writeFDFToWriter:(SKFDFWriter *)writer {
+    [super writeFDFToWriter:writer];
+    [writer appendName:SKFDFAnnotationIconTypeKey];
+    [writer appendName:SKFDFTextAnnotationIconTypeFromPDFTextAnnotationIconType([self iconType])];
 }
 
 - (BOOL)isMovable { return [self isSkimNote]; }
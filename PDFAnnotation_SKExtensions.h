@@ -52,11 +52,11 @@ extern NSString *SKPDFAnnotationBoundsOrderKey;
 
 extern NSString *SKPasteboardTypeSkimNote;
 
-@class SKPDFView, SKNoteText;
+@class SKPDFView, SKNoteText, SKFDFWriter;
 
 @interface PDFAnnotation (SKExtensions) <NSPasteboardReading, NSPasteboardWriting>
 
-- (NSString *)fdfString;
+- (void)writeFDFToWriter:(SKFDFWriter *)writer;
 
 - (NSUInteger)pageIndex;
 
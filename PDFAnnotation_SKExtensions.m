@@ -47,6 +47,7 @@
 #import "SKNPDFAnnotationNote_SKExtensions.h"
 #import "SKStringConstants.h"
 #import "SKFDFParser.h"
+#import "SKFDFWriter.h"
 #import "PDFPage_SKExtensions.h"
 #import "PDFSelection_SKExtensions.h"
 #import "SKPDFView.h"
@@ -134,8 +135,7 @@ NSString *SKPasteboardTypeSkimNote = @"net.sourceforge.skim-app.pasteboard.skimn
     return nil;
 }
 
-- (NSString *)fdfString {
-    NSMutableString *fdfString = [NSMutableString string];
+- (void)writeFDFToWriter:(SKFDFWriter *)writer {
     NSRect bounds = [self bounds];
     CGFloat r, g, b, a = 0.0;
     PDFBorder *border = [self border];
@@ -143,48 +143,56 @@ NSString *SKPasteboardTypeSkimNote = @"net.sourceforge.skim-app.pasteboard.skimn
     NSDate *modDate = [self modificationDate];
     NSString *userName = [self userName];
     [[[self color] colorUsingColorSpaceName:NSDeviceRGBColorSpace] getRed:&r green:&g blue:&b alpha:&a];
-    [fdfString appendFDFName:SKFDFTypeKey];
-    [fdfString appendFDFName:SKFDFAnnotation];
-    [fdfString appendFDFName:SKFDFAnnotationTypeKey];
-    [fdfString appendFormat:@"/%@", [self isNote] ? SKNTextString : [self type]];
-    [fdfString appendFDFName:SKFDFAnnotationBoundsKey];
-    [fdfString appendFormat:@"[%f %f %f %f]", NSMinX(bounds), NSMinY(bounds), NSMaxX(bounds), NSMaxY(bounds)];
-    [fdfString appendFDFName:SKFDFAnnotationPageIndexKey];
-    [fdfString appendFormat:@" %lu", (unsigned long)[self pageIndex]];
-    [fdfString appendFDFName:SKFDFAnnotationFlagsKey];
-    [fdfString appendString:@" 4"];
+    [writer appendName:SKFDFTypeKey];
+    [writer appendName:SKFDFAnnotation];
+    [writer appendName:SKFDFAnnotationTypeKey];
+    [writer appendName:[([self isNote] ? SKNTextString : [self type]) UTF8String]];
+    [writer appendName:SKFDFAnnotationBoundsKey];
+    [writer appendCString:"["];
+    [writer appendReal:NSMinX(bounds)];
+    [writer appendReal:NSMinY(bounds)];
+    [writer appendReal:NSMaxX(bounds)];
+    [writer appendReal:NSMaxY(bounds)];
+    [writer appendCString:"]"];
+    [writer appendName:SKFDFAnnotationPageIndexKey];
+    [writer appendInteger:[self pageIndex]];
+    [writer appendName:SKFDFAnnotationFlagsKey];
+    [writer appendInteger:4];
     if (a > 0.0) {
-        [fdfString appendFDFName:SKFDFAnnotationColorKey];
-        [fdfString appendFormat:@"[%f %f %f]", r, g, b];
+        [writer appendName:SKFDFAnnotationColorKey];
+        [writer appendCString:"["];
+        [writer appendReal:r];
+        [writer appendReal:g];
+        [writer appendReal:b];
+        [writer appendCString:"]"];
     }
-    [fdfString appendFDFName:SKFDFAnnotationBorderStylesKey];
-    [fdfString appendString:@"<<"];
+    [writer appendName:SKFDFAnnotationBorderStylesKey];
+    [writer appendCString:"<<"];
     if (border && [border lineWidth] > 0.0) {
-        [fdfString appendFDFName:SKFDFAnnotationLineWidthKey];
-        [fdfString appendFormat:@" %f", [border lineWidth]];
-        [fdfString appendFDFName:SKFDFAnnotationBorderStyleKey];
-        [fdfString appendFDFName:SKFDFBorderStyleFromPDFBorderStyle([border style])];
-        [fdfString appendFDFName:SKFDFAnnotationDashPatternKey];
-        [fdfString appendFormat:@"[%@]", [[[border dashPattern] valueForKey:@"stringValue"] componentsJoinedByString:@" "]];
+        [writer appendName:SKFDFAnnotationLineWidthKey];
+        [writer appendReal:[border lineWidth]];
+        [writer appendName:SKFDFAnnotationBorderStyleKey];
+        [writer appendName:SKFDFBorderStyleFromPDFBorderStyle([border style])];
+        [writer appendName:SKFDFAnnotationDashPatternKey];
+        [writer appendCString:"["];
+        for (NSNumber *dash in [border dashPattern])
+            [writer appendReal:[dash doubleValue]];
+        [writer appendCString:"]"];
     } else {
-        [fdfString appendFDFName:SKFDFAnnotationLineWidthKey];
-        [fdfString appendString:@" 0.0"];
+        [writer appendName:SKFDFAnnotationLineWidthKey];
+        [writer appendReal:0.0];
     }
-    [fdfString appendString:@">>"];
-    [fdfString appendFDFName:SKFDFAnnotationContentsKey];
-    [fdfString appendString:@"("];
-    if (contents)
-        [fdfString appendString:[[contents lossyStringUsingEncoding:NSISOLatin1StringEncoding] stringByEscapingParenthesis]];
-    [fdfString appendString:@")"];
+    [writer appendCString:">>"];
+    [writer appendName:SKFDFAnnotationContentsKey];
+    [writer appendString:contents ?: @""];
     if (modDate) {
-        [fdfString appendFDFName:SKFDFAnnotationModificationDateKey];
-        [fdfString appendFormat:@"(%@)", [modDate PDFDescription]];
+        [writer appendName:SKFDFAnnotationModificationDateKey];
+        [writer appendString:[modDate PDFDescription]];
     }
     if (userName) {
-        [fdfString appendFDFName:SKFDFAnnotationUserNameKey];
-        [fdfString appendFormat:@"(%@)", [[userName lossyStringUsingEncoding:NSISOLatin1StringEncoding] stringByEscapingParenthesis]];
+        [writer appendName:SKFDFAnnotationUserNameKey];
+        [writer appendString:userName];
     }
-    return fdfString;
 }
 
 - (PDFDestination *)linkDestination {
@@ -32,6 +32,7 @@
  */
 
 #import "SKQLConverter.h"
+#import "SKNRTFString.h"
 #include <tgmath.h>
 
 static NSString *_noteFontName = @"LucidaHandwriting-Italic";
@@ -195,14 +196,16 @@ static NSString *HTMLEscapeString(NSString *htmlString)
         while (note = [noteEnum nextObject]) {
             NSString *type = [note objectForKey:@"type"];
             NSString *contents = [note objectForKey:@"contents"];
-            NSAttributedString *text = [note objectForKey:@"text"];
+            id text = [note objectForKey:@"text"];
             NSColor *color = [note objectForKey:@"color"];
             NSUInteger pageIndex = [[note objectForKey:@"pageIndex"] unsignedIntegerValue];
             NSURL *imgURL = [(NSURL *)CFBundleCopyResourceURL(bundle, (CFStringRef)type, CFSTR("png"), NULL) autorelease];
             NSInteger start;
             
             if ([text isKindOfClass:[NSData class]])
-                text = [[[NSAttributedString alloc] initWithData:(NSData *)text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease];
+                text = [SKNCreateStringFromRTFData(text) autorelease] ?: [[[[NSAttributedString alloc] initWithData:text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease] string];
+            else if ([text isKindOfClass:[NSAttributedString class]])
+                text = [text string];
             if ([color isKindOfClass:[NSArray class]])
                 color = colorFromArray((NSArray *)color);
             
@@ -213,7 +216,7 @@ static NSString *HTMLEscapeString(NSString *htmlString)
             [attrString appendAttributedString:[[[NSAttributedString alloc] initWithString:contents attributes:noteAttrs] autorelease]];
             if (text) {
                 [attrString appendAttributedString:[[[NSAttributedString alloc] initWithString:@"\n"] autorelease]];
-                [attrString appendAttributedString:[[[NSAttributedString alloc] initWithString:[text string] attributes:noteTextAttrs] autorelease]];
+                [attrString appendAttributedString:[[[NSAttributedString alloc] initWithString:text attributes:noteTextAttrs] autorelease]];
             }
             [attrString appendAttributedString:[[[NSAttributedString alloc] initWithString:@"\n"] autorelease]];
             [attrString addAttribute:NSParagraphStyleAttributeName value:noteParStyle range:NSMakeRange(start, [attrString length] - start)];
@@ -240,19 +243,21 @@ static NSString *HTMLEscapeString(NSString *htmlString)
         while (note = [noteEnum nextObject]) {
             NSString *type = [note objectForKey:@"type"];
             NSString *contents = [note objectForKey:@"contents"];
-            NSAttributedString *text = [note objectForKey:@"text"];
+            id text = [note objectForKey:@"text"];
             NSColor *color = [note objectForKey:@"color"];
             NSUInteger pageIndex = [[note objectForKey:@"pageIndex"] unsignedIntegerValue];
             
             if ([text isKindOfClass:[NSData class]])
-                text = [[[NSAttributedString alloc] initWithData:(NSData *)text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease];
+                text = [SKNCreateStringFromRTFData(text) autorelease] ?: [[[[NSAttributedString alloc] initWithData:text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease] string];
+            else if ([text isKindOfClass:[NSAttributedString class]])
+                text = [text string];
             if ([color isKindOfClass:[NSArray class]])
                 color = colorFromArray((NSArray *)color);
             
             [htmlString appendFormat:@"<dt><img src=\"cid:%@.png\" style=\"background-color:#%@\" />%@ (page %ld)</dt>", type, hexStringWithColor(color), type, (long)(pageIndex+1)];
             [htmlString appendFormat:@"<dd>%@", HTMLEscapeString(contents)];
             if (text)
-                [htmlString appendFormat:@"<div class=\"note-text\">%@</div>", HTMLEscapeString([text string])];
+                [htmlString appendFormat:@"<div class=\"note-text\">%@</div>", HTMLEscapeString(text)];
             [htmlString appendString:@"</dd>"];
         }
     }
@@ -0,0 +1,923 @@
+//
+//  SKFDFObjectParser.c
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SKFDFObjectParser.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADER_SEARCH_LENGTH 1024
+#define MAX_NESTING_DEPTH 64
+#define ARENA_BLOCK_SIZE 65536
+#define MAX_REFERENCE_DEPTH 16
+
+struct _SKFDFParser;
+
+struct _SKFDFObject {
+    SKFDFObjectType type;
+    union {
+        bool boolean;
+        SKFDFInteger integer;
+        SKFDFReal real;
+        // names and strings, names are NUL terminated
+        struct {
+            const uint8_t *bytes;
+            size_t length;
+        } string;
+        // arrays, and dictionaries as alternating keys and values with count the number of pairs
+        // the parser is used to resolve indirect references in the items
+        struct {
+            struct _SKFDFObject **items;
+            size_t count;
+            struct _SKFDFParser *parser;
+        } array;
+        struct {
+            SKFDFInteger number;
+            SKFDFInteger generation;
+        } reference;
+    } value;
+};
+
+typedef struct _SKFDFArenaBlock {
+    struct _SKFDFArenaBlock *next;
+    size_t size;
+    size_t used;
+    uint8_t data[];
+} SKFDFArenaBlock;
+
+typedef struct _SKFDFArenaMark {
+    SKFDFArenaBlock *block;
+    size_t used;
+} SKFDFArenaMark;
+
+// where the value of an indirect object starts, right after "number generation obj"
+typedef struct _SKFDFObjectOffset {
+    SKFDFInteger number;
+    SKFDFInteger generation;
+    size_t offset;
+} SKFDFObjectOffset;
+
+typedef struct _SKFDFParser {
+    const uint8_t *start;
+    const uint8_t *current;
+    const uint8_t *end;
+    // memory for the objects of the current top level object
+    SKFDFArenaBlock *blocks;
+    // items of the arrays and dictionaries that are being parsed
+    struct _SKFDFObject **stack;
+    size_t stackCount;
+    size_t stackCapacity;
+    // the indirect objects, sorted by number once the whole file has been scanned
+    SKFDFObjectOffset *offsets;
+    size_t offsetCount;
+    size_t offsetCapacity;
+    bool resolvesReferences;
+    // the catalog from the trailer, or else the last object with an /FDF dictionary
+    SKFDFInteger rootNumber;
+    SKFDFInteger rootGeneration;
+    SKFDFInteger catalogNumber;
+    SKFDFInteger catalogGeneration;
+    bool error;
+} SKFDFParser;
+
+// Memory
+
+static void *SKFDFAllocate(SKFDFParser *parser, size_t size) {
+    SKFDFArenaBlock *block = parser->blocks;
+    size = (size + 15) & ~(size_t)15;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (SKFDFArenaBlock *)malloc(sizeof(SKFDFArenaBlock) + blockSize);
+        if (block == NULL) {
+            parser->error = true;
+            return NULL;
+        }
+        block->next = parser->blocks;
+        block->size = blockSize;
+        block->used = 0;
+        parser->blocks = block;
+    }
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+// keeps a single block around for the next top level object
+static void SKFDFResetMemory(SKFDFParser *parser) {
+    SKFDFArenaBlock *block = parser->blocks;
+    while (block && block->next) {
+        SKFDFArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    if (block)
+        block->used = 0;
+    parser->blocks = block;
+    parser->stackCount = 0;
+}
+
+static SKFDFArenaMark SKFDFGetMark(SKFDFParser *parser) {
+    SKFDFArenaMark mark = {parser->blocks, parser->blocks ? parser->blocks->used : 0};
+    return mark;
+}
+
+// frees everything allocated after the mark was taken
+static void SKFDFReleaseToMark(SKFDFParser *parser, SKFDFArenaMark mark) {
+    while (parser->blocks && parser->blocks != mark.block) {
+        SKFDFArenaBlock *next = parser->blocks->next;
+        free(parser->blocks);
+        parser->blocks = next;
+    }
+    if (parser->blocks)
+        parser->blocks->used = mark.used;
+}
+
+static void SKFDFFreeMemory(SKFDFParser *parser) {
+    SKFDFResetMemory(parser);
+    free(parser->blocks);
+    parser->blocks = NULL;
+    free(parser->stack);
+    parser->stack = NULL;
+    parser->stackCapacity = 0;
+    free(parser->offsets);
+    parser->offsets = NULL;
+    parser->offsetCapacity = 0;
+}
+
+static struct _SKFDFObject *SKFDFCreateObject(SKFDFParser *parser, SKFDFObjectType type) {
+    struct _SKFDFObject *object = (struct _SKFDFObject *)SKFDFAllocate(parser, sizeof(struct _SKFDFObject));
+    if (object)
+        object->type = type;
+    return object;
+}
+
+static bool SKFDFPush(SKFDFParser *parser, struct _SKFDFObject *object) {
+    if (parser->stackCount == parser->stackCapacity) {
+        size_t capacity = parser->stackCapacity ? 2 * parser->stackCapacity : 64;
+        struct _SKFDFObject **stack = (struct _SKFDFObject **)realloc(parser->stack, capacity * sizeof(struct _SKFDFObject *));
+        if (stack == NULL) {
+            parser->error = true;
+            return false;
+        }
+        parser->stack = stack;
+        parser->stackCapacity = capacity;
+    }
+    parser->stack[parser->stackCount++] = object;
+    return true;
+}
+
+// moves the items pushed since start to a new array or dictionary object
+static struct _SKFDFObject *SKFDFCreateContainer(SKFDFParser *parser, SKFDFObjectType type, size_t start) {
+    size_t count = parser->stackCount - start;
+    struct _SKFDFObject *object = SKFDFCreateObject(parser, type);
+    struct _SKFDFObject **items = count ? (struct _SKFDFObject **)SKFDFAllocate(parser, count * sizeof(struct _SKFDFObject *)) : NULL;
+    parser->stackCount = start;
+    if (object == NULL || (count && items == NULL))
+        return NULL;
+    if (count)
+        memcpy(items, parser->stack + start, count * sizeof(struct _SKFDFObject *));
+    object->value.array.items = items;
+    object->value.array.count = type == kSKFDFObjectTypeDictionary ? count / 2 : count;
+    object->value.array.parser = parser;
+    return object;
+}
+
+// Object offsets
+
+static void SKFDFAddObjectOffset(SKFDFParser *parser, SKFDFInteger number, SKFDFInteger generation, size_t offset) {
+    if (parser->offsetCount == parser->offsetCapacity) {
+        size_t capacity = parser->offsetCapacity ? 2 * parser->offsetCapacity : 256;
+        SKFDFObjectOffset *offsets = (SKFDFObjectOffset *)realloc(parser->offsets, capacity * sizeof(SKFDFObjectOffset));
+        // without the offset the object simply cannot be referenced
+        if (offsets == NULL)
+            return;
+        parser->offsets = offsets;
+        parser->offsetCapacity = capacity;
+    }
+    parser->offsets[parser->offsetCount].number = number;
+    parser->offsets[parser->offsetCount].generation = generation;
+    parser->offsets[parser->offsetCount].offset = offset;
+    parser->offsetCount++;
+}
+
+static int SKFDFCompareObjectOffsets(const void *p1, const void *p2) {
+    const SKFDFObjectOffset *offset1 = (const SKFDFObjectOffset *)p1, *offset2 = (const SKFDFObjectOffset *)p2;
+    if (offset1->number != offset2->number)
+        return offset1->number < offset2->number ? -1 : 1;
+    if (offset1->offset != offset2->offset)
+        return offset1->offset < offset2->offset ? -1 : 1;
+    return 0;
+}
+
+// a later definition of the same object number replaces an earlier one, as in an incremental update
+static const SKFDFObjectOffset *SKFDFFindObjectOffset(SKFDFParser *parser, SKFDFInteger number) {
+    size_t lo = 0, hi = parser->offsetCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (parser->offsets[mid].number <= number)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo > 0 && parser->offsets[lo - 1].number == number ? &parser->offsets[lo - 1] : NULL;
+}
+
+// Lexing
+
+static inline bool SKFDFIsWhitespace(uint8_t ch) {
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\f' || ch == '\0';
+}
+
+static inline bool SKFDFIsDelimiter(uint8_t ch) {
+    return ch == '(' || ch == ')' || ch == '<' || ch == '>' || ch == '[' || ch == ']' || ch == '{' || ch == '}' || ch == '/' || ch == '%';
+}
+
+static inline bool SKFDFIsRegular(uint8_t ch) {
+    return SKFDFIsWhitespace(ch) == false && SKFDFIsDelimiter(ch) == false;
+}
+
+static inline int SKFDFHexValue(uint8_t ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    else if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    else if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+static void SKFDFSkipWhitespace(SKFDFParser *parser) {
+    while (parser->current < parser->end) {
+        uint8_t ch = *parser->current;
+        if (ch == '%') {
+            while (parser->current < parser->end && *parser->current != '\n' && *parser->current != '\r')
+                parser->current++;
+        } else if (SKFDFIsWhitespace(ch)) {
+            parser->current++;
+        } else {
+            break;
+        }
+    }
+}
+
+// scans a run of regular characters, which is a number or a keyword
+static size_t SKFDFScanToken(SKFDFParser *parser, const uint8_t **tokenPtr) {
+    const uint8_t *start = parser->current;
+    while (parser->current < parser->end && SKFDFIsRegular(*parser->current))
+        parser->current++;
+    *tokenPtr = start;
+    return parser->current - start;
+}
+
+static inline bool SKFDFTokenIsKeyword(const uint8_t *token, size_t length, const char *keyword) {
+    return length == strlen(keyword) && memcmp(token, keyword, length) == 0;
+}
+
+static bool SKFDFTokenIsUnsignedInteger(const uint8_t *token, size_t length, SKFDFInteger *value) {
+    SKFDFInteger integer = 0;
+    size_t i;
+    if (length == 0 || length > 18)
+        return false;
+    for (i = 0; i < length; i++) {
+        if (token[i] < '0' || token[i] > '9')
+            return false;
+        integer = 10 * integer + (token[i] - '0');
+    }
+    if (value)
+        *value = integer;
+    return true;
+}
+
+static bool SKFDFParseNumber(const uint8_t *token, size_t length, struct _SKFDFObject *object) {
+    size_t i = 0;
+    bool negative = false, isReal = false, hasDigits = false;
+    double real = 0.0, scale = 1.0;
+    SKFDFInteger integer = 0;
+    
+    if (i < length && (token[i] == '+' || token[i] == '-'))
+        negative = token[i++] == '-';
+    for (; i < length; i++) {
+        uint8_t ch = token[i];
+        if (ch >= '0' && ch <= '9') {
+            hasDigits = true;
+            if (isReal) {
+                scale /= 10.0;
+                real += scale * (ch - '0');
+            } else {
+                real = 10.0 * real + (ch - '0');
+                if (integer < 100000000000000000L)
+                    integer = 10 * integer + (ch - '0');
+                else
+                    isReal = true;
+            }
+        } else if (ch == '.' && isReal == false) {
+            isReal = true;
+        } else {
+            return false;
+        }
+    }
+    if (hasDigits == false)
+        return false;
+    if (isReal) {
+        object->type = kSKFDFObjectTypeReal;
+        object->value.real = negative ? -real : real;
+    } else {
+        object->type = kSKFDFObjectTypeInteger;
+        object->value.integer = negative ? -integer : integer;
+    }
+    return true;
+}
+
+static const uint8_t *SKFDFFind(const uint8_t *bytes, const uint8_t *end, const char *string) {
+    size_t length = strlen(string);
+    while (bytes + length <= end) {
+        const uint8_t *found = (const uint8_t *)memchr(bytes, string[0], end - bytes - length + 1);
+        if (found == NULL)
+            break;
+        if (memcmp(found, string, length) == 0)
+            return found;
+        bytes = found + 1;
+    }
+    return NULL;
+}
+
+// Parsing
+
+static struct _SKFDFObject *SKFDFParseObject(SKFDFParser *parser, int depth);
+
+static struct _SKFDFObject *SKFDFParseName(SKFDFParser *parser) {
+    const uint8_t *start = ++parser->current;
+    size_t length;
+    SKFDFScanToken(parser, &start);
+    length = parser->current - start;
+    
+    struct _SKFDFObject *object = SKFDFCreateObject(parser, kSKFDFObjectTypeName);
+    uint8_t *bytes = (uint8_t *)SKFDFAllocate(parser, length + 1);
+    size_t i, j = 0;
+    if (object == NULL || bytes == NULL)
+        return NULL;
+    for (i = 0; i < length; i++) {
+        int hi, lo;
+        if (start[i] == '#' && i + 2 < length && (hi = SKFDFHexValue(start[i + 1])) >= 0 && (lo = SKFDFHexValue(start[i + 2])) >= 0) {
+            bytes[j++] = (uint8_t)(16 * hi + lo);
+            i += 2;
+        } else {
+            bytes[j++] = start[i];
+        }
+    }
+    bytes[j] = 0;
+    object->value.string.bytes = bytes;
+    object->value.string.length = j;
+    return object;
+}
+
+static struct _SKFDFObject *SKFDFParseLiteralString(SKFDFParser *parser) {
+    const uint8_t *start = ++parser->current, *p = start;
+    int nesting = 1;
+    
+    // first find the end, so we know how much to allocate
+    while (p < parser->end) {
+        if (*p == '\\')
+            p++;
+        else if (*p == '(')
+            nesting++;
+        else if (*p == ')' && --nesting == 0)
+            break;
+        p++;
+    }
+    if (p > parser->end)
+        p = parser->end;
+    
+    struct _SKFDFObject *object = SKFDFCreateObject(parser, kSKFDFObjectTypeString);
+    uint8_t *bytes = (uint8_t *)SKFDFAllocate(parser, (p - start) + 1);
+    const uint8_t *s = start;
+    size_t j = 0;
+    if (object == NULL || bytes == NULL)
+        return NULL;
+    while (s < p) {
+        uint8_t ch = *s++;
+        if (ch == '\\' && s < p) {
+            ch = *s++;
+            switch (ch) {
+                case 'n': bytes[j++] = '\n'; break;
+                case 'r': bytes[j++] = '\r'; break;
+                case 't': bytes[j++] = '\t'; break;
+                case 'b': bytes[j++] = '\b'; break;
+                case 'f': bytes[j++] = '\f'; break;
+                case '\r':
+                    // line continuation
+                    if (s < p && *s == '\n')
+                        s++;
+                    break;
+                case '\n':
+                    break;
+                default:
+                    if (ch >= '0' && ch <= '7') {
+                        int value = ch - '0', k;
+                        for (k = 0; k < 2 && s < p && *s >= '0' && *s <= '7'; k++)
+                            value = 8 * value + (*s++ - '0');
+                        bytes[j++] = (uint8_t)value;
+                    } else {
+                        bytes[j++] = ch;
+                    }
+                    break;
+            }
+        } else if (ch == '\r') {
+            // end of lines are normalized to a single newline
+            if (s < p && *s == '\n')
+                s++;
+            bytes[j++] = '\n';
+        } else {
+            bytes[j++] = ch;
+        }
+    }
+    bytes[j] = 0;
+    object->value.string.bytes = bytes;
+    object->value.string.length = j;
+    parser->current = p < parser->end ? p + 1 : p;
+    return object;
+}
+
+static struct _SKFDFObject *SKFDFParseHexString(SKFDFParser *parser) {
+    const uint8_t *start = ++parser->current, *p = start;
+    
+    while (p < parser->end && *p != '>')
+        p++;
+    
+    struct _SKFDFObject *object = SKFDFCreateObject(parser, kSKFDFObjectTypeString);
+    uint8_t *bytes = (uint8_t *)SKFDFAllocate(parser, (p - start) / 2 + 2);
+    const uint8_t *s;
+    size_t j = 0;
+    int hi = -1;
+    if (object == NULL || bytes == NULL)
+        return NULL;
+    for (s = start; s < p; s++) {
+        int value = SKFDFHexValue(*s);
+        if (value < 0)
+            continue;
+        if (hi < 0) {
+            hi = value;
+        } else {
+            bytes[j++] = (uint8_t)(16 * hi + value);
+            hi = -1;
+        }
+    }
+    // a missing final digit is taken to be 0
+    if (hi >= 0)
+        bytes[j++] = (uint8_t)(16 * hi);
+    bytes[j] = 0;
+    object->value.string.bytes = bytes;
+    object->value.string.length = j;
+    parser->current = p < parser->end ? p + 1 : p;
+    return object;
+}
+
+// skips something we cannot use, so we always make progress
+// inside an array or dictionary, a keyword for the end of an object means we missed the closing delimiter
+static void SKFDFSkipUnexpected(SKFDFParser *parser, bool inContainer) {
+    const uint8_t *token;
+    size_t length = SKFDFScanToken(parser, &token);
+    if (length == 0 && parser->current < parser->end)
+        parser->current++;
+    else if (inContainer && (SKFDFTokenIsKeyword(token, length, "endobj") || SKFDFTokenIsKeyword(token, length, "stream") || SKFDFTokenIsKeyword(token, length, "obj")))
+        parser->error = true;
+}
+
+static struct _SKFDFObject *SKFDFParseArray(SKFDFParser *parser, int depth) {
+    size_t start = parser->stackCount;
+    parser->current++;
+    while (parser->error == false) {
+        SKFDFSkipWhitespace(parser);
+        if (parser->current >= parser->end) {
+            break;
+        } else if (*parser->current == ']') {
+            parser->current++;
+            break;
+        }
+        struct _SKFDFObject *item = SKFDFParseObject(parser, depth + 1);
+        if (item)
+            SKFDFPush(parser, item);
+        else if (parser->error == false)
+            SKFDFSkipUnexpected(parser, true);
+    }
+    return parser->error ? NULL : SKFDFCreateContainer(parser, kSKFDFObjectTypeArray, start);
+}
+
+static struct _SKFDFObject *SKFDFParseDictionary(SKFDFParser *parser, int depth) {
+    size_t start = parser->stackCount;
+    parser->current += 2;
+    while (parser->error == false) {
+        SKFDFSkipWhitespace(parser);
+        if (parser->current >= parser->end) {
+            break;
+        } else if (*parser->current == '>') {
+            parser->current++;
+            if (parser->current < parser->end && *parser->current == '>')
+                parser->current++;
+            break;
+        } else if (*parser->current != '/') {
+            SKFDFSkipUnexpected(parser, true);
+            continue;
+        }
+        struct _SKFDFObject *key = SKFDFParseName(parser);
+        SKFDFSkipWhitespace(parser);
+        // a key without a value, the closing delimiter is handled above
+        if (parser->current < parser->end && *parser->current == '>')
+            continue;
+        struct _SKFDFObject *value = key ? SKFDFParseObject(parser, depth + 1) : NULL;
+        if (value) {
+            if (SKFDFPush(parser, key))
+                SKFDFPush(parser, value);
+        } else if (parser->error == false) {
+            SKFDFSkipUnexpected(parser, true);
+        }
+    }
+    return parser->error ? NULL : SKFDFCreateContainer(parser, kSKFDFObjectTypeDictionary, start);
+}
+
+// returns NULL without consuming anything for closing delimiters and keywords other than true, false and null
+static struct _SKFDFObject *SKFDFParseObject(SKFDFParser *parser, int depth) {
+    struct _SKFDFObject *object = NULL;
+    
+    if (depth > MAX_NESTING_DEPTH) {
+        parser->error = true;
+        return NULL;
+    }
+    
+    SKFDFSkipWhitespace(parser);
+    if (parser->current >= parser->end)
+        return NULL;
+    
+    switch (*parser->current) {
+        case '/':
+            return SKFDFParseName(parser);
+        case '(':
+            return SKFDFParseLiteralString(parser);
+        case '<':
+            if (parser->current + 1 < parser->end && parser->current[1] == '<')
+                return SKFDFParseDictionary(parser, depth);
+            return SKFDFParseHexString(parser);
+        case '[':
+            return SKFDFParseArray(parser, depth);
+        case ']':
+        case '>':
+        case ')':
+        case '{':
+        case '}':
+            return NULL;
+        default:
+            break;
+    }
+    
+    const uint8_t *start = parser->current, *token;
+    size_t length = SKFDFScanToken(parser, &token);
+    SKFDFInteger number, generation;
+    
+    if ((object = SKFDFCreateObject(parser, kSKFDFObjectTypeNull)) == NULL)
+        return NULL;
+    
+    if (SKFDFTokenIsUnsignedInteger(token, length, &number)) {
+        // look ahead for an indirect reference
+        const uint8_t *afterNumber = parser->current;
+        SKFDFSkipWhitespace(parser);
+        length = SKFDFScanToken(parser, &token);
+        if (SKFDFTokenIsUnsignedInteger(token, length, &generation)) {
+            SKFDFSkipWhitespace(parser);
+            length = SKFDFScanToken(parser, &token);
+            if (SKFDFTokenIsKeyword(token, length, "R")) {
+                object->type = kSKFDFObjectTypeReference;
+                object->value.reference.number = number;
+                object->value.reference.generation = generation;
+                return object;
+            }
+        }
+        parser->current = afterNumber;
+        object->type = kSKFDFObjectTypeInteger;
+        object->value.integer = number;
+    } else if (SKFDFParseNumber(token, length, object)) {
+    } else if (SKFDFTokenIsKeyword(token, length, "true") || SKFDFTokenIsKeyword(token, length, "false")) {
+        object->type = kSKFDFObjectTypeBoolean;
+        object->value.boolean = token[0] == 't';
+    } else if (SKFDFTokenIsKeyword(token, length, "null") == false) {
+        parser->current = start;
+        object = NULL;
+    }
+    return object;
+}
+
+static void SKFDFSkipStream(SKFDFParser *parser, SKFDFObjectRef dictionary) {
+    SKFDFInteger length = -1;
+    
+    if (parser->current < parser->end && *parser->current == '\r')
+        parser->current++;
+    if (parser->current < parser->end && *parser->current == '\n')
+        parser->current++;
+    
+    if (SKFDFDictionaryGetInteger(dictionary, "Length", &length) && length >= 0 && (size_t)length <= (size_t)(parser->end - parser->current)) {
+        const uint8_t *saved = parser->current, *token;
+        parser->current += length;
+        SKFDFSkipWhitespace(parser);
+        size_t tokenLength = SKFDFScanToken(parser, &token);
+        if (SKFDFTokenIsKeyword(token, tokenLength, "endstream"))
+            return;
+        parser->current = saved;
+    }
+    
+    // no or a wrong length, so look for the end
+    const uint8_t *found = SKFDFFind(parser->current, parser->end, "endstream");
+    parser->current = found ? found + strlen("endstream") : parser->end;
+}
+
+// parses the indirect object with the given number from its recorded offset, or returns NULL when it is not in the file
+static SKFDFObjectRef SKFDFParseIndirectObject(SKFDFParser *parser, SKFDFInteger number, SKFDFInteger generation) {
+    const SKFDFObjectOffset *offset = SKFDFFindObjectOffset(parser, number);
+    if (offset == NULL || offset->generation != generation)
+        return NULL;
+    
+    const uint8_t *saved = parser->current;
+    bool savedError = parser->error;
+    parser->current = parser->start + offset->offset;
+    parser->error = false;
+    SKFDFObjectRef object = SKFDFParseObject(parser, 0);
+    if (parser->error)
+        object = NULL;
+    parser->current = saved;
+    parser->error = savedError;
+    return object;
+}
+
+// references are only resolved after the whole file has been scanned, before that they are returned as is
+static SKFDFObjectRef SKFDFResolveObject(SKFDFParser *parser, SKFDFObjectRef object) {
+    int depth = 0;
+    while (object && object->type == kSKFDFObjectTypeReference && parser && parser->resolvesReferences) {
+        if (++depth > MAX_REFERENCE_DEPTH)
+            return NULL;
+        object = SKFDFParseIndirectObject(parser, object->value.reference.number, object->value.reference.generation);
+    }
+    return object;
+}
+
+static bool SKFDFIsCatalog(SKFDFObjectRef object) {
+    SKFDFObjectType type = SKFDFObjectGetType(SKFDFDictionaryGetObject(object, "FDF"));
+    return type == kSKFDFObjectTypeDictionary || type == kSKFDFObjectTypeReference;
+}
+
+// scans all objects once, recording where the indirect objects are and which one is the catalog
+static void SKFDFScanObjects(SKFDFParser *parser) {
+    while (true) {
+        SKFDFSkipWhitespace(parser);
+        if (parser->current >= parser->end)
+            break;
+        
+        const uint8_t *token;
+        size_t tokenLength;
+        SKFDFInteger number, generation = 0;
+        
+        if (SKFDFIsRegular(*parser->current) == false) {
+            // stray objects outside of indirect objects, ignore them
+            if (SKFDFParseObject(parser, 0) == NULL && parser->error == false)
+                SKFDFSkipUnexpected(parser, false);
+        } else if ((tokenLength = SKFDFScanToken(parser, &token)) && SKFDFTokenIsUnsignedInteger(token, tokenLength, &number)) {
+            // "number generation obj", otherwise we just ignore the number
+            const uint8_t *afterNumber = parser->current;
+            SKFDFSkipWhitespace(parser);
+            tokenLength = SKFDFScanToken(parser, &token);
+            if (SKFDFTokenIsUnsignedInteger(token, tokenLength, &generation)) {
+                SKFDFSkipWhitespace(parser);
+                tokenLength = SKFDFScanToken(parser, &token);
+            }
+            if (SKFDFTokenIsKeyword(token, tokenLength, "obj")) {
+                SKFDFAddObjectOffset(parser, number, generation, parser->current - parser->start);
+                SKFDFObjectRef object = SKFDFParseObject(parser, 0);
+                if (parser->error == false) {
+                    if (SKFDFIsCatalog(object)) {
+                        parser->catalogNumber = number;
+                        parser->catalogGeneration = generation;
+                    }
+                    SKFDFSkipWhitespace(parser);
+                    const uint8_t *afterObject = parser->current;
+                    tokenLength = SKFDFScanToken(parser, &token);
+                    if (SKFDFTokenIsKeyword(token, tokenLength, "stream"))
+                        SKFDFSkipStream(parser, object);
+                    else
+                        parser->current = afterObject;
+                }
+            } else {
+                parser->current = afterNumber;
+            }
+        } else if (SKFDFTokenIsKeyword(token, tokenLength, "trailer")) {
+            SKFDFObjectRef root = SKFDFDictionaryGetObject(SKFDFParseObject(parser, 0), "Root");
+            if (parser->error == false && root && root->type == kSKFDFObjectTypeReference) {
+                parser->rootNumber = root->value.reference.number;
+                parser->rootGeneration = root->value.reference.generation;
+            }
+        }
+        
+        if (parser->error) {
+            // recover at the end of the current object
+            const uint8_t *found = SKFDFFind(parser->current, parser->end, "endobj");
+            parser->current = found ? found + strlen("endobj") : parser->end;
+            parser->error = false;
+        }
+        
+        SKFDFResetMemory(parser);
+    }
+}
+
+long SKFDFParseAnnotations(const void *bytes, size_t length, SKFDFAnnotationCallback callback, void *context) {
+    SKFDFParser parser;
+    const uint8_t *start = (const uint8_t *)bytes;
+    const uint8_t *searchEnd = start + (length < HEADER_SEARCH_LENGTH ? length : HEADER_SEARCH_LENGTH);
+    SKFDFObjectRef catalog = NULL, fdf = NULL, annots = NULL;
+    long count = -1;
+    
+    if (bytes == NULL || callback == NULL)
+        return -1;
+    
+    // the header does not have to be at the very start
+    if (SKFDFFind(start, searchEnd, "%FDF-") == NULL && SKFDFFind(start, searchEnd, "%PDF-") == NULL)
+        return -1;
+    
+    memset(&parser, 0, sizeof(SKFDFParser));
+    parser.start = start;
+    parser.current = start;
+    parser.end = start + length;
+    parser.rootNumber = -1;
+    parser.catalogNumber = -1;
+    
+    SKFDFScanObjects(&parser);
+    
+    if (parser.offsetCount > 1)
+        qsort(parser.offsets, parser.offsetCount, sizeof(SKFDFObjectOffset), &SKFDFCompareObjectOffsets);
+    parser.resolvesReferences = true;
+    
+    if (parser.rootNumber >= 0) {
+        catalog = SKFDFParseIndirectObject(&parser, parser.rootNumber, parser.rootGeneration);
+        if (SKFDFIsCatalog(catalog) == false)
+            catalog = NULL;
+    }
+    if (catalog == NULL && parser.catalogNumber >= 0)
+        catalog = SKFDFParseIndirectObject(&parser, parser.catalogNumber, parser.catalogGeneration);
+    
+    if (SKFDFDictionaryGetDictionary(catalog, "FDF", &fdf)) {
+        count = 0;
+        // only the annotations listed in the catalog belong to the document
+        if (SKFDFDictionaryGetArray(fdf, "Annots", &annots)) {
+            SKFDFArenaMark mark = SKFDFGetMark(&parser);
+            size_t i, annotCount = SKFDFArrayGetCount(annots);
+            for (i = 0; i < annotCount; i++) {
+                SKFDFObjectRef annot = SKFDFArrayGetObject(annots, i);
+                bool stop = false;
+                if (SKFDFObjectGetType(annot) == kSKFDFObjectTypeDictionary) {
+                    count++;
+                    stop = callback(annot, context) == false;
+                }
+                SKFDFReleaseToMark(&parser, mark);
+                if (stop)
+                    break;
+            }
+        }
+    }
+    
+    SKFDFFreeMemory(&parser);
+    
+    return count;
+}
+
+// Accessors
+
+SKFDFObjectType SKFDFObjectGetType(SKFDFObjectRef object) {
+    return object ? object->type : kSKFDFObjectTypeNull;
+}
+
+const char *SKFDFNameGetString(SKFDFObjectRef name) {
+    return name && name->type == kSKFDFObjectTypeName ? (const char *)name->value.string.bytes : NULL;
+}
+
+const uint8_t *SKFDFStringGetBytePtr(SKFDFObjectRef string) {
+    return string && string->type == kSKFDFObjectTypeString ? string->value.string.bytes : NULL;
+}
+
+size_t SKFDFStringGetLength(SKFDFObjectRef string) {
+    return string && string->type == kSKFDFObjectTypeString ? string->value.string.length : 0;
+}
+
+size_t SKFDFArrayGetCount(SKFDFObjectRef array) {
+    return array && array->type == kSKFDFObjectTypeArray ? array->value.array.count : 0;
+}
+
+SKFDFObjectRef SKFDFArrayGetObject(SKFDFObjectRef array, size_t idx) {
+    return idx < SKFDFArrayGetCount(array) ? SKFDFResolveObject(array->value.array.parser, array->value.array.items[idx]) : NULL;
+}
+
+static bool SKFDFObjectGetNumber(SKFDFObjectRef object, SKFDFReal *value) {
+    if (object && object->type == kSKFDFObjectTypeReal) {
+        *value = object->value.real;
+        return true;
+    } else if (object && object->type == kSKFDFObjectTypeInteger) {
+        *value = (SKFDFReal)object->value.integer;
+        return true;
+    }
+    return false;
+}
+
+static bool SKFDFObjectGetName(SKFDFObjectRef object, const char **value) {
+    const char *name = SKFDFNameGetString(object);
+    if (name)
+        *value = name;
+    return name != NULL;
+}
+
+static bool SKFDFObjectGetObjectOfType(SKFDFObjectRef object, SKFDFObjectType type, SKFDFObjectRef *value) {
+    if (object && object->type == type) {
+        *value = object;
+        return true;
+    }
+    return false;
+}
+
+bool SKFDFArrayGetNumber(SKFDFObjectRef array, size_t idx, SKFDFReal *value) {
+    return SKFDFObjectGetNumber(SKFDFArrayGetObject(array, idx), value);
+}
+
+bool SKFDFArrayGetName(SKFDFObjectRef array, size_t idx, const char **value) {
+    return SKFDFObjectGetName(SKFDFArrayGetObject(array, idx), value);
+}
+
+bool SKFDFArrayGetArray(SKFDFObjectRef array, size_t idx, SKFDFObjectRef *value) {
+    return SKFDFObjectGetObjectOfType(SKFDFArrayGetObject(array, idx), kSKFDFObjectTypeArray, value);
+}
+
+SKFDFObjectRef SKFDFDictionaryGetObject(SKFDFObjectRef dictionary, const char *key) {
+    size_t i;
+    if (dictionary == NULL || dictionary->type != kSKFDFObjectTypeDictionary || key == NULL)
+        return NULL;
+    for (i = 0; i < dictionary->value.array.count; i++) {
+        if (strcmp((const char *)dictionary->value.array.items[2 * i]->value.string.bytes, key) == 0)
+            return SKFDFResolveObject(dictionary->value.array.parser, dictionary->value.array.items[2 * i + 1]);
+    }
+    return NULL;
+}
+
+bool SKFDFDictionaryGetInteger(SKFDFObjectRef dictionary, const char *key, SKFDFInteger *value) {
+    SKFDFObjectRef object = SKFDFDictionaryGetObject(dictionary, key);
+    if (object && object->type == kSKFDFObjectTypeInteger) {
+        *value = object->value.integer;
+        return true;
+    }
+    return false;
+}
+
+bool SKFDFDictionaryGetNumber(SKFDFObjectRef dictionary, const char *key, SKFDFReal *value) {
+    return SKFDFObjectGetNumber(SKFDFDictionaryGetObject(dictionary, key), value);
+}
+
+bool SKFDFDictionaryGetName(SKFDFObjectRef dictionary, const char *key, const char **value) {
+    return SKFDFObjectGetName(SKFDFDictionaryGetObject(dictionary, key), value);
+}
+
+bool SKFDFDictionaryGetString(SKFDFObjectRef dictionary, const char *key, SKFDFObjectRef *value) {
+    return SKFDFObjectGetObjectOfType(SKFDFDictionaryGetObject(dictionary, key), kSKFDFObjectTypeString, value);
+}
+
+bool SKFDFDictionaryGetArray(SKFDFObjectRef dictionary, const char *key, SKFDFObjectRef *value) {
+    return SKFDFObjectGetObjectOfType(SKFDFDictionaryGetObject(dictionary, key), kSKFDFObjectTypeArray, value);
+}
+
+bool SKFDFDictionaryGetDictionary(SKFDFObjectRef dictionary, const char *key, SKFDFObjectRef *value) {
+    return SKFDFObjectGetObjectOfType(SKFDFDictionaryGetObject(dictionary, key), kSKFDFObjectTypeDictionary, value);
+}
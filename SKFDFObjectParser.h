@@ -0,0 +1,103 @@
+//
+//  SKFDFObjectParser.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SKFDFOBJECTPARSER_H
+#define SKFDFOBJECTPARSER_H
+
+// A minimal PDF object parser for FDF files, in plain C so it does not depend on CoreGraphics or Foundation.
+// It scans the objects once over bytes that can be mapped to record where the indirect objects are, then parses the annotations of the catalog one at a time and passes each to a callback, after which its memory is reused.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    kSKFDFObjectTypeNull,
+    kSKFDFObjectTypeBoolean,
+    kSKFDFObjectTypeInteger,
+    kSKFDFObjectTypeReal,
+    kSKFDFObjectTypeName,
+    kSKFDFObjectTypeString,
+    kSKFDFObjectTypeArray,
+    kSKFDFObjectTypeDictionary,
+    kSKFDFObjectTypeReference
+} SKFDFObjectType;
+
+typedef long SKFDFInteger;
+typedef double SKFDFReal;
+
+typedef const struct _SKFDFObject *SKFDFObjectRef;
+
+// return false to stop parsing
+typedef bool (*SKFDFAnnotationCallback)(SKFDFObjectRef annotation, void *context);
+
+// Parses FDF (or PDF) data and calls the callback for every dictionary in the /Annots array of the /FDF catalog, in that order.
+// Returns the number of annotations passed to the callback, or -1 when the data has no FDF header or no FDF catalog.
+// Indirect references are resolved by the accessors when they are needed, but objects inside compressed object streams are not seen.
+extern long SKFDFParseAnnotations(const void *bytes, size_t length, SKFDFAnnotationCallback callback, void *context);
+
+extern SKFDFObjectType SKFDFObjectGetType(SKFDFObjectRef object);
+
+// names are NUL terminated, strings are not and may contain NUL bytes
+extern const char *SKFDFNameGetString(SKFDFObjectRef name);
+extern const uint8_t *SKFDFStringGetBytePtr(SKFDFObjectRef string);
+extern size_t SKFDFStringGetLength(SKFDFObjectRef string);
+
+extern size_t SKFDFArrayGetCount(SKFDFObjectRef array);
+extern SKFDFObjectRef SKFDFArrayGetObject(SKFDFObjectRef array, size_t idx);
+extern bool SKFDFArrayGetNumber(SKFDFObjectRef array, size_t idx, SKFDFReal *value);
+extern bool SKFDFArrayGetName(SKFDFObjectRef array, size_t idx, const char **value);
+extern bool SKFDFArrayGetArray(SKFDFObjectRef array, size_t idx, SKFDFObjectRef *value);
+
+extern SKFDFObjectRef SKFDFDictionaryGetObject(SKFDFObjectRef dictionary, const char *key);
+extern bool SKFDFDictionaryGetInteger(SKFDFObjectRef dictionary, const char *key, SKFDFInteger *value);
+extern bool SKFDFDictionaryGetNumber(SKFDFObjectRef dictionary, const char *key, SKFDFReal *value);
+extern bool SKFDFDictionaryGetName(SKFDFObjectRef dictionary, const char *key, const char **value);
+extern bool SKFDFDictionaryGetString(SKFDFObjectRef dictionary, const char *key, SKFDFObjectRef *value);
+extern bool SKFDFDictionaryGetArray(SKFDFObjectRef dictionary, const char *key, SKFDFObjectRef *value);
+extern bool SKFDFDictionaryGetDictionary(SKFDFObjectRef dictionary, const char *key, SKFDFObjectRef *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
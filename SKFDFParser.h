@@ -109,9 +109,6 @@ extern SKFDFString SKFDFLineStyleFromPDFLineStyle(PDFLineStyle lineStyle);
 
 @interface SKFDFParser : NSObject
 + (NSArray *)noteDictionariesFromFDFData:(NSData *)data;
-@end
-
-
-@interface NSMutableString (SKFDFExtensions)
-- (void)appendFDFName:(SKFDFString)name;
+// passes the notes to the block as they are parsed, returns NO if the data is not FDF data
++ (BOOL)enumerateNoteDictionariesFromFDFData:(NSData *)data usingBlock:(void (^)(NSDictionary *note, BOOL *stop))block;
 @end
@@ -37,7 +37,7 @@
  */
 
 #import "SKFDFParser.h"
-#import <ApplicationServices/ApplicationServices.h>
+#import "SKFDFObjectParser.h"
 #import "NSScanner_SKExtensions.h"
 #import "NSGeometry_SKExtensions.h"
 #import "SKStringConstants.h"
@@ -203,42 +203,127 @@ SKFDFString SKFDFLineStyleFromPDFLineStyle(PDFLineStyle lineStyle) {
     }
 }
 
+// PDFDocEncoding differs from Latin-1 in these ranges
+static const unichar SKFDFPDFDocEncodingLowCharacters[8] = {0x02D8, 0x02C7, 0x02C6, 0x02D9, 0x02DD, 0x02DB, 0x02DA, 0x02DC};
+static const unichar SKFDFPDFDocEncodingHighCharacters[33] = {
+    0x2022, 0x2020, 0x2021, 0x2026, 0x2014, 0x2013, 0x0192, 0x2044, 0x2039, 0x203A, 0x2212, 0x2030, 0x201E, 0x201C, 0x201D, 0x2018,
+    0x2019, 0x201A, 0x2122, 0xFB01, 0xFB02, 0x0141, 0x0152, 0x0160, 0x0178, 0x017D, 0x0131, 0x0142, 0x0153, 0x0161, 0x017E, 0xFFFD,
+    0x20AC};
+
+static NSString *SKFDFStringCopyTextString(SKFDFObjectRef string) {
+    const uint8_t *bytes = SKFDFStringGetBytePtr(string);
+    size_t i, length = SKFDFStringGetLength(string);
+    
+    if (bytes == NULL)
+        return nil;
+    if (length >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF)
+        return [[NSString alloc] initWithBytes:bytes + 2 length:(length - 2) & ~(size_t)1 encoding:NSUTF16BigEndianStringEncoding];
+    if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
+        return [[NSString alloc] initWithBytes:bytes + 3 length:length - 3 encoding:NSUTF8StringEncoding];
+    
+    unichar *chars = (unichar *)NSZoneMalloc(NULL, MAX(length, (size_t)1) * sizeof(unichar));
+    for (i = 0; i < length; i++) {
+        uint8_t ch = bytes[i];
+        if (ch >= 0x18 && ch <= 0x1F)
+            chars[i] = SKFDFPDFDocEncodingLowCharacters[ch - 0x18];
+        else if (ch >= 0x80 && ch <= 0xA0)
+            chars[i] = SKFDFPDFDocEncodingHighCharacters[ch - 0x80];
+        else
+            chars[i] = ch;
+    }
+    return [[NSString alloc] initWithCharactersNoCopy:chars length:length freeWhenDone:YES];
+}
+
+static inline BOOL SKFDFScanDigits(const uint8_t **bytesPtr, const uint8_t *end, NSUInteger count, NSInteger *value) {
+    const uint8_t *bytes = *bytesPtr;
+    NSInteger result = 0;
+    if ((NSUInteger)(end - bytes) < count)
+        return NO;
+    for (; count > 0; count--, bytes++) {
+        if (*bytes < '0' || *bytes > '9')
+            return NO;
+        result = 10 * result + (*bytes - '0');
+    }
+    *bytesPtr = bytes;
+    *value = result;
+    return YES;
+}
+
+// date strings have the form D:YYYYMMDDHHmmSSOHH'mm', where everything after the year is optional
+static NSDate *SKFDFStringCopyDate(SKFDFObjectRef string) {
+    const uint8_t *bytes = SKFDFStringGetBytePtr(string);
+    const uint8_t *end = bytes + SKFDFStringGetLength(string);
+    NSInteger year, month = 1, day = 1, hour = 0, minute = 0, second = 0, offsetHour = 0, offsetMinute = 0, sign = 0;
+    
+    if (bytes == NULL)
+        return nil;
+    if (end - bytes >= 2 && bytes[0] == 'D' && bytes[1] == ':')
+        bytes += 2;
+    if (SKFDFScanDigits(&bytes, end, 4, &year) == NO)
+        return nil;
+    if (SKFDFScanDigits(&bytes, end, 2, &month) && SKFDFScanDigits(&bytes, end, 2, &day) && SKFDFScanDigits(&bytes, end, 2, &hour) && SKFDFScanDigits(&bytes, end, 2, &minute) && SKFDFScanDigits(&bytes, end, 2, &second) && bytes < end) {
+        if (*bytes == '+' || *bytes == '-') {
+            sign = *bytes++ == '+' ? 1 : -1;
+            if (SKFDFScanDigits(&bytes, end, 2, &offsetHour) && bytes < end && *bytes++ == '\'')
+                SKFDFScanDigits(&bytes, end, 2, &offsetMinute);
+        }
+    }
+    
+    NSDateComponents *components = [[NSDateComponents alloc] init];
+    [components setYear:year];
+    [components setMonth:month];
+    [components setDay:day];
+    [components setHour:hour];
+    [components setMinute:minute];
+    [components setSecond:second];
+    NSCalendar *calendar = [[NSCalendar alloc] initWithCalendarIdentifier:NSCalendarIdentifierGregorian];
+    // without an offset the time is in the local time zone
+    if (sign != 0)
+        [calendar setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:sign * (3600 * offsetHour + 60 * offsetMinute)]];
+    else if (bytes < end && *bytes == 'Z')
+        [calendar setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
+    NSDate *date = [[calendar dateFromComponents:components] retain];
+    [calendar release];
+    [components release];
+    return date;
+}
+
 @implementation SKFDFParser
 
-+ (NSDictionary *)noteDictionaryFromPDFDictionary:(CGPDFDictionaryRef)annot {
++ (NSDictionary *)noteDictionaryFromFDFDictionary:(SKFDFObjectRef)annot {
     if (annot == NULL)
         return nil;
     
     NSMutableDictionary *dictionary = [NSMutableDictionary dictionary];
-    CGPDFDictionaryRef dict;
-    CGPDFArrayRef array;
-    CGPDFStringRef string;
+    SKFDFObjectRef dict;
+    SKFDFObjectRef array;
+    SKFDFObjectRef string;
     SKFDFString name;
-    CGPDFReal real;
-    CGPDFInteger integer;
+    SKFDFReal real;
+    SKFDFInteger integer;
     BOOL success = YES;
     NSRect bounds = NSZeroRect;
     
-    if (CGPDFDictionaryGetName(annot, SKFDFTypeKey, &name) == NO || SKFDFEqualStrings(name, SKFDFAnnotation) == NO) {
+    if (SKFDFDictionaryGetName(annot, SKFDFTypeKey, &name) == NO || SKFDFEqualStrings(name, SKFDFAnnotation) == NO) {
         success = NO;
     }
     
-    if (success && CGPDFDictionaryGetName(annot, SKFDFAnnotationTypeKey, &name)) {
+    if (success && SKFDFDictionaryGetName(annot, SKFDFAnnotationTypeKey, &name)) {
         [dictionary setObject:[NSString stringWithFormat:@"%s", name] forKey:SKNPDFAnnotationTypeKey];
     } else {
         success = NO;
     }
     
-    if (success && CGPDFDictionaryGetString(annot, SKFDFAnnotationContentsKey, &string)) {
-        NSString *contents = (NSString *)CGPDFStringCopyTextString(string);
+    if (success && SKFDFDictionaryGetString(annot, SKFDFAnnotationContentsKey, &string)) {
+        NSString *contents = (NSString *)SKFDFStringCopyTextString(string);
         if (contents)
             [dictionary setObject:contents forKey:SKNPDFAnnotationContentsKey];
         [contents release];
     }
     
-    if (success && CGPDFDictionaryGetArray(annot, SKFDFAnnotationBoundsKey, &array)) {
-        CGPDFReal l, b, r, t;
-        if (CGPDFArrayGetCount(array) == 4 && CGPDFArrayGetNumber(array, 0, &l) && CGPDFArrayGetNumber(array, 1, &b) && CGPDFArrayGetNumber(array, 2, &r) && CGPDFArrayGetNumber(array, 3, &t)) {
+    if (success && SKFDFDictionaryGetArray(annot, SKFDFAnnotationBoundsKey, &array)) {
+        SKFDFReal l, b, r, t;
+        if (SKFDFArrayGetCount(array) == 4 && SKFDFArrayGetNumber(array, 0, &l) && SKFDFArrayGetNumber(array, 1, &b) && SKFDFArrayGetNumber(array, 2, &r) && SKFDFArrayGetNumber(array, 3, &t)) {
             bounds = NSMakeRect(l, b, r - l, t - b);
             [dictionary setObject:NSStringFromRect(bounds) forKey:SKNPDFAnnotationBoundsKey];
         }
@@ -256,41 +341,41 @@ SKFDFString SKFDFLineStyleFromPDFLineStyle(PDFLineStyle lineStyle) {
         }
     }
     
-    if (success && CGPDFDictionaryGetInteger(annot, SKFDFAnnotationPageIndexKey, &integer)) {
+    if (success && SKFDFDictionaryGetInteger(annot, SKFDFAnnotationPageIndexKey, &integer)) {
         [dictionary setObject:[NSNumber numberWithInteger:integer] forKey:SKNPDFAnnotationPageIndexKey];
     } else {
         success = NO;
     }
     
     if (success) {
-        if (CGPDFDictionaryGetDictionary(annot, SKFDFAnnotationBorderStylesKey, &dict)) {
-            if (CGPDFDictionaryGetNumber(dict, SKFDFAnnotationLineWidthKey, &real)) {
+        if (SKFDFDictionaryGetDictionary(annot, SKFDFAnnotationBorderStylesKey, &dict)) {
+            if (SKFDFDictionaryGetNumber(dict, SKFDFAnnotationLineWidthKey, &real)) {
                 if (real > 0.0) {
                     [dictionary setObject:[NSNumber numberWithDouble:real] forKey:SKNPDFAnnotationLineWidthKey];
-                    if (CGPDFDictionaryGetName(dict, SKFDFAnnotationBorderStyleKey, &name)) {
+                    if (SKFDFDictionaryGetName(dict, SKFDFAnnotationBorderStyleKey, &name)) {
                         [dictionary setObject:[NSNumber numberWithInteger:SKPDFBorderStyleFromFDFBorderStyle(name)] forKey:SKNPDFAnnotationBorderStyleKey];
                     }
-                    if (CGPDFDictionaryGetArray(annot, SKFDFAnnotationDashPatternKey, &array)) {
-                        size_t i, count = CGPDFArrayGetCount(array);
+                    if (SKFDFDictionaryGetArray(dict, SKFDFAnnotationDashPatternKey, &array)) {
+                        size_t i, count = SKFDFArrayGetCount(array);
                         NSMutableArray *dp = [NSMutableArray array];
                         for (i = 0; i < count; i++) {
-                            if (CGPDFArrayGetNumber(array, i, &real))
+                            if (SKFDFArrayGetNumber(array, i, &real))
                                 [dp addObject:[NSNumber numberWithDouble:real]];
                         }
                         [dictionary setObject:dp forKey:SKNPDFAnnotationDashPatternKey];
                     }
                 }
             }
-        } else if (CGPDFDictionaryGetArray(annot, SKFDFAnnotationBorderKey, &array)) {
-            size_t i, count = CGPDFArrayGetCount(array);
-            if (count > 2 && CGPDFArrayGetNumber(array, 2, &real) && real > 0.0) {
+        } else if (SKFDFDictionaryGetArray(annot, SKFDFAnnotationBorderKey, &array)) {
+            size_t i, count = SKFDFArrayGetCount(array);
+            if (count > 2 && SKFDFArrayGetNumber(array, 2, &real) && real > 0.0) {
                 [dictionary setObject:[NSNumber numberWithDouble:real] forKey:SKNPDFAnnotationLineWidthKey];
-                CGPDFArrayRef dp;
-                if (count > 3 && CGPDFArrayGetArray(array, 3, &dp)) {
-                    count = CGPDFArrayGetCount(dp);
+                SKFDFObjectRef dp;
+                if (count > 3 && SKFDFArrayGetArray(array, 3, &dp)) {
+                    count = SKFDFArrayGetCount(dp);
                     NSMutableArray *dashPattern = [NSMutableArray arrayWithCapacity:count];
                     for (i = 0; i < count; i++) {
-                        if (CGPDFArrayGetNumber(dp, i, &real))
+                        if (SKFDFArrayGetNumber(dp, i, &real))
                             [dashPattern addObject:[NSNumber numberWithDouble:real]];
                     }
                     [dictionary setObject:dashPattern forKey:SKNPDFAnnotationDashPatternKey];
@@ -305,50 +390,50 @@ SKFDFString SKFDFLineStyleFromPDFLineStyle(PDFLineStyle lineStyle) {
         }
     }
     
-    if (success && CGPDFDictionaryGetArray(annot, SKFDFAnnotationColorKey, &array)) {
-        CGPDFReal r, g, b;
-        if (CGPDFArrayGetCount(array) == 3 && CGPDFArrayGetNumber(array, 0, &r) && CGPDFArrayGetNumber(array, 1, &g) && CGPDFArrayGetNumber(array, 2, &b)) {
+    if (success && SKFDFDictionaryGetArray(annot, SKFDFAnnotationColorKey, &array)) {
+        SKFDFReal r, g, b;
+        if (SKFDFArrayGetCount(array) == 3 && SKFDFArrayGetNumber(array, 0, &r) && SKFDFArrayGetNumber(array, 1, &g) && SKFDFArrayGetNumber(array, 2, &b)) {
             [dictionary setObject:[NSColor colorWithDeviceRed:r green:g blue:b alpha:1.0] forKey:SKNPDFAnnotationColorKey];
         }
     }
     
-    if (success && CGPDFDictionaryGetArray(annot, SKFDFAnnotationInteriorColorKey, &array)) {
-        CGPDFReal r, g, b;
-        if (CGPDFArrayGetCount(array) == 3 && CGPDFArrayGetNumber(array, 0, &r) && CGPDFArrayGetNumber(array, 1, &g) && CGPDFArrayGetNumber(array, 2, &b)) {
+    if (success && SKFDFDictionaryGetArray(annot, SKFDFAnnotationInteriorColorKey, &array)) {
+        SKFDFReal r, g, b;
+        if (SKFDFArrayGetCount(array) == 3 && SKFDFArrayGetNumber(array, 0, &r) && SKFDFArrayGetNumber(array, 1, &g) && SKFDFArrayGetNumber(array, 2, &b)) {
             [dictionary setObject:[NSColor colorWithDeviceRed:r green:g blue:b alpha:1.0] forKey:SKNPDFAnnotationInteriorColorKey];
         }
     }
     
-    if (success && CGPDFDictionaryGetString(annot, SKFDFAnnotationModificationDateKey, &string)) {
-        NSDate *date = (NSDate *)CGPDFStringCopyDate(string);
+    if (success && SKFDFDictionaryGetString(annot, SKFDFAnnotationModificationDateKey, &string)) {
+        NSDate *date = (NSDate *)SKFDFStringCopyDate(string);
         if (date)
             [dictionary setObject:date forKey:SKNPDFAnnotationModificationDateKey];
         [date release];
     }
     
-    if (success && CGPDFDictionaryGetString(annot, SKFDFAnnotationUserNameKey, &string)) {
-        NSString *userName = (NSString *)CGPDFStringCopyTextString(string);
+    if (success && SKFDFDictionaryGetString(annot, SKFDFAnnotationUserNameKey, &string)) {
+        NSString *userName = (NSString *)SKFDFStringCopyTextString(string);
         if (userName)
             [dictionary setObject:userName forKey:SKNPDFAnnotationUserNameKey];
         [userName release];
     }
     
-    if (success && CGPDFDictionaryGetInteger(annot, SKFDFAnnotationPageIndexKey, &integer)) {
+    if (success && SKFDFDictionaryGetInteger(annot, SKFDFAnnotationAlignmentKey, &integer)) {
         [dictionary setObject:[NSNumber numberWithInteger:SKPDFFreeTextAnnotationAlignmentFromFDFFreeTextAnnotationAlignment(integer)] forKey:SKNPDFAnnotationAlignmentKey];
     }
     
-    if (success && CGPDFDictionaryGetName(annot, SKFDFAnnotationIconTypeKey, &name)) {
+    if (success && SKFDFDictionaryGetName(annot, SKFDFAnnotationIconTypeKey, &name)) {
         [dictionary setObject:[NSNumber numberWithInteger:SKPDFTextAnnotationIconTypeFromFDFTextAnnotationIconType(name)] forKey:SKNPDFAnnotationIconTypeKey];
     }
     
-    if (success && CGPDFDictionaryGetArray(annot, SKFDFAnnotationLineStylesKey, &array)) {
+    if (success && SKFDFDictionaryGetArray(annot, SKFDFAnnotationLineStylesKey, &array)) {
         NSInteger startStyle = kPDFLineStyleNone;
         NSInteger endStyle = kPDFLineStyleNone;
-        if (CGPDFArrayGetCount(array) == 2) {
-            if (CGPDFArrayGetName(array, 0, &name)) {
+        if (SKFDFArrayGetCount(array) == 2) {
+            if (SKFDFArrayGetName(array, 0, &name)) {
                 startStyle = SKPDFLineStyleFromFDFLineStyle(name);
             }
-            if (CGPDFArrayGetName(array, 1, &name)) {
+            if (SKFDFArrayGetName(array, 1, &name)) {
                 endStyle = SKPDFLineStyleFromFDFLineStyle(name);
             }
         }
@@ -356,40 +441,40 @@ SKFDFString SKFDFLineStyleFromPDFLineStyle(PDFLineStyle lineStyle) {
         [dictionary setObject:[NSNumber numberWithInteger:startStyle] forKey:SKNPDFAnnotationStartLineStyleKey];
     }
     
-    if (success && CGPDFDictionaryGetArray(annot, SKFDFAnnotationLinePointsKey, &array)) {
-        NSPoint p1, p2;
-        if (CGPDFArrayGetCount(array) == 4 && CGPDFArrayGetNumber(array, 0, &p1.x) && CGPDFArrayGetNumber(array, 1, &p1.y) && CGPDFArrayGetNumber(array, 2, &p2.x) && CGPDFArrayGetNumber(array, 3, &p2.y)) {
-            [dictionary setObject:NSStringFromPoint(SKSubstractPoints(p1, bounds.origin)) forKey:SKNPDFAnnotationStartPointKey];
-            [dictionary setObject:NSStringFromPoint(SKSubstractPoints(p2, bounds.origin)) forKey:SKNPDFAnnotationEndPointKey];
+    if (success && SKFDFDictionaryGetArray(annot, SKFDFAnnotationLinePointsKey, &array)) {
+        SKFDFReal x1, y1, x2, y2;
+        if (SKFDFArrayGetCount(array) == 4 && SKFDFArrayGetNumber(array, 0, &x1) && SKFDFArrayGetNumber(array, 1, &y1) && SKFDFArrayGetNumber(array, 2, &x2) && SKFDFArrayGetNumber(array, 3, &y2)) {
+            [dictionary setObject:NSStringFromPoint(SKSubstractPoints(NSMakePoint(x1, y1), bounds.origin)) forKey:SKNPDFAnnotationStartPointKey];
+            [dictionary setObject:NSStringFromPoint(SKSubstractPoints(NSMakePoint(x2, y2), bounds.origin)) forKey:SKNPDFAnnotationEndPointKey];
         }
     }
     
-    if (success && CGPDFDictionaryGetArray(annot, SKFDFAnnotationQuadrilateralPointsKey, &array)) {
-        size_t i, count = CGPDFArrayGetCount(array);
+    if (success && SKFDFDictionaryGetArray(annot, SKFDFAnnotationQuadrilateralPointsKey, &array)) {
+        size_t i, count = SKFDFArrayGetCount(array);
         if (count % 8 == 0) {
             NSMutableArray *quadPoints = [NSMutableArray arrayWithCapacity:count / 2];
             for (i = 0; i < count; i++) {
-                NSPoint point;
-                if (CGPDFArrayGetNumber(array, i, &point.x) && CGPDFArrayGetNumber(array, ++i, &point.y))
-                    [quadPoints addObject:NSStringFromPoint(SKSubstractPoints(point, bounds.origin))];
+                SKFDFReal x, y;
+                if (SKFDFArrayGetNumber(array, i, &x) && SKFDFArrayGetNumber(array, ++i, &y))
+                    [quadPoints addObject:NSStringFromPoint(SKSubstractPoints(NSMakePoint(x, y), bounds.origin))];
             }
             [dictionary setObject:quadPoints forKey:SKNPDFAnnotationQuadrilateralPointsKey];
         }
     }
     
-    if (success && CGPDFDictionaryGetArray(annot, SKFDFAnnotationInkListKey, &array)) {
-        size_t i, iMax = CGPDFArrayGetCount(array);
+    if (success && SKFDFDictionaryGetArray(annot, SKFDFAnnotationInkListKey, &array)) {
+        size_t i, iMax = SKFDFArrayGetCount(array);
         NSMutableArray *pointLists = [NSMutableArray arrayWithCapacity:iMax];
         for (i = 0; i < iMax; i++) {
-            CGPDFArrayRef subarray;
-            if (CGPDFArrayGetArray(array, i, &subarray)) {
-                size_t j, jMax = CGPDFArrayGetCount(subarray);
+            SKFDFObjectRef subarray;
+            if (SKFDFArrayGetArray(array, i, &subarray)) {
+                size_t j, jMax = SKFDFArrayGetCount(subarray);
                 if (jMax % 2 == 0) {
                     NSMutableArray *points = [NSMutableArray arrayWithCapacity:jMax / 2];
                     for (j = 0; j < jMax; j++) {
-                        NSPoint point;
-                        if (CGPDFArrayGetNumber(subarray, j, &point.x) && CGPDFArrayGetNumber(subarray, ++j, &point.y))
-                            [points addObject:NSStringFromPoint(SKSubstractPoints(point, bounds.origin))];
+                        SKFDFReal x, y;
+                        if (SKFDFArrayGetNumber(subarray, j, &x) && SKFDFArrayGetNumber(subarray, ++j, &y))
+                            [points addObject:NSStringFromPoint(SKSubstractPoints(NSMakePoint(x, y), bounds.origin))];
                     }
                     [pointLists addObject:points];
                 }
@@ -398,8 +483,8 @@ SKFDFString SKFDFLineStyleFromPDFLineStyle(PDFLineStyle lineStyle) {
         [dictionary setObject:pointLists forKey:SKNPDFAnnotationPointListsKey];
     }
     
-    if (success && CGPDFDictionaryGetString(annot, SKFDFDefaultAppearanceKey, &string)) {
-        NSString *da = (NSString *)CGPDFStringCopyTextString(string);
+    if (success && SKFDFDictionaryGetString(annot, SKFDFDefaultAppearanceKey, &string)) {
+        NSString *da = (NSString *)SKFDFStringCopyTextString(string);
         if (da) {
             NSScanner *scanner = [NSScanner scannerWithString:da];
             NSString *fontName;
@@ -430,56 +515,33 @@ SKFDFString SKFDFLineStyleFromPDFLineStyle(PDFLineStyle lineStyle) {
     return success ? dictionary : nil;
 }
 
-+ (NSArray *)noteDictionariesFromFDFData:(NSData *)data {
-    const char *pdfHeader = "%PDF";
-    NSUInteger pdfHeaderLength = strlen(pdfHeader);
-    NSMutableArray *notes = nil;
-    
-    if ([data length] > pdfHeaderLength) {
-        
-        NSMutableData *pdfData = [data mutableCopy];
-        
-        [pdfData replaceBytesInRange:NSMakeRange(0, pdfHeaderLength) withBytes:pdfHeader length:pdfHeaderLength];
-
-        CGDataProviderRef provider = CGDataProviderCreateWithCFData((CFDataRef)pdfData);
-        CGPDFDocumentRef document = CGPDFDocumentCreateWithProvider(provider);
-        
-        if (document) {
-            CGPDFDictionaryRef catalog = CGPDFDocumentGetCatalog(document);
-            CGPDFDictionaryRef fdfDict;
-            CGPDFArrayRef annots;
-            
-            if (catalog &&
-                CGPDFDictionaryGetDictionary(catalog, SKFDFFDFKey, &fdfDict) &&
-                CGPDFDictionaryGetArray(fdfDict, SKFDFAnnotationsKey, &annots)) {
-                
-                size_t i, count = CGPDFArrayGetCount(annots);
-                notes = [NSMutableArray arrayWithCapacity:count];
-                for (i = 0; i < count; i++) {
-                    CGPDFDictionaryRef annot;
-                    NSDictionary *note;
-                    if (CGPDFArrayGetDictionary(annots, i, &annot) && 
-                        (note = [self noteDictionaryFromPDFDictionary:annot])) {
-                        [notes addObject:note];
-                    }
-                }
-            }
-            
-            CGPDFDocumentRelease(document);
-        }
-        
-        CGDataProviderRelease(provider);
-        [pdfData release];
-    }
-    
-    return notes;
-}
+typedef struct _SKFDFParserContext {
+    Class parserClass;
+    void (^block)(NSDictionary *note, BOOL *stop);
+} SKFDFParserContext;
 
-@end
+static bool SKFDFHandleAnnotation(SKFDFObjectRef annotation, void *context) {
+    SKFDFParserContext *parserContext = (SKFDFParserContext *)context;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSDictionary *note = [parserContext->parserClass noteDictionaryFromFDFDictionary:annotation];
+    BOOL stop = NO;
+    if (note)
+        parserContext->block(note, &stop);
+    [pool release];
+    return stop == NO;
+}
 
++ (BOOL)enumerateNoteDictionariesFromFDFData:(NSData *)data usingBlock:(void (^)(NSDictionary *note, BOOL *stop))block {
+    SKFDFParserContext context = {self, block};
+    return SKFDFParseAnnotations([data bytes], [data length], &SKFDFHandleAnnotation, &context) >= 0;
+}
 
-@implementation NSMutableString (SKFDFExtensions)
-- (void)appendFDFName:(SKFDFString)name {
-    [self appendFormat:@"/%s", name];
++ (NSArray *)noteDictionariesFromFDFData:(NSData *)data {
+    NSMutableArray *notes = [NSMutableArray array];
+    BOOL success = [self enumerateNoteDictionariesFromFDFData:data usingBlock:^(NSDictionary *note, BOOL *stop){
+        [notes addObject:note];
+    }];
+    return success ? notes : nil;
 }
+
 @end
@@ -0,0 +1,78 @@
+//
+//  SKFDFWriter.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "SKFDFParser.h"
+
+// Writes FDF tokens into a byte buffer, which is flushed either to a file descriptor or to an in-memory data object
+// Numbers following a name or another number are separated by a space, all other delimiters are written explicitly
+@interface SKFDFWriter : NSObject {
+    int fileDescriptor;
+    NSMutableData *data;
+    char *buffer;
+    NSUInteger length;
+    BOOL needsSpace;
+    BOOL failed;
+    int errorNumber;
+}
+
+// does not take ownership of the file descriptor
+- (id)initWithFileDescriptor:(int)fd;
+
+// collects the output in memory
+- (id)init;
+
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)len;
+- (void)appendCString:(const char *)string;
+
+- (void)appendName:(SKFDFString)name;
+- (void)appendInteger:(NSInteger)value;
+- (void)appendReal:(CGFloat)value;
+// appends a literal string, encoded lossy as Latin-1 and escaped
+- (void)appendString:(NSString *)string;
+
+// returns NO when writing to the file descriptor failed
+- (BOOL)flush;
+
+// the errno of the first failed write, or 0
+- (int)errorNumber;
+
+// the data written so far, nil when writing to a file descriptor
+- (NSData *)data;
+
+@end
@@ -0,0 +1,248 @@
+//
+//  SKFDFWriter.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKFDFWriter.h"
+#import "NSString_SKExtensions.h"
+
+#define BUFFER_SIZE 65536
+#define CHUNK_SIZE 1024
+#define MAX_REAL_DECIMALS 6
+#define MAX_REAL_LENGTH 400
+
+static const double powersOfTen[MAX_REAL_DECIMALS + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+
+// Writes the shortest decimal with at most 6 decimals that reads back as the same value, or the value rounded to 6 decimals
+// PDF does not allow exponents, so we cannot use %g
+static NSUInteger SKFDFFormatReal(double value, char *buf) {
+    unsigned long long scaled;
+    NSUInteger decimals, n = 0, i;
+    char digits[24];
+    double absValue;
+    
+    if (isfinite(value) == 0)
+        value = 0.0;
+    absValue = fabs(value);
+    // beyond this the scaled value no longer fits in the mantissa
+    if (absValue >= 1e9)
+        return snprintf(buf, MAX_REAL_LENGTH, "%.0f", value);
+    
+    for (decimals = 0; ; decimals++) {
+        scaled = (unsigned long long)llround(absValue * powersOfTen[decimals]);
+        if (decimals == MAX_REAL_DECIMALS || (double)scaled / powersOfTen[decimals] == absValue)
+            break;
+    }
+    while (decimals > 0 && scaled % 10 == 0) {
+        scaled /= 10;
+        decimals--;
+    }
+    
+    do {
+        digits[n++] = '0' + (char)(scaled % 10);
+        scaled /= 10;
+    } while (scaled > 0 || n <= decimals);
+    
+    i = 0;
+    if (value < 0.0 && (n > 1 || digits[0] != '0'))
+        buf[i++] = '-';
+    while (n > decimals)
+        buf[i++] = digits[--n];
+    if (decimals > 0) {
+        buf[i++] = '.';
+        while (n > 0)
+            buf[i++] = digits[--n];
+    }
+    return i;
+}
+
+@interface SKFDFWriter (SKPrivate)
+- (void)flushBuffer;
+@end
+
+@implementation SKFDFWriter
+
+- (id)initWithFileDescriptor:(int)fd {
+    self = [super init];
+    if (self) {
+        fileDescriptor = fd;
+        data = nil;
+        buffer = (char *)NSZoneMalloc(NSDefaultMallocZone(), BUFFER_SIZE);
+        length = 0;
+        needsSpace = NO;
+        failed = NO;
+        errorNumber = 0;
+    }
+    return self;
+}
+
+- (id)init {
+    self = [self initWithFileDescriptor:-1];
+    if (self) {
+        data = [[NSMutableData alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    SKDESTROY(data);
+    SKZONEDESTROY(buffer);
+    [super dealloc];
+}
+
+- (void)flushBuffer {
+    if (length == 0)
+        return;
+    if (failed) {
+        // keep discarding output after a write error
+    } else if (data) {
+        [data appendBytes:buffer length:length];
+    } else {
+        const char *bytes = buffer;
+        NSUInteger remaining = length;
+        while (remaining > 0) {
+            ssize_t written = write(fileDescriptor, bytes, remaining);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                errorNumber = errno;
+                failed = YES;
+                break;
+            }
+            bytes += written;
+            remaining -= written;
+        }
+    }
+    length = 0;
+}
+
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)len {
+    if (len > BUFFER_SIZE - length) {
+        [self flushBuffer];
+        if (len > BUFFER_SIZE) {
+            const char *chunk = (const char *)bytes;
+            while (len > BUFFER_SIZE) {
+                memcpy(buffer, chunk, BUFFER_SIZE);
+                length = BUFFER_SIZE;
+                [self flushBuffer];
+                chunk += BUFFER_SIZE;
+                len -= BUFFER_SIZE;
+            }
+            bytes = chunk;
+        }
+    }
+    memcpy(buffer + length, bytes, len);
+    length += len;
+    needsSpace = NO;
+}
+
+- (void)appendCString:(const char *)string {
+    [self appendBytes:string length:strlen(string)];
+}
+
+- (void)appendName:(SKFDFString)name {
+    NSUInteger len = strlen(name);
+    if (len + 1 > BUFFER_SIZE - length)
+        [self flushBuffer];
+    buffer[length++] = '/';
+    [self appendBytes:name length:len];
+    needsSpace = YES;
+}
+
+- (void)appendInteger:(NSInteger)value {
+    char buf[24];
+    int len = snprintf(buf + 1, sizeof(buf) - 1, "%ld", (long)value);
+    if (needsSpace) {
+        buf[0] = ' ';
+        [self appendBytes:buf length:len + 1];
+    } else {
+        [self appendBytes:buf + 1 length:len];
+    }
+    needsSpace = YES;
+}
+
+- (void)appendReal:(CGFloat)value {
+    char buf[MAX_REAL_LENGTH + 1];
+    NSUInteger len = SKFDFFormatReal(value, buf + 1);
+    if (needsSpace) {
+        buf[0] = ' ';
+        [self appendBytes:buf length:len + 1];
+    } else {
+        [self appendBytes:buf + 1 length:len];
+    }
+    needsSpace = YES;
+}
+
+- (void)appendString:(NSString *)string {
+    UInt8 chunk[CHUNK_SIZE];
+    CFIndex i = 0, len, usedLength, converted;
+    if ([string canBeConvertedToEncoding:NSISOLatin1StringEncoding] == NO)
+        string = [string lossyStringUsingEncoding:NSISOLatin1StringEncoding];
+    len = [string length];
+    [self appendBytes:"(" length:1];
+    while (i < len) {
+        converted = CFStringGetBytes((CFStringRef)string, CFRangeMake(i, MIN(len - i, CHUNK_SIZE)), kCFStringEncodingISOLatin1, '?', false, chunk, CHUNK_SIZE, &usedLength);
+        if (converted <= 0)
+            break;
+        i += converted;
+        // escaping can at most double the length
+        if ((NSUInteger)(2 * usedLength) > BUFFER_SIZE - length)
+            [self flushBuffer];
+        for (CFIndex j = 0; j < usedLength; j++) {
+            UInt8 c = chunk[j];
+            if (c == '(' || c == ')' || c == '\\')
+                buffer[length++] = '\\';
+            buffer[length++] = c;
+        }
+    }
+    [self appendBytes:")" length:1];
+}
+
+- (BOOL)flush {
+    [self flushBuffer];
+    return failed == NO;
+}
+
+- (int)errorNumber {
+    return errorNumber;
+}
+
+- (NSData *)data {
+    [self flushBuffer];
+    return data;
+}
+
+@end
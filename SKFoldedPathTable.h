@@ -0,0 +1,76 @@
+//
+//  SKFoldedPathTable.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/21/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+typedef struct _SKFoldedPathEntry {
+    uint64_t hash;
+    uint64_t nameHash;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t nameOffset;
+    NSInteger value;
+} SKFoldedPathEntry;
+
+// maps paths to nonzero integers, comparing paths case insensitively and in canonical form
+// paths are case folded once when they are added or looked up, the table only hashes and compares the folded UTF-8 bytes
+@interface SKFoldedPathTable : NSObject {
+    char *bytes;
+    NSUInteger bytesLength;
+    NSUInteger bytesCapacity;
+    SKFoldedPathEntry *entries;
+    NSUInteger count;
+    NSUInteger capacity;
+    uint32_t *slots;
+    uint32_t *nameSlots;
+    NSUInteger slotCount;
+}
+
+@property (nonatomic, readonly) NSUInteger count;
+
+// returns 0 when the path is not in the table
+- (NSInteger)valueForPath:(NSString *)path;
+// returns the value of the first added path with the same last path component, or 0
+- (NSInteger)valueForLastPathComponent:(NSString *)name;
+
+// the value should not be 0, replaces the value of an existing path
+- (void)setValue:(NSInteger)value forPath:(NSString *)path;
+
+- (void)removeAllPaths;
+
+@end
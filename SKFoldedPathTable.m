@@ -0,0 +1,233 @@
+//
+//  SKFoldedPathTable.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/21/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKFoldedPathTable.h"
+#import <CoreFoundation/CoreFoundation.h>
+
+#define STACK_BUFFER_SIZE 1024
+#define EMPTY_SLOT 0
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// returns the case folded bytes in canonical decomposed form, either in buffer or in a malloc'ed buffer that the caller should free
+static char *copyFoldedBytes(NSString *path, char *buffer, NSUInteger bufferSize, NSUInteger *lengthPtr) {
+    CFStringRef string = (CFStringRef)path;
+    CFIndex len = CFStringGetLength(string);
+    CFIndex used = 0;
+    
+    // most paths are plain ASCII, those only need to be lowercased
+    if (len <= (CFIndex)bufferSize && CFStringGetBytes(string, CFRangeMake(0, len), kCFStringEncodingASCII, 0, false, (UInt8 *)buffer, bufferSize, &used) == len) {
+        CFIndex i;
+        for (i = 0; i < used; i++) {
+            if (buffer[i] >= 'A' && buffer[i] <= 'Z')
+                buffer[i] += 'a' - 'A';
+        }
+        *lengthPtr = used;
+        return buffer;
+    }
+    
+    CFMutableStringRef folded = CFStringCreateMutableCopy(kCFAllocatorDefault, 0, string);
+    CFStringFold(folded, kCFCompareCaseInsensitive, NULL);
+    CFStringNormalize(folded, kCFStringNormalizationFormD);
+    len = CFStringGetLength(folded);
+    CFStringGetBytes(folded, CFRangeMake(0, len), kCFStringEncodingUTF8, 0, false, NULL, 0, &used);
+    char *bytes = (NSUInteger)used <= bufferSize ? buffer : (char *)malloc(used);
+    CFStringGetBytes(folded, CFRangeMake(0, len), kCFStringEncodingUTF8, 0, false, (UInt8 *)bytes, used, NULL);
+    CFRelease(folded);
+    *lengthPtr = used;
+    return bytes;
+}
+
+static inline uint64_t hashBytes(const char *bytes, NSUInteger length) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    NSUInteger i;
+    for (i = 0; i < length; i++) {
+        hash ^= (uint8_t)bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static inline NSUInteger nameStart(const char *bytes, NSUInteger length) {
+    NSUInteger start = length;
+    while (start > 0 && bytes[start - 1] != '/')
+        start--;
+    return start;
+}
+
+@interface SKFoldedPathTable (SKPrivate)
+- (NSUInteger)slotForBytes:(const char *)folded length:(NSUInteger)length hash:(uint64_t)hash;
+- (NSUInteger)nameSlotForBytes:(const char *)folded length:(NSUInteger)length hash:(uint64_t)hash;
+- (void)insertEntryAtIndex:(NSUInteger)entryIndex;
+- (void)rehash;
+@end
+
+@implementation SKFoldedPathTable
+
+@synthesize count;
+
+- (void)dealloc {
+    if (bytes) free(bytes);
+    if (entries) free(entries);
+    if (slots) free(slots);
+    if (nameSlots) free(nameSlots);
+    [super dealloc];
+}
+
+// returns the slot containing the matching entry, or the empty slot where it should be inserted
+- (NSUInteger)slotForBytes:(const char *)folded length:(NSUInteger)length hash:(uint64_t)hash {
+    NSUInteger mask = slotCount - 1;
+    NSUInteger slot = (NSUInteger)hash & mask;
+    while (slots[slot] != EMPTY_SLOT) {
+        SKFoldedPathEntry *entry = entries + slots[slot] - 1;
+        if (entry->hash == hash && entry->length == length && memcmp(bytes + entry->offset, folded, length) == 0)
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+- (NSUInteger)nameSlotForBytes:(const char *)folded length:(NSUInteger)length hash:(uint64_t)hash {
+    NSUInteger mask = slotCount - 1;
+    NSUInteger slot = (NSUInteger)hash & mask;
+    while (nameSlots[slot] != EMPTY_SLOT) {
+        SKFoldedPathEntry *entry = entries + nameSlots[slot] - 1;
+        if (entry->nameHash == hash && entry->offset + entry->length - entry->nameOffset == length && memcmp(bytes + entry->nameOffset, folded, length) == 0)
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+- (void)insertEntryAtIndex:(NSUInteger)entryIndex {
+    SKFoldedPathEntry *entry = entries + entryIndex;
+    NSUInteger slot = [self slotForBytes:bytes + entry->offset length:entry->length hash:entry->hash];
+    slots[slot] = (uint32_t)entryIndex + 1;
+    // the first path with a given name wins
+    slot = [self nameSlotForBytes:bytes + entry->nameOffset length:entry->offset + entry->length - entry->nameOffset hash:entry->nameHash];
+    if (nameSlots[slot] == EMPTY_SLOT)
+        nameSlots[slot] = (uint32_t)entryIndex + 1;
+}
+
+- (void)rehash {
+    if (slots) free(slots);
+    if (nameSlots) free(nameSlots);
+    slotCount = slotCount ? 2 * slotCount : 16;
+    slots = (uint32_t *)calloc(slotCount, sizeof(uint32_t));
+    nameSlots = (uint32_t *)calloc(slotCount, sizeof(uint32_t));
+    // reinsert in order, so the first path with a given name still wins
+    NSUInteger i;
+    for (i = 0; i < count; i++)
+        [self insertEntryAtIndex:i];
+}
+
+- (NSInteger)valueForPath:(NSString *)path {
+    if (count == 0 || path == nil)
+        return 0;
+    char stackBuffer[STACK_BUFFER_SIZE];
+    NSUInteger length = 0;
+    char *folded = copyFoldedBytes(path, stackBuffer, STACK_BUFFER_SIZE, &length);
+    NSUInteger slot = [self slotForBytes:folded length:length hash:hashBytes(folded, length)];
+    if (folded != stackBuffer)
+        free(folded);
+    return slots[slot] == EMPTY_SLOT ? 0 : entries[slots[slot] - 1].value;
+}
+
+- (NSInteger)valueForLastPathComponent:(NSString *)name {
+    if (count == 0 || name == nil)
+        return 0;
+    char stackBuffer[STACK_BUFFER_SIZE];
+    NSUInteger length = 0;
+    char *folded = copyFoldedBytes(name, stackBuffer, STACK_BUFFER_SIZE, &length);
+    NSUInteger start = nameStart(folded, length);
+    NSUInteger slot = [self nameSlotForBytes:folded + start length:length - start hash:hashBytes(folded + start, length - start)];
+    if (folded != stackBuffer)
+        free(folded);
+    return nameSlots[slot] == EMPTY_SLOT ? 0 : entries[nameSlots[slot] - 1].value;
+}
+
+- (void)setValue:(NSInteger)value forPath:(NSString *)path {
+    if (path == nil || value == 0)
+        return;
+    if (2 * (count + 1) > slotCount)
+        [self rehash];
+    
+    char stackBuffer[STACK_BUFFER_SIZE];
+    NSUInteger length = 0;
+    char *folded = copyFoldedBytes(path, stackBuffer, STACK_BUFFER_SIZE, &length);
+    uint64_t hash = hashBytes(folded, length);
+    NSUInteger slot = [self slotForBytes:folded length:length hash:hash];
+    
+    if (slots[slot] != EMPTY_SLOT) {
+        entries[slots[slot] - 1].value = value;
+    } else {
+        if (bytesLength + length >= bytesCapacity) {
+            bytesCapacity = MAX(2 * bytesCapacity, bytesLength + length + 1024);
+            bytes = (char *)realloc(bytes, bytesCapacity);
+        }
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            entries = (SKFoldedPathEntry *)realloc(entries, capacity * sizeof(SKFoldedPathEntry));
+        }
+        memcpy(bytes + bytesLength, folded, length);
+        NSUInteger start = nameStart(folded, length);
+        SKFoldedPathEntry *entry = entries + count;
+        entry->hash = hash;
+        entry->nameHash = hashBytes(folded + start, length - start);
+        entry->offset = (uint32_t)bytesLength;
+        entry->length = (uint32_t)length;
+        entry->nameOffset = (uint32_t)(bytesLength + start);
+        entry->value = value;
+        bytesLength += length;
+        [self insertEntryAtIndex:count++];
+    }
+    
+    if (folded != stackBuffer)
+        free(folded);
+}
+
+- (void)removeAllPaths {
+    count = 0;
+    bytesLength = 0;
+    if (slotCount) {
+        memset(slots, 0, slotCount * sizeof(uint32_t));
+        memset(nameSlots, 0, slotCount * sizeof(uint32_t));
+    }
+}
+
+@end
@@ -56,7 +56,12 @@ extern NSString *SKSkimFileDidSaveNotification;
     
     NSMapTable *pageOffsets;
     
+    // encoded chunks of notes that did not change since they were last saved
+    NSMapTable *noteChunks;
+    
     SKPDFSynchronizer *synchronizer;
+    // suspended script commands waiting for the synchronizer, in the order of the requests
+    NSMutableArray *syncScriptCommands;
     
     SKFileUpdateChecker *fileUpdateChecker;
     
@@ -94,6 +99,8 @@ extern NSString *SKSkimFileDidSaveNotification;
 - (void)insertObject:(PDFAnnotation *)newNote inNotesAtIndex:(NSUInteger)anIndex;
 - (void)removeObjectFromNotesAtIndex:(NSUInteger)anIndex;
 
+- (void)invalidateNoteDataForNote:(PDFAnnotation *)note;
+
 @property (nonatomic, retain) PDFPage *currentPage;
 @property (nonatomic, retain) PDFAnnotation *activeNote;
 @property (nonatomic, readonly) NSTextStorage *richText;
@@ -106,6 +113,7 @@ extern NSString *SKSkimFileDidSaveNotification;
 - (void)handleGoToScriptCommand:(NSScriptCommand *)command;
 - (id)handleFindScriptCommand:(NSScriptCommand *)command;
 - (void)handleShowTeXScriptCommand:(NSScriptCommand *)command;
+- (void)handleSynchronizeScriptCommand:(NSScriptCommand *)command;
 - (void)handleConvertNotesScriptCommand:(NSScriptCommand *)command;
 - (void)handleReadNotesScriptCommand:(NSScriptCommand *)command;
 
@@ -155,6 +155,9 @@ enum {
 
 - (void)tryToUnlockDocument:(PDFDocument *)document;
 
+- (NSDictionary *)SkimNotePropertiesRemovingPageOffset:(NSDictionary *)dict;
+- (NSData *)binaryNotesData;
+
 - (void)handleWindowWillCloseNotification:(NSNotification *)notification;
 
 @end
@@ -175,11 +178,13 @@ enum {
         SKENSURE_MAIN_THREAD( [fileUpdateChecker terminate]; );
     SKDESTROY(fileUpdateChecker);
     SKDESTROY(synchronizer);
+    SKDESTROY(syncScriptCommands);
     SKDESTROY(mainWindowController);
     SKDESTROY(pdfData);
     SKDESTROY(originalData);
     SKDESTROY(tmpData);
     SKDESTROY(pageOffsets);
+    SKDESTROY(noteChunks);
     [super dealloc];
 }
 
@@ -408,6 +413,20 @@ enum {
     [super runModalSavePanelForSaveOperation:saveOperation delegate:self didSaveSelector:@selector(document:didSaveUsingPanel:contextInfo:) contextInfo:[invocation retain]];
 }
 
+- (NSDictionary *)SkimNotePropertiesRemovingPageOffset:(NSDictionary *)dict {
+    NSUInteger pageIndex = [[dict objectForKey:SKNPDFAnnotationPageIndexKey] unsignedIntegerValue];
+    NSPointPointer offsetPtr = pageOffsets ? NSMapGet(pageOffsets, (const void *)pageIndex) : NULL;
+    if (offsetPtr != NULL) {
+        NSMutableDictionary *mutableDict = [[dict mutableCopy] autorelease];
+        NSRect bounds = NSRectFromString([dict objectForKey:SKNPDFAnnotationBoundsKey]);
+        bounds.origin.x -= offsetPtr->x;
+        bounds.origin.y -= offsetPtr->y;
+        [mutableDict setObject:NSStringFromRect(bounds) forKey:SKNPDFAnnotationBoundsKey];
+        dict = mutableDict;
+    }
+    return dict;
+}
+
 - (NSArray *)SkimNoteProperties {
     NSArray *array = [super SkimNoteProperties];
     NSArray *widgetProperties = [[self mainWindowController] widgetProperties];
@@ -415,26 +434,44 @@ enum {
         array = [array arrayByAddingObjectsFromArray:widgetProperties];
     if (pageOffsets != nil) {
         NSMutableArray *mutableArray = [NSMutableArray array];
-        for (NSDictionary *dict in array) {
-            NSUInteger pageIndex = [[dict objectForKey:SKNPDFAnnotationPageIndexKey] unsignedIntegerValue];
-            NSPointPointer offsetPtr = NSMapGet(pageOffsets, (const void *)pageIndex);
-            if (offsetPtr != NULL) {
-                NSMutableDictionary *mutableDict = [dict mutableCopy];
-                NSRect bounds = NSRectFromString([dict objectForKey:SKNPDFAnnotationBoundsKey]);
-                bounds.origin.x -= offsetPtr->x;
-                bounds.origin.y -= offsetPtr->y;
-                [mutableDict setObject:NSStringFromRect(bounds) forKey:SKNPDFAnnotationBoundsKey];
-                [mutableArray addObject:mutableDict];
-                [mutableDict release];
-            } else {
-                [mutableArray addObject:dict];
-            }
-        }
+        for (NSDictionary *dict in array)
+            [mutableArray addObject:[self SkimNotePropertiesRemovingPageOffset:dict]];
         array = mutableArray;
     }
     return  array;
 }
 
+// only notes that changed since the last save are encoded again, the widgets are cheap and not observed
+- (NSData *)binaryNotesData {
+    NSArray *notes = [self notes];
+    NSMutableArray *chunks = [NSMutableArray arrayWithCapacity:[notes count]];
+    
+    if (noteChunks == nil)
+        noteChunks = [[NSMapTable alloc] initWithKeyOptions:NSMapTableWeakMemory | NSMapTableObjectPointerPersonality valueOptions:NSMapTableStrongMemory | NSMapTableObjectPointerPersonality capacity:[notes count]];
+    
+    for (PDFAnnotation *note in notes) {
+        NSData *chunk = [noteChunks objectForKey:note];
+        if (chunk == nil) {
+            chunk = SKNBinaryChunkFromSkimNote([self SkimNotePropertiesRemovingPageOffset:[note SkimNoteProperties]]);
+            if (chunk)
+                [noteChunks setObject:chunk forKey:note];
+        }
+        if (chunk)
+            [chunks addObject:chunk];
+    }
+    for (NSDictionary *dict in [[self mainWindowController] widgetProperties]) {
+        NSData *chunk = SKNBinaryChunkFromSkimNote([self SkimNotePropertiesRemovingPageOffset:dict]);
+        if (chunk)
+            [chunks addObject:chunk];
+    }
+    
+    return [chunks count] ? SKNBinaryDataFromSkimNoteChunks(chunks) : nil;
+}
+
+- (void)invalidateNoteDataForNote:(PDFAnnotation *)note {
+    [noteChunks removeObjectForKey:note];
+}
+
 - (BOOL)attachNotesAtURL:(NSURL *)absoluteURL {
     NSFileManager *fm = [NSFileManager defaultManager];
     NSNumber *permissions = [[fm attributesOfItemAtPath:[absoluteURL path] error:NULL] objectForKey:NSFilePosixPermissions];
@@ -458,8 +495,16 @@ enum {
     }
     if ([[NSUserDefaults standardUserDefaults] boolForKey:SKWriteSkimNotesAsPlistKey])
         writeOptions |= SKNSkimNotesWritingPlist;
-    
-    BOOL success = [fm writeSkimNotes:[self SkimNoteProperties] textNotes:[self notesString] richTextNotes:[self notesRTFData] toExtendedAttributesAtURL:absoluteURL options:writeOptions error:NULL];
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:SKWriteSkimNotesInLargeFragmentsKey])
+        writeOptions |= SKNSkimNotesWritingLargeFragments;
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:SKWriteSkimNotesWithFastCompressionKey])
+        writeOptions |= SKNSkimNotesWritingFastCompression;
+    
+    BOOL success;
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:SKWriteSkimNotesAsBinaryKey])
+        success = [fm writeSkimNotesData:[self binaryNotesData] textNotes:[self notesString] richTextNotes:[self notesRTFData] toExtendedAttributesAtURL:absoluteURL options:writeOptions error:NULL];
+    else
+        success = [fm writeSkimNotes:[self SkimNoteProperties] textNotes:[self notesString] richTextNotes:[self notesRTFData] toExtendedAttributesAtURL:absoluteURL options:writeOptions error:NULL];
     
     NSDictionary *options = [[self mainWindowController] presentationOptions];
     SKNExtendedAttributeManager *eam = [SKNExtendedAttributeManager sharedNoSplitManager];
@@ -683,10 +728,8 @@ enum {
     NSError *error = nil;
     NSWorkspace *ws = [NSWorkspace sharedWorkspace];
     if ([ws type:SKNotesTextDocumentType conformsToType:typeName]) {
-        NSString *string = [self notesString];
-        if (string)
-            didWrite = [string writeToURL:absoluteURL atomically:NO encoding:NSUTF8StringEncoding error:&error];
-        else
+        didWrite = [self writeNotesForTemplateType:@"notesTemplate.txt" toURL:absoluteURL error:&error];
+        if (didWrite == NO && error == nil)
             error = [NSError writeFileErrorWithLocalizedDescription:NSLocalizedString(@"Unable to write notes as text", @"Error description")];
     } else if ([ws type:SKPDFDocumentType conformsToType:typeName]) {
         if (mdFlags.exportOption == SKExportOptionWithEmbeddedNotes)
@@ -710,10 +753,8 @@ enum {
         SKNSkimNotesWritingOptions options = [[NSUserDefaults standardUserDefaults] boolForKey:SKWriteSkimNotesAsPlistKey] ? SKNSkimNotesWritingPlist : 0;
         didWrite = [[NSFileManager defaultManager] writeSkimNotes:[self SkimNoteProperties] toSkimFileAtURL:absoluteURL options:options error:&error];
     } else if ([ws type:SKNotesRTFDocumentType conformsToType:typeName]) {
-        NSData *data = [self notesRTFData];
-        if (data)
-            didWrite = [data writeToURL:absoluteURL options:0 error:&error];
-        else
+        didWrite = [self writeNotesForTemplateType:@"notesTemplate.rtf" toURL:absoluteURL error:&error];
+        if (didWrite == NO && error == nil)
             error = [NSError writeFileErrorWithLocalizedDescription:NSLocalizedString(@"Unable to write notes as RTF", @"Error description")];
     } else if ([ws type:SKNotesRTFDDocumentType conformsToType:typeName]) {
         NSFileWrapper *fileWrapper = [self notesRTFDFileWrapper];
@@ -725,11 +766,7 @@ enum {
         NSURL *fileURL = [self fileURL];
         if (fileURL && [ws type:[self fileType] conformsToType:SKPDFBundleDocumentType])
             fileURL = [[NSFileManager defaultManager] bundledFileURLWithExtension:@"pdf" inPDFBundleAtURL:fileURL error:NULL];
-        NSData *data = [self notesFDFDataForFile:[fileURL lastPathComponent] fileIDStrings:[[self pdfDocument] fileIDStrings]];
-        if (data)
-            didWrite = [data writeToURL:absoluteURL options:0 error:&error];
-        else 
-            error = [NSError writeFileErrorWithLocalizedDescription:NSLocalizedString(@"Unable to write notes as FDF", @"Error description")];
+        didWrite = [self writeNotesFDFForFile:[fileURL lastPathComponent] fileIDStrings:[[self pdfDocument] fileIDStrings] toURL:absoluteURL error:&error];
     } else if ([[SKTemplateManager sharedManager] isRichTextBundleTemplateType:typeName]) {
         NSFileWrapper *fileWrapper = [self notesFileWrapperForTemplateType:typeName];
         if (fileWrapper)
@@ -737,10 +774,8 @@ enum {
         else
             error = [NSError writeFileErrorWithLocalizedDescription:NSLocalizedString(@"Unable to write notes using template", @"Error description")];
     } else {
-        NSData *data = [self notesDataForTemplateType:typeName];
-        if (data)
-            didWrite = [data writeToURL:absoluteURL options:0 error:&error];
-        else
+        didWrite = [self writeNotesForTemplateType:typeName toURL:absoluteURL error:&error];
+        if (didWrite == NO && error == nil)
             error = [NSError writeFileErrorWithLocalizedDescription:NSLocalizedString(@"Unable to write notes using template", @"Error description")];
     }
     
@@ -783,6 +818,8 @@ enum {
         pdfData = [data retain];
     }
     SKDESTROY(pageOffsets);
+    // the page offsets are applied to the encoded notes
+    [noteChunks removeAllObjects];
 }
 
 - (void)setOriginalData:(NSData *)data {
@@ -1046,7 +1083,7 @@ static BOOL isIgnorablePOSIXError(NSError *error) {
     if ([ws type:type conformsToType:SKNotesDocumentType]) {
         array = [[NSFileManager defaultManager] readSkimNotesFromSkimFileAtURL:notesURL error:NULL];
     } else if ([ws type:type conformsToType:SKNotesFDFDocumentType]) {
-        NSData *fdfData = [NSData dataWithContentsOfURL:notesURL];
+        NSData *fdfData = [NSData dataWithContentsOfURL:notesURL options:NSDataReadingMappedIfSafe error:NULL];
         if (fdfData)
             array = [SKFDFParser noteDictionariesFromFDFData:fdfData];
     }
@@ -1413,6 +1450,13 @@ static BOOL isIgnorablePOSIXError(NSError *error) {
         [fileUpdateChecker terminate];
         SKDESTROY(fileUpdateChecker);
         [synchronizer terminate];
+        // the synchronizer won't answer anymore
+        for (NSScriptCommand *command in syncScriptCommands) {
+            [command setScriptErrorNumber:NSInternalScriptError];
+            [command setScriptErrorString:@"The document was closed."];
+            [command resumeExecutionWithResult:nil];
+        }
+        [syncScriptCommands removeAllObjects];
     }
 }
 
@@ -1546,6 +1590,47 @@ static void replaceInShellCommand(NSMutableString *cmdString, NSString *find, NS
     }
 }
 
+- (void)synchronizer:(SKPDFSynchronizer *)aSynchronizer foundLines:(NSArray *)lines inFiles:(NSArray *)files {
+    if ([syncScriptCommands count] == 0)
+        return;
+    NSScriptCommand *command = [[[syncScriptCommands objectAtIndex:0] retain] autorelease];
+    NSMutableArray *locations = [NSMutableArray arrayWithCapacity:[lines count]];
+    NSUInteger i, iMax = [lines count];
+    [syncScriptCommands removeObjectAtIndex:0];
+    for (i = 0; i < iMax; i++) {
+        NSInteger line = [[lines objectAtIndex:i] integerValue];
+        id file = [files objectAtIndex:i];
+        if (line == NSNotFound || [file isKindOfClass:[NSString class]] == NO)
+            [locations addObject:[NSDictionary dictionary]];
+        else
+            [locations addObject:[NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInteger:line + 1], @"Line", [NSURL fileURLWithPath:file isDirectory:NO], @"Source", nil]];
+    }
+    [command resumeExecutionWithResult:locations];
+}
+
+- (void)synchronizer:(SKPDFSynchronizer *)aSynchronizer foundLocations:(NSArray *)points atPageIndexes:(NSArray *)pageIndexes options:(SKPDFSynchronizerOption)options {
+    if ([syncScriptCommands count] == 0)
+        return;
+    NSScriptCommand *command = [[[syncScriptCommands objectAtIndex:0] retain] autorelease];
+    PDFDocument *pdfDoc = [self pdfDocument];
+    NSMutableArray *locations = [NSMutableArray arrayWithCapacity:[points count]];
+    NSUInteger i, iMax = [points count];
+    [syncScriptCommands removeObjectAtIndex:0];
+    for (i = 0; i < iMax; i++) {
+        NSUInteger pageIndex = [[pageIndexes objectAtIndex:i] unsignedIntegerValue];
+        if (pageIndex < [pdfDoc pageCount]) {
+            PDFPage *page = [pdfDoc pageAtIndex:pageIndex];
+            NSPoint point = [[points objectAtIndex:i] pointValue];
+            if ((options & SKPDFSynchronizerFlippedMask))
+                point.y = NSMaxY([page boundsForBox:kPDFDisplayBoxMediaBox]) - point.y;
+            [locations addObject:[NSDictionary dictionaryWithObjectsAndKeys:page, @"Page", [NSData dataWithPointAsQDPoint:point], @"Point", nil]];
+        } else {
+            [locations addObject:[NSDictionary dictionary]];
+        }
+    }
+    [command resumeExecutionWithResult:locations];
+}
+
 
 #pragma mark Accessors
 
@@ -2068,6 +2153,70 @@ static void replaceInShellCommand(NSMutableString *cmdString, NSString *find, NS
     }
 }
 
+- (void)handleSynchronizeScriptCommand:(NSScriptCommand *)command {
+	NSDictionary *args = [command evaluatedArguments];
+    id lines = [args objectForKey:@"Lines"];
+    id pointsData = [args objectForKey:@"Points"];
+    
+    if ([lines isKindOfClass:[NSNumber class]])
+        lines = [NSArray arrayWithObjects:lines, nil];
+    if ([pointsData isKindOfClass:[NSData class]])
+        pointsData = [NSArray arrayWithObjects:pointsData, nil];
+    
+    BOOL hasLines = [lines isKindOfClass:[NSArray class]];
+    
+    if (hasLines == [pointsData isKindOfClass:[NSArray class]]) {
+        [command setScriptErrorNumber:NSArgumentsWrongScriptError];
+        [command setScriptErrorString:@"Either lines or points should be given."];
+    } else if ([(hasLines ? lines : pointsData) count] == 0) {
+        [command setScriptErrorNumber:NSArgumentsWrongScriptError];
+        [command setScriptErrorString:@"The list of lines or points is empty."];
+    } else if (hasLines) {
+        id sources = [args objectForKey:@"Source"];
+        NSMutableArray *files = [NSMutableArray arrayWithCapacity:[lines count]];
+        NSMutableArray *lineNumbers = [NSMutableArray arrayWithCapacity:[lines count]];
+        NSUInteger i, iMax = [lines count];
+        for (i = 0; i < iMax; i++) {
+            id source = [sources isKindOfClass:[NSArray class]] ? (i < [sources count] ? [sources objectAtIndex:i] : nil) : sources;
+            if ([source isKindOfClass:[NSString class]])
+                source = [NSURL fileURLWithPath:source isDirectory:NO];
+            [files addObject:[source isKindOfClass:[NSURL class]] ? [source path] : [NSNull null]];
+            // script lines are 1 based, like for the go command
+            [lineNumbers addObject:[NSNumber numberWithInteger:[[lines objectAtIndex:i] integerValue] - 1]];
+        }
+        if (syncScriptCommands == nil)
+            syncScriptCommands = [[NSMutableArray alloc] init];
+        [syncScriptCommands addObject:command];
+        [command suspendExecution];
+        [[self synchronizer] findPagesAndLocationsForLines:lineNumbers inFiles:files options:0];
+    } else {
+        id pages = [args objectForKey:@"Page"];
+        NSMutableArray *points = [NSMutableArray arrayWithCapacity:[pointsData count]];
+        NSMutableArray *rects = [NSMutableArray arrayWithCapacity:[pointsData count]];
+        NSMutableArray *bounds = [NSMutableArray arrayWithCapacity:[pointsData count]];
+        NSMutableArray *pageIndexes = [NSMutableArray arrayWithCapacity:[pointsData count]];
+        NSUInteger i, iMax = [pointsData count];
+        for (i = 0; i < iMax; i++) {
+            id page = [pages isKindOfClass:[NSArray class]] ? (i < [pages count] ? [pages objectAtIndex:i] : nil) : pages;
+            id pointData = [pointsData objectAtIndex:i];
+            NSPoint point = [pointData isKindOfClass:[NSData class]] ? [pointData pointValueAsQDPoint] : NSZeroPoint;
+            if ([page isKindOfClass:[PDFPage class]] == NO)
+                page = [[self pdfView] currentPage];
+            PDFSelection *sel = [page selectionForLineAtPoint:point];
+            NSRect rect = [sel hasCharacters] ? [sel boundsForPage:page] : NSMakeRect(point.x - 20.0, point.y - 5.0, 40.0, 10.0);
+            [points addObject:[NSValue valueWithPoint:point]];
+            [rects addObject:[NSValue valueWithRect:rect]];
+            [bounds addObject:[NSValue valueWithRect:[page boundsForBox:kPDFDisplayBoxMediaBox]]];
+            [pageIndexes addObject:[NSNumber numberWithUnsignedInteger:[page pageIndex]]];
+        }
+        if (syncScriptCommands == nil)
+            syncScriptCommands = [[NSMutableArray alloc] init];
+        [syncScriptCommands addObject:command];
+        [command suspendExecution];
+        [[self synchronizer] findFilesAndLinesForLocations:points inRects:rects pageBounds:bounds atPageIndexes:pageIndexes];
+    }
+}
+
 - (void)handleConvertNotesScriptCommand:(NSScriptCommand *)command {
     if ([[NSWorkspace sharedWorkspace] type:[self fileType] conformsToType:SKPDFDocumentType] == NO && [[NSWorkspace sharedWorkspace] type:[self fileType] conformsToType:SKPDFBundleDocumentType] == NO) {
         [command setScriptErrorNumber:NSArgumentsWrongScriptError];
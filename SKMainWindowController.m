@@ -881,20 +881,31 @@ static char SKMainWindowThumbnailSelectionObservationContext;
 }
 
 - (void)changeWidgetsFromDictionaries:(NSArray *)widgetDicts {
+    if ([widgetDicts count] == 0 || widgets == nil)
+        return;
+    // index the widgets of each page once, so matching is not quadratic for forms with many fields
+    NSMutableDictionary *widgetIndex = [NSMutableDictionary dictionary];
+    NSMapEnumerator enumerator = NSEnumerateMapTable(widgets);
+    NSUInteger pageIndex;
+    NSArray *array;
+    while (NSNextMapEnumeratorPair(&enumerator, (void **)&pageIndex, (void **)&array)) {
+        NSMutableDictionary *pageWidgets = [NSMutableDictionary dictionary];
+        for (PDFAnnotation *widget in array) {
+            NSString *key = SKNWidgetIndexKey([widget widgetType], [widget fieldName], [widget bounds]);
+            if ([pageWidgets objectForKey:key] == nil)
+                [pageWidgets setObject:widget forKey:key];
+        }
+        [widgetIndex setObject:pageWidgets forKey:[NSNumber numberWithUnsignedInteger:pageIndex]];
+    }
+    NSEndMapTableEnumeration(&enumerator);
     for (NSDictionary *dict in widgetDicts) {
-        NSRect bounds = NSIntegralRect(NSRectFromString([dict objectForKey:SKNPDFAnnotationBoundsKey]));
-        NSUInteger pageIndex = [[dict objectForKey:SKNPDFAnnotationPageIndexKey] unsignedIntegerValue];
         SKNPDFWidgetType widgetType = [[dict objectForKey:SKNPDFAnnotationWidgetTypeKey] integerValue];
-        NSString *fieldName = [dict objectForKey:SKNPDFAnnotationFieldNameKey] ?: @"";
-        for (PDFAnnotation *widget in (NSArray *)NSMapGet(widgets, (const void *)pageIndex)) {
-            if ([widget widgetType] == widgetType &&
-                [([widget fieldName] ?: @"") isEqualToString:fieldName] &&
-                NSEqualRects(NSIntegralRect([widget bounds]), bounds)) {
-                id value = [dict objectForKey:widgetType == kSKNPDFWidgetTypeButton ? SKNPDFAnnotationStateKey : SKNPDFAnnotationStringValueKey];
-                if ([([widget objectValue] ?: @"") isEqual:(value ?: @"")] == NO)
-                    [(PDFAnnotationTextWidget *)widget setObjectValue:value];
-                break;
-            }
+        NSNumber *page = [NSNumber numberWithUnsignedInteger:[[dict objectForKey:SKNPDFAnnotationPageIndexKey] unsignedIntegerValue]];
+        PDFAnnotation *widget = [[widgetIndex objectForKey:page] objectForKey:SKNWidgetIndexKey(widgetType, [dict objectForKey:SKNPDFAnnotationFieldNameKey], NSRectFromString([dict objectForKey:SKNPDFAnnotationBoundsKey]))];
+        if (widget) {
+            id value = [dict objectForKey:widgetType == kSKNPDFWidgetTypeButton ? SKNPDFAnnotationStateKey : SKNPDFAnnotationStringValueKey];
+            if ([([widget objectValue] ?: @"") isEqual:(value ?: @"")] == NO)
+                [(PDFAnnotationTextWidget *)widget setObjectValue:value];
         }
     }
 }
@@ -2370,6 +2381,8 @@ enum { SKOptionAsk = -1, SKOptionNever = 0, SKOptionAlways = 1 };
         
         // The value of some note's property has changed
         PDFAnnotation *note = (PDFAnnotation *)object;
+        // Make sure the note is encoded again on the next save, also when the change is not recorded for undo
+        [[self document] invalidateNoteDataForNote:note];
         // Ignore changes that aren't really changes.
         // How much processor time does this memory optimization cost? We don't know, because we haven't measured it. The use of NSKeyValueObservingOptionNew in -startObservingNotes:, which makes NSKeyValueChangeNewKey entries appear in change dictionaries, definitely costs something when KVO notifications are sent (it costs virtually nothing at observer registration time). Regardless, it's probably a good idea to do simple memory optimizations like this as they're discovered and debug just enough to confirm that they're saving the expected memory (and not introducing bugs). Later on it will be easier to test for good responsiveness and sample to hunt down processor time problems than it will be to figure out where all the darn memory went when your app turns out to be notably RAM-hungry (and therefore slowing down _other_ apps on your user's computers too, if the problem is bad enough to cause paging).
         // Is this a premature optimization? No. Leaving out this very simple check, because we're worried about the processor time cost of using NSKeyValueChangeNewKey, would be a premature optimization.
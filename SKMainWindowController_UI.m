@@ -1923,6 +1923,9 @@ static NSArray *allMainDocumentPDFViews() {
     PDFAnnotation *annotation = [[notification userInfo] objectForKey:SKPDFViewAnnotationKey];
     PDFPage *page = [[notification userInfo] objectForKey:SKPDFViewPageKey];
     
+    // a note can be added back to a different page, e.g. when undoing
+    [[self document] invalidateNoteDataForNote:annotation];
+    
     if ([annotation isSkimNote] && mwcFlags.addOrRemoveNotesInBulk == 0) {
         mwcFlags.updatingNoteSelection = 1;
         [[self mutableArrayValueForKey:NOTES_KEY] addObject:annotation];
@@ -1970,6 +1973,9 @@ static NSArray *allMainDocumentPDFViews() {
     PDFPage *oldPage = [[notification userInfo] objectForKey:SKPDFViewOldPageKey];
     PDFPage *newPage = [[notification userInfo] objectForKey:SKPDFViewNewPageKey];
     
+    // the page index is saved with the note
+    [[self document] invalidateNoteDataForNote:[[notification userInfo] objectForKey:SKPDFViewAnnotationKey]];
+    
     if (oldPage || newPage) {
         if (oldPage)
             [self updateThumbnailAtPageIndex:[oldPage pageIndex]];
@@ -0,0 +1,77 @@
+//
+//  SKPDFSyncIndex.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/14/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Cocoa/Cocoa.h>
+
+@class SKFoldedPathTable;
+
+#define SKPDFSyncNoFileID -1
+#define SKPDFSyncNoPageIndex -1
+
+typedef struct _SKPDFSyncRecord {
+    int32_t fileID;
+    int32_t line;
+    int32_t pageIndex;
+    float x;
+    float y;
+} SKPDFSyncRecord;
+
+@interface SKPDFSyncIndex : NSObject {
+    SKPDFSyncRecord *records;
+    NSUInteger recordCount;
+    
+    NSUInteger pageCount;
+    uint32_t *pageOffsets;
+    uint32_t *pageRecords;
+    
+    NSArray *files;
+    SKFoldedPathTable *fileIDs;
+    uint32_t *fileOffsets;
+    uint32_t *fileRecords;
+}
+
+// takes ownership of the malloc'ed records, fileIDs should map the files to their index in files plus one
+- (id)initWithRecords:(SKPDFSyncRecord *)someRecords count:(NSUInteger)count pageCount:(NSUInteger)numPages files:(NSArray *)someFiles fileIDs:(SKFoldedPathTable *)someFileIDs;
+
+@property (nonatomic, readonly) NSUInteger recordCount, pageCount;
+@property (nonatomic, readonly) NSArray *files;
+
+- (BOOL)findFileLine:(NSInteger *)linePtr file:(NSString **)filePtr forLocation:(NSPoint)point inRect:(NSRect)rect atPageIndex:(NSUInteger)pageIndex;
+- (BOOL)findPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line inFile:(NSString *)file;
+
+@end
@@ -0,0 +1,278 @@
+//
+//  SKPDFSyncIndex.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/14/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKPDFSyncIndex.h"
+#import "SKFoldedPathTable.h"
+
+static int comparePageRecords(void *context, const void *item1, const void *item2);
+static int compareFileRecords(void *context, const void *item1, const void *item2);
+
+static inline NSUInteger countForOffsets(uint32_t *offsets, NSUInteger i) {
+    return offsets[i + 1] - offsets[i];
+}
+
+@implementation SKPDFSyncIndex
+
+@synthesize recordCount, pageCount, files;
+
+- (id)initWithRecords:(SKPDFSyncRecord *)someRecords count:(NSUInteger)count pageCount:(NSUInteger)numPages files:(NSArray *)someFiles fileIDs:(SKFoldedPathTable *)someFileIDs {
+    self = [super init];
+    if (self) {
+        records = someRecords;
+        recordCount = count;
+        pageCount = numPages;
+        files = [someFiles copy];
+        fileIDs = [someFileIDs retain];
+        
+        NSUInteger i, fileCount = [files count];
+        uint32_t *cursors;
+        
+        pageOffsets = (uint32_t *)calloc(pageCount + 1, sizeof(uint32_t));
+        fileOffsets = (uint32_t *)calloc(fileCount + 1, sizeof(uint32_t));
+        
+        // count the records for each page and file, we ignore records that were never located on a page or in a file
+        for (i = 0; i < recordCount; i++) {
+            SKPDFSyncRecord *record = records + i;
+            if (record->fileID < 0 || (NSUInteger)record->fileID >= fileCount || record->pageIndex < 0 || (NSUInteger)record->pageIndex >= pageCount) {
+                record->pageIndex = SKPDFSyncNoPageIndex;
+                continue;
+            }
+            if (record->line != 0)
+                pageOffsets[record->pageIndex + 1]++;
+            fileOffsets[record->fileID + 1]++;
+        }
+        for (i = 0; i < pageCount; i++)
+            pageOffsets[i + 1] += pageOffsets[i];
+        for (i = 0; i < fileCount; i++)
+            fileOffsets[i + 1] += fileOffsets[i];
+        
+        pageRecords = (uint32_t *)malloc(MAX(pageOffsets[pageCount], 1u) * sizeof(uint32_t));
+        fileRecords = (uint32_t *)malloc(MAX(fileOffsets[fileCount], 1u) * sizeof(uint32_t));
+        
+        // bucket the record indexes, this keeps them in record order within each bucket
+        cursors = (uint32_t *)malloc((MAX(pageCount, fileCount) + 1) * sizeof(uint32_t));
+        memcpy(cursors, pageOffsets, (pageCount + 1) * sizeof(uint32_t));
+        for (i = 0; i < recordCount; i++) {
+            if (records[i].pageIndex != SKPDFSyncNoPageIndex && records[i].line != 0)
+                pageRecords[cursors[records[i].pageIndex]++] = (uint32_t)i;
+        }
+        memcpy(cursors, fileOffsets, (fileCount + 1) * sizeof(uint32_t));
+        for (i = 0; i < recordCount; i++) {
+            if (records[i].pageIndex != SKPDFSyncNoPageIndex)
+                fileRecords[cursors[records[i].fileID]++] = (uint32_t)i;
+        }
+        free(cursors);
+        
+        // sort the pages from top to bottom and left to right, and the files by line
+        for (i = 0; i < pageCount; i++) {
+            if (countForOffsets(pageOffsets, i) > 1)
+                qsort_r(pageRecords + pageOffsets[i], countForOffsets(pageOffsets, i), sizeof(uint32_t), records, &comparePageRecords);
+        }
+        for (i = 0; i < fileCount; i++) {
+            if (countForOffsets(fileOffsets, i) > 1)
+                qsort_r(fileRecords + fileOffsets[i], countForOffsets(fileOffsets, i), sizeof(uint32_t), records, &compareFileRecords);
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    SKDESTROY(files);
+    SKDESTROY(fileIDs);
+    if (records) free(records);
+    records = NULL;
+    if (pageOffsets) free(pageOffsets);
+    pageOffsets = NULL;
+    if (pageRecords) free(pageRecords);
+    pageRecords = NULL;
+    if (fileOffsets) free(fileOffsets);
+    fileOffsets = NULL;
+    if (fileRecords) free(fileRecords);
+    fileRecords = NULL;
+    [super dealloc];
+}
+
+- (BOOL)findFileLine:(NSInteger *)linePtr file:(NSString **)filePtr forLocation:(NSPoint)point inRect:(NSRect)rect atPageIndex:(NSUInteger)pageIndex {
+    if (pageIndex >= pageCount)
+        return NO;
+    
+    uint32_t *pageRecordIndexes = pageRecords + pageOffsets[pageIndex];
+    NSUInteger i, count = countForOffsets(pageOffsets, pageIndex);
+    NSUInteger lo = 0, hi = count, mid;
+    SKPDFSyncRecord *record = NULL;
+    SKPDFSyncRecord *beforeRecord = NULL;
+    SKPDFSyncRecord *afterRecord = NULL;
+    SKPDFSyncRecord *atRecord = NULL;
+    CGFloat distance, atDistance = CGFLOAT_MAX;
+    
+    // find the first record that is not above the rect, the records before it are above
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (records[pageRecordIndexes[mid]].y > NSMaxY(rect))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0)
+        beforeRecord = records + pageRecordIndexes[lo - 1];
+    
+    for (i = lo; i < count; i++) {
+        record = records + pageRecordIndexes[i];
+        if (record->y < NSMinY(rect)) {
+            afterRecord = record;
+            break;
+        } else if (record->x < NSMinX(rect)) {
+            beforeRecord = record;
+        } else if (record->x > NSMaxX(rect)) {
+            afterRecord = record;
+            break;
+        } else {
+            distance = fabs(record->x - point.x);
+            if (distance <= atDistance) {
+                atDistance = distance;
+                atRecord = record;
+            }
+        }
+    }
+    
+    record = NULL;
+    if (atRecord) {
+        record = atRecord;
+    } else if (beforeRecord && afterRecord) {
+        if (beforeRecord->y - point.y < point.y - afterRecord->y)
+            record = beforeRecord;
+        else if (beforeRecord->y - point.y > point.y - afterRecord->y)
+            record = afterRecord;
+        else if (beforeRecord->x - point.x < point.x - afterRecord->x)
+            record = beforeRecord;
+        else if (beforeRecord->x - point.x > point.x - afterRecord->x)
+            record = afterRecord;
+        else
+            record = beforeRecord;
+    } else if (beforeRecord) {
+        record = beforeRecord;
+    } else if (afterRecord) {
+        record = afterRecord;
+    }
+    
+    if (record) {
+        *linePtr = record->line;
+        *filePtr = [files objectAtIndex:record->fileID];
+        return YES;
+    }
+    return NO;
+}
+
+- (BOOL)findPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line inFile:(NSString *)file {
+    // the file IDs are stored shifted by one, so a missing file gives 0
+    NSUInteger fileID = (NSUInteger)[fileIDs valueForPath:file];
+    if (fileID-- == 0)
+        return NO;
+    
+    uint32_t *fileRecordIndexes = fileRecords + fileOffsets[fileID];
+    NSUInteger count = countForOffsets(fileOffsets, fileID);
+    NSUInteger lo = 0, hi = count, mid;
+    SKPDFSyncRecord *record = NULL;
+    SKPDFSyncRecord *beforeRecord = NULL;
+    SKPDFSyncRecord *afterRecord = NULL;
+    
+    // find the first record at or after the line
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (records[fileRecordIndexes[mid]].line < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0)
+        beforeRecord = records + fileRecordIndexes[lo - 1];
+    if (lo < count)
+        afterRecord = records + fileRecordIndexes[lo];
+    
+    if (afterRecord && afterRecord->line == line) {
+        record = afterRecord;
+    } else if (beforeRecord && afterRecord) {
+        if (beforeRecord->line - line > line - afterRecord->line)
+            record = afterRecord;
+        else
+            record = beforeRecord;
+    } else if (beforeRecord) {
+        record = beforeRecord;
+    } else if (afterRecord) {
+        record = afterRecord;
+    }
+    
+    if (record) {
+        *pageIndexPtr = record->pageIndex;
+        *pointPtr = NSMakePoint(record->x, record->y);
+        return YES;
+    }
+    return NO;
+}
+
+@end
+
+#pragma mark -
+
+static int comparePageRecords(void *context, const void *item1, const void *item2) {
+    SKPDFSyncRecord *records = (SKPDFSyncRecord *)context;
+    uint32_t i1 = *(uint32_t *)item1, i2 = *(uint32_t *)item2;
+    SKPDFSyncRecord *record1 = records + i1, *record2 = records + i2;
+    if (record1->y > record2->y)
+        return -1;
+    else if (record1->y < record2->y)
+        return 1;
+    else if (record1->x < record2->x)
+        return -1;
+    else if (record1->x > record2->x)
+        return 1;
+    else
+        return i1 < i2 ? -1 : i1 > i2 ? 1 : 0;
+}
+
+static int compareFileRecords(void *context, const void *item1, const void *item2) {
+    SKPDFSyncRecord *records = (SKPDFSyncRecord *)context;
+    uint32_t i1 = *(uint32_t *)item1, i2 = *(uint32_t *)item2;
+    int32_t line1 = records[i1].line, line2 = records[i2].line;
+    if (line1 < line2)
+        return -1;
+    else if (line1 > line2)
+        return 1;
+    else
+        return i1 < i2 ? -1 : i1 > i2 ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+//
+//  SKPDFSyncParser.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/15/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+enum {
+    SKPDFSyncTokenNone = 0,
+    SKPDFSyncTokenLine = 'l',
+    SKPDFSyncTokenPoint = 'p',
+    SKPDFSyncTokenPage = 's',
+    SKPDFSyncTokenOpenFile = '(',
+    SKPDFSyncTokenCloseFile = ')'
+};
+typedef char SKPDFSyncTokenType;
+
+typedef struct _SKPDFSyncToken {
+    SKPDFSyncTokenType type;
+    NSInteger recordIndex;
+    NSInteger line;
+    NSInteger pageNumber;
+    double x;
+    double y;
+    // for an open file token, points into the scanned bytes, not NUL terminated
+    const char *name;
+    NSUInteger nameLength;
+} SKPDFSyncToken;
+
+typedef struct _SKPDFSyncScanner {
+    const char *current;
+    const char *end;
+} SKPDFSyncScanner;
+
+// the bytes should be UTF-8 encoded and stay valid while the scanner is used, e.g. mapped file data
+extern void SKPDFSyncScannerInit(SKPDFSyncScanner *scanner, const void *bytes, NSUInteger length);
+
+// scans the name of the main file and the version line, the name points into the scanned bytes
+extern BOOL SKPDFSyncScanHeader(SKPDFSyncScanner *scanner, const char **namePtr, NSUInteger *nameLengthPtr);
+
+// scans the next line, returns NO at the end, tokens that cannot be parsed get type SKPDFSyncTokenNone
+extern BOOL SKPDFSyncScanToken(SKPDFSyncScanner *scanner, SKPDFSyncToken *token);
@@ -0,0 +1,221 @@
+//
+//  SKPDFSyncParser.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/15/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKPDFSyncParser.h"
+
+#define MAX_MANTISSA_DIGITS 18
+
+static const double inversePowersOf10[] = {1.0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9, 1e-10, 1e-11, 1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18};
+
+static inline BOOL isWhitespace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline BOOL isNewline(char c) {
+    return c == '\n' || c == '\r';
+}
+
+static inline BOOL isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline void skipWhitespace(SKPDFSyncScanner *scanner) {
+    while (scanner->current < scanner->end && isWhitespace(*scanner->current))
+        scanner->current++;
+}
+
+static inline void skipLine(SKPDFSyncScanner *scanner) {
+    const char *eol = memchr(scanner->current, '\n', scanner->end - scanner->current);
+    const char *cr = memchr(scanner->current, '\r', (eol ?: scanner->end) - scanner->current);
+    scanner->current = cr ?: eol ?: scanner->end;
+    while (scanner->current < scanner->end && isNewline(*scanner->current))
+        scanner->current++;
+}
+
+static inline BOOL scanCharacter(SKPDFSyncScanner *scanner, char c) {
+    skipWhitespace(scanner);
+    if (scanner->current < scanner->end && *scanner->current == c) {
+        scanner->current++;
+        return YES;
+    }
+    return NO;
+}
+
+static inline BOOL scanInteger(SKPDFSyncScanner *scanner, NSInteger *integerPtr) {
+    skipWhitespace(scanner);
+    const char *p = scanner->current;
+    BOOL negative = NO;
+    NSInteger value = 0;
+    if (p < scanner->end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p >= scanner->end || isDigit(*p) == NO)
+        return NO;
+    while (p < scanner->end && isDigit(*p)) {
+        if (value < NSIntegerMax / 10)
+            value = 10 * value + (*p - '0');
+        p++;
+    }
+    scanner->current = p;
+    if (integerPtr)
+        *integerPtr = negative ? -value : value;
+    return YES;
+}
+
+// coordinates are written as decimal numbers, so we collect the digits as an integer and scale once
+static inline BOOL scanFixedPoint(SKPDFSyncScanner *scanner, double *doublePtr) {
+    skipWhitespace(scanner);
+    const char *p = scanner->current;
+    BOOL negative = NO, hasDigits = NO;
+    int64_t mantissa = 0;
+    NSInteger digits = 0, fractionDigits = 0, integerExponent = 0;
+    if (p < scanner->end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    while (p < scanner->end && isDigit(*p)) {
+        hasDigits = YES;
+        if (digits < MAX_MANTISSA_DIGITS) {
+            mantissa = 10 * mantissa + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            integerExponent++;
+        }
+        p++;
+    }
+    if (p < scanner->end && *p == '.') {
+        p++;
+        while (p < scanner->end && isDigit(*p)) {
+            hasDigits = YES;
+            if (digits < MAX_MANTISSA_DIGITS && fractionDigits < MAX_MANTISSA_DIGITS) {
+                mantissa = 10 * mantissa + (*p - '0');
+                if (mantissa) digits++;
+                fractionDigits++;
+            }
+            p++;
+        }
+    }
+    if (hasDigits == NO)
+        return NO;
+    scanner->current = p;
+    if (doublePtr) {
+        double value = (double)mantissa;
+        if (fractionDigits > 0)
+            value *= inversePowersOf10[fractionDigits];
+        while (integerExponent-- > 0)
+            value *= 10.0;
+        *doublePtr = negative ? -value : value;
+    }
+    return YES;
+}
+
+// scans up to the end of the line, trimming surrounding whitespace
+static inline BOOL scanName(SKPDFSyncScanner *scanner, const char **namePtr, NSUInteger *nameLengthPtr) {
+    skipWhitespace(scanner);
+    const char *start = scanner->current, *p = start;
+    while (p < scanner->end && isNewline(*p) == NO)
+        p++;
+    scanner->current = p;
+    while (p > start && isWhitespace(p[-1]))
+        p--;
+    if (p == start)
+        return NO;
+    *namePtr = start;
+    *nameLengthPtr = p - start;
+    return YES;
+}
+
+void SKPDFSyncScannerInit(SKPDFSyncScanner *scanner, const void *bytes, NSUInteger length) {
+    scanner->current = (const char *)bytes;
+    scanner->end = (const char *)bytes + length;
+    // skip a UTF-8 BOM
+    if (length >= 3 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0)
+        scanner->current += 3;
+}
+
+BOOL SKPDFSyncScanHeader(SKPDFSyncScanner *scanner, const char **namePtr, NSUInteger *nameLengthPtr) {
+    if (scanName(scanner, namePtr, nameLengthPtr) == NO || scanner->current >= scanner->end)
+        return NO;
+    skipLine(scanner);
+    // we ignore the version
+    skipWhitespace(scanner);
+    if (scanner->end - scanner->current < 7 || memcmp(scanner->current, "version", 7) != 0)
+        return NO;
+    scanner->current += 7;
+    if (scanInteger(scanner, NULL) == NO)
+        return NO;
+    skipLine(scanner);
+    return YES;
+}
+
+BOOL SKPDFSyncScanToken(SKPDFSyncScanner *scanner, SKPDFSyncToken *token) {
+    skipWhitespace(scanner);
+    if (scanner->current >= scanner->end)
+        return NO;
+    
+    token->type = *scanner->current++;
+    
+    switch (token->type) {
+        case SKPDFSyncTokenLine:
+            // we ignore the column
+            if (scanInteger(scanner, &token->recordIndex) == NO || scanInteger(scanner, &token->line) == NO)
+                token->type = SKPDFSyncTokenNone;
+            break;
+        case SKPDFSyncTokenPoint:
+            // we ignore * and + modifiers
+            if (scanCharacter(scanner, '*') == NO)
+                scanCharacter(scanner, '+');
+            if (scanInteger(scanner, &token->recordIndex) == NO || scanFixedPoint(scanner, &token->x) == NO || scanFixedPoint(scanner, &token->y) == NO)
+                token->type = SKPDFSyncTokenNone;
+            break;
+        case SKPDFSyncTokenPage:
+            if (scanInteger(scanner, &token->pageNumber) == NO)
+                token->pageNumber = -1;
+            break;
+        case SKPDFSyncTokenOpenFile:
+            if (scanName(scanner, &token->name, &token->nameLength) == NO)
+                token->type = SKPDFSyncTokenNone;
+            break;
+        case SKPDFSyncTokenCloseFile:
+            break;
+        default:
+            // shouldn't reach
+            token->type = SKPDFSyncTokenNone;
+            break;
+    }
+    
+    skipLine(scanner);
+    return YES;
+}
@@ -37,7 +37,6 @@
  */
 
 #import <Cocoa/Cocoa.h>
-#import "synctex_parser.h"
 
 typedef NS_OPTIONS(NSUInteger, SKPDFSynchronizerOption) {
     SKPDFSynchronizerDefaultOptions = 0,
@@ -46,26 +45,27 @@ typedef NS_OPTIONS(NSUInteger, SKPDFSynchronizerOption) {
 };
 
 @protocol SKPDFSynchronizerDelegate;
+@class SKPDFSyncSnapshot;
 
 @interface SKPDFSynchronizer : NSObject {
     id <SKPDFSynchronizerDelegate> delegate;
     
     dispatch_queue_t queue;
+    dispatch_queue_t loadQueue;
     dispatch_queue_t lockQueue;
     
     NSString *fileName;
-    NSString *syncFileName;
-    NSDate *lastModDate;
-    BOOL isPdfsync;
     
     NSFileManager *fileManager;
     
-    NSMutableArray *pages;
-    NSMapTable *lines;
-    
-    NSMapTable *filenames;
-    synctex_scanner_p scanner;
+    // these are only accessed on the queue
+    SKPDFSyncSnapshot *snapshot;
+    NSMutableArray *pendingQueries;
+    NSString *loadingFileName;
+    NSDate *loadingModDate;
+    BOOL isLoading;
     
+    volatile int32_t loadGeneration;
     volatile int32_t shouldKeepRunning;
 }
 
@@ -76,6 +76,11 @@ typedef NS_OPTIONS(NSUInteger, SKPDFSynchronizerOption) {
 - (void)findFileAndLineForLocation:(NSPoint)point inRect:(NSRect)rect pageBounds:(NSRect)bounds atPageIndex:(NSUInteger)pageIndex;
 - (void)findPageAndLocationForLine:(NSInteger)line inFile:(NSString *)file options:(SKPDFSynchronizerOption)options;
 
+// batch versions, all results are sent in a single delegate message in the same order as the queries
+// points, rects and bounds are NSValues, lines and page indexes NSNumbers, files NSStrings or NSNull for the default source file
+- (void)findFilesAndLinesForLocations:(NSArray *)points inRects:(NSArray *)rects pageBounds:(NSArray *)bounds atPageIndexes:(NSArray *)pageIndexes;
+- (void)findPagesAndLocationsForLines:(NSArray *)lines inFiles:(NSArray *)files options:(SKPDFSynchronizerOption)options;
+
 // this must be called to stop the DO server from running in the server thread
 - (void)terminate;
 
@@ -87,4 +92,10 @@ typedef NS_OPTIONS(NSUInteger, SKPDFSynchronizerOption) {
 - (void)synchronizer:(SKPDFSynchronizer *)synchronizer foundLine:(NSInteger)line inFile:(NSString *)file;
 - (void)synchronizer:(SKPDFSynchronizer *)synchronizer foundLocation:(NSPoint)point atPageIndex:(NSUInteger)pageIndex options:(SKPDFSynchronizerOption)options;
 
+@optional
+
+// queries that could not be resolved have NSNotFound for the line or page index, NSNull for the file, and a zero point
+- (void)synchronizer:(SKPDFSynchronizer *)synchronizer foundLines:(NSArray *)lines inFiles:(NSArray *)files;
+- (void)synchronizer:(SKPDFSynchronizer *)synchronizer foundLocations:(NSArray *)points atPageIndexes:(NSArray *)pageIndexes options:(SKPDFSynchronizerOption)options;
+
 @end
@@ -38,11 +38,14 @@
 
 #import "SKPDFSynchronizer.h"
 #import <libkern/OSAtomic.h>
-#import "SKPDFSyncRecord.h"
+#import "SKPDFSyncIndex.h"
+#import "SKPDFSyncParser.h"
+#import "SKSyncTeXIndex.h"
+#import "SKFoldedPathTable.h"
+#import "synctex_parser.h"
 #import "NSCharacterSet_SKExtensions.h"
-#import "NSScanner_SKExtensions.h"
-#import <CoreFoundation/CoreFoundation.h>
 #import "NSFileManager_SKExtensions.h"
+#import "SKStringConstants.h"
 
 #define PDFSYNC_TO_PDF(coord) ((CGFloat)coord / 65536.0)
 
@@ -52,8 +55,48 @@ static NSPoint pdfOffset = {0.0, 0.0};
 #define SKPDFSynchronizerPdfsyncExtension @"pdfsync"
 static NSArray *SKPDFSynchronizerTexExtensions = nil;
 
-static BOOL caseInsensitiveStringEqual(const void *item1, const void *item2, NSUInteger (*size)(const void *item));
-static NSUInteger caseInsensitiveStringHash(const void *item, NSUInteger (*size)(const void *item));
+// The sync data loaded from one version of a sync file. A snapshot is built on the load queue and is not changed after it is handed to the query queue, apart from the source file cache, which is only used by the queue that owns the snapshot.
+@interface SKPDFSyncSnapshot : NSObject {
+    NSString *fileName;
+    NSString *syncFileName;
+    NSDate *modDate;
+    BOOL isPdfsync;
+    
+    SKPDFSyncIndex *pdfsyncIndex;
+    
+    SKFoldedPathTable *filenames;
+    SKSyncTeXIndex *synctexIndex;
+    
+    NSFileManager *fileManager;
+    BOOL (^shouldKeepLoading)(void);
+    
+    NSMutableDictionary *sourceFiles;
+    NSMutableDictionary *existingFiles;
+    NSUInteger fileProbeCount;
+    NSUInteger sourceFileCount;
+    NSUInteger sourceFileCacheHits;
+}
+
+// returns nil when no sync file could be loaded, or when the load was cancelled
+- (id)initWithFileName:(NSString *)aFileName previousSnapshot:(SKPDFSyncSnapshot *)previousSnapshot fileManager:(NSFileManager *)aFileManager shouldKeepLoading:(BOOL (^)(void))aBlock;
+
+@property (nonatomic, readonly) NSString *fileName, *syncFileName;
+@property (nonatomic, readonly) BOOL isPdfsync;
+@property (nonatomic, readonly) SKPDFSyncIndex *pdfsyncIndex;
+@property (nonatomic, readonly) SKSyncTeXIndex *synctexIndex;
+
+- (BOOL)isCurrentForFileName:(NSString *)aFileName modificationDate:(NSDate *)fileModDate;
+
+- (NSString *)sourceFileForFileName:(NSString *)file isTeX:(BOOL)isTeX removeQuotes:(BOOL)removeQuotes;
+
+- (BOOL)findFileLine:(NSInteger *)linePtr file:(NSString **)filePtr forLocation:(NSPoint)point inRect:(NSRect)rect pageBounds:(NSRect)bounds atPageIndex:(NSUInteger)pageIndex;
+- (BOOL)findPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line inFile:(NSString *)file;
+
+- (int32_t)synctexTagForFile:(NSString *)file;
+
+@end
+
+typedef void (^SKPDFSyncQuery)(SKPDFSyncSnapshot *syncSnapshot);
 
 #pragma mark -
 
@@ -71,18 +114,17 @@ static NSUInteger caseInsensitiveStringHash(const void *item, NSUInteger (*size)
     self = [super init];
     if (self) {
         queue = NULL;
+        loadQueue = NULL;
         lockQueue = dispatch_queue_create("net.sourceforge.skim-app.lockQueue.SKPDFSynchronizer", NULL);
         
         fileName = nil;
-        syncFileName = nil;
-        lastModDate = nil;
-        isPdfsync = YES;
         
-        pages = nil;
-        lines = nil;
-        
-        filenames = nil;
-        scanner = NULL;
+        snapshot = nil;
+        pendingQueries = [[NSMutableArray alloc] init];
+        loadingFileName = nil;
+        loadingModDate = nil;
+        isLoading = NO;
+        loadGeneration = 0;
         
         shouldKeepRunning = 1;
         
@@ -94,16 +136,14 @@ static NSUInteger caseInsensitiveStringHash(const void *item, NSUInteger (*size)
 
 - (void)dealloc {
     SKDISPATCHDESTROY(queue);
+    SKDISPATCHDESTROY(loadQueue);
     SKDISPATCHDESTROY(lockQueue);
     SKDESTROY(fileManager);
-    SKDESTROY(pages);
-    SKDESTROY(lines);
-    SKDESTROY(filenames);
     SKDESTROY(fileName);
-    SKDESTROY(syncFileName);
-    SKDESTROY(lastModDate);
-    if (scanner) synctex_scanner_free(scanner);
-    scanner = NULL;
+    SKDESTROY(snapshot);
+    SKDESTROY(pendingQueries);
+    SKDESTROY(loadingFileName);
+    SKDESTROY(loadingModDate);
     [super dealloc];
 }
 
@@ -121,6 +161,11 @@ static NSUInteger caseInsensitiveStringHash(const void *item, NSUInteger (*size)
     return shouldKeepRunning == 1;
 }
 
+- (BOOL)shouldKeepLoadingGeneration:(int32_t)generation {
+    OSMemoryBarrier();
+    return shouldKeepRunning == 1 && loadGeneration == generation;
+}
+
 - (NSString *)fileName {
     NSString __block *file = nil;
     dispatch_sync(lockQueue, ^{
@@ -134,329 +179,593 @@ static NSUInteger caseInsensitiveStringHash(const void *item, NSUInteger (*size)
     newFileName = [[newFileName stringByResolvingSymlinksInPath] stringByStandardizingPath];
     dispatch_async(lockQueue, ^{
         if (fileName != newFileName) {
-            if ([fileName isEqualToString:newFileName] == NO) {
-                SKDESTROY(syncFileName);
-                SKDESTROY(lastModDate);
-            }
             [fileName release];
             fileName = [newFileName retain];
         }
     });
 }
 
-- (NSString *)syncFileName {
-    NSString __block *file = nil;
-    dispatch_sync(lockQueue, ^{
-        file = [[syncFileName retain] autorelease];
-    });
-    return file;
+#pragma mark Support
+
+- (NSString *)defaultSourceFile {
+    NSString *file = [[self fileName] stringByDeletingPathExtension];
+    for (NSString *extension in SKPDFSynchronizerTexExtensions) {
+        NSString *tryFile = [file stringByAppendingPathExtension:extension];
+        if ([fileManager fileExistsAtPath:tryFile])
+            return tryFile;
+    }
+    return [file stringByAppendingPathExtension:[SKPDFSynchronizerTexExtensions firstObject]];
 }
 
-// this should only be used from the server thread
-- (void)setSyncFileName:(NSString *)newSyncFileName {
-    dispatch_async(lockQueue, ^{
-        if (syncFileName != newSyncFileName) {
-            [syncFileName release];
-            syncFileName = [newSyncFileName retain];
+#pragma mark Queue
+
+- (dispatch_queue_t)queue {
+    if (queue == NULL)
+        queue = dispatch_queue_create("net.sourceforge.skim-app.queue.SKPDFSynchronizer", NULL);
+    return queue;
+}
+
+// this should only be called from the queue
+- (dispatch_queue_t)loadQueue {
+    if (loadQueue == NULL)
+        loadQueue = dispatch_queue_create("net.sourceforge.skim-app.loadQueue.SKPDFSynchronizer", NULL);
+    return loadQueue;
+}
+
+#pragma mark Loading
+
+// this should only be called from the queue, the new snapshot is built on the load queue and swapped in on the queue
+- (void)loadSnapshotForFileName:(NSString *)theFileName modificationDate:(NSDate *)fileModDate {
+    // any running load is superseded, it will stop at its next check
+    int32_t generation = OSAtomicIncrement32Barrier(&loadGeneration);
+    SKPDFSyncSnapshot *previousSnapshot = [snapshot retain];
+    
+    isLoading = YES;
+    [loadingFileName release];
+    loadingFileName = [theFileName retain];
+    [loadingModDate release];
+    loadingModDate = [fileModDate retain];
+    
+    dispatch_async([self loadQueue], ^{
+        SKPDFSyncSnapshot *newSnapshot = nil;
+        
+        if ([self shouldKeepLoadingGeneration:generation]) {
+            newSnapshot = [[SKPDFSyncSnapshot alloc] initWithFileName:theFileName previousSnapshot:previousSnapshot fileManager:fileManager shouldKeepLoading:^{
+                return [self shouldKeepLoadingGeneration:generation];
+            }];
         }
-        [lastModDate release];
-        lastModDate = [(syncFileName ? [[fileManager attributesOfItemAtPath:syncFileName error:NULL] fileModificationDate] : nil) retain];
+        [previousSnapshot release];
+        
+        // the queue exists, as we were called from it
+        dispatch_async(queue, ^{
+            // a superseded load leaves the pending queries for the load that replaced it
+            if (generation == loadGeneration) {
+                isLoading = NO;
+                if (newSnapshot) {
+                    [snapshot release];
+                    snapshot = [newSnapshot retain];
+                } else if ([self shouldKeepRunning]) {
+                    NSLog(@"Unable to find or load synctex or pdfsync file.");
+                }
+                NSArray *queries = [pendingQueries copy];
+                [pendingQueries removeAllObjects];
+                for (SKPDFSyncQuery query in queries)
+                    query(newSnapshot);
+                [queries release];
+            }
+            [newSnapshot release];
+        });
     });
 }
 
-- (NSDate *)lastModDate {
-    NSDate __block *date = nil;
-    dispatch_sync(lockQueue, ^{
-        date = [[lastModDate retain] autorelease];
+// runs the query on the queue, using the current snapshot when it is still valid for the file
+// when the sync file changed, a new snapshot is loaded in the background, and the query is answered from the previous snapshot for the same file if there is one
+// otherwise the query waits for the load and gets the new snapshot, or nil when the load failed
+- (void)performQuery:(SKPDFSyncQuery)query {
+    query = [[query copy] autorelease];
+    dispatch_async([self queue], ^{
+        if ([self shouldKeepRunning] == NO)
+            return;
+        
+        NSString *theFileName = [self fileName];
+        
+        if (theFileName == nil) {
+            NSLog(@"Unable to find or load synctex or pdfsync file.");
+            query(nil);
+            return;
+        }
+        
+        NSDate *fileModDate = [[fileManager attributesOfItemAtPath:theFileName error:NULL] fileModificationDate];
+        BOOL hasSnapshot = [[snapshot fileName] isEqualToString:theFileName];
+        
+        if (hasSnapshot == NO || [snapshot isCurrentForFileName:theFileName modificationDate:fileModDate] == NO) {
+            if (isLoading == NO || [loadingFileName isEqualToString:theFileName] == NO || (fileModDate && loadingModDate && [fileModDate compare:loadingModDate] == NSOrderedDescending))
+                [self loadSnapshotForFileName:theFileName modificationDate:fileModDate];
+        }
+        
+        if (hasSnapshot)
+            query(snapshot);
+        else
+            [pendingQueries addObject:query];
     });
-    return date;
+}
+
+#pragma mark Finding API
+
+- (void)findFileAndLineForLocation:(NSPoint)point inRect:(NSRect)rect pageBounds:(NSRect)bounds atPageIndex:(NSUInteger)pageIndex {
+    [self performQuery:^(SKPDFSyncSnapshot *syncSnapshot){
+        if (syncSnapshot && [self shouldKeepRunning]) {
+            NSInteger foundLine = 0;
+            NSString *foundFile = nil;
+            
+            if ([syncSnapshot findFileLine:&foundLine file:&foundFile forLocation:point inRect:rect pageBounds:bounds atPageIndex:pageIndex] && [self shouldKeepRunning]) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [delegate synchronizer:self foundLine:foundLine inFile:foundFile];
+                });
+            }
+        }
+    }];
+}
+
+- (void)findPageAndLocationForLine:(NSInteger)line inFile:(NSString *)file options:(SKPDFSynchronizerOption)options {
+    if (file == nil)
+        file = [self defaultSourceFile];
+    if (file == nil)
+        return;
+    [self performQuery:^(SKPDFSyncSnapshot *syncSnapshot){
+        if (syncSnapshot && [self shouldKeepRunning]) {
+            NSUInteger foundPageIndex = NSNotFound;
+            NSPoint foundPoint = NSZeroPoint;
+            SKPDFSynchronizerOption foundOptions = options;
+            NSString *fixedFile = [syncSnapshot sourceFileForFileName:file isTeX:YES removeQuotes:NO];
+            
+            if ([syncSnapshot findPage:&foundPageIndex location:&foundPoint forLine:line inFile:fixedFile] && [self shouldKeepRunning]) {
+                if ([syncSnapshot isPdfsync])
+                    foundOptions &= ~SKPDFSynchronizerFlippedMask;
+                else
+                    foundOptions |= SKPDFSynchronizerFlippedMask;
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [delegate synchronizer:self foundLocation:foundPoint atPageIndex:foundPageIndex options:foundOptions];
+                });
+            }
+        }
+    }];
+}
+
+#pragma mark Batch Finding API
+
+- (void)findFilesAndLinesForLocations:(NSArray *)points inRects:(NSArray *)rects pageBounds:(NSArray *)bounds atPageIndexes:(NSArray *)pageIndexes {
+    [self performQuery:^(SKPDFSyncSnapshot *syncSnapshot){
+        if ([self shouldKeepRunning] == NO)
+            return;
+        
+        NSUInteger i, count = [points count];
+        NSMutableArray *foundLines = [NSMutableArray arrayWithCapacity:count];
+        NSMutableArray *foundFiles = [NSMutableArray arrayWithCapacity:count];
+        SKPDFSyncIndex *pdfsyncIndex = [syncSnapshot pdfsyncIndex];
+        SKSyncTeXIndex *synctexIndex = [syncSnapshot synctexIndex];
+        // many locations come from the same source file, so only resolve each file once
+        NSMutableDictionary *sourceFiles = [NSMutableDictionary dictionary];
+        
+        for (i = 0; i < count; i++) {
+            NSPoint point = [[points objectAtIndex:i] pointValue];
+            NSRect rect = [[rects objectAtIndex:i] rectValue];
+            NSUInteger pageIndex = [[pageIndexes objectAtIndex:i] unsignedIntegerValue];
+            NSInteger foundLine = NSNotFound;
+            id foundFile = [NSNull null];
+            
+            if (pdfsyncIndex) {
+                NSString *file = nil;
+                if ([pdfsyncIndex findFileLine:&foundLine file:&file forLocation:point inRect:rect atPageIndex:pageIndex])
+                    foundFile = file;
+                else
+                    foundLine = NSNotFound;
+            } else if (synctexIndex) {
+                NSRect pageBounds = [[bounds objectAtIndex:i] rectValue];
+                int32_t tag = 0;
+                NSInteger line = 0;
+                const char *file;
+                if ([synctexIndex findTag:&tag line:&line forLocation:NSMakePoint(point.x, NSMaxY(pageBounds) - point.y) atPageIndex:pageIndex] &&
+                    (file = [synctexIndex nameForTag:tag])) {
+                    NSNumber *key = [NSNumber numberWithInt:tag];
+                    if ((foundFile = [sourceFiles objectForKey:key]) == nil) {
+                        foundFile = [syncSnapshot sourceFileForFileName:[NSString stringWithUTF8String:file] isTeX:YES removeQuotes:NO];
+                        [sourceFiles setObject:foundFile forKey:key];
+                    }
+                    foundLine = MAX(line, 1) - 1;
+                }
+            }
+            [foundLines addObject:[NSNumber numberWithInteger:foundLine]];
+            [foundFiles addObject:foundFile];
+        }
+        
+        if ([self shouldKeepRunning]) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if ([delegate respondsToSelector:@selector(synchronizer:foundLines:inFiles:)])
+                    [delegate synchronizer:self foundLines:foundLines inFiles:foundFiles];
+            });
+        }
+    }];
+}
+
+- (void)findPagesAndLocationsForLines:(NSArray *)lines inFiles:(NSArray *)files options:(SKPDFSynchronizerOption)options {
+    NSString *defaultFile = [files containsObject:[NSNull null]] || [files count] < [lines count] ? [self defaultSourceFile] : nil;
+    [self performQuery:^(SKPDFSyncSnapshot *syncSnapshot){
+        if ([self shouldKeepRunning] == NO)
+            return;
+        
+        NSUInteger i, count = [lines count];
+        NSUInteger *foundPageIndexes = (NSUInteger *)malloc(MAX(count, 1ul) * sizeof(NSUInteger));
+        NSPoint *foundPoints = (NSPoint *)malloc(MAX(count, 1ul) * sizeof(NSPoint));
+        NSMutableDictionary *queriesByFile = [NSMutableDictionary dictionary];
+        SKPDFSynchronizerOption foundOptions = options;
+        SKPDFSyncIndex *pdfsyncIndex = [syncSnapshot pdfsyncIndex];
+        SKSyncTeXIndex *synctexIndex = [syncSnapshot synctexIndex];
+        
+        for (i = 0; i < count; i++) {
+            foundPageIndexes[i] = NSNotFound;
+            foundPoints[i] = NSZeroPoint;
+        }
+        
+        if (syncSnapshot) {
+            // group the queries by file, so we resolve each file only once, and look up the lines of a file in order
+            for (i = 0; i < count; i++) {
+                id file = i < [files count] ? [files objectAtIndex:i] : nil;
+                if ([file isKindOfClass:[NSString class]] == NO)
+                    file = defaultFile;
+                if (file == nil)
+                    continue;
+                NSMutableArray *queries = [queriesByFile objectForKey:file];
+                if (queries == nil) {
+                    queries = [NSMutableArray array];
+                    [queriesByFile setObject:queries forKey:file];
+                }
+                [queries addObject:[NSNumber numberWithUnsignedInteger:i]];
+            }
+            
+            for (NSString *file in queriesByFile) {
+                NSArray *queries = [[queriesByFile objectForKey:file] sortedArrayUsingComparator:^NSComparisonResult(id obj1, id obj2){
+                    NSInteger line1 = [[lines objectAtIndex:[obj1 unsignedIntegerValue]] integerValue];
+                    NSInteger line2 = [[lines objectAtIndex:[obj2 unsignedIntegerValue]] integerValue];
+                    return line1 < line2 ? NSOrderedAscending : line1 > line2 ? NSOrderedDescending : NSOrderedSame;
+                }];
+                NSString *fixedFile = [syncSnapshot sourceFileForFileName:file isTeX:YES removeQuotes:NO];
+                NSUInteger j, queryCount = [queries count];
+                
+                if (pdfsyncIndex) {
+                    for (j = 0; j < queryCount; j++) {
+                        i = [[queries objectAtIndex:j] unsignedIntegerValue];
+                        if ([pdfsyncIndex findPage:foundPageIndexes + i location:foundPoints + i forLine:[[lines objectAtIndex:i] integerValue] inFile:fixedFile] == NO) {
+                            foundPageIndexes[i] = NSNotFound;
+                            foundPoints[i] = NSZeroPoint;
+                        }
+                    }
+                } else {
+                    int32_t tag = [syncSnapshot synctexTagForFile:fixedFile];
+                    if (tag != 0) {
+                        NSInteger *sortedLines = (NSInteger *)malloc(queryCount * sizeof(NSInteger));
+                        NSUInteger *sortedPageIndexes = (NSUInteger *)malloc(queryCount * sizeof(NSUInteger));
+                        NSPoint *sortedPoints = (NSPoint *)malloc(queryCount * sizeof(NSPoint));
+                        for (j = 0; j < queryCount; j++)
+                            sortedLines[j] = [[lines objectAtIndex:[[queries objectAtIndex:j] unsignedIntegerValue]] integerValue] + 1;
+                        [synctexIndex findPages:sortedPageIndexes locations:sortedPoints forLines:sortedLines count:queryCount tag:tag];
+                        for (j = 0; j < queryCount; j++) {
+                            i = [[queries objectAtIndex:j] unsignedIntegerValue];
+                            foundPageIndexes[i] = sortedPageIndexes[j];
+                            foundPoints[i] = sortedPoints[j];
+                        }
+                        free(sortedLines);
+                        free(sortedPageIndexes);
+                        free(sortedPoints);
+                    }
+                }
+            }
+            
+            if ([syncSnapshot isPdfsync])
+                foundOptions &= ~SKPDFSynchronizerFlippedMask;
+            else
+                foundOptions |= SKPDFSynchronizerFlippedMask;
+        }
+        
+        NSMutableArray *foundPageIndexesArray = [NSMutableArray arrayWithCapacity:count];
+        NSMutableArray *foundPointsArray = [NSMutableArray arrayWithCapacity:count];
+        for (i = 0; i < count; i++) {
+            [foundPageIndexesArray addObject:[NSNumber numberWithUnsignedInteger:foundPageIndexes[i]]];
+            [foundPointsArray addObject:[NSValue valueWithPoint:foundPoints[i]]];
+        }
+        free(foundPageIndexes);
+        free(foundPoints);
+        
+        if ([self shouldKeepRunning]) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if ([delegate respondsToSelector:@selector(synchronizer:foundLocations:atPageIndexes:options:)])
+                    [delegate synchronizer:self foundLocations:foundPointsArray atPageIndexes:foundPageIndexesArray options:foundOptions];
+            });
+        }
+    }];
+}
+
+@end
+
+#pragma mark -
+
+@implementation SKPDFSyncSnapshot
+
+@synthesize fileName, syncFileName, isPdfsync, pdfsyncIndex, synctexIndex;
+
+- (id)initWithFileName:(NSString *)aFileName previousSnapshot:(SKPDFSyncSnapshot *)previousSnapshot fileManager:(NSFileManager *)aFileManager shouldKeepLoading:(BOOL (^)(void))aBlock {
+    self = [super init];
+    if (self) {
+        fileName = [aFileName retain];
+        syncFileName = nil;
+        modDate = nil;
+        isPdfsync = YES;
+        pdfsyncIndex = nil;
+        filenames = nil;
+        synctexIndex = nil;
+        fileManager = [aFileManager retain];
+        shouldKeepLoading = [aBlock copy];
+        sourceFiles = [[NSMutableDictionary alloc] init];
+        existingFiles = [[NSMutableDictionary alloc] init];
+        fileProbeCount = 0;
+        sourceFileCount = 0;
+        sourceFileCacheHits = 0;
+        
+        BOOL rv = NO;
+        NSString *theSyncFileName = [previousSnapshot syncFileName];
+        
+        // reload the same kind of sync file when we had one for this file
+        if (theSyncFileName && [[previousSnapshot fileName] isEqualToString:fileName] && [fileManager fileExistsAtPath:theSyncFileName]) {
+            if ([previousSnapshot isPdfsync])
+                rv = [self loadPdfsyncFile:theSyncFileName];
+            else
+                rv = [self loadSynctexFileUpdatingSnapshot:previousSnapshot];
+        } else {
+            rv = [self loadSynctexFileUpdatingSnapshot:nil];
+            if (rv == NO) {
+                theSyncFileName = [[fileName stringByDeletingPathExtension] stringByAppendingPathExtension:SKPDFSynchronizerPdfsyncExtension];
+                if ([fileManager fileExistsAtPath:theSyncFileName])
+                    rv = [self loadPdfsyncFile:theSyncFileName];
+            }
+        }
+        
+        // the block refers to the synchronizer, so don't keep it
+        SKDESTROY(shouldKeepLoading);
+        
+        if (rv == NO) {
+            [self release];
+            self = nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    SKDESTROY(fileName);
+    SKDESTROY(syncFileName);
+    SKDESTROY(modDate);
+    SKDESTROY(pdfsyncIndex);
+    SKDESTROY(filenames);
+    SKDESTROY(synctexIndex);
+    SKDESTROY(fileManager);
+    SKDESTROY(shouldKeepLoading);
+    SKDESTROY(sourceFiles);
+    SKDESTROY(existingFiles);
+    [super dealloc];
+}
+
+- (BOOL)isCurrentForFileName:(NSString *)aFileName modificationDate:(NSDate *)fileModDate {
+    return [fileName isEqualToString:aFileName] && modDate && [fileModDate compare:modDate] != NSOrderedDescending && [fileManager fileExistsAtPath:syncFileName];
+}
+
+- (void)setSyncFileName:(NSString *)newSyncFileName {
+    if (syncFileName != newSyncFileName) {
+        [syncFileName release];
+        syncFileName = [newSyncFileName retain];
+    }
+    [modDate release];
+    modDate = [(syncFileName ? [[fileManager attributesOfItemAtPath:syncFileName error:NULL] fileModificationDate] : nil) retain];
 }
 
 #pragma mark Support
 
+- (void)logSourceFileCacheForSyncFile:(NSString *)theSyncFileName {
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:SKLogSyncFileProbesKey])
+        NSLog(@"Loading %@ resolved %lu source files with %lu file system probes, %lu lookups were cached.", [theSyncFileName lastPathComponent], (unsigned long)sourceFileCount, (unsigned long)fileProbeCount, (unsigned long)sourceFileCacheHits);
+}
+
+- (BOOL)cachedFileExistsAtPath:(NSString *)file {
+    NSNumber *exists = [existingFiles objectForKey:file];
+    if (exists == nil) {
+        fileProbeCount++;
+        exists = [NSNumber numberWithBool:[fileManager fileExistsAtPath:file]];
+        [existingFiles setObject:exists forKey:file];
+    }
+    return [exists boolValue];
+}
+
+// the resolved source files and file probes are cached for the snapshot, as the same files are resolved many times
 - (NSString *)sourceFileForFileName:(NSString *)file isTeX:(BOOL)isTeX removeQuotes:(BOOL)removeQuotes {
     if (removeQuotes && [file length] > 2 && [file characterAtIndex:0] == '"' && [file characterAtIndex:[file length] - 1] == '"')
         file = [file substringWithRange:NSMakeRange(1, [file length] - 2)];
     if ([file isAbsolutePath] == NO)
-        file = [[[self fileName] stringByDeletingLastPathComponent] stringByAppendingPathComponent:file];
-    if (isTeX && [fileManager fileExistsAtPath:file] == NO && [SKPDFSynchronizerTexExtensions containsObject:[[file pathExtension] lowercaseString]] == NO) {
+        file = [[fileName stringByDeletingLastPathComponent] stringByAppendingPathComponent:file];
+    if (isTeX == NO)
+        return [[file stringByResolvingSymlinksInPath] stringByStandardizingPath];
+    NSString *sourceFile = [sourceFiles objectForKey:file];
+    if (sourceFile) {
+        sourceFileCacheHits++;
+        return sourceFile;
+    }
+    sourceFile = file;
+    if ([self cachedFileExistsAtPath:file] == NO && [SKPDFSynchronizerTexExtensions containsObject:[[file pathExtension] lowercaseString]] == NO) {
         for (NSString *extension in SKPDFSynchronizerTexExtensions) {
             NSString *tryFile = [file stringByAppendingPathExtension:extension];
-            if ([fileManager fileExistsAtPath:tryFile]) {
-                file = tryFile;
+            if ([self cachedFileExistsAtPath:tryFile]) {
+                sourceFile = tryFile;
                 break;
             }
         }
     }
     // the docs say -stringByStandardizingPath uses -stringByResolvingSymlinksInPath, but it doesn't 
-    return [[file stringByResolvingSymlinksInPath] stringByStandardizingPath];
+    sourceFile = [[sourceFile stringByResolvingSymlinksInPath] stringByStandardizingPath];
+    [sourceFiles setObject:sourceFile forKey:file];
+    sourceFileCount++;
+    return sourceFile;
 }
 
-- (NSString *)defaultSourceFile {
-    NSString *file = [[self fileName] stringByDeletingPathExtension];
-    for (NSString *extension in SKPDFSynchronizerTexExtensions) {
-        NSString *tryFile = [file stringByAppendingPathExtension:extension];
-        if ([fileManager fileExistsAtPath:tryFile])
-            return tryFile;
+#pragma mark PDFSync
+
+#define MIN_RECORD_CAPACITY 1024
+#define MAX_RECORD_INDEX_GAP 65536
+
+static inline SKPDFSyncRecord *recordForIndex(SKPDFSyncRecord **records, NSUInteger *count, NSUInteger *capacity, NSInteger recordIndex) {
+    // pdfsync numbers its records consecutively, so an index far beyond the records we have is corrupt and would make us allocate a huge array
+    if (recordIndex < 0 || recordIndex >= INT32_MAX || (NSUInteger)recordIndex >= *count + MAX_RECORD_INDEX_GAP)
+        return NULL;
+    if ((NSUInteger)recordIndex >= *count) {
+        if ((NSUInteger)recordIndex >= *capacity) {
+            NSUInteger newCapacity = MAX(MAX(2 * *capacity, (NSUInteger)recordIndex + 1), (NSUInteger)MIN_RECORD_CAPACITY);
+            SKPDFSyncRecord *newRecords = (SKPDFSyncRecord *)realloc(*records, newCapacity * sizeof(SKPDFSyncRecord));
+            if (newRecords == NULL)
+                return NULL;
+            *records = newRecords;
+            *capacity = newCapacity;
+        }
+        // records are identified by their index, so we fill any gap with empty records
+        while (*count <= (NSUInteger)recordIndex) {
+            SKPDFSyncRecord *record = *records + (*count)++;
+            record->fileID = SKPDFSyncNoFileID;
+            record->line = -1;
+            record->pageIndex = SKPDFSyncNoPageIndex;
+            record->x = record->y = 0.0;
+        }
     }
-    return [file stringByAppendingPathExtension:[SKPDFSynchronizerTexExtensions firstObject]];
+    return *records + recordIndex;
 }
 
-#pragma mark PDFSync
-
-static inline SKPDFSyncRecord *recordForIndex(NSMapTable *records, NSInteger recordIndex) {
-    SKPDFSyncRecord *record = NSMapGet(records, (const void *)recordIndex);
-    if (record == nil) {
-        record = [[SKPDFSyncRecord alloc] initWithRecordIndex:recordIndex];
-        NSMapInsert(records, (const void *)recordIndex, record);
-        [record release];
+static inline int32_t fileIDForFile(NSString *file, NSMutableArray *files, SKFoldedPathTable *fileIDs) {
+    // we store the IDs shifted by one, so we can distinguish a missing file
+    NSUInteger fileID = (NSUInteger)[fileIDs valueForPath:file];
+    if (fileID == 0) {
+        [files addObject:file];
+        fileID = [files count];
+        [fileIDs setValue:fileID forPath:file];
     }
-    return record;
+    return (int32_t)fileID - 1;
 }
 
 - (BOOL)loadPdfsyncFile:(NSString *)theFileName {
 
-    if (pages)
-        [pages removeAllObjects];
-    else
-        pages = [[NSMutableArray alloc] init];
-    if (lines) {
-        [lines removeAllObjects];
-    } else {
-        NSPointerFunctions *keyPointerFunctions = [NSPointerFunctions pointerFunctionsWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPersonality];
-        [keyPointerFunctions setIsEqualFunction:&caseInsensitiveStringEqual];
-        [keyPointerFunctions setHashFunction:&caseInsensitiveStringHash];
-        NSPointerFunctions *valuePointerFunctions = [NSPointerFunctions pointerFunctionsWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPersonality];
-        lines = [[NSMapTable alloc] initWithKeyPointerFunctions:keyPointerFunctions valuePointerFunctions:valuePointerFunctions capacity:0];
-    }
+    SKDESTROY(pdfsyncIndex);
     
     [self setSyncFileName:theFileName];
     isPdfsync = YES;
     
-    NSString *pdfsyncString = [NSString stringWithContentsOfFile:theFileName encoding:NSUTF8StringEncoding error:NULL];
+    // the tokenizer works directly on the mapped bytes, only the file names are converted to strings
+    NSData *pdfsyncData = [[NSData alloc] initWithContentsOfFile:theFileName options:NSDataReadingMappedIfSafe error:NULL];
     BOOL rv = NO;
     
-    if ([pdfsyncString length]) {
+    if ([pdfsyncData length]) {
         
-        NSMapTable *records = NSCreateMapTable(NSIntegerMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+        SKPDFSyncRecord *records = NULL;
+        NSUInteger recordCount = 0, recordCapacity = 0, pageCount = 0;
         NSMutableArray *files = [[NSMutableArray alloc] init];
+        SKFoldedPathTable *fileIDs = [[SKFoldedPathTable alloc] init];
+        NSMutableArray *fileStack = [[NSMutableArray alloc] init];
         NSString *file;
-        NSInteger recordIndex, line, pageIndex;
-        double x, y;
+        int32_t fileID;
         SKPDFSyncRecord *record;
-        NSMutableArray *array;
-        unichar ch;
-        NSScanner *sc = [[NSScanner alloc] initWithString:pdfsyncString];
-        NSCharacterSet *newlines = [NSCharacterSet newlineCharacterSet];
+        SKPDFSyncScanner sc;
+        SKPDFSyncToken token;
+        const char *name;
+        NSUInteger nameLength;
+        NSUInteger lineCount = 0;
         
-        [sc setCharactersToBeSkipped:[NSCharacterSet whitespaceCharacterSet]];
+        SKPDFSyncScannerInit(&sc, [pdfsyncData bytes], [pdfsyncData length]);
         
-        if ([sc scanUpToCharactersFromSet:newlines intoString:&file] &&
-            [sc scanCharactersFromSet:newlines intoString:NULL]) {
+        if (SKPDFSyncScanHeader(&sc, &name, &nameLength) &&
+            (file = [[[NSString alloc] initWithBytes:name length:nameLength encoding:NSUTF8StringEncoding] autorelease])) {
             
             file = [self sourceFileForFileName:file isTeX:YES removeQuotes:YES];
-            [files addObject:file];
-            
-            array = [[NSMutableArray alloc] init];
-            [lines setObject:array forKey:file];
-            [array release];
+            fileID = fileIDForFile(file, files, fileIDs);
+            [fileStack addObject:[NSNumber numberWithInt:fileID]];
             
-            // we ignore the version
-            if ([sc scanString:@"version" intoString:NULL] && [sc scanInteger:NULL]) {
+            // checking the stop flag involves a memory barrier, so don't do it for every line
+            while (((++lineCount & 0xFFF) != 0 || shouldKeepLoading()) && SKPDFSyncScanToken(&sc, &token)) {
                 
-                [sc scanCharactersFromSet:newlines intoString:NULL];
-                
-                while ([self shouldKeepRunning] && [sc scanCharacter:&ch]) {
-                    
-                    switch (ch) {
-                        case 'l':
-                            if ([sc scanInteger:&recordIndex] && [sc scanInteger:&line]) {
-                                // we ignore the column
-                                [sc scanInteger:NULL];
-                                record = recordForIndex(records, recordIndex);
-                                [record setFile:file];
-                                [record setLine:line];
-                                [[lines objectForKey:file] addObject:record];
-                            }
-                            break;
-                        case 'p':
-                            // we ignore * and + modifiers
-                            if ([sc scanString:@"*" intoString:NULL] == NO)
-                                [sc scanString:@"+" intoString:NULL];
-                            if ([sc scanInteger:&recordIndex] && [sc scanDouble:&x] && [sc scanDouble:&y]) {
-                                record = recordForIndex(records, recordIndex);
-                                [record setPageIndex:[pages count] - 1];
-                                [record setPoint:NSMakePoint(PDFSYNC_TO_PDF(x) + pdfOffset.x, PDFSYNC_TO_PDF(y) + pdfOffset.y)];
-                                [[pages lastObject] addObject:record];
-                            }
-                            break;
-                        case 's':
-                            // start of a new page, the scanned integer should always equal [pages count]+1
-                            if ([sc scanInteger:&pageIndex] == NO) pageIndex = [pages count] + 1;
-                            while (pageIndex > (NSInteger)[pages count]) {
-                                array = [[NSMutableArray alloc] init];
-                                [pages addObject:array];
-                                [array release];
-                            }
-                            break;
-                        case '(':
-                            // start of a new source file
-                            if ([sc scanUpToCharactersFromSet:newlines intoString:&file]) {
-                                file = [self sourceFileForFileName:file isTeX:YES removeQuotes:YES];
-                                [files addObject:file];
-                                if ([lines objectForKey:file] == nil) {
-                                    array = [[NSMutableArray alloc] init];
-                                    [lines setObject:array forKey:file];
-                                    [array release];
-                                }
-                            }
-                            break;
-                        case ')':
-                            // closing of a source file
-                            if ([files count]) {
-                                [files removeLastObject];
-                                file = [files lastObject];
-                            }
-                            break;
-                        default:
-                            // shouldn't reach
-                            break;
-                    }
-                    
-                    [sc scanUpToCharactersFromSet:newlines intoString:NULL];
-                    [sc scanCharactersFromSet:newlines intoString:NULL];
+                switch (token.type) {
+                    case SKPDFSyncTokenLine:
+                        if ((record = recordForIndex(&records, &recordCount, &recordCapacity, token.recordIndex))) {
+                            record->fileID = fileID;
+                            record->line = (int32_t)token.line;
+                        }
+                        break;
+                    case SKPDFSyncTokenPoint:
+                        if (pageCount > 0 && (record = recordForIndex(&records, &recordCount, &recordCapacity, token.recordIndex))) {
+                            record->pageIndex = (int32_t)pageCount - 1;
+                            record->x = PDFSYNC_TO_PDF(token.x) + pdfOffset.x;
+                            record->y = PDFSYNC_TO_PDF(token.y) + pdfOffset.y;
+                        }
+                        break;
+                    case SKPDFSyncTokenPage:
+                        // start of a new page, the scanned integer should always equal pageCount+1
+                        if (token.pageNumber < 0)
+                            token.pageNumber = pageCount + 1;
+                        if (token.pageNumber > (NSInteger)pageCount && token.pageNumber < INT32_MAX)
+                            pageCount = token.pageNumber;
+                        break;
+                    case SKPDFSyncTokenOpenFile:
+                        // start of a new source file
+                        if ((file = [[NSString alloc] initWithBytes:token.name length:token.nameLength encoding:NSUTF8StringEncoding])) {
+                            fileID = fileIDForFile([self sourceFileForFileName:file isTeX:YES removeQuotes:YES], files, fileIDs);
+                            [fileStack addObject:[NSNumber numberWithInt:fileID]];
+                            [file release];
+                        }
+                        break;
+                    case SKPDFSyncTokenCloseFile:
+                        // closing of a source file
+                        if ([fileStack count]) {
+                            [fileStack removeLastObject];
+                            fileID = [fileStack count] ? [[fileStack lastObject] intValue] : SKPDFSyncNoFileID;
+                        }
+                        break;
+                    default:
+                        // shouldn't reach
+                        break;
                 }
-                
-                NSSortDescriptor *lineSortDescriptor = [[[NSSortDescriptor alloc] initWithKey:@"line" ascending:YES] autorelease];
-                NSSortDescriptor *xSortDescriptor = [[[NSSortDescriptor alloc] initWithKey:@"x" ascending:YES] autorelease];
-                NSSortDescriptor *ySortDescriptor = [[[NSSortDescriptor alloc] initWithKey:@"y" ascending:NO] autorelease];
-                NSArray *lineSortDescriptors = [NSArray arrayWithObjects:lineSortDescriptor, nil];
-                
-                for (array in [lines objectEnumerator])
-                    [array sortUsingDescriptors:lineSortDescriptors];
-                [pages makeObjectsPerformSelector:@selector(sortUsingDescriptors:)
-                                       withObject:[NSArray arrayWithObjects:ySortDescriptor, xSortDescriptor, nil]];
-                
-                rv = [self shouldKeepRunning];
+            }
+            
+            if (shouldKeepLoading()) {
+                // the index takes ownership of the records
+                pdfsyncIndex = [[SKPDFSyncIndex alloc] initWithRecords:records count:recordCount pageCount:pageCount files:files fileIDs:fileIDs];
+                records = NULL;
+                rv = YES;
             }
         }
         
-        NSFreeMapTable(records);
+        if (records) free(records);
         [files release];
-        [sc release];
+        [fileIDs release];
+        [fileStack release];
     }
     
+    [pdfsyncData release];
+    
+    [self logSourceFileCacheForSyncFile:theFileName];
+    
     return rv;
 }
 
 - (BOOL)pdfsyncFindFileLine:(NSInteger *)linePtr file:(NSString **)filePtr forLocation:(NSPoint)point inRect:(NSRect)rect pageBounds:(NSRect)bounds atPageIndex:(NSUInteger)pageIndex {
-    BOOL rv = NO;
-    if (pageIndex < [pages count]) {
-        
-        SKPDFSyncRecord *record = nil;
-        SKPDFSyncRecord *beforeRecord = nil;
-        SKPDFSyncRecord *afterRecord = nil;
-        NSMutableDictionary *atRecords = [NSMutableDictionary dictionary];
-        
-        for (record in [pages objectAtIndex:pageIndex]) {
-            if ([record line] == 0)
-                continue;
-            NSPoint p = [record point];
-            if (p.y > NSMaxY(rect)) {
-                beforeRecord = record;
-            } else if (p.y < NSMinY(rect)) {
-                afterRecord = record;
-                break;
-            } else if (p.x < NSMinX(rect)) {
-                beforeRecord = record;
-            } else if (p.x > NSMaxX(rect)) {
-                afterRecord = record;
-                break;
-            } else {
-                [atRecords setObject:record forKey:[NSNumber numberWithDouble:fabs(p.x - point.x)]];
-            }
-        }
-        
-        record = nil;
-        if ([atRecords count]) {
-            NSNumber *nearest = [[[atRecords allKeys] sortedArrayUsingSelector:@selector(compare:)] objectAtIndex:0];
-            record = [atRecords objectForKey:nearest];
-        } else if (beforeRecord && afterRecord) {
-            NSPoint beforePoint = [beforeRecord point];
-            NSPoint afterPoint = [afterRecord point];
-            if (beforePoint.y - point.y < point.y - afterPoint.y)
-                record = beforeRecord;
-            else if (beforePoint.y - point.y > point.y - afterPoint.y)
-                record = afterRecord;
-            else if (beforePoint.x - point.x < point.x - afterPoint.x)
-                record = beforeRecord;
-            else if (beforePoint.x - point.x > point.x - afterPoint.x)
-                record = afterRecord;
-            else
-                record = beforeRecord;
-        } else if (beforeRecord) {
-            record = beforeRecord;
-        } else if (afterRecord) {
-            record = afterRecord;
-        }
-        
-        if (record) {
-            *linePtr = [record line];
-            *filePtr = [record file];
-            rv = YES;
-        }
-    }
+    BOOL rv = [pdfsyncIndex findFileLine:linePtr file:filePtr forLocation:point inRect:rect atPageIndex:pageIndex];
     if (rv == NO)
         NSLog(@"PDFSync was unable to find file and line.");
     return rv;
 }
 
 - (BOOL)pdfsyncFindPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line inFile:(NSString *)file {
-    BOOL rv = NO;
-    NSArray *theLines = [lines objectForKey:file];
-    if (theLines) {
-        
-        SKPDFSyncRecord *record = nil;
-        SKPDFSyncRecord *beforeRecord = nil;
-        SKPDFSyncRecord *afterRecord = nil;
-        SKPDFSyncRecord *atRecord = nil;
-        
-        for (record in theLines) {
-            if ([record pageIndex] == NSNotFound)
-                continue;
-            NSInteger l = [record line];
-            if (l < line) {
-                beforeRecord = record;
-            } else if (l > line) {
-                afterRecord = record;
-                break;
-            } else {
-                atRecord = record;
-                break;
-            }
-        }
-        
-        if (atRecord) {
-            record = atRecord;
-        } else if (beforeRecord && afterRecord) {
-            NSInteger beforeLine = [beforeRecord line];
-            NSInteger afterLine = [afterRecord line];
-            if (beforeLine - line > line - afterLine)
-                record = afterRecord;
-            else
-                record = beforeRecord;
-        } else if (beforeRecord) {
-            record = beforeRecord;
-        } else if (afterRecord) {
-            record = afterRecord;
-        }
-        
-        if (record) {
-            *pageIndexPtr = [record pageIndex];
-            *pointPtr = [record point];
-            rv = YES;
-        }
-    }
+    BOOL rv = [pdfsyncIndex findPage:pageIndexPtr location:pointPtr forLine:line inFile:file];
     if (rv == NO)
         NSLog(@"PDFSync was unable to find location and page.");
     return rv;
@@ -464,46 +773,73 @@ static inline SKPDFSyncRecord *recordForIndex(NSMapTable *records, NSInteger rec
 
 #pragma mark SyncTeX
 
-- (BOOL)loadSynctexFileForFile:(NSString *)theFileName {
+- (BOOL)loadSynctexFileUpdatingSnapshot:(SKPDFSyncSnapshot *)previousSnapshot {
     BOOL rv = NO;
-    if (scanner)
-        synctex_scanner_free(scanner);
-    scanner = synctex_scanner_new_with_output_file([theFileName UTF8String], NULL, 1);
-    if (scanner) {
-        const char *fileRep = synctex_scanner_get_synctex(scanner);
-        [self setSyncFileName:[self sourceFileForFileName:[NSString stringWithUTF8String:fileRep] isTeX:NO removeQuotes:NO]];
-        if (filenames) {
-            NSResetMapTable(filenames);
-        } else {
-            NSPointerFunctions *keyPointerFunctions = [NSPointerFunctions pointerFunctionsWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPersonality];
-            [keyPointerFunctions setIsEqualFunction:&caseInsensitiveStringEqual];
-            [keyPointerFunctions setHashFunction:&caseInsensitiveStringHash];
-            NSPointerFunctions *valuePointerFunctions = [NSPointerFunctions pointerFunctionsWithOptions:NSPointerFunctionsMallocMemory | NSPointerFunctionsCStringPersonality | NSPointerFunctionsCopyIn];
-            filenames = [[NSMapTable alloc] initWithKeyPointerFunctions:keyPointerFunctions valuePointerFunctions:valuePointerFunctions capacity:0];
-        }
-        synctex_node_p node = synctex_scanner_input(scanner);
-        do {
-            if ((fileRep = synctex_scanner_get_name(scanner, synctex_node_tag(node)))) {
-                NSMapInsert(filenames, [self sourceFileForFileName:[NSString stringWithUTF8String:fileRep] isTeX:YES removeQuotes:NO], fileRep);
+    NSString *theSyncFileName = [SKSyncTeXIndex syncTeXFileForFile:fileName fileManager:fileManager];
+    SKSyncTeXFileSignature signature = {0, 0, 0};
+    // without a signature we cannot validate a cache, but we can still build the index
+    BOOL hasSignature = theSyncFileName && [SKSyncTeXIndex getSignature:&signature forSyncTeXFile:theSyncFileName];
+    NSURL *cacheURL = hasSignature ? [SKSyncTeXIndex cacheURLForSyncTeXFile:theSyncFileName fileManager:fileManager] : nil;
+    SKSyncTeXIndex *oldIndex = [previousSnapshot synctexIndex];
+    
+    SKDESTROY(synctexIndex);
+    
+    // first try the cache, so we don't need to inflate and parse the synctex file again
+    if (cacheURL)
+        synctexIndex = [[SKSyncTeXIndex alloc] initWithContentsOfCacheURL:cacheURL signature:signature];
+    
+    // after typesetting again usually only a few pages change, so only parse those and reuse the rest of the old index
+    if (synctexIndex == nil && theSyncFileName && oldIndex && [[previousSnapshot syncFileName] isEqualToString:[self sourceFileForFileName:theSyncFileName isTeX:NO removeQuotes:NO]] && shouldKeepLoading()) {
+        synctexIndex = [[SKSyncTeXIndex alloc] initWithSyncTeXFile:theSyncFileName updatingIndex:oldIndex signature:signature];
+        if (hasSignature)
+            [synctexIndex writeToCacheURL:cacheURL];
+    }
+    
+    if (synctexIndex == nil && shouldKeepLoading()) {
+        synctex_scanner_p scanner = synctex_scanner_new_with_output_file([fileName UTF8String], NULL, 1);
+        if (scanner) {
+            NSString *scannerSyncFileName = [NSString stringWithUTF8String:synctex_scanner_get_synctex(scanner)];
+            if ([scannerSyncFileName isEqualToString:theSyncFileName] == NO) {
+                theSyncFileName = scannerSyncFileName;
+                hasSignature = [SKSyncTeXIndex getSignature:&signature forSyncTeXFile:theSyncFileName];
+                cacheURL = hasSignature ? [SKSyncTeXIndex cacheURLForSyncTeXFile:theSyncFileName fileManager:fileManager] : nil;
+            }
+            if (hasSignature == NO)
+                memset(&signature, 0, sizeof(SKSyncTeXFileSignature));
+            if (shouldKeepLoading()) {
+                synctexIndex = [[SKSyncTeXIndex alloc] initWithScanner:scanner syncTeXFile:theSyncFileName signature:signature];
+                if (hasSignature)
+                    [synctexIndex writeToCacheURL:cacheURL];
             }
-        } while ((node = synctex_node_next(node)));
+            synctex_scanner_free(scanner);
+        }
+    }
+    
+    if (synctexIndex) {
+        [self setSyncFileName:[self sourceFileForFileName:theSyncFileName isTeX:NO removeQuotes:NO]];
+        SKDESTROY(filenames);
+        filenames = [[SKFoldedPathTable alloc] init];
+        // map the source files to their synctex tags, these are always positive
+        NSUInteger i, iMax = [synctexIndex inputCount];
+        for (i = 0; i < iMax; i++)
+            [filenames setValue:[synctexIndex tagAtIndex:i] forPath:[self sourceFileForFileName:[NSString stringWithUTF8String:[synctexIndex nameAtIndex:i]] isTeX:YES removeQuotes:NO]];
+        [self logSourceFileCacheForSyncFile:theSyncFileName];
         isPdfsync = NO;
-        rv = [self shouldKeepRunning];
+        rv = shouldKeepLoading();
     }
     return rv;
 }
 
 - (BOOL)synctexFindFileLine:(NSInteger *)linePtr file:(NSString **)filePtr forLocation:(NSPoint)point inRect:(NSRect)rect pageBounds:(NSRect)bounds atPageIndex:(NSUInteger)pageIndex {
     BOOL rv = NO;
-    if (synctex_edit_query(scanner, (int)pageIndex + 1, point.x, NSMaxY(bounds) - point.y) > 0) {
-        synctex_node_p node;
-        const char *file;
-        while (rv == NO && (node = synctex_scanner_next_result(scanner))) {
-            if ((file = synctex_scanner_get_name(scanner, synctex_node_tag(node)))) {
-                *linePtr = MAX(synctex_node_line(node), 1) - 1;
-                *filePtr = [self sourceFileForFileName:[NSString stringWithUTF8String:file] isTeX:YES removeQuotes:NO];
-                rv = YES;
-            }
+    int32_t tag = 0;
+    NSInteger line = 0;
+    if ([synctexIndex findTag:&tag line:&line forLocation:NSMakePoint(point.x, NSMaxY(bounds) - point.y) atPageIndex:pageIndex]) {
+        const char *file = [synctexIndex nameForTag:tag];
+        if (file) {
+            *linePtr = MAX(line, 1) - 1;
+            *filePtr = [self sourceFileForFileName:[NSString stringWithUTF8String:file] isTeX:YES removeQuotes:NO];
+            rv = YES;
         }
     }
     if (rv == NO)
@@ -511,156 +847,40 @@ static inline SKPDFSyncRecord *recordForIndex(NSMapTable *records, NSInteger rec
     return rv;
 }
 
-- (BOOL)synctexFindPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line inFile:(NSString *)file {
-    BOOL rv = NO;
-    char *filename = NSMapGet(filenames, file) ?: NSMapGet(filenames, [[file stringByResolvingSymlinksInPath] stringByStandardizingPath]);
-    if (filename == NULL) {
-        for (NSString *fn in filenames) {
-            if ([[fn lastPathComponent] caseInsensitiveCompare:[file lastPathComponent]] == NSOrderedSame) {
-                filename = NSMapGet(filenames, file);
-                break;
-            }
-        }
-        if (filename == NULL)
-            filename = (char *)[[file lastPathComponent] UTF8String];
+- (int32_t)synctexTagForFile:(NSString *)file {
+    int32_t tag = (int32_t)([filenames valueForPath:file] ?: [filenames valueForPath:[[file stringByResolvingSymlinksInPath] stringByStandardizingPath]]);
+    if (tag == 0) {
+        tag = (int32_t)[filenames valueForLastPathComponent:[file lastPathComponent]];
+        if (tag == 0)
+            tag = [synctexIndex tagForName:[[file lastPathComponent] UTF8String]];
     }
-    if (synctex_display_query(scanner, filename, (int)line + 1, 0, -1) > 0) {
-        synctex_node_p node = synctex_scanner_next_result(scanner);
-        if (node) {
-            NSUInteger page = synctex_node_page(node);
-            *pageIndexPtr = MAX(page, 1ul) - 1;
-            *pointPtr = NSMakePoint(synctex_node_visible_h(node), synctex_node_visible_v(node));
-            rv = YES;
-        }
-    }
-    if (rv == NO)
-        NSLog(@"SyncTeX was unable to find location and page.");
-    return rv;
+    return tag;
 }
 
-#pragma mark Generic
-
-- (BOOL)loadSyncFileIfNeeded {
-    NSString *theFileName = [self fileName];
+- (BOOL)synctexFindPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line inFile:(NSString *)file {
     BOOL rv = NO;
-    
-    if (theFileName) {
-        NSString *theSyncFileName = [self syncFileName];
-        
-        if (theSyncFileName && [fileManager fileExistsAtPath:theSyncFileName]) {
-            NSDate *modDate = [[fileManager attributesOfItemAtPath:theFileName error:NULL] fileModificationDate];
-            NSDate *currentModDate = [self lastModDate];
-        
-            if (currentModDate && [modDate compare:currentModDate] != NSOrderedDescending)
-                rv = YES;
-            else if (isPdfsync)
-                rv = [self loadPdfsyncFile:theSyncFileName];
-            else
-                rv = [self loadSynctexFileForFile:theFileName];
-        } else {
-            rv = [self loadSynctexFileForFile:theFileName];
-            if (rv == NO) {
-                theSyncFileName = [[theFileName stringByDeletingPathExtension] stringByAppendingPathExtension:SKPDFSynchronizerPdfsyncExtension];
-                if ([fileManager fileExistsAtPath:theSyncFileName])
-                    rv = [self loadPdfsyncFile:theSyncFileName];
-            }
-        }
-    }
+    int32_t tag = [self synctexTagForFile:file];
+    if (tag != 0 && [synctexIndex findPage:pageIndexPtr location:pointPtr forLine:line + 1 tag:tag])
+        rv = YES;
     if (rv == NO)
-        NSLog(@"Unable to find or load synctex or pdfsync file.");
+        NSLog(@"SyncTeX was unable to find location and page.");
     return rv;
 }
 
-#pragma mark Queue
-
-- (dispatch_queue_t)queue {
-    if (queue == NULL)
-        queue = dispatch_queue_create("net.sourceforge.skim-app.queue.SKPDFSynchronizer", NULL);
-    return queue;
-}
-
-#pragma mark Finding API
+#pragma mark Generic
 
-- (void)findFileAndLineForLocation:(NSPoint)point inRect:(NSRect)rect pageBounds:(NSRect)bounds atPageIndex:(NSUInteger)pageIndex {
-    dispatch_async([self queue], ^{
-        if ([self shouldKeepRunning] && [self loadSyncFileIfNeeded]) {
-            NSInteger foundLine = 0;
-            NSString *foundFile = nil;
-            BOOL success = NO;
-            
-            if (isPdfsync)
-                success = [self pdfsyncFindFileLine:&foundLine file:&foundFile forLocation:point inRect:rect pageBounds:bounds atPageIndex:pageIndex];
-            else
-                success = [self synctexFindFileLine:&foundLine file:&foundFile forLocation:point inRect:rect pageBounds:bounds atPageIndex:pageIndex];
-            
-            if (success && [self shouldKeepRunning]) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    [delegate synchronizer:self foundLine:foundLine inFile:foundFile];
-                });
-            }
-        }
-    });
+- (BOOL)findFileLine:(NSInteger *)linePtr file:(NSString **)filePtr forLocation:(NSPoint)point inRect:(NSRect)rect pageBounds:(NSRect)bounds atPageIndex:(NSUInteger)pageIndex {
+    if (isPdfsync)
+        return [self pdfsyncFindFileLine:linePtr file:filePtr forLocation:point inRect:rect pageBounds:bounds atPageIndex:pageIndex];
+    else
+        return [self synctexFindFileLine:linePtr file:filePtr forLocation:point inRect:rect pageBounds:bounds atPageIndex:pageIndex];
 }
 
-- (void)findPageAndLocationForLine:(NSInteger)line inFile:(NSString *)file options:(SKPDFSynchronizerOption)options {
-    if (file == nil)
-        file = [self defaultSourceFile];
-    dispatch_async([self queue], ^{
-        if (file && [self shouldKeepRunning] && [self loadSyncFileIfNeeded]) {
-            NSUInteger foundPageIndex = NSNotFound;
-            NSPoint foundPoint = NSZeroPoint;
-            SKPDFSynchronizerOption foundOptions = options;
-            BOOL success = NO;
-            NSString *fixedFile = [self sourceFileForFileName:file isTeX:YES removeQuotes:NO];
-            
-            if (isPdfsync)
-                success = [self pdfsyncFindPage:&foundPageIndex location:&foundPoint forLine:line inFile:fixedFile];
-            else
-                success = [self synctexFindPage:&foundPageIndex location:&foundPoint forLine:line inFile:fixedFile];
-            
-            if (success && [self shouldKeepRunning]) {
-                if (isPdfsync)
-                    foundOptions &= ~SKPDFSynchronizerFlippedMask;
-                else
-                    foundOptions |= SKPDFSynchronizerFlippedMask;
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    [delegate synchronizer:self foundLocation:foundPoint atPageIndex:foundPageIndex options:foundOptions];
-                });
-            }
-        }
-    });
+- (BOOL)findPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line inFile:(NSString *)file {
+    if (isPdfsync)
+        return [self pdfsyncFindPage:pageIndexPtr location:pointPtr forLine:line inFile:file];
+    else
+        return [self synctexFindPage:pageIndexPtr location:pointPtr forLine:line inFile:file];
 }
 
 @end
-
-#pragma mark -
-
-#define STACK_BUFFER_SIZE 256
-
-static BOOL caseInsensitiveStringEqual(const void *item1, const void *item2, NSUInteger (*size)(const void *item)) {
-    return CFStringCompare(item1, item2, kCFCompareCaseInsensitive | kCFCompareNonliteral) == kCFCompareEqualTo;
-}
-
-static NSUInteger caseInsensitiveStringHash(const void *item, NSUInteger (*size)(const void *item)) {
-    if(item == NULL) return 0;
-    
-    NSUInteger hash = 0;
-    CFAllocatorRef allocator = CFGetAllocator(item);
-    CFIndex len = CFStringGetLength(item);
-    
-    // use a generous length, in case the lowercase changes the number of characters
-    UniChar *buffer, stackBuffer[STACK_BUFFER_SIZE];
-    if (len + 10 >= STACK_BUFFER_SIZE)
-        buffer = (UniChar *)CFAllocatorAllocate(allocator, (len + 10) * sizeof(UniChar), 0);
-    else
-        buffer = stackBuffer;
-    CFStringGetCharacters(item, CFRangeMake(0, len), buffer);
-    
-    // If we create the string with external characters, CFStringGetCharactersPtr is guaranteed to succeed; since we're going to call CFStringGetCharacters anyway in fastHash if CFStringGetCharactsPtr fails, let's do it now when we lowercase the string
-    CFMutableStringRef mutableString = CFStringCreateMutableWithExternalCharactersNoCopy(allocator, buffer, len, len + 10, (buffer != stackBuffer ? allocator : kCFAllocatorNull));
-    CFStringLowercase(mutableString, NULL);
-    hash = [(id)mutableString hash];
-    // if we used the allocator, this should free the buffer for us
-    CFRelease(mutableString);
-    return hash;
-}
@@ -0,0 +1,73 @@
+//
+//  SKRTFWriter.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// Writes an RTF document from attributed strings that are appended one piece at a time
+// The body is spooled to an anonymous temporary file, because the font and color tables have to come before it
+// Supports fonts, colors, underline, strikethrough, links and the basic paragraph attributes, attachments are dropped
+@interface SKRTFWriter : NSObject {
+    int fileDescriptor;
+    int spoolFileDescriptor;
+    char *buffer;
+    NSUInteger length;
+    NSDictionary *documentAttributes;
+    NSMutableDictionary *fontIndexes;
+    NSMutableArray *fontNames;
+    NSMutableDictionary *colorIndexes;
+    NSMutableArray *colors;
+    NSString *currentCharacterFormat;
+    NSString *currentParagraphFormat;
+    BOOL atParagraphStart;
+    int errorNumber;
+    BOOL failed;
+}
+
+// does not take ownership of the file descriptor, which should be empty
+- (id)initWithFileDescriptor:(int)fd documentAttributes:(NSDictionary *)attributes;
+
+// attributes should be fixed, paragraph attributes are taken from the start of each paragraph
+- (void)appendAttributedString:(NSAttributedString *)attrString;
+
+// writes the header and the tables followed by the spooled body, returns NO when writing failed
+- (BOOL)finish;
+
+// the errno of the first failed write, or 0
+- (int)errorNumber;
+
+@end
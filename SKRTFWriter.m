@@ -0,0 +1,454 @@
+//
+//  SKRTFWriter.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKRTFWriter.h"
+#import <fcntl.h>
+
+#define BUFFER_SIZE 65536
+#define CHUNK_SIZE 1024
+#define MAX_ESCAPE_LENGTH 10
+
+#define TWIPS(points) (lround(20.0 * (points)))
+
+// writes the escaped character to buf, which must have room for MAX_ESCAPE_LENGTH bytes, and returns the number of bytes
+static NSUInteger SKRTFEscapeCharacter(unichar ch, char *buf) {
+    switch (ch) {
+        case '\\':
+        case '{':
+        case '}':
+            buf[0] = '\\';
+            buf[1] = (char)ch;
+            return 2;
+        case '\t':
+            memcpy(buf, "\\tab ", 5);
+            return 5;
+        case '\n':
+        case '\r':
+        case 0x2029:
+            memcpy(buf, "\\par\n", 5);
+            return 5;
+        case 0x2028:
+            memcpy(buf, "\\line ", 6);
+            return 6;
+        case NSAttachmentCharacter:
+            return 0;
+        default:
+            if (ch < 0x20)
+                return 0;
+            if (ch < 0x80) {
+                buf[0] = (char)ch;
+                return 1;
+            }
+            // \uc0 is set in the header, so no fallback characters follow, RTF wants a signed 16 bit value
+            return snprintf(buf, MAX_ESCAPE_LENGTH, "\\u%d ", (int)(short)ch);
+    }
+}
+
+static void SKRTFAppendEscapedString(NSMutableData *data, NSString *string) {
+    NSUInteger i, length = [string length];
+    char buf[MAX_ESCAPE_LENGTH];
+    for (i = 0; i < length; i++)
+        [data appendBytes:buf length:SKRTFEscapeCharacter([string characterAtIndex:i], buf)];
+}
+
+static inline void SKRTFAppendCString(NSMutableData *data, const char *string) {
+    [data appendBytes:string length:strlen(string)];
+}
+
+static int SKRTFWriteBytes(int fd, const char *bytes, NSUInteger len) {
+    while (len > 0) {
+        ssize_t written = write(fd, bytes, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        bytes += written;
+        len -= written;
+    }
+    return 0;
+}
+
+@interface SKRTFWriter (SKPrivate)
+- (void)flushBuffer;
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)len;
+- (void)appendCString:(const char *)string;
+- (void)appendCharacters:(NSString *)string range:(NSRange)range;
+- (NSUInteger)indexForFont:(NSFont *)font;
+- (NSUInteger)indexForColor:(NSColor *)color;
+- (NSString *)characterFormatForAttributes:(NSDictionary *)attributes;
+- (NSString *)paragraphFormatForParagraphStyle:(NSParagraphStyle *)paragraphStyle;
+- (void)appendParagraphRange:(NSRange)range ofAttributedString:(NSAttributedString *)attrString;
+- (NSData *)header;
+@end
+
+@implementation SKRTFWriter
+
+- (id)initWithFileDescriptor:(int)fd documentAttributes:(NSDictionary *)attributes {
+    self = [super init];
+    if (self) {
+        fileDescriptor = fd;
+        buffer = (char *)NSZoneMalloc(NSDefaultMallocZone(), BUFFER_SIZE);
+        length = 0;
+        documentAttributes = [attributes copy];
+        fontIndexes = [[NSMutableDictionary alloc] init];
+        fontNames = [[NSMutableArray alloc] init];
+        colorIndexes = [[NSMutableDictionary alloc] init];
+        colors = [[NSMutableArray alloc] init];
+        currentCharacterFormat = nil;
+        currentParagraphFormat = nil;
+        atParagraphStart = YES;
+        errorNumber = 0;
+        failed = NO;
+        
+        // the file is removed right away, so it goes away when we close it
+        char path[PATH_MAX];
+        NSString *pathTemplate = [NSTemporaryDirectory() stringByAppendingPathComponent:@"SkimRTFBody.XXXXXX"];
+        spoolFileDescriptor = -1;
+        if ([pathTemplate getFileSystemRepresentation:path maxLength:sizeof(path)])
+            spoolFileDescriptor = mkstemp(path);
+        if (spoolFileDescriptor == -1) {
+            errorNumber = errno ?: EIO;
+            failed = YES;
+        } else {
+            unlink(path);
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (spoolFileDescriptor != -1)
+        close(spoolFileDescriptor);
+    SKZONEDESTROY(buffer);
+    SKDESTROY(documentAttributes);
+    SKDESTROY(fontIndexes);
+    SKDESTROY(fontNames);
+    SKDESTROY(colorIndexes);
+    SKDESTROY(colors);
+    SKDESTROY(currentCharacterFormat);
+    SKDESTROY(currentParagraphFormat);
+    [super dealloc];
+}
+
+- (int)errorNumber {
+    return errorNumber;
+}
+
+- (void)flushBuffer {
+    if (length > 0 && failed == NO) {
+        errorNumber = SKRTFWriteBytes(spoolFileDescriptor, buffer, length);
+        failed = errorNumber != 0;
+    }
+    length = 0;
+}
+
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)len {
+    if (len > BUFFER_SIZE - length) {
+        [self flushBuffer];
+        if (len > BUFFER_SIZE) {
+            if (failed == NO) {
+                errorNumber = SKRTFWriteBytes(spoolFileDescriptor, bytes, len);
+                failed = errorNumber != 0;
+            }
+            return;
+        }
+    }
+    memcpy(buffer + length, bytes, len);
+    length += len;
+}
+
+- (void)appendCString:(const char *)string {
+    [self appendBytes:string length:strlen(string)];
+}
+
+- (void)appendCharacters:(NSString *)string range:(NSRange)range {
+    unichar chars[CHUNK_SIZE];
+    while (range.length > 0) {
+        NSUInteger i, count = MIN(range.length, (NSUInteger)CHUNK_SIZE);
+        [string getCharacters:chars range:NSMakeRange(range.location, count)];
+        for (i = 0; i < count; i++) {
+            if (BUFFER_SIZE - length < MAX_ESCAPE_LENGTH)
+                [self flushBuffer];
+            length += SKRTFEscapeCharacter(chars[i], buffer + length);
+        }
+        range.location += count;
+        range.length -= count;
+    }
+}
+
+- (NSUInteger)indexForFont:(NSFont *)font {
+    NSString *fontName = [font fontName];
+    NSNumber *idx = [fontIndexes objectForKey:fontName];
+    if (idx == nil) {
+        idx = [NSNumber numberWithUnsignedInteger:[fontNames count]];
+        [fontIndexes setObject:idx forKey:fontName];
+        [fontNames addObject:fontName];
+    }
+    return [idx unsignedIntegerValue];
+}
+
+// index 0 is the automatic color, returns 0 for colors that cannot be converted to RGB
+- (NSUInteger)indexForColor:(NSColor *)color {
+    CGFloat r, g, b, a;
+    NSColor *rgbColor = [color colorUsingColorSpace:[NSColorSpace sRGBColorSpace]];
+    if (rgbColor == nil)
+        return 0;
+    [rgbColor getRed:&r green:&g blue:&b alpha:&a];
+    NSString *key = [NSString stringWithFormat:@"\\red%ld\\green%ld\\blue%ld;", lround(255.0 * r), lround(255.0 * g), lround(255.0 * b)];
+    NSNumber *idx = [colorIndexes objectForKey:key];
+    if (idx == nil) {
+        [colors addObject:key];
+        idx = [NSNumber numberWithUnsignedInteger:[colors count]];
+        [colorIndexes setObject:idx forKey:key];
+    }
+    return [idx unsignedIntegerValue];
+}
+
+- (NSString *)characterFormatForAttributes:(NSDictionary *)attributes {
+    NSFont *font = [attributes objectForKey:NSFontAttributeName] ?: [NSFont fontWithName:@"Helvetica" size:12.0] ?: [NSFont userFontOfSize:12.0];
+    NSMutableString *format = [NSMutableString stringWithFormat:@"\\plain\\f%lu\\fs%ld", (unsigned long)[self indexForFont:font], lround(2.0 * [font pointSize])];
+    NSColor *color = [attributes objectForKey:NSForegroundColorAttributeName];
+    NSInteger style;
+    if (color)
+        [format appendFormat:@"\\cf%lu", (unsigned long)[self indexForColor:color]];
+    if ((color = [attributes objectForKey:NSBackgroundColorAttributeName]))
+        [format appendFormat:@"\\cb%lu", (unsigned long)[self indexForColor:color]];
+    if ((style = [[attributes objectForKey:NSUnderlineStyleAttributeName] integerValue] & 0xFF)) {
+        if (style == NSUnderlineStyleDouble)
+            [format appendString:@"\\uldb"];
+        else if (style == NSUnderlineStyleThick)
+            [format appendString:@"\\ulth"];
+        else
+            [format appendString:@"\\ul"];
+    }
+    if ([[attributes objectForKey:NSStrikethroughStyleAttributeName] integerValue])
+        [format appendString:@"\\strike"];
+    if ((style = [[attributes objectForKey:NSSuperscriptAttributeName] integerValue]))
+        [format appendString:style > 0 ? @"\\super" : @"\\sub"];
+    [format appendString:@" "];
+    return format;
+}
+
+- (NSString *)paragraphFormatForParagraphStyle:(NSParagraphStyle *)paragraphStyle {
+    NSMutableString *format = [NSMutableString stringWithString:@"\\pard"];
+    if (paragraphStyle == nil)
+        paragraphStyle = [NSParagraphStyle defaultParagraphStyle];
+    switch ([paragraphStyle alignment]) {
+        case NSCenterTextAlignment:    [format appendString:@"\\qc"]; break;
+        case NSRightTextAlignment:     [format appendString:@"\\qr"]; break;
+        case NSJustifiedTextAlignment: [format appendString:@"\\qj"]; break;
+        default:                       [format appendString:@"\\ql"]; break;
+    }
+    for (NSTextTab *tab in [paragraphStyle tabStops]) {
+        if ([tab alignment] == NSRightTextAlignment)
+            [format appendString:@"\\tqr"];
+        else if ([tab alignment] == NSCenterTextAlignment)
+            [format appendString:@"\\tqc"];
+        [format appendFormat:@"\\tx%ld", TWIPS([tab location])];
+    }
+    if ([paragraphStyle headIndent] > 0.0)
+        [format appendFormat:@"\\li%ld", TWIPS([paragraphStyle headIndent])];
+    if ([paragraphStyle firstLineHeadIndent] != [paragraphStyle headIndent])
+        [format appendFormat:@"\\fi%ld", TWIPS([paragraphStyle firstLineHeadIndent] - [paragraphStyle headIndent])];
+    // a positive tail indent is measured from the leading margin, which RTF cannot express
+    if ([paragraphStyle tailIndent] < 0.0)
+        [format appendFormat:@"\\ri%ld", TWIPS(-[paragraphStyle tailIndent])];
+    if ([paragraphStyle paragraphSpacingBefore] > 0.0)
+        [format appendFormat:@"\\sb%ld", TWIPS([paragraphStyle paragraphSpacingBefore])];
+    if ([paragraphStyle paragraphSpacing] > 0.0)
+        [format appendFormat:@"\\sa%ld", TWIPS([paragraphStyle paragraphSpacing])];
+    [format appendString:@"\n"];
+    return format;
+}
+
+- (void)appendParagraphRange:(NSRange)range ofAttributedString:(NSAttributedString *)attrString {
+    NSString *string = [attrString string];
+    NSUInteger end = NSMaxRange(range);
+    NSRange linkRange, runRange;
+    
+    if (atParagraphStart) {
+        NSString *format = [self paragraphFormatForParagraphStyle:[attrString attribute:NSParagraphStyleAttributeName atIndex:range.location effectiveRange:NULL]];
+        if ([format isEqualToString:currentParagraphFormat] == NO) {
+            [self appendCString:[format UTF8String]];
+            [currentParagraphFormat release];
+            currentParagraphFormat = [format retain];
+        }
+        atParagraphStart = NO;
+    }
+    
+    while (range.location < end) {
+        id link = [attrString attribute:NSLinkAttributeName atIndex:range.location longestEffectiveRange:&linkRange inRange:range];
+        NSString *linkString = [link isKindOfClass:[NSURL class]] ? [link absoluteString] : [link isKindOfClass:[NSString class]] ? link : nil;
+        
+        if (linkString) {
+            NSMutableData *fieldData = [NSMutableData data];
+            SKRTFAppendCString(fieldData, "{\\field{\\*\\fldinst{HYPERLINK \"");
+            SKRTFAppendEscapedString(fieldData, linkString);
+            SKRTFAppendCString(fieldData, "\"}}{\\fldrslt ");
+            [self appendBytes:[fieldData bytes] length:[fieldData length]];
+        }
+        
+        while (linkRange.length > 0) {
+            NSDictionary *attributes = [attrString attributesAtIndex:linkRange.location longestEffectiveRange:&runRange inRange:linkRange];
+            NSString *format = [self characterFormatForAttributes:attributes];
+            if ([format isEqualToString:currentCharacterFormat] == NO) {
+                [self appendCString:[format UTF8String]];
+                [currentCharacterFormat release];
+                currentCharacterFormat = [format retain];
+            }
+            [self appendCharacters:string range:runRange];
+            linkRange.length = NSMaxRange(linkRange) - NSMaxRange(runRange);
+            linkRange.location = NSMaxRange(runRange);
+        }
+        
+        if (linkString) {
+            [self appendCString:"}}"];
+            // the formatting inside the field group is gone after the group ends
+            SKDESTROY(currentCharacterFormat);
+        }
+        
+        range.length = end - linkRange.location;
+        range.location = linkRange.location;
+    }
+    
+    if (end > 0) {
+        unichar ch = [string characterAtIndex:end - 1];
+        atParagraphStart = ch == '\n' || ch == '\r' || ch == 0x2029;
+    }
+}
+
+- (void)appendAttributedString:(NSAttributedString *)attrString {
+    NSString *string = [attrString string];
+    NSUInteger location = 0, stringLength = [string length];
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    while (location < stringLength) {
+        NSUInteger paragraphEnd;
+        [string getParagraphStart:NULL end:&paragraphEnd contentsEnd:NULL forRange:NSMakeRange(location, 0)];
+        [self appendParagraphRange:NSMakeRange(location, paragraphEnd - location) ofAttributedString:attrString];
+        location = paragraphEnd;
+    }
+    [pool release];
+}
+
+- (NSData *)header {
+    NSMutableData *header = [NSMutableData data];
+    NSString *fontName;
+    NSString *color;
+    NSUInteger i = 0;
+    id value;
+    
+    SKRTFAppendCString(header, "{\\rtf1\\ansi\\ansicpg1252\\uc0\\deff0\n{\\fonttbl");
+    for (fontName in fontNames) {
+        SKRTFAppendCString(header, [[NSString stringWithFormat:@"{\\f%lu\\fnil\\fcharset0 ", (unsigned long)i++] UTF8String]);
+        SKRTFAppendEscapedString(header, fontName);
+        SKRTFAppendCString(header, ";}");
+    }
+    SKRTFAppendCString(header, "}\n{\\colortbl;");
+    for (color in colors)
+        SKRTFAppendCString(header, [color UTF8String]);
+    SKRTFAppendCString(header, "}\n");
+    
+    if ([documentAttributes objectForKey:NSAuthorDocumentAttribute] || [documentAttributes objectForKey:NSTitleDocumentAttribute] || [documentAttributes objectForKey:NSCreationTimeDocumentAttribute]) {
+        SKRTFAppendCString(header, "{\\info");
+        if ((value = [documentAttributes objectForKey:NSTitleDocumentAttribute])) {
+            SKRTFAppendCString(header, "{\\title ");
+            SKRTFAppendEscapedString(header, value);
+            SKRTFAppendCString(header, "}");
+        }
+        if ((value = [documentAttributes objectForKey:NSAuthorDocumentAttribute])) {
+            SKRTFAppendCString(header, "{\\author ");
+            SKRTFAppendEscapedString(header, value);
+            SKRTFAppendCString(header, "}");
+        }
+        if ((value = [documentAttributes objectForKey:NSCreationTimeDocumentAttribute])) {
+            NSDateComponents *components = [[NSCalendar currentCalendar] components:NSCalendarUnitYear | NSCalendarUnitMonth | NSCalendarUnitDay | NSCalendarUnitHour | NSCalendarUnitMinute fromDate:value];
+            SKRTFAppendCString(header, [[NSString stringWithFormat:@"{\\creatim\\yr%ld\\mo%ld\\dy%ld\\hr%ld\\min%ld}", (long)[components year], (long)[components month], (long)[components day], (long)[components hour], (long)[components minute]] UTF8String]);
+        }
+        SKRTFAppendCString(header, "}\n");
+    }
+    
+    if ((value = [documentAttributes objectForKey:NSPaperSizeDocumentAttribute])) {
+        NSSize size = [value sizeValue];
+        SKRTFAppendCString(header, [[NSString stringWithFormat:@"\\paperw%ld\\paperh%ld", TWIPS(size.width), TWIPS(size.height)] UTF8String]);
+    }
+    if ((value = [documentAttributes objectForKey:NSLeftMarginDocumentAttribute]))
+        SKRTFAppendCString(header, [[NSString stringWithFormat:@"\\margl%ld", TWIPS([value doubleValue])] UTF8String]);
+    if ((value = [documentAttributes objectForKey:NSRightMarginDocumentAttribute]))
+        SKRTFAppendCString(header, [[NSString stringWithFormat:@"\\margr%ld", TWIPS([value doubleValue])] UTF8String]);
+    if ((value = [documentAttributes objectForKey:NSTopMarginDocumentAttribute]))
+        SKRTFAppendCString(header, [[NSString stringWithFormat:@"\\margt%ld", TWIPS([value doubleValue])] UTF8String]);
+    if ((value = [documentAttributes objectForKey:NSBottomMarginDocumentAttribute]))
+        SKRTFAppendCString(header, [[NSString stringWithFormat:@"\\margb%ld", TWIPS([value doubleValue])] UTF8String]);
+    if ((value = [documentAttributes objectForKey:NSViewModeDocumentAttribute]))
+        SKRTFAppendCString(header, [[NSString stringWithFormat:@"\\viewkind%ld", (long)[value integerValue]] UTF8String]);
+    SKRTFAppendCString(header, "\n");
+    
+    return header;
+}
+
+- (BOOL)finish {
+    [self flushBuffer];
+    if (failed)
+        return NO;
+    
+    NSData *header = [self header];
+    errorNumber = SKRTFWriteBytes(fileDescriptor, [header bytes], [header length]);
+    
+    if (errorNumber == 0 && lseek(spoolFileDescriptor, 0, SEEK_SET) == -1)
+        errorNumber = errno;
+    while (errorNumber == 0) {
+        ssize_t count = read(spoolFileDescriptor, buffer, BUFFER_SIZE);
+        if (count < 0) {
+            if (errno != EINTR)
+                errorNumber = errno;
+        } else if (count == 0) {
+            break;
+        } else {
+            errorNumber = SKRTFWriteBytes(fileDescriptor, buffer, count);
+        }
+    }
+    
+    if (errorNumber == 0)
+        errorNumber = SKRTFWriteBytes(fileDescriptor, "}\n", 2);
+    
+    failed = errorNumber != 0;
+    return failed == NO;
+}
+
+@end
@@ -55,6 +55,9 @@ extern NSString *SKRememberLastPageViewedKey;
 extern NSString *SKRememberSnapshotsKey;
 extern NSString *SKWriteLegacySkimNotesKey;
 extern NSString *SKWriteSkimNotesAsPlistKey;
+extern NSString *SKWriteSkimNotesAsBinaryKey;
+extern NSString *SKWriteSkimNotesInLargeFragmentsKey;
+extern NSString *SKWriteSkimNotesWithFastCompressionKey;
 extern NSString *SKAutoSaveSkimNotesKey;
 extern NSString *SKSnapshotsOnTopKey;
 extern NSString *SKSnapshotThumbnailSizeKey;
@@ -141,3 +144,4 @@ extern NSString *SKDisableSearchAfterSpotlighKey;
 extern NSString *SKDisplayNoteBoundsKey;
 extern NSString *SKDisplayPageBoundsKey;
 extern NSString *SKDisableHistoryHighlightsKey;
+extern NSString *SKLogSyncFileProbesKey;
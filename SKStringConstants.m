@@ -56,6 +56,9 @@ NSString *SKRememberLastPageViewedKey = @"SKRememberLastPageViewed";
 NSString *SKRememberSnapshotsKey = @"SKRememberSnapshots";
 NSString *SKWriteLegacySkimNotesKey = @"SKWriteLegacySkimNotes";
 NSString *SKWriteSkimNotesAsPlistKey = @"SKWriteSkimNotesAsPlist";
+NSString *SKWriteSkimNotesAsBinaryKey = @"SKWriteSkimNotesAsBinary";
+NSString *SKWriteSkimNotesInLargeFragmentsKey = @"SKWriteSkimNotesInLargeFragments";
+NSString *SKWriteSkimNotesWithFastCompressionKey = @"SKWriteSkimNotesWithFastCompression";
 NSString *SKAutoSaveSkimNotesKey = @"SKAutoSaveSkimNotes";
 NSString *SKSnapshotsOnTopKey = @"SKSnapshotsOnTop";
 NSString *SKSnapshotThumbnailSizeKey = @"SKSnapshotThumbnailSize";
@@ -142,3 +145,4 @@ NSString *SKDisableSearchAfterSpotlighKey = @"SKDisableSearchAfterSpotligh";
 NSString *SKDisplayNoteBoundsKey = @"SKDisplayNoteBounds";
 NSString *SKDisplayPageBoundsKey = @"SKDisplayPageBounds";
 NSString *SKDisableHistoryHighlightsKey = @"SKDisableHistoryHighlights";
+NSString *SKLogSyncFileProbesKey = @"SKLogSyncFileProbes";
@@ -0,0 +1,122 @@
+//
+//  SKSyncTeXIndex.h
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/18/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "synctex_parser.h"
+
+enum {
+    SKSyncTeXRecordTypeLeaf,
+    SKSyncTeXRecordTypeHBox,
+    SKSyncTeXRecordTypeVBox
+};
+
+// coordinates are in PDF units relative to the top left of the page, as returned by the synctex parser
+typedef struct _SKSyncTeXRecord {
+    int32_t tag;
+    int32_t line;
+    int32_t pageIndex;
+    int32_t parent;
+    int32_t type;
+    float h;
+    float v;
+    float width;
+    float height;
+    float depth;
+} SKSyncTeXRecord;
+
+typedef struct _SKSyncTeXFileSignature {
+    uint64_t size;
+    int64_t modificationTime;
+    uint64_t hash;
+} SKSyncTeXFileSignature;
+
+@interface SKSyncTeXIndex : NSObject {
+    NSData *data;
+    SKSyncTeXFileSignature signature;
+    NSUInteger inputCount;
+    NSUInteger pageCount;
+    NSUInteger recordCount;
+    const void *inputs;
+    const char *names;
+    const SKSyncTeXRecord *records;
+    const uint32_t *pageOffsets;
+    const uint32_t *lineOffsets;
+    const uint32_t *lineRecords;
+    const uint64_t *pageHashes;
+    uint64_t skeletonHash;
+    // spatial grids for dense pages, built on demand
+    struct _SKSyncTeXGrid **grids;
+}
+
+// the synctex file next to the PDF file, if any
++ (NSString *)syncTeXFileForFile:(NSString *)file fileManager:(NSFileManager *)fm;
++ (NSURL *)cacheURLForSyncTeXFile:(NSString *)file fileManager:(NSFileManager *)fm;
+
+// size, modification date and a hash of the contents, get this before parsing the file
++ (BOOL)getSignature:(SKSyncTeXFileSignature *)signaturePtr forSyncTeXFile:(NSString *)file;
+
+// returns nil when there is no valid cache for the synctex file with this signature
+- (id)initWithContentsOfCacheURL:(NSURL *)url signature:(SKSyncTeXFileSignature)aSignature;
+- (id)initWithScanner:(synctex_scanner_p)scanner syncTeXFile:(NSString *)file signature:(SKSyncTeXFileSignature)aSignature;
+// only parses the pages whose contents changed since the old index was built, returns nil when that is not possible
+- (id)initWithSyncTeXFile:(NSString *)file updatingIndex:(SKSyncTeXIndex *)oldIndex signature:(SKSyncTeXFileSignature)aSignature;
+
+// also removes the caches that were not used for two months, and the least recently used ones beyond 256 MB
+- (BOOL)writeToCacheURL:(NSURL *)url;
+
+@property (nonatomic, readonly) SKSyncTeXFileSignature signature;
+@property (nonatomic, readonly) NSUInteger inputCount, pageCount, recordCount;
+
+// a hash of the contents of the page in the synctex file, 0 when unknown
+- (uint64_t)hashForPageAtIndex:(NSUInteger)pageIndex;
+- (NSRange)rangeOfRecordsForPageAtIndex:(NSUInteger)pageIndex;
+- (const SKSyncTeXRecord *)recordAtIndex:(NSUInteger)anIndex;
+
+- (int32_t)tagAtIndex:(NSUInteger)anIndex;
+- (const char *)nameAtIndex:(NSUInteger)anIndex;
+- (const char *)nameForTag:(int32_t)tag;
+- (int32_t)tagForName:(const char *)name;
+
+// the point is in synctex coordinates, the returned line is 1 based
+- (BOOL)findTag:(int32_t *)tagPtr line:(NSInteger *)linePtr forLocation:(NSPoint)point atPageIndex:(NSUInteger)pageIndex;
+// the line is 1 based, the returned point is in synctex coordinates
+- (BOOL)findPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line tag:(int32_t)tag;
+// sorted lines are found in a single pass, the page index is NSNotFound for lines that were not found, returns the number of lines found
+- (NSUInteger)findPages:(NSUInteger *)pageIndexes locations:(NSPoint *)points forLines:(const NSInteger *)lines count:(NSUInteger)count tag:(int32_t)tag;
+
+@end
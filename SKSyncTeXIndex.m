@@ -0,0 +1,1246 @@
+//
+//  SKSyncTeXIndex.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/18/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKSyncTeXIndex.h"
+#import "synctex_parser_advanced.h"
+#import <sys/stat.h>
+#import <sys/time.h>
+#import <zlib.h>
+
+#define SKSyncTeXIndexMagic "SKSTXIDX"
+#define SKSyncTeXIndexVersion 2
+#define SKSyncTeXIndexExtension @"synctexindex"
+
+#define MIN_RECORD_CAPACITY 4096
+#define MAX_LINE_TRIES 100
+#define SECTION_BUFFER_SIZE 262144
+#define MIN_GRID_RECORDS 128
+#define MAX_GRID_ROWS 256
+#define MAX_GRID_COLUMNS 64
+#define MAX_CACHE_SIZE 268435456
+#define MAX_CACHE_AGE 5184000.0
+
+typedef struct _SKSyncTeXInput {
+    int32_t tag;
+    uint32_t nameOffset;
+} SKSyncTeXInput;
+
+// all sections are 8 byte aligned, the cache is only read on the machine that wrote it, so we use native byte order
+typedef struct _SKSyncTeXIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    SKSyncTeXFileSignature signature;
+    uint32_t inputCount;
+    uint32_t pageCount;
+    uint32_t recordCount;
+    uint32_t lineRecordCount;
+    uint64_t namesLength;
+    uint64_t inputsOffset;
+    uint64_t namesOffset;
+    uint64_t recordsOffset;
+    uint64_t pageOffsetsOffset;
+    uint64_t lineOffsetsOffset;
+    uint64_t lineRecordsOffset;
+    uint64_t pageHashesOffset;
+    uint64_t skeletonHash;
+} SKSyncTeXIndexHeader;
+
+typedef struct _SKSyncTeXBuilder {
+    SKSyncTeXRecord *records;
+    NSUInteger count;
+    NSUInteger capacity;
+} SKSyncTeXBuilder;
+
+// the skeleton hash covers everything outside the pages that affects the records, except the inputs
+typedef struct _SKSyncTeXSections {
+    uint64_t skeletonHash;
+    uint64_t *pageHashes;
+    NSUInteger pageCount;
+    NSUInteger pageCapacity;
+} SKSyncTeXSections;
+
+typedef BOOL (^SKSyncTeXPageFilter)(NSUInteger pageIndex, uint64_t pageHash);
+
+// a uniform grid over the records of a page, the records in a cell are in page order
+typedef struct _SKSyncTeXGrid {
+    NSUInteger columns;
+    NSUInteger rows;
+    CGFloat minX;
+    CGFloat minY;
+    CGFloat cellWidth;
+    CGFloat cellHeight;
+    uint32_t *cellOffsets;
+    uint32_t *cellRecords;
+    // the end of the range of descendants of each record on the page
+    uint32_t *subtreeEnds;
+} SKSyncTeXGrid;
+
+static uint64_t hashBytes(const void *bytes, NSUInteger length);
+static BOOL scanSections(NSString *file, SKSyncTeXSections *sections, FILE *output, SKSyncTeXPageFilter shouldWritePage);
+static NSData *createIndexData(synctex_scanner_p scanner, SKSyncTeXIndex *oldIndex, const NSInteger *oldPageIndexes, NSUInteger oldPageIndexCount, const SKSyncTeXSections *sections, SKSyncTeXFileSignature signature);
+static int compareInputs(const void *item1, const void *item2);
+static SKSyncTeXGrid *createGrid(const SKSyncTeXRecord *records, NSUInteger start, NSUInteger end);
+static void freeGrid(SKSyncTeXGrid *grid);
+static void pruneCacheDirectory(NSURL *cacheDirURL, NSURL *keptURL);
+
+@interface SKSyncTeXIndex (SKPrivate)
+- (id)initWithData:(NSData *)someData;
+- (const SKSyncTeXRecord *)recordForLine:(NSInteger)line atInputIndex:(NSUInteger)inputIndex start:(NSUInteger *)startPtr;
+@end
+
+@implementation SKSyncTeXIndex
+
+@synthesize signature, inputCount, pageCount, recordCount;
+
++ (NSString *)syncTeXFileForFile:(NSString *)file fileManager:(NSFileManager *)fm {
+    NSString *dir = [file stringByDeletingLastPathComponent];
+    NSString *base = [[file lastPathComponent] stringByDeletingPathExtension];
+    // TeX quotes the job name when it contains spaces
+    for (NSString *name in [NSArray arrayWithObjects:base, [NSString stringWithFormat:@"\"%@\"", base], nil]) {
+        for (NSString *extension in [NSArray arrayWithObjects:@"synctex.gz", @"synctex", nil]) {
+            NSString *syncFile = [dir stringByAppendingPathComponent:[name stringByAppendingPathExtension:extension]];
+            if ([fm fileExistsAtPath:syncFile])
+                return syncFile;
+        }
+    }
+    return nil;
+}
+
++ (NSURL *)cacheURLForSyncTeXFile:(NSString *)file fileManager:(NSFileManager *)fm {
+    NSURL *cachesURL = [fm URLForDirectory:NSCachesDirectory inDomain:NSUserDomainMask appropriateForURL:nil create:YES error:NULL];
+    NSString *bundleIdentifier = [[NSBundle mainBundle] bundleIdentifier];
+    const char *path = [file fileSystemRepresentation];
+    if (cachesURL == nil || bundleIdentifier == nil || path == NULL)
+        return nil;
+    NSURL *cacheDirURL = [[cachesURL URLByAppendingPathComponent:bundleIdentifier] URLByAppendingPathComponent:@"SyncTeX"];
+    if ([cacheDirURL checkResourceIsReachableAndReturnError:NULL] == NO &&
+        [fm createDirectoryAtURL:cacheDirURL withIntermediateDirectories:YES attributes:nil error:NULL] == NO)
+        return nil;
+    // different files hashing to the same name just overwrite each other's cache, the signature protects us from using the wrong one
+    NSString *cacheName = [NSString stringWithFormat:@"%016llx", (unsigned long long)hashBytes(path, strlen(path))];
+    return [cacheDirURL URLByAppendingPathComponent:[cacheName stringByAppendingPathExtension:SKSyncTeXIndexExtension]];
+}
+
++ (BOOL)getSignature:(SKSyncTeXFileSignature *)signaturePtr forSyncTeXFile:(NSString *)file {
+    struct stat info;
+    const char *path = [file fileSystemRepresentation];
+    if (path == NULL || stat(path, &info) != 0)
+        return NO;
+    // hashing the compressed file is much cheaper than inflating and parsing it
+    NSData *fileData = [[NSData alloc] initWithContentsOfFile:file options:NSDataReadingMappedIfSafe error:NULL];
+    if (fileData == nil)
+        return NO;
+    signaturePtr->size = [fileData length];
+    signaturePtr->modificationTime = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+    signaturePtr->hash = hashBytes([fileData bytes], [fileData length]);
+    [fileData release];
+    return YES;
+}
+
+- (id)initWithData:(NSData *)someData {
+    self = [super init];
+    if (self) {
+        const SKSyncTeXIndexHeader *header = (const SKSyncTeXIndexHeader *)[someData bytes];
+        uint64_t length = [someData length];
+        
+        if (length < sizeof(SKSyncTeXIndexHeader) ||
+            memcmp(header->magic, SKSyncTeXIndexMagic, sizeof(header->magic)) != 0 ||
+            header->version != SKSyncTeXIndexVersion ||
+            header->recordSize != sizeof(SKSyncTeXRecord) ||
+            header->inputsOffset + header->inputCount * sizeof(SKSyncTeXInput) > length ||
+            header->namesOffset + header->namesLength > length ||
+            header->recordsOffset + header->recordCount * sizeof(SKSyncTeXRecord) > length ||
+            header->pageOffsetsOffset + (header->pageCount + 1) * sizeof(uint32_t) > length ||
+            header->lineOffsetsOffset + (header->inputCount + 1) * sizeof(uint32_t) > length ||
+            header->lineRecordsOffset + header->lineRecordCount * sizeof(uint32_t) > length ||
+            header->pageHashesOffset + header->pageCount * sizeof(uint64_t) > length ||
+            (header->namesLength > 0 && ((const char *)header)[header->namesOffset + header->namesLength - 1] != 0)) {
+            [self release];
+            return nil;
+        }
+        
+        data = [someData retain];
+        signature = header->signature;
+        inputCount = header->inputCount;
+        pageCount = header->pageCount;
+        recordCount = header->recordCount;
+        inputs = (const char *)header + header->inputsOffset;
+        names = (const char *)header + header->namesOffset;
+        records = (const SKSyncTeXRecord *)((const char *)header + header->recordsOffset);
+        pageOffsets = (const uint32_t *)((const char *)header + header->pageOffsetsOffset);
+        lineOffsets = (const uint32_t *)((const char *)header + header->lineOffsetsOffset);
+        lineRecords = (const uint32_t *)((const char *)header + header->lineRecordsOffset);
+        pageHashes = (const uint64_t *)((const char *)header + header->pageHashesOffset);
+        skeletonHash = header->skeletonHash;
+        
+        // make sure a damaged cache can never send us outside the data
+        NSUInteger i;
+        BOOL isValid = pageOffsets[pageCount] <= recordCount && lineOffsets[inputCount] <= header->lineRecordCount;
+        for (i = 0; isValid && i < pageCount; i++)
+            isValid = pageOffsets[i] <= pageOffsets[i + 1];
+        for (i = 0; isValid && i < inputCount; i++)
+            isValid = lineOffsets[i] <= lineOffsets[i + 1] && ((const SKSyncTeXInput *)inputs)[i].nameOffset < header->namesLength;
+        if (isValid == NO) {
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (id)initWithContentsOfCacheURL:(NSURL *)url signature:(SKSyncTeXFileSignature)aSignature {
+    NSData *cacheData = url ? [[NSData alloc] initWithContentsOfURL:url options:NSDataReadingMappedAlways error:NULL] : nil;
+    self = [self initWithData:cacheData];
+    [cacheData release];
+    if (self && (signature.size != aSignature.size || signature.modificationTime != aSignature.modificationTime || signature.hash != aSignature.hash)) {
+        [self release];
+        self = nil;
+    } else if (self) {
+        // mark the cache as used, so pruning keeps it
+        utimes([url fileSystemRepresentation], NULL);
+    }
+    return self;
+}
+
+- (id)initWithScanner:(synctex_scanner_p)scanner syncTeXFile:(NSString *)file signature:(SKSyncTeXFileSignature)aSignature {
+    SKSyncTeXSections sections = {0, NULL, 0, 0};
+    NSData *indexData = nil;
+    if (scanner) {
+        // we only need the page hashes for a later update, so an unreadable file does not make the index invalid
+        if (scanSections(file, &sections, NULL, nil) == NO) {
+            sections.skeletonHash = 0;
+            sections.pageCount = 0;
+        }
+        indexData = createIndexData(scanner, nil, NULL, 0, &sections, aSignature);
+    }
+    free(sections.pageHashes);
+    self = [self initWithData:indexData];
+    [indexData release];
+    return self;
+}
+
+- (id)initWithSyncTeXFile:(NSString *)file updatingIndex:(SKSyncTeXIndex *)oldIndex signature:(SKSyncTeXFileSignature)aSignature {
+    NSData *indexData = nil;
+    NSString *tmpDir = [NSTemporaryDirectory() stringByAppendingPathComponent:@"SKSyncTeX.XXXXXX"];
+    char *tmpPath = strdup([tmpDir fileSystemRepresentation]);
+    
+    if (oldIndex && [oldIndex pageCount] > 0 && tmpPath && mkdtemp(tmpPath)) {
+        NSString *partialFile = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:tmpPath length:strlen(tmpPath)];
+        NSString *partialPDFFile = [partialFile stringByAppendingPathComponent:@"partial.pdf"];
+        partialFile = [partialFile stringByAppendingPathComponent:@"partial.synctex"];
+        FILE *output = fopen([partialFile fileSystemRepresentation], "w");
+        
+        if (output) {
+            SKSyncTeXSections sections = {0, NULL, 0, 0};
+            NSMutableDictionary *oldPages = [[NSMutableDictionary alloc] init];
+            NSMutableData *oldPageIndexesData = [[NSMutableData alloc] init];
+            NSUInteger i, oldPageCount = [oldIndex pageCount];
+            BOOL success;
+            
+            // pages can move when material is inserted or deleted, so we also look for identical pages elsewhere
+            for (i = oldPageCount; i-- > 0; ) {
+                uint64_t pageHash = [oldIndex hashForPageAtIndex:i];
+                if (pageHash)
+                    [oldPages setObject:[NSNumber numberWithUnsignedInteger:i] forKey:[NSNumber numberWithUnsignedLongLong:pageHash]];
+            }
+            
+            // only the changed pages are written to the partial file, together with everything outside the pages
+            success = scanSections(file, &sections, output, ^BOOL(NSUInteger pageIndex, uint64_t pageHash){
+                NSInteger oldPageIndex = -1;
+                NSUInteger count = [oldPageIndexesData length] / sizeof(NSInteger);
+                if (pageIndex < oldPageCount && [oldIndex hashForPageAtIndex:pageIndex] == pageHash)
+                    oldPageIndex = pageIndex;
+                else if (pageHash && [oldPages objectForKey:[NSNumber numberWithUnsignedLongLong:pageHash]])
+                    oldPageIndex = [[oldPages objectForKey:[NSNumber numberWithUnsignedLongLong:pageHash]] integerValue];
+                if (pageIndex >= count) {
+                    [oldPageIndexesData setLength:(pageIndex + 1) * sizeof(NSInteger)];
+                    // pages without a section, if any, are reparsed
+                    for (; count < pageIndex; count++)
+                        ((NSInteger *)[oldPageIndexesData mutableBytes])[count] = -1;
+                }
+                ((NSInteger *)[oldPageIndexesData mutableBytes])[pageIndex] = oldPageIndex;
+                return oldPageIndex == -1;
+            });
+            
+            fclose(output);
+            
+            // a different unit, offset or magnification changes all the records
+            if (success && sections.skeletonHash == oldIndex->skeletonHash) {
+                synctex_scanner_p scanner = synctex_scanner_new_with_output_file([partialPDFFile fileSystemRepresentation], NULL, 1);
+                if (scanner) {
+                    indexData = createIndexData(scanner, oldIndex, (const NSInteger *)[oldPageIndexesData bytes], [oldPageIndexesData length] / sizeof(NSInteger), &sections, aSignature);
+                    synctex_scanner_free(scanner);
+                }
+            }
+            
+            free(sections.pageHashes);
+            [oldPages release];
+            [oldPageIndexesData release];
+            unlink([partialFile fileSystemRepresentation]);
+        }
+        rmdir(tmpPath);
+    }
+    free(tmpPath);
+    
+    self = [self initWithData:indexData];
+    [indexData release];
+    return self;
+}
+
+- (void)dealloc {
+    if (grids) {
+        NSUInteger i;
+        for (i = 0; i < pageCount; i++)
+            freeGrid(grids[i]);
+        free(grids);
+        grids = NULL;
+    }
+    SKDESTROY(data);
+    [super dealloc];
+}
+
+- (BOOL)writeToCacheURL:(NSURL *)url {
+    if (url == nil || [data writeToURL:url options:NSDataWritingAtomic error:NULL] == NO)
+        return NO;
+    pruneCacheDirectory([url URLByDeletingLastPathComponent], url);
+    return YES;
+}
+
+#pragma mark Pages
+
+- (uint64_t)hashForPageAtIndex:(NSUInteger)pageIndex {
+    return pageIndex < pageCount ? pageHashes[pageIndex] : 0;
+}
+
+- (NSRange)rangeOfRecordsForPageAtIndex:(NSUInteger)pageIndex {
+    if (pageIndex >= pageCount)
+        return NSMakeRange(0, 0);
+    return NSMakeRange(pageOffsets[pageIndex], pageOffsets[pageIndex + 1] - pageOffsets[pageIndex]);
+}
+
+- (const SKSyncTeXRecord *)recordAtIndex:(NSUInteger)anIndex {
+    return records + anIndex;
+}
+
+#pragma mark Inputs
+
+- (int32_t)tagAtIndex:(NSUInteger)anIndex {
+    return ((const SKSyncTeXInput *)inputs)[anIndex].tag;
+}
+
+- (const char *)nameAtIndex:(NSUInteger)anIndex {
+    return names + ((const SKSyncTeXInput *)inputs)[anIndex].nameOffset;
+}
+
+- (NSUInteger)indexOfTag:(int32_t)tag {
+    // the inputs are sorted by tag
+    const SKSyncTeXInput *theInputs = (const SKSyncTeXInput *)inputs;
+    NSUInteger lo = 0, hi = inputCount, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (theInputs[mid].tag < tag)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < inputCount && theInputs[lo].tag == tag ? lo : NSNotFound;
+}
+
+- (const char *)nameForTag:(int32_t)tag {
+    NSUInteger i = [self indexOfTag:tag];
+    return i == NSNotFound ? NULL : [self nameAtIndex:i];
+}
+
+- (int32_t)tagForName:(const char *)name {
+    NSUInteger i;
+    if (name) {
+        for (i = 0; i < inputCount; i++) {
+            if (strcmp([self nameAtIndex:i], name) == 0)
+                return [self tagAtIndex:i];
+        }
+    }
+    return 0;
+}
+
+#pragma mark Queries
+
+static inline BOOL pointInRecord(NSPoint point, const SKSyncTeXRecord *record) {
+    return point.x >= record->h && point.x <= record->h + record->width &&
+           point.y >= record->v - record->height && point.y <= record->v + record->depth;
+}
+
+// negative when the record is left of the point, positive when it is right of the point
+static inline CGFloat horizontalDistance(NSPoint point, const SKSyncTeXRecord *record) {
+    if (point.x < record->h)
+        return record->h - point.x;
+    else if (point.x > record->h + record->width)
+        return record->h + record->width - point.x;
+    else
+        return 0.0;
+}
+
+static inline CGFloat squaredDistance(NSPoint point, const SKSyncTeXRecord *record) {
+    CGFloat dx = horizontalDistance(point, record), dy = 0.0;
+    if (point.y < record->v - record->height)
+        dy = record->v - record->height - point.y;
+    else if (point.y > record->v + record->depth)
+        dy = point.y - record->v - record->depth;
+    return dx * dx + dy * dy;
+}
+
+static inline BOOL isBetterContainer(const SKSyncTeXRecord *record, CGFloat area, const SKSyncTeXRecord *container, CGFloat containerArea) {
+    return container == NULL ||
+           (record->type == SKSyncTeXRecordTypeHBox && container->type == SKSyncTeXRecordTypeVBox) ||
+           (record->type == container->type && area <= containerArea);
+}
+
+- (SKSyncTeXGrid *)gridForPageAtIndex:(NSUInteger)pageIndex {
+    SKSyncTeXGrid *grid = NULL;
+    @synchronized (self) {
+        if (grids == NULL)
+            grids = (SKSyncTeXGrid **)calloc(pageCount, sizeof(SKSyncTeXGrid *));
+        if (grids) {
+            if (grids[pageIndex] == NULL)
+                grids[pageIndex] = createGrid(records, pageOffsets[pageIndex], pageOffsets[pageIndex + 1]);
+            grid = grids[pageIndex];
+        }
+    }
+    return grid;
+}
+
+- (BOOL)findTag:(int32_t *)tagPtr line:(NSInteger *)linePtr forLocation:(NSPoint)point atPageIndex:(NSUInteger)pageIndex {
+    if (pageIndex >= pageCount)
+        return NO;
+    
+    NSUInteger i, start = pageOffsets[pageIndex], end = pageOffsets[pageIndex + 1];
+    NSUInteger container = NSNotFound, found = NSNotFound;
+    CGFloat area, containerArea = CGFLOAT_MAX;
+    const SKSyncTeXRecord *record;
+    // dense pages get a grid, so we only need to look at the records near the point
+    SKSyncTeXGrid *grid = end - start >= MIN_GRID_RECORDS ? [self gridForPageAtIndex:pageIndex] : NULL;
+    
+    // like synctex, find the smallest horizontal box containing the point, or a vertical box when there is none
+    if (grid) {
+        NSInteger column = (NSInteger)floor((point.x - grid->minX) / grid->cellWidth);
+        NSInteger row = (NSInteger)floor((point.y - grid->minY) / grid->cellHeight);
+        if (column >= 0 && row >= 0 && column < (NSInteger)grid->columns && row < (NSInteger)grid->rows) {
+            NSUInteger cell = row * grid->columns + column, j;
+            for (j = grid->cellOffsets[cell]; j < grid->cellOffsets[cell + 1]; j++) {
+                i = grid->cellRecords[j];
+                record = records + i;
+                if (record->type == SKSyncTeXRecordTypeLeaf || pointInRecord(point, record) == NO)
+                    continue;
+                area = record->width * (record->height + record->depth);
+                if (isBetterContainer(record, area, container == NSNotFound ? NULL : records + container, containerArea)) {
+                    container = i;
+                    containerArea = area;
+                }
+            }
+        }
+    } else {
+        for (i = start; i < end; i++) {
+            record = records + i;
+            if (record->type == SKSyncTeXRecordTypeLeaf || pointInRecord(point, record) == NO)
+                continue;
+            area = record->width * (record->height + record->depth);
+            if (isBetterContainer(record, area, container == NSNotFound ? NULL : records + container, containerArea)) {
+                container = i;
+                containerArea = area;
+            }
+        }
+    }
+    
+    if (container != NSNotFound) {
+        // find the closest children on either side of the point, children come after their box in page order
+        NSUInteger left = NSNotFound, right = NSNotFound;
+        NSUInteger childrenEnd = grid ? grid->subtreeEnds[container - start] : end;
+        CGFloat distance, leftDistance = CGFLOAT_MAX, rightDistance = CGFLOAT_MAX;
+        for (i = container + 1; i < childrenEnd; i++) {
+            record = records + i;
+            if ((NSUInteger)record->parent != container)
+                continue;
+            distance = horizontalDistance(point, record);
+            if (distance <= 0.0 && -distance < leftDistance) {
+                left = i;
+                leftDistance = -distance;
+            } else if (distance > 0.0 && distance < rightDistance) {
+                right = i;
+                rightDistance = distance;
+            }
+        }
+        if (left != NSNotFound && right != NSNotFound) {
+            // prefer the earlier line, otherwise the closest one
+            if (records[left].line != records[right].line)
+                found = records[left].line < records[right].line ? left : right;
+            else
+                found = leftDistance <= rightDistance ? left : right;
+        } else if (left != NSNotFound) {
+            found = left;
+        } else if (right != NSNotFound) {
+            found = right;
+        } else {
+            found = container;
+        }
+    } else if (grid) {
+        // no box contains the point, so look for the closest node in growing rings of cells around the point
+        NSInteger column = MIN(MAX((NSInteger)floor((point.x - grid->minX) / grid->cellWidth), 0), (NSInteger)grid->columns - 1);
+        NSInteger row = MIN(MAX((NSInteger)floor((point.y - grid->minY) / grid->cellHeight), 0), (NSInteger)grid->rows - 1);
+        NSInteger ring, maxRing = MAX(MAX(column, (NSInteger)grid->columns - 1 - column), MAX(row, (NSInteger)grid->rows - 1 - row));
+        CGFloat distance, closestDistance = CGFLOAT_MAX;
+        for (ring = 0; ring <= maxRing; ring++) {
+            NSInteger minColumn = MAX(column - ring, 0), maxColumn = MIN(column + ring, (NSInteger)grid->columns - 1);
+            NSInteger minRow = MAX(row - ring, 0), maxRow = MIN(row + ring, (NSInteger)grid->rows - 1);
+            NSInteger c, r;
+            for (r = minRow; r <= maxRow; r++) {
+                for (c = minColumn; c <= maxColumn; c++) {
+                    // only the cells on the border of the ring are new
+                    if (r != row - ring && r != row + ring && c != column - ring && c != column + ring)
+                        continue;
+                    NSUInteger cell = r * grid->columns + c, j;
+                    for (j = grid->cellOffsets[cell]; j < grid->cellOffsets[cell + 1]; j++) {
+                        i = grid->cellRecords[j];
+                        distance = squaredDistance(point, records + i);
+                        // like the linear search, prefer the first record in page order
+                        if (distance < closestDistance || (distance == closestDistance && i < found)) {
+                            found = i;
+                            closestDistance = distance;
+                        }
+                    }
+                }
+            }
+            if (found != NSNotFound) {
+                // any record we did not see yet lies beyond one of the sides of the rings we looked at
+                CGFloat bound = CGFLOAT_MAX;
+                if (minColumn > 0)
+                    bound = MIN(bound, MAX(0.0, point.x - (grid->minX + minColumn * grid->cellWidth)));
+                if (maxColumn < (NSInteger)grid->columns - 1)
+                    bound = MIN(bound, MAX(0.0, grid->minX + (maxColumn + 1) * grid->cellWidth - point.x));
+                if (minRow > 0)
+                    bound = MIN(bound, MAX(0.0, point.y - (grid->minY + minRow * grid->cellHeight)));
+                if (maxRow < (NSInteger)grid->rows - 1)
+                    bound = MIN(bound, MAX(0.0, grid->minY + (maxRow + 1) * grid->cellHeight - point.y));
+                if (bound == CGFLOAT_MAX || closestDistance < bound * bound)
+                    break;
+            }
+        }
+    } else {
+        // no box contains the point, so look for the closest node
+        CGFloat distance, closestDistance = CGFLOAT_MAX;
+        for (i = start; i < end; i++) {
+            distance = squaredDistance(point, records + i);
+            if (distance < closestDistance) {
+                found = i;
+                closestDistance = distance;
+            }
+        }
+    }
+    
+    if (found == NSNotFound)
+        return NO;
+    *tagPtr = records[found].tag;
+    *linePtr = records[found].line;
+    return YES;
+}
+
+// the start is a lower bound for the position of the line in the line records, it is updated for a following larger line
+- (const SKSyncTeXRecord *)recordForLine:(NSInteger)line atInputIndex:(NSUInteger)inputIndex start:(NSUInteger *)startPtr {
+    const uint32_t *lineRecordIndexes = lineRecords + lineOffsets[inputIndex];
+    NSUInteger count = lineOffsets[inputIndex + 1] - lineOffsets[inputIndex];
+    NSUInteger lo, hi, mid, start = startPtr ? MIN(*startPtr, count) : 0;
+    NSInteger maxLine, lineOffset = 1, tries = MAX_LINE_TRIES;
+    
+    if (count == 0 || lineRecordIndexes[count - 1] >= recordCount)
+        return NULL;
+    
+    maxLine = records[lineRecordIndexes[count - 1]].line;
+    if (line > maxLine)
+        line = maxLine;
+    
+    // like synctex, look at the nearby lines alternating after and before the line when there is no exact match
+    while (tries-- > 0) {
+        // only the first try looks for the requested line, the others can be before it
+        lo = tries == MAX_LINE_TRIES - 1 ? start : 0;
+        hi = count;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (lineRecordIndexes[mid] < recordCount && records[lineRecordIndexes[mid]].line < line)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (startPtr && tries == MAX_LINE_TRIES - 1)
+            *startPtr = lo;
+        if (lo < count && lineRecordIndexes[lo] < recordCount && records[lineRecordIndexes[lo]].line == line) {
+            // the records for a line are sorted with nodes before boxes, and then by page and position
+            return records + lineRecordIndexes[lo];
+        }
+        line += lineOffset;
+        lineOffset = lineOffset < 0 ? -(lineOffset - 1) : -(lineOffset + 1);
+        if (line <= 0) {
+            line += lineOffset;
+            lineOffset = lineOffset < 0 ? -(lineOffset - 1) : -(lineOffset + 1);
+        }
+    }
+    return NULL;
+}
+
+- (BOOL)findPage:(NSUInteger *)pageIndexPtr location:(NSPoint *)pointPtr forLine:(NSInteger)line tag:(int32_t)tag {
+    NSUInteger inputIndex = [self indexOfTag:tag];
+    const SKSyncTeXRecord *record = inputIndex == NSNotFound ? NULL : [self recordForLine:line atInputIndex:inputIndex start:NULL];
+    if (record == NULL)
+        return NO;
+    *pageIndexPtr = record->pageIndex;
+    *pointPtr = NSMakePoint(record->h, record->v);
+    return YES;
+}
+
+- (NSUInteger)findPages:(NSUInteger *)pageIndexes locations:(NSPoint *)points forLines:(const NSInteger *)lines count:(NSUInteger)count tag:(int32_t)tag {
+    NSUInteger i, start = 0, found = 0, inputIndex = [self indexOfTag:tag];
+    for (i = 0; i < count; i++) {
+        if (i > 0 && lines[i] < lines[i - 1])
+            start = 0;
+        const SKSyncTeXRecord *record = inputIndex == NSNotFound ? NULL : [self recordForLine:lines[i] atInputIndex:inputIndex start:&start];
+        if (record) {
+            pageIndexes[i] = record->pageIndex;
+            points[i] = NSMakePoint(record->h, record->v);
+            found++;
+        } else {
+            pageIndexes[i] = NSNotFound;
+            points[i] = NSZeroPoint;
+        }
+    }
+    return found;
+}
+
+@end
+
+#pragma mark -
+
+// removes caches that were not used for a long time, and the least recently used ones when the caches get too large
+static void pruneCacheDirectory(NSURL *cacheDirURL, NSURL *keptURL) {
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    NSArray *keys = [NSArray arrayWithObjects:NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey, nil];
+    NSArray *urls = [fm contentsOfDirectoryAtURL:cacheDirURL includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles error:NULL];
+    NSMutableArray *caches = [NSMutableArray arrayWithCapacity:[urls count]];
+    NSDate *cutoffDate = [NSDate dateWithTimeIntervalSinceNow:-MAX_CACHE_AGE];
+    NSString *keptName = [keptURL lastPathComponent];
+    unsigned long long totalSize = 0;
+    
+    for (NSURL *url in urls) {
+        NSDate *modDate = nil;
+        NSNumber *size = nil;
+        if ([[url pathExtension] isEqualToString:SKSyncTeXIndexExtension] == NO || [[url lastPathComponent] isEqualToString:keptName])
+            continue;
+        [url getResourceValue:&modDate forKey:NSURLContentModificationDateKey error:NULL];
+        [url getResourceValue:&size forKey:NSURLTotalFileAllocatedSizeKey error:NULL];
+        [caches addObject:[NSDictionary dictionaryWithObjectsAndKeys:url, @"URL", modDate ?: [NSDate distantPast], @"date", size ?: [NSNumber numberWithInt:0], @"size", nil]];
+    }
+    
+    // the cache we just wrote counts towards the total size, but is always kept
+    if (keptURL) {
+        NSNumber *size = nil;
+        [keptURL getResourceValue:&size forKey:NSURLTotalFileAllocatedSizeKey error:NULL];
+        totalSize = [size unsignedLongLongValue];
+    }
+    
+    [caches sortUsingDescriptors:[NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:@"date" ascending:NO] autorelease]]];
+    for (NSDictionary *cache in caches) {
+        unsigned long long size = [[cache objectForKey:@"size"] unsignedLongLongValue];
+        if (totalSize + size > MAX_CACHE_SIZE || [[cache objectForKey:@"date"] compare:cutoffDate] == NSOrderedAscending)
+            [fm removeItemAtURL:[cache objectForKey:@"URL"] error:NULL];
+        else
+            totalSize += size;
+    }
+    
+    [fm release];
+}
+
+static uint64_t hashBytes(const void *bytes, NSUInteger length) {
+    const uint8_t *p = (const uint8_t *)bytes;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)length, word;
+    while (length >= sizeof(uint64_t)) {
+        memcpy(&word, p, sizeof(uint64_t));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+        p += sizeof(uint64_t);
+        length -= sizeof(uint64_t);
+    }
+    while (length-- > 0)
+        hash = (hash ^ *p++) * 0x100000001b3ULL;
+    return hash;
+}
+
+static inline uint64_t combineHash(uint64_t hash, const char *line, size_t length) {
+    return (hash ^ hashBytes(line, length)) * 0x9e3779b97f4a7c15ULL;
+}
+
+static inline BOOL lineHasPrefix(const char *line, size_t length, const char *prefix) {
+    size_t prefixLength = strlen(prefix);
+    return length >= prefixLength && memcmp(line, prefix, prefixLength) == 0;
+}
+
+enum {
+    SKSyncTeXSectionPreamble,
+    SKSyncTeXSectionContent,
+    SKSyncTeXSectionPage,
+    SKSyncTeXSectionForm,
+    SKSyncTeXSectionPostamble
+};
+
+typedef struct _SKSyncTeXSectionScanner {
+    SKSyncTeXSections *sections;
+    FILE *output;
+    NSMutableData *pageData;
+    SKSyncTeXPageFilter shouldWritePage;
+    int state;
+    NSInteger pageIndex;
+    uint64_t pageHash;
+    BOOL failed;
+} SKSyncTeXSectionScanner;
+
+static void writeLine(SKSyncTeXSectionScanner *scanner, const char *line, size_t length) {
+    if (scanner->output && fwrite(line, 1, length, scanner->output) != length)
+        scanner->failed = YES;
+}
+
+static void endPage(SKSyncTeXSectionScanner *scanner) {
+    SKSyncTeXSections *sections = scanner->sections;
+    NSUInteger pageIndex = scanner->pageIndex;
+    if (pageIndex >= sections->pageCapacity) {
+        NSUInteger newCapacity = MAX(2 * sections->pageCapacity, pageIndex + 64);
+        uint64_t *newHashes = (uint64_t *)realloc(sections->pageHashes, newCapacity * sizeof(uint64_t));
+        if (newHashes == NULL) {
+            scanner->failed = YES;
+            return;
+        }
+        sections->pageHashes = newHashes;
+        sections->pageCapacity = newCapacity;
+    }
+    if (pageIndex >= sections->pageCount) {
+        memset(sections->pageHashes + sections->pageCount, 0, (pageIndex + 1 - sections->pageCount) * sizeof(uint64_t));
+        sections->pageCount = pageIndex + 1;
+    }
+    // 0 means unknown
+    sections->pageHashes[pageIndex] = scanner->pageHash ?: 1;
+    if (scanner->output && scanner->shouldWritePage(pageIndex, sections->pageHashes[pageIndex]))
+        writeLine(scanner, [scanner->pageData bytes], [scanner->pageData length]);
+}
+
+static void scanLine(SKSyncTeXSectionScanner *scanner, const char *line, size_t length) {
+    SKSyncTeXSections *sections = scanner->sections;
+    switch (scanner->state) {
+        case SKSyncTeXSectionPreamble:
+            if (lineHasPrefix(line, length, "Content:"))
+                scanner->state = SKSyncTeXSectionContent;
+            else if (lineHasPrefix(line, length, "Input:") == NO)
+                sections->skeletonHash = combineHash(sections->skeletonHash, line, length);
+            writeLine(scanner, line, length);
+            break;
+        case SKSyncTeXSectionContent:
+            if (length > 1 && line[0] == '{') {
+                NSInteger page = 0;
+                size_t i;
+                for (i = 1; i < length && line[i] >= '0' && line[i] <= '9'; i++)
+                    page = 10 * page + line[i] - '0';
+                if (page <= 0) {
+                    scanner->failed = YES;
+                    break;
+                }
+                scanner->state = SKSyncTeXSectionPage;
+                scanner->pageIndex = page - 1;
+                scanner->pageHash = 0;
+                if (scanner->output) {
+                    [scanner->pageData setLength:0];
+                    [scanner->pageData appendBytes:line length:length];
+                }
+            } else {
+                if (line[0] == '<') {
+                    scanner->state = SKSyncTeXSectionForm;
+                    sections->skeletonHash = combineHash(sections->skeletonHash, line, length);
+                } else if (lineHasPrefix(line, length, "Postamble:")) {
+                    scanner->state = SKSyncTeXSectionPostamble;
+                }
+                writeLine(scanner, line, length);
+            }
+            break;
+        case SKSyncTeXSectionPage:
+            if (line[0] == '}') {
+                if (scanner->output)
+                    [scanner->pageData appendBytes:line length:length];
+                endPage(scanner);
+                scanner->state = SKSyncTeXSectionContent;
+            } else if (lineHasPrefix(line, length, "Input:")) {
+                // the inputs are always written, so the partial file knows all of them
+                scanner->pageHash = combineHash(scanner->pageHash, line, length);
+                writeLine(scanner, line, length);
+            } else {
+                scanner->pageHash = combineHash(scanner->pageHash, line, length);
+                if (scanner->output)
+                    [scanner->pageData appendBytes:line length:length];
+            }
+            break;
+        case SKSyncTeXSectionForm:
+            sections->skeletonHash = combineHash(sections->skeletonHash, line, length);
+            if (line[0] == '>')
+                scanner->state = SKSyncTeXSectionContent;
+            writeLine(scanner, line, length);
+            break;
+        case SKSyncTeXSectionPostamble:
+            // the post scriptum can change the unit and offsets, the count is irrelevant
+            if (lineHasPrefix(line, length, "Count:") == NO)
+                sections->skeletonHash = combineHash(sections->skeletonHash, line, length);
+            writeLine(scanner, line, length);
+            break;
+    }
+}
+
+// reads the (possibly compressed) synctex file line by line, without building any nodes
+static BOOL scanSections(NSString *file, SKSyncTeXSections *sections, FILE *output, SKSyncTeXPageFilter shouldWritePage) {
+    const char *path = [file fileSystemRepresentation];
+    gzFile gzfile = path ? gzopen(path, "rb") : NULL;
+    if (gzfile == NULL)
+        return NO;
+    
+    SKSyncTeXSectionScanner scanner = {sections, output, nil, shouldWritePage, SKSyncTeXSectionPreamble, 0, 0, NO};
+    char *buffer = (char *)malloc(SECTION_BUFFER_SIZE);
+    size_t length = 0;
+    int n;
+    
+    if (buffer == NULL) {
+        gzclose(gzfile);
+        return NO;
+    }
+    if (output)
+        scanner.pageData = [[NSMutableData alloc] init];
+    gzbuffer(gzfile, SECTION_BUFFER_SIZE / 2);
+    
+    while (scanner.failed == NO) {
+        n = gzread(gzfile, buffer + length, (unsigned)(SECTION_BUFFER_SIZE - length));
+        if (n < 0) {
+            scanner.failed = YES;
+            break;
+        }
+        length += n;
+        
+        char *start = buffer, *end = buffer + length, *eol;
+        while (start < end && scanner.failed == NO) {
+            if ((eol = memchr(start, '\n', end - start)))
+                eol++;
+            else if (n == 0)
+                eol = end;
+            else
+                break;
+            scanLine(&scanner, start, eol - start);
+            start = eol;
+        }
+        length = end - start;
+        if (n == 0)
+            break;
+        if (length == SECTION_BUFFER_SIZE) {
+            // synctex lines are short, this cannot be a valid file
+            scanner.failed = YES;
+            break;
+        }
+        memmove(buffer, start, length);
+    }
+    
+    // a file that is still being written ends in the middle of a page
+    if (scanner.state == SKSyncTeXSectionPage || scanner.state == SKSyncTeXSectionPreamble)
+        scanner.failed = YES;
+    
+    free(buffer);
+    [scanner.pageData release];
+    gzclose(gzfile);
+    
+    return scanner.failed == NO;
+}
+
+static inline void getRecordExtent(const SKSyncTeXRecord *record, CGFloat *minX, CGFloat *maxX, CGFloat *minY, CGFloat *maxY) {
+    *minX = record->h;
+    *maxX = record->h + record->width;
+    *minY = MIN(record->v - record->height, record->v + record->depth);
+    *maxY = MAX(record->v - record->height, record->v + record->depth);
+}
+
+static inline NSUInteger cellIndex(CGFloat value, CGFloat origin, CGFloat size, NSUInteger count) {
+    return MIN((NSUInteger)MAX(floor((value - origin) / size), 0.0), count - 1);
+}
+
+static SKSyncTeXGrid *createGrid(const SKSyncTeXRecord *records, NSUInteger start, NSUInteger end) {
+    SKSyncTeXGrid *grid = (SKSyncTeXGrid *)calloc(1, sizeof(SKSyncTeXGrid));
+    NSUInteger i, count = end - start, cellCount, column, row;
+    CGFloat minX = CGFLOAT_MAX, maxX = -CGFLOAT_MAX, minY = CGFLOAT_MAX, maxY = -CGFLOAT_MAX, x0, x1, y0, y1;
+    uint32_t *fill;
+    
+    if (grid == NULL)
+        return NULL;
+    
+    for (i = start; i < end; i++) {
+        getRecordExtent(records + i, &x0, &x1, &y0, &y1);
+        minX = MIN(minX, x0);
+        maxX = MAX(maxX, x1);
+        minY = MIN(minY, y0);
+        maxY = MAX(maxY, y1);
+    }
+    
+    // aim for a few records per cell, text lines are wide so we use fewer columns than rows
+    grid->rows = MIN(MAX((NSUInteger)ceil(sqrt(count)), 1ul), (NSUInteger)MAX_GRID_ROWS);
+    grid->columns = MIN(MAX(count / (4 * grid->rows), 1ul), (NSUInteger)MAX_GRID_COLUMNS);
+    grid->minX = minX;
+    grid->minY = minY;
+    grid->cellWidth = MAX((maxX - minX) / grid->columns, 1.0);
+    grid->cellHeight = MAX((maxY - minY) / grid->rows, 1.0);
+    cellCount = grid->columns * grid->rows;
+    
+    grid->cellOffsets = (uint32_t *)calloc(cellCount + 1, sizeof(uint32_t));
+    grid->subtreeEnds = (uint32_t *)malloc(MAX(count, 1ul) * sizeof(uint32_t));
+    if (grid->cellOffsets == NULL || grid->subtreeEnds == NULL) {
+        freeGrid(grid);
+        return NULL;
+    }
+    
+    // count the records overlapping each cell, then fill the cells in page order
+    for (i = start; i < end; i++) {
+        getRecordExtent(records + i, &x0, &x1, &y0, &y1);
+        for (row = cellIndex(y0, minY, grid->cellHeight, grid->rows); row <= cellIndex(y1, minY, grid->cellHeight, grid->rows); row++) {
+            for (column = cellIndex(x0, minX, grid->cellWidth, grid->columns); column <= cellIndex(x1, minX, grid->cellWidth, grid->columns); column++)
+                grid->cellOffsets[row * grid->columns + column + 1]++;
+        }
+    }
+    for (i = 0; i < cellCount; i++)
+        grid->cellOffsets[i + 1] += grid->cellOffsets[i];
+    grid->cellRecords = (uint32_t *)malloc(MAX(grid->cellOffsets[cellCount], 1u) * sizeof(uint32_t));
+    fill = (uint32_t *)malloc(cellCount * sizeof(uint32_t));
+    if (grid->cellRecords == NULL || fill == NULL) {
+        free(fill);
+        freeGrid(grid);
+        return NULL;
+    }
+    memcpy(fill, grid->cellOffsets, cellCount * sizeof(uint32_t));
+    for (i = start; i < end; i++) {
+        getRecordExtent(records + i, &x0, &x1, &y0, &y1);
+        for (row = cellIndex(y0, minY, grid->cellHeight, grid->rows); row <= cellIndex(y1, minY, grid->cellHeight, grid->rows); row++) {
+            for (column = cellIndex(x0, minX, grid->cellWidth, grid->columns); column <= cellIndex(x1, minX, grid->cellWidth, grid->columns); column++)
+                grid->cellRecords[fill[row * grid->columns + column]++] = (uint32_t)i;
+        }
+    }
+    free(fill);
+    
+    // descendants follow their box in page order, so walking backwards finishes the children before their parent
+    for (i = end; i-- > start; )
+        grid->subtreeEnds[i - start] = (uint32_t)(i + 1);
+    for (i = end; i-- > start; ) {
+        int32_t parent = records[i].parent;
+        if (parent >= (int32_t)start && (NSUInteger)parent < i)
+            grid->subtreeEnds[parent - start] = MAX(grid->subtreeEnds[parent - start], grid->subtreeEnds[i - start]);
+    }
+    
+    return grid;
+}
+
+static void freeGrid(SKSyncTeXGrid *grid) {
+    if (grid) {
+        free(grid->cellOffsets);
+        free(grid->cellRecords);
+        free(grid->subtreeEnds);
+        free(grid);
+    }
+}
+
+static int32_t addRecord(SKSyncTeXBuilder *builder, const SKSyncTeXRecord *record) {
+    if (builder->count >= builder->capacity) {
+        NSUInteger newCapacity = MAX(2 * builder->capacity, (NSUInteger)MIN_RECORD_CAPACITY);
+        SKSyncTeXRecord *newRecords = (SKSyncTeXRecord *)realloc(builder->records, newCapacity * sizeof(SKSyncTeXRecord));
+        if (newRecords == NULL)
+            return -1;
+        builder->records = newRecords;
+        builder->capacity = newCapacity;
+    }
+    builder->records[builder->count] = *record;
+    return (int32_t)builder->count++;
+}
+
+static void addNodes(SKSyncTeXBuilder *builder, synctex_node_p node, int32_t parent, int32_t pageIndex) {
+    for (; node; node = synctex_node_sibling(node)) {
+        SKSyncTeXRecord record;
+        BOOL isBox = NO;
+        int32_t recordIndex;
+        
+        switch (synctex_node_type(node)) {
+            case synctex_node_type_hbox:
+            case synctex_node_type_proxy_hbox:
+                record.type = SKSyncTeXRecordTypeHBox;
+                isBox = YES;
+                break;
+            case synctex_node_type_vbox:
+            case synctex_node_type_proxy_vbox:
+                record.type = SKSyncTeXRecordTypeVBox;
+                isBox = YES;
+                break;
+            case synctex_node_type_void_hbox:
+            case synctex_node_type_void_vbox:
+            case synctex_node_type_kern:
+            case synctex_node_type_glue:
+            case synctex_node_type_rule:
+            case synctex_node_type_math:
+            case synctex_node_type_boundary:
+            case synctex_node_type_box_bdry:
+            case synctex_node_type_proxy:
+            case synctex_node_type_proxy_last:
+                record.type = SKSyncTeXRecordTypeLeaf;
+                break;
+            default:
+                continue;
+        }
+        
+        record.tag = synctex_node_tag(node);
+        record.line = synctex_node_line(node);
+        record.pageIndex = pageIndex;
+        record.parent = parent;
+        if (isBox) {
+            record.h = synctex_node_box_visible_h(node);
+            record.v = synctex_node_box_visible_v(node);
+            record.width = synctex_node_box_visible_width(node);
+            record.height = synctex_node_box_visible_height(node);
+            record.depth = synctex_node_box_visible_depth(node);
+        } else {
+            record.h = synctex_node_visible_h(node);
+            record.v = synctex_node_visible_v(node);
+            record.width = synctex_node_visible_width(node);
+            record.height = synctex_node_visible_height(node);
+            record.depth = synctex_node_visible_depth(node);
+        }
+        if (record.width < 0.0) {
+            record.h += record.width;
+            record.width = -record.width;
+        }
+        
+        recordIndex = addRecord(builder, &record);
+        if (recordIndex == -1)
+            return;
+        if (isBox)
+            addNodes(builder, synctex_node_child(node), recordIndex, pageIndex);
+    }
+}
+
+static int compareSheets(const void *item1, const void *item2) {
+    int page1 = synctex_node_page(*(synctex_node_p *)item1), page2 = synctex_node_page(*(synctex_node_p *)item2);
+    return page1 < page2 ? -1 : page1 > page2 ? 1 : 0;
+}
+
+static int compareInputs(const void *item1, const void *item2) {
+    int32_t tag1 = ((const SKSyncTeXInput *)item1)->tag, tag2 = ((const SKSyncTeXInput *)item2)->tag;
+    return tag1 < tag2 ? -1 : tag1 > tag2 ? 1 : 0;
+}
+
+static int compareLineRecords(void *context, const void *item1, const void *item2) {
+    const SKSyncTeXRecord *records = (const SKSyncTeXRecord *)context;
+    uint32_t i1 = *(const uint32_t *)item1, i2 = *(const uint32_t *)item2;
+    const SKSyncTeXRecord *record1 = records + i1, *record2 = records + i2;
+    BOOL isBox1 = record1->type != SKSyncTeXRecordTypeLeaf, isBox2 = record2->type != SKSyncTeXRecordTypeLeaf;
+    if (record1->line != record2->line)
+        return record1->line < record2->line ? -1 : 1;
+    else if (isBox1 != isBox2)
+        return isBox1 ? 1 : -1;
+    else if (record1->pageIndex != record2->pageIndex)
+        return record1->pageIndex < record2->pageIndex ? -1 : 1;
+    else if (record1->v != record2->v)
+        return record1->v < record2->v ? -1 : 1;
+    else if (record1->h != record2->h)
+        return record1->h < record2->h ? -1 : 1;
+    else
+        return i1 < i2 ? -1 : i1 > i2 ? 1 : 0;
+}
+
+static uint64_t appendSection(NSMutableData *indexData, const void *bytes, NSUInteger length) {
+    NSUInteger padding = (8 - [indexData length] % 8) % 8;
+    if (padding)
+        [indexData increaseLengthBy:padding];
+    uint64_t offset = [indexData length];
+    if (length)
+        [indexData appendBytes:bytes length:length];
+    return offset;
+}
+
+static NSData *createIndexData(synctex_scanner_p scanner, SKSyncTeXIndex *oldIndex, const NSInteger *oldPageIndexes, NSUInteger oldPageIndexCount, const SKSyncTeXSections *sections, SKSyncTeXFileSignature signature) {
+    SKSyncTeXBuilder builder = {NULL, 0, 0};
+    SKSyncTeXIndexHeader header;
+    NSMutableData *namesData = [[NSMutableData alloc] init];
+    SKSyncTeXInput *inputs = NULL;
+    NSUInteger i, j, inputCount = 0, inputCapacity = 0, sheetCount = 0, sheetCapacity = 0, pageCount = 0;
+    synctex_node_p *sheets = NULL;
+    synctex_node_p node;
+    uint32_t *pageOffsets, *lineOffsets, *lineRecords, *cursors;
+    uint64_t *pageHashes;
+    const char *name;
+    NSMutableData *indexData;
+    
+    // the inputs, sorted by tag
+    if ((node = synctex_scanner_input(scanner))) {
+        do {
+            if ((name = synctex_scanner_get_name(scanner, synctex_node_tag(node)))) {
+                if (inputCount >= inputCapacity) {
+                    inputCapacity = MAX(2 * inputCapacity, 16ul);
+                    inputs = (SKSyncTeXInput *)realloc(inputs, inputCapacity * sizeof(SKSyncTeXInput));
+                }
+                inputs[inputCount].tag = synctex_node_tag(node);
+                inputs[inputCount].nameOffset = (uint32_t)[namesData length];
+                [namesData appendBytes:name length:strlen(name) + 1];
+                inputCount++;
+            }
+        } while ((node = synctex_node_next(node)));
+    }
+    if (inputCount > 1)
+        qsort(inputs, inputCount, sizeof(SKSyncTeXInput), &compareInputs);
+    
+    // the sheets, sorted by page, so the records for a page are contiguous
+    if ((node = synctex_sheet(scanner, 0))) {
+        do {
+            if (synctex_node_page(node) <= 0)
+                continue;
+            if (sheetCount >= sheetCapacity) {
+                sheetCapacity = MAX(2 * sheetCapacity, 64ul);
+                sheets = (synctex_node_p *)realloc(sheets, sheetCapacity * sizeof(synctex_node_p));
+            }
+            sheets[sheetCount++] = node;
+        } while ((node = synctex_node_sibling(node)));
+    }
+    if (sheetCount > 1)
+        qsort(sheets, sheetCount, sizeof(synctex_node_p), &compareSheets);
+    
+    if (sheetCount > 0)
+        pageCount = synctex_node_page(sheets[sheetCount - 1]);
+    pageCount = MAX(pageCount, MAX(sections->pageCount, oldPageIndexCount));
+    
+    // unchanged pages are copied from the old index, the others come from the scanner
+    for (i = 0, j = 0; i < pageCount; i++) {
+        NSInteger oldPageIndex = i < oldPageIndexCount ? oldPageIndexes[i] : -1;
+        while (j < sheetCount && synctex_node_page(sheets[j]) - 1 < (int)i)
+            j++;
+        if (oldPageIndex >= 0) {
+            NSRange range = [oldIndex rangeOfRecordsForPageAtIndex:oldPageIndex];
+            int32_t start = (int32_t)builder.count;
+            NSUInteger k;
+            // parents are on the same page, so we only need to shift them
+            for (k = range.location; k < NSMaxRange(range); k++) {
+                SKSyncTeXRecord record = *[oldIndex recordAtIndex:k];
+                record.pageIndex = (int32_t)i;
+                if (record.parent >= 0)
+                    record.parent += start - (int32_t)range.location;
+                if (addRecord(&builder, &record) == -1)
+                    break;
+            }
+        } else {
+            for (; j < sheetCount && synctex_node_page(sheets[j]) - 1 == (int)i; j++)
+                addNodes(&builder, synctex_node_child(sheets[j]), -1, (int32_t)i);
+        }
+    }
+    free(sheets);
+    
+    pageHashes = (uint64_t *)calloc(MAX(pageCount, 1ul), sizeof(uint64_t));
+    if (sections->pageCount)
+        memcpy(pageHashes, sections->pageHashes, sections->pageCount * sizeof(uint64_t));
+    
+    pageOffsets = (uint32_t *)calloc(pageCount + 1, sizeof(uint32_t));
+    for (i = 0; i < builder.count; i++)
+        pageOffsets[builder.records[i].pageIndex + 1]++;
+    for (i = 0; i < pageCount; i++)
+        pageOffsets[i + 1] += pageOffsets[i];
+    
+    // bucket the records by input, and sort them by line
+    lineOffsets = (uint32_t *)calloc(inputCount + 1, sizeof(uint32_t));
+    cursors = (uint32_t *)malloc((builder.count + 1) * sizeof(uint32_t));
+    for (i = 0; i < builder.count; i++) {
+        SKSyncTeXInput key = {builder.records[i].tag, 0};
+        SKSyncTeXInput *input = inputCount ? bsearch(&key, inputs, inputCount, sizeof(SKSyncTeXInput), &compareInputs) : NULL;
+        // temporarily store the input index for the record
+        cursors[i] = input ? (uint32_t)(input - inputs) : UINT32_MAX;
+        if (input)
+            lineOffsets[input - inputs + 1]++;
+    }
+    for (i = 0; i < inputCount; i++)
+        lineOffsets[i + 1] += lineOffsets[i];
+    lineRecords = (uint32_t *)malloc(MAX(lineOffsets[inputCount], 1u) * sizeof(uint32_t));
+    {
+        uint32_t *fill = (uint32_t *)malloc((inputCount + 1) * sizeof(uint32_t));
+        memcpy(fill, lineOffsets, (inputCount + 1) * sizeof(uint32_t));
+        for (i = 0; i < builder.count; i++) {
+            if (cursors[i] != UINT32_MAX)
+                lineRecords[fill[cursors[i]]++] = (uint32_t)i;
+        }
+        free(fill);
+    }
+    free(cursors);
+    for (i = 0; i < inputCount; i++) {
+        if (lineOffsets[i + 1] - lineOffsets[i] > 1)
+            qsort_r(lineRecords + lineOffsets[i], lineOffsets[i + 1] - lineOffsets[i], sizeof(uint32_t), builder.records, &compareLineRecords);
+    }
+    
+    memset(&header, 0, sizeof(SKSyncTeXIndexHeader));
+    memcpy(header.magic, SKSyncTeXIndexMagic, sizeof(header.magic));
+    header.version = SKSyncTeXIndexVersion;
+    header.recordSize = sizeof(SKSyncTeXRecord);
+    header.signature = signature;
+    header.inputCount = (uint32_t)inputCount;
+    header.pageCount = (uint32_t)pageCount;
+    header.recordCount = (uint32_t)builder.count;
+    header.lineRecordCount = lineOffsets[inputCount];
+    header.namesLength = [namesData length];
+    header.skeletonHash = sections->skeletonHash;
+    
+    indexData = [[NSMutableData alloc] initWithLength:sizeof(SKSyncTeXIndexHeader)];
+    header.recordsOffset = appendSection(indexData, builder.records, builder.count * sizeof(SKSyncTeXRecord));
+    header.inputsOffset = appendSection(indexData, inputs, inputCount * sizeof(SKSyncTeXInput));
+    header.pageOffsetsOffset = appendSection(indexData, pageOffsets, (pageCount + 1) * sizeof(uint32_t));
+    header.lineOffsetsOffset = appendSection(indexData, lineOffsets, (inputCount + 1) * sizeof(uint32_t));
+    header.lineRecordsOffset = appendSection(indexData, lineRecords, lineOffsets[inputCount] * sizeof(uint32_t));
+    header.pageHashesOffset = appendSection(indexData, pageHashes, pageCount * sizeof(uint64_t));
+    header.namesOffset = appendSection(indexData, [namesData bytes], [namesData length]);
+    memcpy([indexData mutableBytes], &header, sizeof(SKSyncTeXIndexHeader));
+    
+    free(builder.records);
+    free(inputs);
+    free(pageOffsets);
+    free(lineOffsets);
+    free(lineRecords);
+    free(pageHashes);
+    [namesData release];
+    
+    return indexData;
+}
@@ -1,10 +1,10 @@
 //
-//  SKPDFSyncRecord.m
+//  SKTemplateKeyPath.h
 //  Skim
 //
-//  Created by Christiaan Hofman on 7/12/08.
+//  Created by Christiaan Hofman on 12/22/20.
 /*
- This software is Copyright (c) 2008-2020
+ This software is Copyright (c) 2020
  Christiaan Hofman. All rights reserved.
 
  Redistribution and use in source and binary forms, with or without
@@ -36,38 +36,29 @@
  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#import "SKPDFSyncRecord.h"
-#import "NSPointerArray_SKExtensions.h"
+#import <Cocoa/Cocoa.h>
 
+typedef NS_ENUM(NSInteger, SKTemplateKeyPathRoot) {
+    SKTemplateKeyPathRootObject,
+    SKTemplateKeyPathRootIndex,
+    SKTemplateKeyPathRootApplication,
+    SKTemplateKeyPathRootInvalid
+};
 
-@implementation SKPDFSyncRecord
+typedef struct _SKTemplateKey SKTemplateKey;
 
-@synthesize recordIndex, pageIndex, point, file, line;
-@dynamic x, y;
-
-- (id)initWithRecordIndex:(NSInteger)aRecordIndex {
-    self = [super init];
-    if (self) {
-        recordIndex = aRecordIndex;
-        pageIndex = NSNotFound;
-        point = NSZeroPoint;
-        file = nil;
-        line = -1;
-    }
-    return self;
+// A template key path parsed once, so it can be evaluated many times without parsing it again
+// Plain keys are evaluated by calling the getter through an IMP cached per class
+@interface SKTemplateKeyPath : NSObject {
+    SKTemplateKeyPathRoot root;
+    NSString *keyPath;
+    SKTemplateKey *keys;
+    NSUInteger keyCount;
+    SKTemplateKeyPath *trailingKeyPath;
 }
 
-- (void)dealloc {
-    SKDESTROY(file);
-    [super dealloc];
-}
+- (id)initWithKeyPath:(NSString *)aKeyPath;
 
-- (CGFloat)x {
-    return point.x;
-}
-
-- (CGFloat)y {
-    return point.y;
-}
+- (id)valueForObject:(id)object atIndex:(NSInteger)anIndex;
 
 @end
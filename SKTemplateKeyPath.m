@@ -0,0 +1,227 @@
+//
+//  SKTemplateKeyPath.m
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKTemplateKeyPath.h"
+#import <objc/runtime.h>
+
+struct _SKTemplateKey {
+    SEL selector;
+    SEL getSelector;
+    NSString *remainingKeyPath;
+    NSMapTable *accessors;
+};
+
+typedef struct _SKTemplateAccessor {
+    IMP imp;
+    char returnType;
+} SKTemplateAccessor;
+
+static IMP objectValueForKeyIMP = NULL;
+static IMP objectValueForKeyPathIMP = NULL;
+
+static NSSet *arrayOperators = nil;
+
+static SKTemplateAccessor *accessorForClass(SKTemplateKey *key, Class cls) {
+    SKTemplateAccessor *accessor = (SKTemplateAccessor *)NSMapGet(key->accessors, cls);
+    if (accessor == NULL) {
+        accessor = (SKTemplateAccessor *)NSZoneMalloc(NSDefaultMallocZone(), sizeof(SKTemplateAccessor));
+        accessor->imp = NULL;
+        accessor->returnType = 0;
+        // only call the getter directly when KVC would do the same, otherwise use KVC for this and the remaining keys
+        if (key->getSelector != NULL &&
+            class_getMethodImplementation(cls, @selector(valueForKey:)) == objectValueForKeyIMP &&
+            class_getMethodImplementation(cls, @selector(valueForKeyPath:)) == objectValueForKeyPathIMP &&
+            class_getInstanceMethod(cls, key->getSelector) == NULL) {
+            Method method = class_getInstanceMethod(cls, key->selector);
+            if (method && method_getNumberOfArguments(method) == 2) {
+                char type[4];
+                method_getReturnType(method, type, sizeof(type));
+                if (type[0] != 0 && type[1] == 0 && strchr("@cCsSiIlLqQfdB", type[0])) {
+                    accessor->imp = method_getImplementation(method);
+                    accessor->returnType = type[0];
+                }
+            }
+        }
+        NSMapInsert(key->accessors, cls, accessor);
+    }
+    return accessor;
+}
+
+static inline id callAccessor(SKTemplateAccessor *accessor, id object, SEL selector) {
+    IMP imp = accessor->imp;
+    switch (accessor->returnType) {
+        case '@': return ((id (*)(id, SEL))imp)(object, selector);
+        case 'c': return [NSNumber numberWithChar:((char (*)(id, SEL))imp)(object, selector)];
+        case 'C': return [NSNumber numberWithUnsignedChar:((unsigned char (*)(id, SEL))imp)(object, selector)];
+        case 's': return [NSNumber numberWithShort:((short (*)(id, SEL))imp)(object, selector)];
+        case 'S': return [NSNumber numberWithUnsignedShort:((unsigned short (*)(id, SEL))imp)(object, selector)];
+        case 'i': return [NSNumber numberWithInt:((int (*)(id, SEL))imp)(object, selector)];
+        case 'I': return [NSNumber numberWithUnsignedInt:((unsigned int (*)(id, SEL))imp)(object, selector)];
+        case 'l': return [NSNumber numberWithLong:((long (*)(id, SEL))imp)(object, selector)];
+        case 'L': return [NSNumber numberWithUnsignedLong:((unsigned long (*)(id, SEL))imp)(object, selector)];
+        case 'q': return [NSNumber numberWithLongLong:((long long (*)(id, SEL))imp)(object, selector)];
+        case 'Q': return [NSNumber numberWithUnsignedLongLong:((unsigned long long (*)(id, SEL))imp)(object, selector)];
+        case 'f': return [NSNumber numberWithFloat:((float (*)(id, SEL))imp)(object, selector)];
+        case 'd': return [NSNumber numberWithDouble:((double (*)(id, SEL))imp)(object, selector)];
+        case 'B': return [NSNumber numberWithBool:((BOOL (*)(id, SEL))imp)(object, selector)];
+        default: return nil;
+    }
+}
+
+@implementation SKTemplateKeyPath
+
++ (void)initialize {
+    SKINITIALIZE;
+    objectValueForKeyIMP = class_getMethodImplementation([NSObject class], @selector(valueForKey:));
+    objectValueForKeyPathIMP = class_getMethodImplementation([NSObject class], @selector(valueForKeyPath:));
+    arrayOperators = [[NSSet alloc] initWithObjects:@"@avg", @"@max", @"@min", @"@sum", @"@distinctUnionOfArrays", @"@distinctUnionOfObjects", @"@distinctUnionOfSets", @"@unionOfArrays", @"@unionOfObjects", @"@unionOfSets", nil];
+}
+
+- (id)initWithKeyPath:(NSString *)aKeyPath {
+    self = [super init];
+    if (self) {
+        root = SKTemplateKeyPathRootObject;
+        keys = NULL;
+        keyCount = 0;
+        trailingKeyPath = nil;
+        
+        if ([aKeyPath hasPrefix:@"#"]) {
+            root = SKTemplateKeyPathRootIndex;
+            if ([aKeyPath length] == 1)
+                aKeyPath = nil;
+            else if ([aKeyPath hasPrefix:@"#."] == NO || [aKeyPath length] < 3)
+                root = SKTemplateKeyPathRootInvalid;
+            else
+                aKeyPath = [aKeyPath substringFromIndex:2];
+        } else if ([aKeyPath hasPrefix:@"."]) {
+            root = SKTemplateKeyPathRootApplication;
+            if ([aKeyPath length] == 1)
+                root = SKTemplateKeyPathRootInvalid;
+            else
+                aKeyPath = [aKeyPath substringFromIndex:1];
+        }
+        
+        if (root != SKTemplateKeyPathRootInvalid && aKeyPath) {
+            NSUInteger atIndex = [aKeyPath rangeOfString:@"@"].location;
+            if (atIndex != NSNotFound) {
+                // a key starting with @ that is not an array operator ends the KVC key path, the rest is evaluated separately
+                NSUInteger dotIndex = [aKeyPath rangeOfString:@"." options:0 range:NSMakeRange(atIndex + 1, [aKeyPath length] - atIndex - 1)].location;
+                if (dotIndex != NSNotFound && [arrayOperators containsObject:[aKeyPath substringWithRange:NSMakeRange(atIndex, dotIndex - atIndex)]] == NO) {
+                    trailingKeyPath = [[SKTemplateKeyPath alloc] initWithKeyPath:[aKeyPath substringFromIndex:dotIndex + 1]];
+                    aKeyPath = [aKeyPath substringToIndex:dotIndex];
+                }
+            } else if ([aKeyPath length] > 0) {
+                NSArray *components = [aKeyPath componentsSeparatedByString:@"."];
+                NSUInteger i;
+                keyCount = [components count];
+                keys = (SKTemplateKey *)NSZoneCalloc(NSDefaultMallocZone(), keyCount, sizeof(SKTemplateKey));
+                for (i = 0; i < keyCount; i++) {
+                    NSString *key = [components objectAtIndex:i];
+                    keys[i].selector = NSSelectorFromString(key);
+                    keys[i].getSelector = [key length] > 0 ? NSSelectorFromString([@"get" stringByAppendingString:[key stringByReplacingCharactersInRange:NSMakeRange(0, 1) withString:[[key substringToIndex:1] uppercaseString]]]) : NULL;
+                    keys[i].remainingKeyPath = [[[components subarrayWithRange:NSMakeRange(i, keyCount - i)] componentsJoinedByString:@"."] retain];
+                    keys[i].accessors = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSOwnedPointerMapValueCallBacks, 0);
+                }
+            }
+            keyPath = [aKeyPath copy];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    NSUInteger i;
+    for (i = 0; i < keyCount; i++) {
+        SKDESTROY(keys[i].remainingKeyPath);
+        NSFreeMapTable(keys[i].accessors);
+    }
+    SKZONEDESTROY(keys);
+    SKDESTROY(keyPath);
+    SKDESTROY(trailingKeyPath);
+    [super dealloc];
+}
+
+- (id)valueForObject:(id)object atIndex:(NSInteger)anIndex {
+    id value = nil;
+    
+    switch (root) {
+        case SKTemplateKeyPathRootIndex:
+            if (anIndex <= 0)
+                return nil;
+            object = [NSNumber numberWithInteger:anIndex];
+            if (keyPath == nil)
+                return object;
+            break;
+        case SKTemplateKeyPathRootApplication:
+            object = NSApp;
+            break;
+        case SKTemplateKeyPathRootInvalid:
+            return nil;
+        default:
+            break;
+    }
+    if (object == nil)
+        return nil;
+    
+    if (keys) {
+        NSUInteger i;
+        value = object;
+        // accessors can raise just like valueForKeyPath:, e.g. for invalid ranges
+        @try{
+            for (i = 0; i < keyCount && value; i++) {
+                SKTemplateKey *key = &keys[i];
+                SKTemplateAccessor *accessor = accessorForClass(key, object_getClass(value));
+                if (accessor->imp) {
+                    value = callAccessor(accessor, value, key->selector);
+                } else {
+                    value = [value valueForKeyPath:key->remainingKeyPath];
+                    break;
+                }
+            }
+        }
+        @catch(id exception) { value = nil; }
+    } else {
+        @try{ value = [object valueForKeyPath:keyPath]; }
+        @catch(id exception) { value = nil; }
+    }
+    if (trailingKeyPath)
+        value = [trailingKeyPath valueForObject:value atIndex:0];
+    return value;
+}
+
+@end
@@ -41,6 +41,7 @@
 
 @interface SKTemplateManager : NSObject {
     NSArray *customTemplateTypes;
+    NSMutableDictionary *compiledTemplates;
 }
 
 + (id)sharedManager;
@@ -51,6 +52,10 @@
 
 - (NSURL *)URLForTemplateType:(NSString *)typeName;
 
+// returns the parsed template for the template type, cached until the template file changes
+// the document attributes are only returned for rich text templates
+- (NSArray *)templateForTemplateType:(NSString *)typeName documentAttributes:(NSDictionary **)docAttributes;
+
 - (NSString *)fileNameExtensionForTemplateType:(NSString *)typeName;
 - (NSString *)displayNameForTemplateType:(NSString *)typeName;
 - (NSString *)templateTypeForDisplayName:(NSString *)name;
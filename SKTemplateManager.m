@@ -37,11 +37,27 @@
  */
 
 #import "SKTemplateManager.h"
+#import "SKTemplateParser.h"
 #import "NSFileManager_SKExtensions.h"
 #import "NSString_SKExtensions.h"
 
 #define TEMPLATES_DIRECTORY @"Templates"
 
+@interface SKCompiledTemplate : NSObject {
+    NSArray *template;
+    NSDictionary *documentAttributes;
+    NSDate *modificationDate;
+}
+
+- (id)initWithURL:(NSURL *)aURL isRichText:(BOOL)isRichText modificationDate:(NSDate *)aModDate;
+
+@property (nonatomic, readonly) NSArray *template;
+@property (nonatomic, readonly) NSDictionary *documentAttributes;
+@property (nonatomic, readonly) NSDate *modificationDate;
+
+@end
+
+#pragma mark -
 
 @implementation SKTemplateManager
 
@@ -56,6 +72,7 @@
 
 - (void)dealloc {
     SKDESTROY(customTemplateTypes);
+    SKDESTROY(compiledTemplates);
     [super dealloc];
 }
 
@@ -85,6 +102,7 @@
 
 - (void)resetCustomTemplateTypes {
     SKDESTROY(customTemplateTypes);
+    [compiledTemplates removeAllObjects];
 }
 
 - (NSURL *)URLForTemplateType:(NSString *)typeName {
@@ -101,6 +119,29 @@
     return url;
 }
 
+- (NSArray *)templateForTemplateType:(NSString *)typeName documentAttributes:(NSDictionary **)docAttributes {
+    NSURL *url = [self URLForTemplateType:typeName];
+    NSDate *modDate = nil;
+    SKCompiledTemplate *compiledTemplate = nil;
+    
+    if (url == nil)
+        return nil;
+    
+    [url getResourceValue:&modDate forKey:NSURLContentModificationDateKey error:NULL];
+    compiledTemplate = [compiledTemplates objectForKey:url];
+    if (compiledTemplate == nil || modDate == nil || [[compiledTemplate modificationDate] isEqualToDate:modDate] == NO) {
+        compiledTemplate = [[SKCompiledTemplate alloc] initWithURL:url isRichText:[self isRichTextTemplateType:typeName] modificationDate:modDate];
+        if (compiledTemplates == nil)
+            compiledTemplates = [[NSMutableDictionary alloc] init];
+        [compiledTemplates setObject:compiledTemplate forKey:url];
+        [compiledTemplate release];
+    }
+    
+    if (docAttributes)
+        *docAttributes = [compiledTemplate documentAttributes];
+    return [compiledTemplate template];
+}
+
 - (NSString *)fileNameExtensionForTemplateType:(NSString *)typeName {
     return [[self customTemplateTypes] containsObject:typeName] ? [typeName pathExtension] : nil;
 }
@@ -129,3 +170,39 @@
 }
 
 @end
+
+#pragma mark -
+
+@implementation SKCompiledTemplate
+
+@synthesize template, documentAttributes, modificationDate;
+
+- (id)initWithURL:(NSURL *)aURL isRichText:(BOOL)isRichText modificationDate:(NSDate *)aModDate {
+    self = [super init];
+    if (self) {
+        if (isRichText) {
+            NSDictionary *docAttributes = nil;
+            NSAttributedString *templateAttrString = [[NSAttributedString alloc] initWithURL:aURL options:[NSDictionary dictionary] documentAttributes:&docAttributes error:NULL];
+            if (templateAttrString)
+                template = [[SKTemplateParser compiledArrayByParsingTemplateAttributedString:templateAttrString] retain];
+            documentAttributes = [docAttributes copy];
+            [templateAttrString release];
+        } else {
+            NSString *templateString = [[NSString alloc] initWithContentsOfURL:aURL encoding:NSUTF8StringEncoding error:NULL];
+            if (templateString)
+                template = [[SKTemplateParser compiledArrayByParsingTemplateString:templateString] retain];
+            [templateString release];
+        }
+        modificationDate = [aModDate retain];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    SKDESTROY(template);
+    SKDESTROY(documentAttributes);
+    SKDESTROY(modificationDate);
+    [super dealloc];
+}
+
+@end
@@ -45,11 +45,19 @@
 + (NSArray *)arrayByParsingTemplateString:(NSString *)templateString;
 + (NSArray *)arrayByParsingTemplateString:(NSString *)templateString isSubtemplate:(BOOL)isSubtemplate;
 + (NSString *)stringFromTemplateArray:(NSArray *)templateArray usingObject:(id)object atIndex:(NSInteger)anIndex;
+// renders the template straight to the file as UTF-8, without building the complete string in memory
++ (BOOL)writeTemplateArray:(NSArray *)templateArray usingObject:(id)object toURL:(NSURL *)url error:(NSError **)outError;
+
+// also parses all subtemplates, so the returned template is not changed when it is used and can be reused
++ (NSArray *)compiledArrayByParsingTemplateString:(NSString *)templateString;
++ (NSArray *)compiledArrayByParsingTemplateAttributedString:(NSAttributedString *)templateAttrString;
 
 + (NSAttributedString *)attributedStringByParsingTemplateAttributedString:(NSAttributedString *)templateAttrString usingObject:(id)object;
 + (NSArray *)arrayByParsingTemplateAttributedString:(NSAttributedString *)templateAttrString;
 + (NSArray *)arrayByParsingTemplateAttributedString:(NSAttributedString *)templateAttrString isSubtemplate:(BOOL)isSubtemplate;
 + (NSAttributedString *)attributedStringFromTemplateArray:(NSArray *)templateArray usingObject:(id)object atIndex:(NSInteger)anIndex;
+// renders the template straight to the file as RTF, a paragraph at a time
++ (BOOL)writeAttributedTemplateArray:(NSArray *)templateArray usingObject:(id)object documentAttributes:(NSDictionary *)docAttributes toURL:(NSURL *)url error:(NSError **)outError;
 
 @end
 
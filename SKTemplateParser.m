@@ -38,9 +38,12 @@
 
 #import "SKTemplateParser.h"
 #import "SKTemplateTag.h"
+#import "SKTemplateKeyPath.h"
 #import "NSString_SKExtensions.h"
 #import "PDFSelection_SKExtensions.h"
 #import "NSCharacterSet_SKExtensions.h"
+#import "SKRTFWriter.h"
+#import <fcntl.h>
 
 #define START_TAG_OPEN_DELIM            @"<$"
 #define END_TAG_OPEN_DELIM              @"</$"
@@ -81,6 +84,98 @@
                or: <$key!~value?> <?$key?> </$key?>
 */
 
+#define SINK_FLUSH_LENGTH 16384
+
+typedef struct _SKTemplateStringSink {
+    NSMutableString *string;
+    int fileDescriptor;
+    BOOL failed;
+    // the errno of a failed write, 0 when the text could not be converted
+    int errorNumber;
+} SKTemplateStringSink;
+
+typedef struct _SKTemplateAttributedStringSink {
+    NSMutableAttributedString *attributedString;
+    SKRTFWriter *writer;
+    // the length up to which we know there is no paragraph end
+    NSUInteger searchedLength;
+} SKTemplateAttributedStringSink;
+
+// writes the collected text as UTF-8 to the file, when the sink has a file descriptor
+static void flushStringSink(SKTemplateStringSink *sink) {
+    NSMutableString *string = sink->string;
+    NSUInteger length = [string length];
+    if (sink->fileDescriptor == -1 || length == 0)
+        return;
+    if (sink->failed == NO) {
+        char buffer[4096];
+        NSRange remainingRange = NSMakeRange(0, length);
+        NSUInteger usedLength;
+        while (remainingRange.length > 0 && sink->failed == NO) {
+            if ([string getBytes:buffer maxLength:sizeof(buffer) usedLength:&usedLength encoding:NSUTF8StringEncoding options:0 range:remainingRange remainingRange:&remainingRange] == NO) {
+                sink->failed = YES;
+                break;
+            }
+            const char *bytes = buffer;
+            while (usedLength > 0) {
+                ssize_t written = write(sink->fileDescriptor, bytes, usedLength);
+                if (written < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    sink->errorNumber = errno;
+                    sink->failed = YES;
+                    break;
+                }
+                bytes += written;
+                usedLength -= written;
+            }
+        }
+    }
+    [string setString:@""];
+}
+
+static inline void appendToStringSink(SKTemplateStringSink *sink, NSString *string) {
+    [sink->string appendString:string];
+    if (sink->fileDescriptor != -1 && [sink->string length] >= SINK_FLUSH_LENGTH)
+        flushStringSink(sink);
+}
+
+// passes the complete paragraphs with fixed attributes to the RTF writer, or everything when all is YES, when the sink has a writer
+static void flushAttributedStringSink(SKTemplateAttributedStringSink *sink, BOOL all) {
+    NSMutableAttributedString *attrString = sink->attributedString;
+    NSUInteger length = [attrString length];
+    if (sink->writer == nil || length == 0)
+        return;
+    if (all == NO) {
+        // fixing the paragraph attributes needs whole paragraphs
+        NSRange range = [[attrString string] rangeOfCharacterFromSet:[NSCharacterSet newlineCharacterSet] options:NSBackwardsSearch range:NSMakeRange(sink->searchedLength, length - sink->searchedLength)];
+        sink->searchedLength = length;
+        if (range.location == NSNotFound)
+            return;
+        length = NSMaxRange(range);
+    }
+    NSRange range = NSMakeRange(0, length);
+    [attrString fixAttributesInRange:range];
+    [sink->writer appendAttributedString:[attrString attributedSubstringFromRange:range]];
+    [attrString deleteCharactersInRange:range];
+    sink->searchedLength = 0;
+}
+
+static inline void appendToAttributedStringSink(SKTemplateAttributedStringSink *sink, NSAttributedString *attrString) {
+    [sink->attributedString appendAttributedString:attrString];
+    if (sink->writer != nil && [sink->attributedString length] >= SINK_FLUSH_LENGTH)
+        flushAttributedStringSink(sink, NO);
+}
+
+// a POSIX error when we know the errno, otherwise the text could not be converted
+static NSError *writeErrorForURL(NSURL *url, int errorNumber) {
+    NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:url, NSURLErrorKey, nil];
+    if (errorNumber != 0)
+        return [NSError errorWithDomain:NSPOSIXErrorDomain code:errorNumber userInfo:userInfo];
+    else
+        return [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:userInfo];
+}
+
 @implementation SKTemplateParser
 
 
@@ -205,46 +300,6 @@ static inline BOOL findAltConditionTag(NSString *template, NSString *altTag, NSS
     return altTagRange.location != NSNotFound;
 }
 
-static id templateValueForKeyPath(id object, NSString *keyPath, NSInteger anIndex) {
-    if ([keyPath hasPrefix:@"#"]) {
-        if (anIndex <= 0)
-            return nil;
-        object = [NSNumber numberWithInteger:anIndex];
-        if ([keyPath length] == 1)
-            return object;
-        if ([keyPath hasPrefix:@"#."] == NO || [keyPath length] < 3)
-            return nil;
-        keyPath = [keyPath substringFromIndex:2];
-    } else if ([keyPath hasPrefix:@"."]) {
-        if ([keyPath length] == 1)
-            return nil;
-        object = NSApp;
-        keyPath = [keyPath substringFromIndex:1];
-    }
-    if (object == nil)
-        return nil;
-    id value = nil;
-    NSString *trailingKeyPath = nil;
-    NSUInteger atIndex = [keyPath rangeOfString:@"@"].location;
-    if (atIndex != NSNotFound) {
-        NSUInteger dotIndex = [keyPath rangeOfString:@"." options:0 range:NSMakeRange(atIndex + 1, [keyPath length] - atIndex - 1)].location;
-        if (dotIndex != NSNotFound) {
-            static NSSet *arrayOperators = nil;
-            if (arrayOperators == nil)
-                arrayOperators = [[NSSet alloc] initWithObjects:@"@avg", @"@max", @"@min", @"@sum", @"@distinctUnionOfArrays", @"@distinctUnionOfObjects", @"@distinctUnionOfSets", @"@unionOfArrays", @"@unionOfObjects", @"@unionOfSets", nil];
-            if ([arrayOperators containsObject:[keyPath substringWithRange:NSMakeRange(atIndex, dotIndex - atIndex)]] == NO) {
-                trailingKeyPath = [keyPath substringFromIndex:dotIndex + 1];
-                keyPath = [keyPath substringToIndex:dotIndex];
-            }
-        }
-    }
-    @try{ value = [object valueForKeyPath:keyPath]; }
-    @catch(id exception) { value = nil; }
-    if (trailingKeyPath)
-        value = templateValueForKeyPath(value, trailingKeyPath, 0);
-    return value;
-}
-
 static inline BOOL matchesCondition(NSString *keyValue, NSString *matchString, SKTemplateTagMatchType matchType) {
     if ([matchString isEqualToString:@""]) {
         switch (matchType) {
@@ -472,40 +527,46 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
     return [result autorelease];    
 }
 
-+ (NSString *)stringFromTemplateArray:(NSArray *)template usingObject:(id)object atIndex:(NSInteger)anIndex {
-    NSMutableString *result = [[NSMutableString alloc] init];
-    
++ (NSArray *)compiledArrayByParsingTemplateString:(NSString *)template {
+    NSArray *result = [self arrayByParsingTemplateString:template isSubtemplate:NO];
+    [result makeObjectsPerformSelector:@selector(compile)];
+    return result;
+}
+
++ (void)appendStringFromTemplateArray:(NSArray *)template usingObject:(id)object atIndex:(NSInteger)anIndex toSink:(SKTemplateStringSink *)sink {
     for (id tag in template) {
         SKTemplateTagType type = [(SKTemplateTag *)tag type];
         
         if (type == SKTemplateTagText) {
             
-            [result appendString:[(SKTextTemplateTag *)tag text]];
+            appendToStringSink(sink, [(SKTextTemplateTag *)tag text]);
             
         } else {
             
-            NSString *keyPath = [tag keyPath];
-            id keyValue = templateValueForKeyPath(object, keyPath, anIndex);
+            id keyValue = [[tag compiledKeyPath] valueForObject:object atIndex:anIndex];
             
             if (type == SKTemplateTagValue) {
                 
                 if (keyValue)
-                    [result appendString:[keyValue templateStringValue]];
+                    appendToStringSink(sink, [keyValue templateStringValue]);
                 
             } else if (type == SKTemplateTagCollection) {
                 
-                NSArray *itemTemplate = nil;
+                NSArray *itemTemplate = [tag itemTemplate];
+                NSArray *separatorTemplate = [tag separatorTemplate];
                 NSInteger idx = 1;
                 id prevItem = nil;
                 
                 if ([keyValue conformsToProtocol:@protocol(NSFastEnumeration)]) {
                     for (id item in keyValue) {
                         if (prevItem) {
-                            if (itemTemplate == nil)
-                                itemTemplate = [[tag itemTemplate] arrayByAddingObjectsFromArray:[tag separatorTemplate]];
-                            keyValue = [self stringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx++];
-                            if (keyValue != nil)
-                                [result appendString:keyValue];
+                            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+                            // the separator is rendered with the previous item, like the item template
+                            [self appendStringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx toSink:sink];
+                            if (separatorTemplate)
+                                [self appendStringFromTemplateArray:separatorTemplate usingObject:prevItem atIndex:idx toSink:sink];
+                            idx++;
+                            [pool release];
                         }
                         prevItem = item;
                     }
@@ -513,24 +574,23 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
                     prevItem = keyValue;
                     idx = anIndex;
                 }
-                if (prevItem) {
-                    itemTemplate = [tag itemTemplate];
-                    keyValue = [self stringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx];
-                    if (keyValue != nil)
-                        [result appendString:keyValue];
-                }
+                if (prevItem)
+                    [self appendStringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx toSink:sink];
                 
             } else {
                 
                 NSString *matchString = nil;
                 NSArray *matchStrings = [tag matchStrings];
+                NSArray *matchKeyPaths = [tag matchKeyPaths];
                 NSUInteger i, count = [matchStrings count];
                 NSArray *subtemplate = nil;
                 
                 for (i = 0; i < count; i++) {
-                    matchString = [matchStrings objectAtIndex:i];
-                    if ([matchString hasPrefix:@"$"])
-                        matchString = [templateValueForKeyPath(object, [matchString substringFromIndex:1], anIndex) templateStringValue] ?: @"";
+                    id matchKeyPath = [matchKeyPaths objectAtIndex:i];
+                    if (matchKeyPath == [NSNull null])
+                        matchString = [matchStrings objectAtIndex:i];
+                    else
+                        matchString = [[matchKeyPath valueForObject:object atIndex:anIndex] templateStringValue] ?: @"";
                     if (matchesCondition(keyValue, matchString, [tag matchType])) {
                         subtemplate = [tag objectInSubtemplatesAtIndex:i];
                         break;
@@ -538,17 +598,44 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
                 }
                 if (subtemplate == nil && [tag countOfSubtemplates] > count)
                     subtemplate = [tag objectInSubtemplatesAtIndex:count];
-                if (subtemplate != nil) {
-                    if ((keyValue = [self stringFromTemplateArray:subtemplate usingObject:object atIndex:anIndex]))
-                        [result appendString:keyValue];
-                }
+                if (subtemplate != nil)
+                    [self appendStringFromTemplateArray:subtemplate usingObject:object atIndex:anIndex toSink:sink];
                 
             }
             
         }
     } // while
-    
-    return [result autorelease];    
+}
+
++ (NSString *)stringFromTemplateArray:(NSArray *)template usingObject:(id)object atIndex:(NSInteger)anIndex {
+    SKTemplateStringSink sink = {[NSMutableString string], -1, NO, 0};
+    [self appendStringFromTemplateArray:template usingObject:object atIndex:anIndex toSink:&sink];
+    return sink.string;
+}
+
++ (BOOL)writeTemplateArray:(NSArray *)template usingObject:(id)object toURL:(NSURL *)url error:(NSError **)outError {
+    const char *path = [[url path] fileSystemRepresentation];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int errorNumber = fd == -1 ? errno : 0;
+    BOOL didWrite = NO;
+    if (fd != -1) {
+        SKTemplateStringSink sink = {[[NSMutableString alloc] init], fd, NO, 0};
+        [self appendStringFromTemplateArray:template usingObject:object atIndex:0 toSink:&sink];
+        flushStringSink(&sink);
+        [sink.string release];
+        didWrite = sink.failed == NO;
+        errorNumber = sink.errorNumber;
+        if (close(fd) != 0 && didWrite) {
+            errorNumber = errno;
+            didWrite = NO;
+        }
+        // don't leave a partial file behind
+        if (didWrite == NO)
+            unlink(path);
+    }
+    if (didWrite == NO && outError)
+        *outError = writeErrorForURL(url, errorNumber);
+    return didWrite;
 }
 
 #pragma mark Parsing attributed string templates
@@ -719,6 +806,12 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
     return [result autorelease];    
 }
 
++ (NSArray *)compiledArrayByParsingTemplateAttributedString:(NSAttributedString *)template {
+    NSArray *result = [self arrayByParsingTemplateAttributedString:template isSubtemplate:NO];
+    [result makeObjectsPerformSelector:@selector(compile)];
+    return result;
+}
+
 + (id)attributeFromTemplate:(SKAttributeTemplate *)attributeTemplate usingObject:(id)object atIndex:(NSInteger)anIndex {
     id anAttribute = [self stringFromTemplateArray:[attributeTemplate template] usingObject:object atIndex:anIndex];
     if (anAttribute && [[attributeTemplate attributeClass] isSubclassOfClass:[NSURL class]]) {
@@ -728,9 +821,7 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
     return anAttribute;
 }
 
-+ (NSAttributedString *)attributedStringFromTemplateArray:(NSArray *)template usingObject:(id)object atIndex:(NSInteger)anIndex {
-    NSMutableAttributedString *result = [[NSMutableAttributedString alloc] init];
-    
++ (void)appendAttributedStringFromTemplateArray:(NSArray *)template usingObject:(id)object atIndex:(NSInteger)anIndex toSink:(SKTemplateAttributedStringSink *)sink {
     for (id tag in template) {
         SKTemplateTagType type = [(SKTemplateTag *)tag type];
         
@@ -749,16 +840,15 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
                     else
                         [tmpMutAttrStr removeAttribute:NSLinkAttributeName range:range];
                 }
-                [result appendAttributedString:tmpMutAttrStr];
+                appendToAttributedStringSink(sink, tmpMutAttrStr);
                 [tmpMutAttrStr release];
             } else {
-                [result appendAttributedString:tmpAttrStr];
+                appendToAttributedStringSink(sink, tmpAttrStr);
             }
             
         } else {
             
-            NSString *keyPath = [tag keyPath];
-            id keyValue = templateValueForKeyPath(object, keyPath, anIndex);
+            id keyValue = [[tag compiledKeyPath] valueForObject:object atIndex:anIndex];
             
             if (type == SKTemplateTagValue) {
                 
@@ -776,24 +866,26 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
                         tmpAttrStr = [keyValue templateAttributedStringValueWithAttributes:attrs];
                     }
                     if (tmpAttrStr != nil)
-                        [result appendAttributedString:tmpAttrStr];
+                        appendToAttributedStringSink(sink, tmpAttrStr);
                 }
                 
             } else if (type == SKTemplateTagCollection) {
                 
-                NSAttributedString *tmpAttrStr = nil;
-                NSArray *itemTemplate = nil;
+                NSArray *itemTemplate = [tag itemTemplate];
+                NSArray *separatorTemplate = [tag separatorTemplate];
                 NSInteger idx = 1;
                 id prevItem = nil;
                 
                 if ([keyValue conformsToProtocol:@protocol(NSFastEnumeration)]) {
                     for (id item in keyValue) {
                         if (prevItem) {
-                            if (itemTemplate == nil)
-                                itemTemplate = [[tag itemTemplate] arrayByAddingObjectsFromArray:[tag separatorTemplate]];
-                            tmpAttrStr = [self attributedStringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx++];
-                            if (tmpAttrStr != nil)
-                                [result appendAttributedString:tmpAttrStr];
+                            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+                            // the separator is rendered with the previous item, like the item template
+                            [self appendAttributedStringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx toSink:sink];
+                            if (separatorTemplate)
+                                [self appendAttributedStringFromTemplateArray:separatorTemplate usingObject:prevItem atIndex:idx toSink:sink];
+                            idx++;
+                            [pool release];
                         }
                         prevItem = item;
                     }
@@ -801,25 +893,24 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
                     prevItem = keyValue;
                     idx = anIndex;
                 }
-                if (prevItem) {
-                    itemTemplate = [tag itemTemplate];
-                    tmpAttrStr = [self attributedStringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx];
-                    if (tmpAttrStr != nil)
-                        [result appendAttributedString:tmpAttrStr];
-                }
+                if (prevItem)
+                    [self appendAttributedStringFromTemplateArray:itemTemplate usingObject:prevItem atIndex:idx toSink:sink];
                 
             } else {
                 
                 NSString *matchString = nil;
                 NSArray *matchStrings = [tag matchStrings];
+                NSArray *matchKeyPaths = [tag matchKeyPaths];
                 NSUInteger i, count = [matchStrings count];
                 NSArray *subtemplate = nil;
                 
                 subtemplate = nil;
                 for (i = 0; i < count; i++) {
-                    matchString = [matchStrings objectAtIndex:i];
-                    if ([matchString hasPrefix:@"$"])
-                        matchString = [templateValueForKeyPath(object, [matchString substringFromIndex:1], anIndex) templateStringValue] ?: @"";
+                    id matchKeyPath = [matchKeyPaths objectAtIndex:i];
+                    if (matchKeyPath == [NSNull null])
+                        matchString = [matchStrings objectAtIndex:i];
+                    else
+                        matchString = [[matchKeyPath valueForObject:object atIndex:anIndex] templateStringValue] ?: @"";
                     if (matchesCondition(keyValue, matchString, [tag matchType])) {
                         subtemplate = [tag objectInSubtemplatesAtIndex:i];
                         break;
@@ -827,20 +918,47 @@ static inline NSRange rangeAfterRemovingEmptyLines(NSString *string, SKTemplateT
                 }
                 if (subtemplate == nil && [tag countOfSubtemplates] > count)
                     subtemplate = [tag objectInSubtemplatesAtIndex:count];
-                if (subtemplate != nil) {
-                    NSAttributedString *tmpAttrStr = [self attributedStringFromTemplateArray:subtemplate usingObject:object atIndex:anIndex];
-                    if (tmpAttrStr != nil)
-                        [result appendAttributedString:tmpAttrStr];
-                }
+                if (subtemplate != nil)
+                    [self appendAttributedStringFromTemplateArray:subtemplate usingObject:object atIndex:anIndex toSink:sink];
                 
             }
             
         }
     } // while
-    
+}
+
++ (NSAttributedString *)attributedStringFromTemplateArray:(NSArray *)template usingObject:(id)object atIndex:(NSInteger)anIndex {
+    NSMutableAttributedString *result = [[NSMutableAttributedString alloc] init];
+    SKTemplateAttributedStringSink sink = {result, nil, 0};
+    [result beginEditing];
+    [self appendAttributedStringFromTemplateArray:template usingObject:object atIndex:anIndex toSink:&sink];
     [result fixAttributesInRange:NSMakeRange(0, [result length])];
-    
-    return [result autorelease];    
+    [result endEditing];
+    return [result autorelease];
+}
+
++ (BOOL)writeAttributedTemplateArray:(NSArray *)template usingObject:(id)object documentAttributes:(NSDictionary *)docAttributes toURL:(NSURL *)url error:(NSError **)outError {
+    const char *path = [[url path] fileSystemRepresentation];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int errorNumber = fd == -1 ? errno : 0;
+    if (fd != -1) {
+        SKRTFWriter *writer = [[SKRTFWriter alloc] initWithFileDescriptor:fd documentAttributes:docAttributes];
+        SKTemplateAttributedStringSink sink = {[[NSMutableAttributedString alloc] init], writer, 0};
+        [self appendAttributedStringFromTemplateArray:template usingObject:object atIndex:0 toSink:&sink];
+        flushAttributedStringSink(&sink, YES);
+        [sink.attributedString release];
+        if ([writer finish] == NO)
+            errorNumber = [writer errorNumber] ?: EIO;
+        [writer release];
+        if (close(fd) != 0 && errorNumber == 0)
+            errorNumber = errno;
+        // don't leave a partial file behind
+        if (errorNumber != 0)
+            unlink(path);
+    }
+    if (errorNumber != 0 && outError)
+        *outError = writeErrorForURL(url, errorNumber);
+    return errorNumber == 0;
 }
 
 @end
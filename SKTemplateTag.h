@@ -57,23 +57,28 @@ typedef NS_ENUM(NSInteger, SKTemplateTagMatchType) {
     SKTemplateTagMatchNotContain
 };
 
-@class SKAttributeTemplate;
+@class SKAttributeTemplate, SKTemplateKeyPath;
 
 @interface SKTemplateTag : NSObject
 
 @property (nonatomic, readonly) SKTemplateTagType type;
 
+// parses all lazily parsed subtemplates and link templates, after this the tag is not changed anymore
+- (void)compile;
+
 @end
 
 #pragma mark -
 
 @interface SKValueTemplateTag : SKTemplateTag {
     NSString *keyPath;
+    SKTemplateKeyPath *compiledKeyPath;
 }
 
 - (id)initWithKeyPath:(NSString *)aKeyPath;
 
 @property (nonatomic, readonly) NSString *keyPath;
+@property (nonatomic, readonly) SKTemplateKeyPath *compiledKeyPath;
 
 @end
 
@@ -127,12 +132,15 @@ typedef NS_ENUM(NSInteger, SKTemplateTagMatchType) {
     SKTemplateTagMatchType matchType;
     NSMutableArray *subtemplates;
     NSArray *matchStrings;
+    NSArray *matchKeyPaths;
 }
 
 - (id)initWithKeyPath:(NSString *)aKeyPath matchType:(SKTemplateTagMatchType)aMatchType matchStrings:(NSArray *)aMatchStrings subtemplates:(NSArray *)aSubtemplates;
 
 @property (nonatomic, readonly) SKTemplateTagMatchType matchType;
 @property (nonatomic, readonly) NSArray *matchStrings;
+// compiled key paths for match strings starting with $, NSNull for the other match strings
+@property (nonatomic, readonly) NSArray *matchKeyPaths;
 
 - (NSUInteger)countOfSubtemplates;
 - (NSArray *)objectInSubtemplatesAtIndex:(NSUInteger)anIndex;
@@ -189,4 +197,6 @@ typedef NS_ENUM(NSInteger, SKTemplateTagMatchType) {
 @property (nonatomic, readonly) NSRange range;
 @property (nonatomic, readonly) Class attributeClass;
 
+- (void)compile;
+
 @end
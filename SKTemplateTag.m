@@ -38,6 +38,7 @@
 
 #import "SKTemplateTag.h"
 #import "SKTemplateParser.h"
+#import "SKTemplateKeyPath.h"
 
 static inline SKAttributeTemplate *copyTemplateForLink(id aLink, NSRange range) {
     SKAttributeTemplate *linkTemplate = nil;
@@ -72,24 +73,28 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
 
 - (SKTemplateTagType)type { return -1; }
 
+- (void)compile {}
+
 @end
 
 #pragma mark -
 
 @implementation SKValueTemplateTag
 
-@synthesize keyPath;
+@synthesize keyPath, compiledKeyPath;
 
 - (id)initWithKeyPath:(NSString *)aKeyPath {
     self = [super init];
     if (self) {
         keyPath = [aKeyPath copy];
+        compiledKeyPath = [[SKTemplateKeyPath alloc] initWithKeyPath:keyPath];
     }
     return self;
 }
 
 - (void)dealloc {
     SKDESTROY(keyPath);
+    SKDESTROY(compiledKeyPath);
     [super dealloc];
 }
 
@@ -123,6 +128,10 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
     return [linkTemplate template] ? linkTemplate : nil;
 }
 
+- (void)compile {
+    [[self linkTemplate] compile];
+}
+
 @end
 
 #pragma mark -
@@ -164,6 +173,11 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
     return separatorTemplate;
 }
 
+- (void)compile {
+    [[self itemTemplate] makeObjectsPerformSelector:@selector(compile)];
+    [[self separatorTemplate] makeObjectsPerformSelector:@selector(compile)];
+}
+
 @end
 
 #pragma mark -
@@ -205,13 +219,18 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
     return separatorTemplate;
 }
 
+- (void)compile {
+    [[self itemTemplate] makeObjectsPerformSelector:@selector(compile)];
+    [[self separatorTemplate] makeObjectsPerformSelector:@selector(compile)];
+}
+
 @end
 
 #pragma mark -
 
 @implementation SKConditionTemplateTag
 
-@synthesize matchType, matchStrings;
+@synthesize matchType, matchStrings, matchKeyPaths;
 
 - (id)initWithKeyPath:(NSString *)aKeyPath matchType:(SKTemplateTagMatchType)aMatchType matchStrings:(NSArray *)aMatchStrings subtemplates:(NSArray *)aSubtemplates {
     self = [super initWithKeyPath:aKeyPath];
@@ -219,6 +238,17 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
         matchType = aMatchType;
         matchStrings = [aMatchStrings copy];
         subtemplates = [aSubtemplates mutableCopy];
+        NSMutableArray *keyPaths = [[NSMutableArray alloc] init];
+        for (NSString *matchString in matchStrings) {
+            if ([matchString hasPrefix:@"$"]) {
+                SKTemplateKeyPath *matchKeyPath = [[SKTemplateKeyPath alloc] initWithKeyPath:[matchString substringFromIndex:1]];
+                [keyPaths addObject:matchKeyPath];
+                [matchKeyPath release];
+            } else {
+                [keyPaths addObject:[NSNull null]];
+            }
+        }
+        matchKeyPaths = keyPaths;
     }
     return self;
 }
@@ -226,6 +256,7 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
 - (void)dealloc {
     SKDESTROY(subtemplates);
     SKDESTROY(matchStrings);
+    SKDESTROY(matchKeyPaths);
     [super dealloc];
 }
 
@@ -244,6 +275,12 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
     return subtemplate;
 }
 
+- (void)compile {
+    NSUInteger i, count = [subtemplates count];
+    for (i = 0; i < count; i++)
+        [[self objectInSubtemplatesAtIndex:i] makeObjectsPerformSelector:@selector(compile)];
+}
+
 @end
 
 #pragma mark -
@@ -317,6 +354,10 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
     return [linkTemplates count] ? linkTemplates : nil;
 }
 
+- (void)compile {
+    [[self linkTemplates] makeObjectsPerformSelector:@selector(compile)];
+}
+
 - (void)appendAttributedText:(NSAttributedString *)newAttributedText {
     NSMutableAttributedString *newAttrText = [attributedText mutableCopy];
     [newAttrText appendAttributedString:newAttributedText];
@@ -352,4 +393,8 @@ static inline NSArray *copyTemplatesForLinksFromAttributedString(NSAttributedStr
     [super dealloc];
 }
 
+- (void)compile {
+    [template makeObjectsPerformSelector:@selector(compile)];
+}
+
 @end
@@ -42,6 +42,22 @@
 #import <Quartz/Quartz.h>
 #import <SkimNotesBase/SkimNotesBase.h>
 
+// the maximum number of bytes of the PDF text in a bundle that we hand to Spotlight
+#define MAX_TEXT_CONTENT_LENGTH 10485760
+
+// decodes at most the first maxLength bytes of UTF-8 data, without splitting a character
+static NSString *CreateStringFromUTF8DataPrefix(NSData *data, NSUInteger maxLength)
+{
+    const uint8_t *bytes = (const uint8_t *)[data bytes];
+    NSUInteger length = [data length];
+    if (length > maxLength) {
+        length = maxLength;
+        while (length > 0 && (bytes[length] & 0xC0) == 0x80)
+            length--;
+    }
+    return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
+
 static BOOL GetTextAndAttributesForPDFFile(NSURL *url, NSString **text, NSDictionary **info)
 {
     PDFDocument *pdfDoc = [[PDFDocument alloc] initWithURL:url];
@@ -93,9 +109,11 @@ Boolean GetMetadataForFile(void* thisInterface,
         } else if (isPDFBundle) {
             notes = [fm readSkimNotesFromPDFBundleAtURL:fileURL error:NULL];
             NSString *textPath = [(NSString *)pathToFile stringByAppendingPathComponent:@"data.txt"];
-            pdfText = [NSString stringWithContentsOfFile:textPath encoding:NSUTF8StringEncoding error:NULL];
+            // map the sidecar files and only decode a bounded prefix of the text, so memory use does not grow with its size
+            NSData *textData = [NSData dataWithContentsOfFile:textPath options:NSDataReadingMappedIfSafe error:NULL];
+            pdfText = textData ? [CreateStringFromUTF8DataPrefix(textData, MAX_TEXT_CONTENT_LENGTH) autorelease] : nil;
             NSString *plistPath = [(NSString *)pathToFile stringByAppendingPathComponent:@"data.plist"];
-            NSData *plistData = [NSData dataWithContentsOfFile:plistPath];
+            NSData *plistData = [NSData dataWithContentsOfFile:plistPath options:NSDataReadingMappedIfSafe error:NULL];
             info = plistData ? [NSPropertyListSerialization propertyListWithData:plistData options:NSPropertyListImmutable format:NULL error:NULL] : nil;
             if (pdfText == nil || info == nil) {
                 NSString *pdfPath = [fm bundledFileWithExtension:@"pdf" inPDFBundleAtPath:(NSString *)pathToFile error:NULL];
@@ -116,7 +134,7 @@ Boolean GetMetadataForFile(void* thisInterface,
                         [textContent appendString:@"\n\n"];
                     [textContent appendString:contents];
                 }
-                NSString *text = [[note objectForKey:@"text"] string];
+                NSString *text = SKNStringFromSkimNoteText([note objectForKey:@"text"]);
                 if (text) {
                     if ([textContent length])
                         [textContent appendString:@"\n\n"];
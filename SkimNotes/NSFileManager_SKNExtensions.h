@@ -49,10 +49,16 @@
  @discussion  These options can be passed to the main methods for writing Skim notes to extended attributes or to file.
  @constant    SKNSkimNotesWritingPlist      Write plist data rather than archived data.
  @constant    SKNSkimNotesWritingSyncable   Hint to add a syncable flag to the attribute names if available, when writing to extended attributes.
+ @constant    SKNSkimNotesWritingBinary     Write compact binary data rather than archived data. This takes precedence over <code>SKNSkimNotesWritingPlist</code>. Older versions of the framework cannot read this format.
+ @constant    SKNSkimNotesWritingLargeFragments  Split long notes data into as few extended attribute fragments as the file system allows. The data remains readable by older versions of the framework, but may not survive copying to file systems with smaller limits.
+ @constant    SKNSkimNotesWritingFastCompression  Compress long notes data in extended attributes using a fast codec rather than bzip2 when available. Older versions of the framework cannot read notes compressed this way.
  */
 enum {
     SKNSkimNotesWritingPlist = 1 << 0,
-    SKNSkimNotesWritingSyncable = 1 << 1
+    SKNSkimNotesWritingSyncable = 1 << 1,
+    SKNSkimNotesWritingBinary = 1 << 2,
+    SKNSkimNotesWritingLargeFragments = 1 << 3,
+    SKNSkimNotesWritingFastCompression = 1 << 4
 };
 typedef NSInteger SKNSkimNotesWritingOptions;
 
@@ -160,6 +166,19 @@ typedef NSInteger SKNSkimNotesWritingOptions;
  */
 - (BOOL)writeSkimNotes:(NSArray *)notes textNotes:(NSString *)notesString richTextNotes:(NSData *)notesRTFData toExtendedAttributesAtURL:(NSURL *)aURL options:(SKNSkimNotesWritingOptions)options error:(NSError **)outError;
 
+/*!
+ @abstract   Writes Skim notes data that was already encoded to the extended attributes of a file, as well as text Skim notes and RTF Skim notes.
+ @discussion This allows writing notes data that was assembled from cached chunks using <code>SKNBinaryDataFromSkimNoteChunks</code>, so unchanged notes do not need to be encoded again.  The data is only decoded when <code>notesString</code> or <code>notesRTFData</code> needs to be generated.
+ @param      data The encoded Skim notes data, or <code>nil</code> when there are no notes.
+ @param      notesString A text representation of the Skim notes.  When <code>NULL</code>, a default representation will be generated from the notes.
+ @param      notesRTFData An RTF data representation of the Skim notes.  When <code>NULL</code>, a default representation will be generated from the notes.
+ @param      aURL The URL for the file to write the Skim notes to.
+ @param      options The write options to use. The options determining the format of the data are ignored.
+ @param      outError If there is an error writing the Skim notes, upon return contains an <code>NSError</code> object that describes the problem.
+ @result     Returns <code>YES</code> if writing out the Skim notes was successful; otherwise returns <code>NO</code>.
+ */
+- (BOOL)writeSkimNotesData:(NSData *)data textNotes:(NSString *)notesString richTextNotes:(NSData *)notesRTFData toExtendedAttributesAtURL:(NSURL *)aURL options:(SKNSkimNotesWritingOptions)options error:(NSError **)outError;
+
 /*!
     @abstract   Writes Skim notes passed as an array of property dictionaries to a .skim file.
     @discussion Calls <code>writeSkimNotes:toSkimFileAtURL:options:error:</code> with zero options.
@@ -207,7 +226,7 @@ typedef NSInteger SKNSkimNotesWritingOptions;
 /*!
     @abstract   Returns an array of Skim notes from the data.
     @discussion This is used to write a default Skim text notes representation when not provided for writing.
-    @param      data The data object to extract the notes from, either an archive or plist data.
+    @param      data The data object to extract the notes from, either an archive, plist data, or binary data.
     @result     A string representation of the notes.
 */
 extern NSArray *SKNSkimNotesFromData(NSData *data);
@@ -221,6 +240,30 @@ extern NSArray *SKNSkimNotesFromData(NSData *data);
 */
 extern NSData *SKNDataFromSkimNotes(NSArray *notes, BOOL asPlist);
 
+/*!
+    @abstract   Returns compact binary data for the Skim notes.
+    @discussion The data is written in a single pass, and the rich text and images are decoded lazily when the data is read back using <code>SKNSkimNotesFromData</code>.
+    @param      notes An array of dictionaries containing Skim note properties, as returned by the properties of a <code>PDFAnnotation</code>.
+    @result     The binary data representation of the notes.
+*/
+extern NSData *SKNBinaryDataFromSkimNotes(NSArray *notes);
+
+/*!
+    @abstract   Returns an encoded chunk for a single Skim note, to be combined using <code>SKNBinaryDataFromSkimNoteChunks</code>.
+    @discussion Chunks are independent of each other, so the chunk for a note that did not change can be reused for the next save.
+    @param      note A dictionary containing Skim note properties, as returned by the properties of a <code>PDFAnnotation</code>.
+    @result     The encoded chunk for the note.
+*/
+extern NSData *SKNBinaryChunkFromSkimNote(NSDictionary *note);
+
+/*!
+    @abstract   Returns compact binary data for Skim notes from the chunks of the notes.
+    @discussion The result can be read using <code>SKNSkimNotesFromData</code>, just like the data returned by <code>SKNBinaryDataFromSkimNotes</code>.
+    @param      chunks An array of data objects returned by <code>SKNBinaryChunkFromSkimNote</code>.
+    @result     The binary data representation of the notes.
+*/
+extern NSData *SKNBinaryDataFromSkimNoteChunks(NSArray *chunks);
+
 /*!
     @abstract   Returns a string representation of Skim notes.
     @discussion This is used to write a default Skim text notes representation when not provided for writing.
@@ -236,3 +279,20 @@ extern NSString *SKNSkimTextNotes(NSArray *noteDicts);
     @result     An RTF data representation of the notes.
 */
 extern NSData *SKNSkimRTFNotes(NSArray *noteDicts);
+
+/*!
+    @abstract   Returns both the text and the RTF data representations of Skim notes.
+    @discussion This walks the notes only once and decodes the rich text of each note only once, so it is faster than calling both <code>SKNSkimTextNotes</code> and <code>SKNSkimRTFNotes</code>.
+    @param      noteDicts An array of dictionaries containing Skim note properties, as returned by the properties of a <code>PDFAnnotation</code>.
+    @param      textNotes Upon return contains a text representation of the notes.  Can be <code>NULL</code>, in which case it is not generated.
+    @param      rtfNotes Upon return contains an RTF data representation of the notes.  Can be <code>NULL</code>, in which case it is not generated.
+*/
+extern void SKNSkimTextAndRTFNotes(NSArray *noteDicts, NSString **textNotes, NSData **rtfNotes);
+
+/*!
+    @abstract   Returns the plain text of the rich text of a Skim note.
+    @discussion When the text has not been decoded yet, RTF data is converted directly to plain text without creating an attributed string, which is much faster when only the text is needed, for instance for indexing.
+    @param      text The value for the <code>"text"</code> key of a Skim note dictionary, an attributed string or RTF or RTFD data.
+    @result     A plain string representation of the text, or <code>nil</code> if the text is not valid.
+*/
+extern NSString *SKNStringFromSkimNoteText(id text);
@@ -52,12 +52,21 @@
 }
 
 - (BOOL)writeSkimNotes:(NSArray *)notes textNotes:(NSString *)notesString richTextNotes:(NSData *)notesRTFData toExtendedAttributesAtURL:(NSURL *)aURL options:(SKNSkimNotesWritingOptions)options error:(NSError **)outError {
+    NSData *data = nil;
+    if ([aURL isFileURL] && [notes count]) {
+        BOOL asPlist = (options & SKNSkimNotesWritingPlist) != 0;
+        data = (options & SKNSkimNotesWritingBinary) ? SKNBinaryDataFromSkimNotes(notes) : SKNDataFromSkimNotes(notes, asPlist);
+        if (notesString == nil || notesRTFData == nil)
+            SKNSkimTextAndRTFNotes(notes, notesString ? NULL : &notesString, notesRTFData ? NULL : &notesRTFData);
+    }
+    return [self writeSkimNotesData:data textNotes:notesString richTextNotes:notesRTFData toExtendedAttributesAtURL:aURL options:options error:outError];
+}
+
+- (BOOL)writeSkimNotesData:(NSData *)data textNotes:(NSString *)notesString richTextNotes:(NSData *)notesRTFData toExtendedAttributesAtURL:(NSURL *)aURL options:(SKNSkimNotesWritingOptions)options error:(NSError **)outError {
     BOOL success = YES;
     
     if ([aURL isFileURL]) {
         NSString *path = [aURL path];
-        BOOL asPlist = (options & SKNSkimNotesWritingPlist) != 0;
-        NSData *data = SKNDataFromSkimNotes(notes, asPlist);
         NSError *error = nil;
         SKNExtendedAttributeManager *eam = [SKNExtendedAttributeManager sharedManager];
         
@@ -69,17 +78,19 @@
         [eam removeExtendedAttributeNamed:SKIM_TEXT_NOTES_KEY atPath:path traverseLink:YES error:NULL];
         [eam removeExtendedAttributeNamed:SKIM_RTF_NOTES_KEY atPath:path traverseLink:YES error:NULL];
         
-        if ([notes count]) {
+        if ([data length]) {
             SKNXattrFlags xattrOptions = (options & SKNSkimNotesWritingSyncable) ? kSKNXattrSyncable : kSKNXattrDefault;
+            if (options & SKNSkimNotesWritingLargeFragments)
+                xattrOptions |= kSKNXattrLargeFragments;
+            if (options & SKNSkimNotesWritingFastCompression)
+                xattrOptions |= kSKNXattrFastCompress;
             if ([eam setExtendedAttributeNamed:SKIM_NOTES_KEY toValue:data atPath:path options:xattrOptions error:&error] == NO) {
                 success = NO;
                 if (outError) *outError = error;
                 //NSLog(@"%@: %@", self, error);
             } else {
-                if (notesString == nil)
-                    notesString = SKNSkimTextNotes(notes);
-                if (notesRTFData == nil)
-                    notesRTFData = SKNSkimRTFNotes(notes);
+                if (notesString == nil || notesRTFData == nil)
+                    SKNSkimTextAndRTFNotes(SKNSkimNotesFromData(data), notesString ? NULL : &notesString, notesRTFData ? NULL : &notesRTFData);
                 [eam setExtendedAttributeNamed:SKIM_TEXT_NOTES_KEY toPropertyListValue:notesString atPath:path options:xattrOptions error:NULL];
                 [eam setExtendedAttributeNamed:SKIM_RTF_NOTES_KEY toValue:notesRTFData atPath:path options:xattrOptions error:NULL];
             }
@@ -97,7 +108,7 @@
     
     if ([aURL isFileURL]) {
         BOOL asPlist = (options & SKNSkimNotesWritingPlist) != 0;
-        NSData *data = SKNDataFromSkimNotes(notes, asPlist);
+        NSData *data = (options & SKNSkimNotesWritingBinary) ? SKNBinaryDataFromSkimNotes(notes) : SKNDataFromSkimNotes(notes, asPlist);
         success = [data writeToURL:aURL options:NSAtomicWrite error:outError];
     }
     return success;
@@ -161,7 +172,7 @@
     
     if ([aURL isFileURL] && [self fileExistsAtPath:path isDirectory:&isDir] && isDir) {
         NSURL *skimFileURL = [self bundledFileURLWithExtension:SKIM_EXTENSION inPDFBundleAtURL:aURL error:&error];
-        NSData *data = skimFileURL ? [NSData dataWithContentsOfURL:skimFileURL options:0 error:&error] : nil;
+        NSData *data = skimFileURL ? [NSData dataWithContentsOfURL:skimFileURL options:NSDataReadingMappedIfSafe error:&error] : nil;
         if (data) {
             notes = SKNSkimNotesFromData(data);
             if (notes == nil)
@@ -201,7 +212,7 @@
         NSURL *notesFileURL = [self bundledFileURLWithExtension:RTF_EXTENSION inPDFBundleAtURL:aURL error:&error];
         
         if (notesFileURL)
-            data = [NSData dataWithContentsOfURL:notesFileURL options:0 error:&error];
+            data = [NSData dataWithContentsOfURL:notesFileURL options:NSDataReadingMappedIfSafe error:&error];
         
         if (data == nil)
             data = [NSData data];
@@ -216,7 +227,7 @@
     NSError *error = nil;
     
     if ([aURL isFileURL] && [self fileExistsAtPath:[aURL path]]) {
-        NSData *data = [NSData dataWithContentsOfURL:aURL options:0 error:&error];
+        NSData *data = [NSData dataWithContentsOfURL:aURL options:NSDataReadingMappedIfSafe error:&error];
         if (data) {
             notes = SKNSkimNotesFromData(data);
             if (notes == nil)
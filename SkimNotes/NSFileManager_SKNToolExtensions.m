@@ -44,6 +44,10 @@
 
 #define SYNCABLE_FLAG @"#S"
 
+// hidden defaults, the same as the ones Skim uses
+#define WRITE_LARGE_FRAGMENTS_KEY @"SKWriteSkimNotesInLargeFragments"
+#define WRITE_FAST_COMPRESSION_KEY @"SKWriteSkimNotesWithFastCompression"
+
 @implementation NSFileManager (SKNToolExtensions)
 
 - (NSString *)notesFileWithExtension:(NSString *)extension atPath:(NSString *)path error:(NSError **)error {
@@ -81,11 +85,11 @@
     if ([extension caseInsensitiveCompare:PDFD_EXTENSION] == NSOrderedSame) {
         NSString *notePath = [self notesFileWithExtension:SKIM_EXTENSION atPath:path error:&error];
         if (notePath)
-            data = [NSData dataWithContentsOfFile:notePath options:0 error:&error];
+            data = [NSData dataWithContentsOfFile:notePath options:NSDataReadingMappedIfSafe error:&error];
         if (nil == data && outError)
             *outError = error;
     } else if ([extension caseInsensitiveCompare:SKIM_EXTENSION] == NSOrderedSame) {
-        data = [NSData dataWithContentsOfFile:path options:0 error:&error];
+        data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:&error];
         if (nil == data && outError)
             *outError = error;
     } else {
@@ -133,7 +137,7 @@
     if ([extension caseInsensitiveCompare:PDFD_EXTENSION] == NSOrderedSame) {
         NSString *notePath = [self notesFileWithExtension:RTF_EXTENSION atPath:path error:&error];
         if (notePath)
-            data = [NSData dataWithContentsOfFile:notePath options:0 error:&error];
+            data = [NSData dataWithContentsOfFile:notePath options:NSDataReadingMappedIfSafe error:&error];
         if (nil == data && outError)
             *outError = error;
     } else {
@@ -157,12 +161,8 @@
     if ([notesData length]) {
         if (textNotes == nil || rtfNotesData == nil) {
             NSArray *notes = SKNSkimNotesFromData(notesData);
-            if ([notes count]) {
-                if (textNotes == nil)
-                    textNotes = SKNSkimTextNotes(notes);
-                if (rtfNotesData == nil)
-                    rtfNotesData = SKNSkimRTFNotes(notes);
-            }
+            if ([notes count])
+                SKNSkimTextAndRTFNotes(notes, textNotes ? NULL : &textNotes, rtfNotesData ? NULL : &rtfNotesData);
         }
         if ([extension caseInsensitiveCompare:PDFD_EXTENSION] == NSOrderedSame) {
             NSString *name = [[path lastPathComponent] stringByDeletingPathExtension];
@@ -181,6 +181,10 @@
         } else {
             SKNExtendedAttributeManager *eam = [SKNExtendedAttributeManager sharedManager];
             SKNXattrFlags options = syncable ? kSKNXattrSyncable : kSKNXattrDefault;
+            if ([[NSUserDefaults standardUserDefaults] boolForKey:WRITE_LARGE_FRAGMENTS_KEY])
+                options |= kSKNXattrLargeFragments;
+            if ([[NSUserDefaults standardUserDefaults] boolForKey:WRITE_FAST_COMPRESSION_KEY])
+                options |= kSKNXattrFastCompress;
             success = [eam setExtendedAttributeNamed:SKIM_NOTES_KEY toValue:notesData atPath:path options:options error:&error];
             if (textNotes)
                 [eam setExtendedAttributeNamed:SKIM_TEXT_NOTES_KEY toPropertyListValue:textNotes atPath:path options:options error:NULL];
@@ -43,6 +43,7 @@
 */
 #import <Cocoa/Cocoa.h>
 #import <Quartz/Quartz.h>
+#import "PDFAnnotation_SKNExtensions.h"
 
 
 /*!
@@ -71,4 +72,24 @@
 */
 - (NSArray *)addSkimNotesWithProperties:(NSArray *)noteDicts;
 
+/*!
+    @method     
+    @abstract   Restores the state of existing form widgets of the receiver from an array of widget property dictionaries, and returns the number of widgets that were restored.
+    @discussion Widgets are matched by page, widget type, field name and integral bounds.  The annotations of each page are indexed at most once, so this is much faster than matching the dictionaries one at a time for documents with many form fields.  Dictionaries that are not widget properties are ignored.  This is called by <code>addSkimNotesWithProperties:</code> for the widget properties it is passed.
+    @param      widgetDicts An array of dictionaries containing widget properties as returned by the properties of <code>PDFAnnotation</code> objects.
+    @result     The number of widgets whose state was restored.
+*/
+- (NSUInteger)restoreWidgetsWithProperties:(NSArray *)widgetDicts;
+
 @end
+
+/*!
+    @function   SKNWidgetIndexKey
+    @abstract   Returns a key used to match a form widget with the widget properties saved for it.
+    @discussion Widgets on the same page match when they have the same widget type, field name and integral bounds.  The key does not contain the page, so an index of widgets using these keys should be kept for each page.
+    @param      widgetType The widget type of the widget.
+    @param      fieldName The field name of the widget, can be <code>nil</code>.
+    @param      bounds The bounds of the widget, in page space.
+    @result     A string key for the widget.
+*/
+extern NSString *SKNWidgetIndexKey(SKNPDFWidgetType widgetType, NSString *fieldName, NSRect bounds);
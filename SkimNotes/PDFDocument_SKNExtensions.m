@@ -77,11 +77,62 @@ static inline SKNPDFWidgetType SKNWidgetTypeForAnnotation(PDFAnnotation *annotat
         return kSKNPDFWidgetTypeUnknown;
 }
 
+NSString *SKNWidgetIndexKey(SKNPDFWidgetType widgetType, NSString *fieldName, NSRect bounds) {
+    return [NSString stringWithFormat:@"%ld\t%@\t%@", (long)widgetType, NSStringFromRect(NSIntegralRect(bounds)), fieldName ?: @""];
+}
+
+- (NSUInteger)restoreWidgetsWithProperties:(NSArray *)widgetDicts {
+    NSUInteger pageCount = [self pageCount], count = 0;
+    NSMutableDictionary **pageWidgets;
+    NSDictionary *dict;
+    
+    if (pageCount == 0 || [widgetDicts count] == 0) return 0;
+    
+    // the index for a page maps (widget type, field name, integral bounds) to the first matching widget, built only when the page is first needed
+    pageWidgets = (NSMutableDictionary **)NSZoneCalloc(NSDefaultMallocZone(), pageCount, sizeof(NSMutableDictionary *));
+    
+    for (dict in widgetDicts) {
+        if ([[dict objectForKey:SKNPDFAnnotationTypeKey] isEqualToString:SKNWidgetString] == NO)
+            continue;
+        NSUInteger pageIndex = [[dict objectForKey:SKNPDFAnnotationPageIndexKey] unsignedIntegerValue];
+        if (pageIndex >= pageCount)
+            continue;
+        NSMutableDictionary *widgets = pageWidgets[pageIndex];
+        if (widgets == nil) {
+            widgets = pageWidgets[pageIndex] = [[NSMutableDictionary alloc] init];
+            for (PDFAnnotation *annotation in [[self pageAtIndex:pageIndex] annotations]) {
+                if ([[annotation type] isEqualToString:SKNWidgetString]) {
+                    id key = SKNWidgetIndexKey(SKNWidgetTypeForAnnotation(annotation), [(PDFAnnotationTextWidget *)annotation fieldName], [annotation bounds]);
+                    if ([widgets objectForKey:key] == nil)
+                        [widgets setObject:annotation forKey:key];
+                }
+            }
+        }
+        SKNPDFWidgetType widgetType = [[dict objectForKey:SKNPDFAnnotationWidgetTypeKey] integerValue];
+        PDFAnnotation *annotation = [widgets objectForKey:SKNWidgetIndexKey(widgetType, [dict objectForKey:SKNPDFAnnotationFieldNameKey], NSRectFromString([dict objectForKey:SKNPDFAnnotationBoundsKey]))];
+        if (annotation) {
+            if (widgetType == kSKNPDFWidgetTypeButton)
+                [(PDFAnnotationButtonWidget *)annotation setState:[[dict objectForKey:SKNPDFAnnotationStateKey] integerValue]];
+            else
+                [(PDFAnnotationTextWidget *)annotation setStringValue:[dict objectForKey:SKNPDFAnnotationStringValueKey]];
+            count++;
+        }
+    }
+    
+    NSUInteger i;
+    for (i = 0; i < pageCount; i++)
+        [pageWidgets[i] release];
+    NSZoneFree(NSDefaultMallocZone(), pageWidgets);
+    
+    return count;
+}
+
 - (NSArray *)addSkimNotesWithProperties:(NSArray *)noteDicts {
     NSEnumerator *e = [noteDicts objectEnumerator];
     PDFAnnotation *annotation;
     NSDictionary *dict;
     NSMutableArray *notes = [NSMutableArray array];
+    NSMutableArray *widgetDicts = nil;
     
     if ([self pageCount] == 0) return nil;
     
@@ -97,27 +148,17 @@ static inline SKNPDFWidgetType SKNWidgetTypeForAnnotation(PDFAnnotation *annotat
             [page addAnnotation:annotation];
             [notes addObject:annotation];
             [annotation release];
-        } else if ([[dict objectForKey:SKNPDFAnnotationTypeKey] isEqualToString:SKNWidgetString] &&
-                   pageIndex >= 0 && pageIndex < [self pageCount]) {
-            PDFPage *page = [self pageAtIndex:pageIndex];
-            NSRect bounds = NSIntegralRect(NSRectFromString([dict objectForKey:SKNPDFAnnotationBoundsKey]));
-            SKNPDFWidgetType widgetType = [[dict objectForKey:SKNPDFAnnotationWidgetTypeKey] integerValue];
-            NSString *fieldName = [dict objectForKey:SKNPDFAnnotationFieldNameKey] ?: @"";
-            for (annotation in [page annotations]) {
-                if ([[annotation type] isEqualToString:SKNWidgetString] &&
-                    SKNWidgetTypeForAnnotation(annotation) == widgetType &&
-                    [fieldName isEqualToString:([(PDFAnnotationTextWidget *)annotation fieldName] ?: @"")] &&
-                    NSEqualRects(NSIntegralRect([annotation bounds]), bounds)) {
-                    if (widgetType == kSKNPDFWidgetTypeButton)
-                        [(PDFAnnotationButtonWidget *)annotation setState:[[dict objectForKey:SKNPDFAnnotationStateKey] integerValue]];
-                    else
-                        [(PDFAnnotationTextWidget *)annotation setStringValue:[dict objectForKey:SKNPDFAnnotationStringValueKey]];
-                    break;
-                }
-            }
+        } else if ([[dict objectForKey:SKNPDFAnnotationTypeKey] isEqualToString:SKNWidgetString]) {
+            if (widgetDicts == nil)
+                widgetDicts = [NSMutableArray array];
+            [widgetDicts addObject:dict];
         }
     }
     
+    // restore the form state in one pass, so each page is only scanned once
+    if (widgetDicts)
+        [self restoreWidgetsWithProperties:widgetDicts];
+    
     return notes;
 }
 @end
@@ -129,4 +129,37 @@
     return [string dataUsingEncoding:encoding];
 }
 
+- (bycopy NSArray *)SkimNotesAtPaths:(in bycopy NSArray *)files;
+{
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:[files count]];
+    for (NSString *file in files) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        [results addObject:[self SkimNotesAtPath:file] ?: [NSNull null]];
+        [pool release];
+    }
+    return results;
+}
+
+- (bycopy NSArray *)RTFNotesAtPaths:(in bycopy NSArray *)files;
+{
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:[files count]];
+    for (NSString *file in files) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        [results addObject:[self RTFNotesAtPath:file] ?: [NSNull null]];
+        [pool release];
+    }
+    return results;
+}
+
+- (bycopy NSArray *)textNotesAtPaths:(in bycopy NSArray *)files encoding:(NSStringEncoding)encoding;
+{
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:[files count]];
+    for (NSString *file in files) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        [results addObject:[self textNotesAtPath:file encoding:encoding] ?: [NSNull null]];
+        [pool release];
+    }
+    return results;
+}
+
 @end
@@ -53,6 +53,8 @@
     @constant    kSKNXattrNoSplitData  Don't split data objects into segments.
     @constant    kSKNXattrNoCompress   Don't compress data to reduce space for long attributes.
     @constant    kSKNXattrSyncable     Add a syncable flag to the attribute name if available.
+    @constant    kSKNXattrLargeFragments  Split data into fragments as large as the file system allows, rather than small fragments that can be copied to any file system.
+    @constant    kSKNXattrFastCompress Compress long attributes using a fast codec rather than bzip2 when available. Older versions cannot read attributes compressed this way.
 */
 enum {
     kSKNXattrDefault     = 0,
@@ -61,7 +63,9 @@ enum {
     kSKNXattrReplaceOnly = 1 << 3,
     kSKNXattrNoSplitData = 1 << 4,
     kSKNXattrNoCompress  = 1 << 5,
-    kSKNXattrSyncable    = 1 << 6
+    kSKNXattrSyncable    = 1 << 6,
+    kSKNXattrLargeFragments = 1 << 7,
+    kSKNXattrFastCompress = 1 << 8
 };
 typedef NSInteger SKNXattrFlags;
 
@@ -95,6 +99,7 @@ enum {
     NSString *uniqueKey;
     NSString *wrapperKey;
     NSString *fragmentsKey;
+    NSString *fragmentsLengthKey;
 }
 
 /*!
@@ -38,8 +38,10 @@
 #import "SKNExtendedAttributeManager.h"
 #include <sys/xattr.h>
 #import <bzlib.h>
+#import <compression.h>
 
 #define MAX_XATTR_LENGTH        2048
+#define MAX_LARGE_XATTR_LENGTH  0xFFFFFF
 #define MIN_EXTRA_NAME_LENGTH   34
 #define PREFIX                  @"net_sourceforge_skim-app"
 
@@ -48,9 +50,24 @@
 #define UNIQUE_KEY_SUFFIX       @"_unique_key"
 #define WRAPPER_KEY_SUFFIX      @"_has_wrapper"
 #define FRAGMENTS_KEY_SUFFIX    @"_number_of_fragments"
+#define FRAGMENTS_LENGTH_KEY_SUFFIX @"_fragments_length"
 
 #define SYNCABLE_FLAG @"#S"
 
+// header for data compressed with a codec other than bzip2, which has its own header:
+// 4 magic bytes, a codec byte, and the little endian 64 bit length of the uncompressed data
+#define COMPRESSION_MAGIC       "SKNz"
+#define COMPRESSION_MAGIC_LENGTH 4
+#define COMPRESSION_HEADER_LENGTH 13
+#define MAX_UNCOMPRESSED_LENGTH 0x40000000
+
+// the most we preallocate for reassembling fragments before we have actually read them
+#define MAX_PREALLOCATED_LENGTH 0x1000000
+
+enum {
+    SKNCompressionCodecLZ4 = 1
+};
+
 #ifndef NSFoundationVersionNumber10_10
 #define NSFoundationVersionNumber10_10 1151.16
 #endif
@@ -61,15 +78,68 @@ NSString *SKNSkimNotesErrorDomain = @"SKNSkimNotesErrorDomain";
 // private methods to get a unique attractor name for fragments
 - (NSString *)uniqueName;
 // private methods to (un)compress data
+- (NSData *)compressData:(NSData *)data options:(SKNXattrFlags)options;
+- (NSData *)decompressData:(NSData *)data;
+- (BOOL)isCompressedData:(NSData *)data;
 - (NSData *)bzipData:(NSData *)data;
 - (NSData *)bunzipData:(NSData *)data;
 - (BOOL)isBzipData:(NSData *)data;
+- (NSData *)fastCompressData:(NSData *)data;
+- (NSData *)fastDecompressData:(NSData *)data;
+- (BOOL)isFastCompressedData:(NSData *)data;
 - (BOOL)isPlistData:(NSData *)data;
 // private method to print error messages
 - (NSError *)xattrError:(NSInteger)err forPath:(NSString *)path;
 @end
 
 
+// the largest fragment the file system can store, falling back to the conservative length that can be copied anywhere
+static size_t SKNMaxFragmentLength(const char *fsPath) {
+    size_t length = MAX_XATTR_LENGTH;
+#ifdef _PC_XATTR_SIZE_BITS
+    long bits = pathconf(fsPath, _PC_XATTR_SIZE_BITS);
+    if (bits >= 24)
+        length = MAX_LARGE_XATTR_LENGTH;
+    else if (bits > 0)
+        length = MAX(((size_t)1 << bits) - 1, (size_t)MAX_XATTR_LENGTH);
+#endif
+    return length;
+}
+
+// reads the attribute directly into the buffer after length, only growing the buffer when the value does not fit
+static ssize_t SKNAppendExtendedAttribute(const char *fsPath, const char *attrName, char **buffer, size_t *length, size_t *capacity, int xopts) {
+    ssize_t status;
+    if (*capacity > *length) {
+        status = getxattr(fsPath, attrName, *buffer + *length, *capacity - *length, 0, xopts);
+        if (status != -1 || errno != ERANGE) {
+            if (status != -1)
+                *length += status;
+            return status;
+        }
+    }
+    status = getxattr(fsPath, attrName, NULL, 0, 0, xopts);
+    if (status == -1)
+        return -1;
+    if ((size_t)status > SIZE_MAX - *length) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (*length + status > *capacity) {
+        size_t newCapacity = *capacity <= SIZE_MAX / 2 ? MAX(*length + status, 2 * *capacity) : *length + status;
+        char *newBuffer = (char *)NSZoneRealloc(NSDefaultMallocZone(), *buffer, newCapacity);
+        if (newBuffer == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        *buffer = newBuffer;
+        *capacity = newCapacity;
+    }
+    status = getxattr(fsPath, attrName, *buffer + *length, *capacity - *length, 0, xopts);
+    if (status != -1)
+        *length += status;
+    return status;
+}
+
 @implementation SKNExtendedAttributeManager
 
 static id sharedManager = nil;
@@ -110,6 +180,7 @@ static id sharedNoSplitManager = nil;
         uniqueKey = [[prefix stringByAppendingString:UNIQUE_KEY_SUFFIX] retain];
         wrapperKey = [[prefix stringByAppendingString:WRAPPER_KEY_SUFFIX] retain];
         fragmentsKey = [[prefix stringByAppendingString:FRAGMENTS_KEY_SUFFIX] retain];
+        fragmentsLengthKey = [[prefix stringByAppendingString:FRAGMENTS_LENGTH_KEY_SUFFIX] retain];
     }
     return self;
 }
@@ -119,6 +190,7 @@ static id sharedNoSplitManager = nil;
     [uniqueKey release];
     [wrapperKey release];
     [fragmentsKey release];
+    [fragmentsLengthKey release];
     [super dealloc];
 }
 
@@ -270,40 +342,65 @@ static id sharedNoSplitManager = nil;
             
             NSString *uniqueValue = [plist objectForKey:uniqueKey];
             NSUInteger i, numberOfFragments = [[plist objectForKey:fragmentsKey] unsignedIntegerValue];
-
-            NSMutableData *buffer = [NSMutableData data];
+            NSNumber *fragmentsLength = [plist objectForKey:fragmentsLengthKey];
+            
             BOOL success = (nil != uniqueValue && numberOfFragments > 0);
             
             if (success == NO)
                 NSLog(@"failed to read unique key %@ for %lu fragments from property list.", uniqueKey, (long)numberOfFragments);
             
+            if (success && numberOfFragments > SIZE_MAX / MAX_LARGE_XATTR_LENGTH) {
+                NSLog(@"invalid number of fragments %lu for attribute named %@.", (long)numberOfFragments, attr);
+                success = NO;
+            }
+            
+            // older writers did not record the total length, but never wrote fragments larger than MAX_XATTR_LENGTH
+            // the recorded values come from the file, so only use them as a hint and grow the buffer as fragments are actually read
+            const char *fsPath = [path fileSystemRepresentation];
+            int xopts = follow ? 0 : XATTR_NOFOLLOW;
+            size_t length = 0, capacity = 0;
+            if (success) {
+                capacity = [fragmentsLength isKindOfClass:[NSNumber class]] ? MIN([fragmentsLength unsignedIntegerValue], numberOfFragments * MAX_LARGE_XATTR_LENGTH) : numberOfFragments * MAX_XATTR_LENGTH;
+                capacity = MIN(capacity, (size_t)MAX_PREALLOCATED_LENGTH);
+            }
+            char *buffer = (char *)NSZoneMalloc(NSDefaultMallocZone(), MAX(capacity, (size_t)1));
+            if (buffer == NULL) {
+                NSLog(@"unable to allocate memory to reassemble attribute named %@.", attr);
+                capacity = 0;
+                success = NO;
+            }
+            
             NSUInteger j = [attr rangeOfString:@"#"].location;
             NSString *suffix = j == NSNotFound || j == [attr length] - 1 ? @"" : [attr substringFromIndex:j];
             
             // reassemble the original data object
             for (i = 0; success && i < numberOfFragments; i++) {
-                NSError *tmpError = nil;
                 NSString *name = [[NSString alloc] initWithFormat:@"%@%@%lu%@", uniqueValue, FRAGMENT_NAME_SEPARATOR, (long)i, suffix];
-                NSData *subdata = [self copyRawExtendedAttributeNamed:name atPath:path traverseLink:follow error:&tmpError];
-                if (nil == subdata && i == 0 && [suffix length] > 0 && [tmpError code] == ENOATTR) {
+                ssize_t status = SKNAppendExtendedAttribute(fsPath, [name UTF8String], &buffer, &length, &capacity, xopts);
+                if (status == -1 && i == 0 && [suffix length] > 0 && errno == ENOATTR) {
                     NSString *oldName = [[NSString alloc] initWithFormat:@"%@%@%lu", uniqueValue, FRAGMENT_NAME_SEPARATOR, (long)i];
-                    subdata = [self copyRawExtendedAttributeNamed:oldName atPath:path traverseLink:follow error:&tmpError];
-                    if (subdata)
+                    status = SKNAppendExtendedAttribute(fsPath, [oldName UTF8String], &buffer, &length, &capacity, xopts);
+                    if (status != -1)
                         suffix = @"";
                     [oldName release];
                 }
-                if (nil == subdata) {
-                    NSLog(@"failed to find subattribute %@ of %lu for attribute named %@. %@", name, (long)numberOfFragments, attr, [tmpError localizedDescription]);
+                if (status == -1) {
+                    NSLog(@"failed to find subattribute %@ of %lu for attribute named %@. %@", name, (long)numberOfFragments, attr, [[self xattrError:errno forPath:path] localizedDescription]);
                     success = NO;
-                } else {
-                    [buffer appendData:subdata];
-                    [subdata release];
                 }
                 [name release];
             }
             
             [attribute release];
-            attribute = success ? [[self bunzipData:buffer] retain] : nil;
+            attribute = nil;
+            if (success) {
+                // let NSData worry about freeing the buffer
+                NSData *data = [[NSData alloc] initWithBytesNoCopy:buffer length:length];
+                attribute = [[self decompressData:data] retain];
+                [data release];
+            } else if (buffer != NULL) {
+                NSZoneFree(NSDefaultMallocZone(), buffer);
+            }
             
             if (success == NO && NULL != error)
                 *error = [NSError errorWithDomain:SKNSkimNotesErrorDomain code:SKNReassembleAttributeFailedError userInfo:[NSDictionary dictionaryWithObjectsAndKeys:path, NSFilePathErrorKey, SKNLocalizedString(@"Failed to reassemble attribute value.", @"Error description"), NSLocalizedDescriptionKey, nil]];
@@ -324,8 +421,8 @@ static id sharedNoSplitManager = nil;
         if (error) *error = anError;
     } else {
         // decompress the data if necessary, we may have compressed when setting
-        if ([self isBzipData:data]) 
-            data = [self bunzipData:data];
+        if ([self isCompressedData:data])
+            data = [self decompressData:data];
         
         if (nil == data) {
             if (error) *error = [NSError errorWithDomain:SKNSkimNotesErrorDomain code:SKNInvalidDataError userInfo:[NSDictionary dictionaryWithObjectsAndKeys:SKNLocalizedString(@"Invalid data.", @"Error description"), NSLocalizedDescriptionKey, nil]];
@@ -369,42 +466,65 @@ static id sharedNoSplitManager = nil;
     if ((options & kSKNXattrNoSplitData) == 0 && namePrefix && [value length] > MAX_XATTR_LENGTH) {
                     
         // compress to save space, and so we don't identify this as a plist when reading it (in case it really is plist data)
-        value = [self bzipData:value];
+        value = [self compressData:value options:options];
         
         // this will be a unique identifier for the set of keys we're about to write (appending a counter to the UUID)
         NSString *uniqueValue = [self uniqueName];
-        NSUInteger numberOfFragments = ([value length] / MAX_XATTR_LENGTH) + ([value length] % MAX_XATTR_LENGTH ? 1 : 0);
-        NSDictionary *wrapper = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:YES], wrapperKey, uniqueValue, uniqueKey, [NSNumber numberWithUnsignedInteger:numberOfFragments], fragmentsKey, nil];
-        NSData *wrapperData = [NSPropertyListSerialization dataFromPropertyList:wrapper format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
-        NSParameterAssert([wrapperData length] < MAX_XATTR_LENGTH && [wrapperData length] > 0);
+        NSUInteger valueLength = [value length];
+        size_t fragmentLength = (options & kSKNXattrLargeFragments) ? MIN(SKNMaxFragmentLength(fsPath), (size_t)MAX(valueLength, (NSUInteger)MAX_XATTR_LENGTH)) : MAX_XATTR_LENGTH;
+        NSUInteger numberOfFragments = 0;
         
-        // we don't want to split this dictionary (or compress it)
-        if (setxattr(fsPath, attrName, [wrapperData bytes], [wrapperData length], 0, xopts))
-            success = NO;
-        else
-            success = YES;
-        
-        // now split the original data value into multiple segments
-        NSString *name;
-        NSUInteger i;
+        // fragments are new attributes, so they should only get the symlink option
+        int fragmentXopts = xopts & XATTR_NOFOLLOW;
         const char *valuePtr = [value bytes];
         
         NSUInteger j = [attr rangeOfString:@"#"].location;
         NSString *suffix = j == NSNotFound || j == [attr length] - 1 ? @"" : [attr substringFromIndex:j];
         
-        for (i = 0; success && i < numberOfFragments; i++) {
-            name = [[NSString alloc] initWithFormat:@"%@%@%lu%@", uniqueValue, FRAGMENT_NAME_SEPARATOR, (long)i, suffix];
-            
-            char *subdataPtr = (char *)&valuePtr[i * MAX_XATTR_LENGTH];
-            size_t subdataLen = i == numberOfFragments - 1 ? ([value length] - i * MAX_XATTR_LENGTH) : MAX_XATTR_LENGTH;
+        // first split the data value into multiple segments, so the wrapper never refers to missing fragments
+        success = YES;
+        while (success && numberOfFragments * fragmentLength < valueLength) {
+            NSUInteger i = numberOfFragments;
+            NSString *name = [[NSString alloc] initWithFormat:@"%@%@%lu%@", uniqueValue, FRAGMENT_NAME_SEPARATOR, (long)i, suffix];
+            const char *subdataPtr = &valuePtr[i * fragmentLength];
+            size_t subdataLen = MIN(fragmentLength, valueLength - i * fragmentLength);
             
             // could recurse here, but it's more efficient to use the variables we already have
-            if (setxattr(fsPath, [name UTF8String], subdataPtr, subdataLen, 0, xopts)) {
-                NSLog(@"full data length of note named %@ was %lu, subdata length was %lu (failed on pass %lu)", name, (long)[value length], (long)subdataLen, (long)i);
+            if (setxattr(fsPath, [name UTF8String], subdataPtr, subdataLen, 0, fragmentXopts) == 0) {
+                numberOfFragments++;
+            } else if (i == 0 && errno == E2BIG && fragmentLength > MAX_XATTR_LENGTH) {
+                // the file system reported a larger limit than it accepts, fall back to small fragments
+                fragmentLength = MAX_XATTR_LENGTH;
+            } else {
+                NSLog(@"full data length of note named %@ was %lu, subdata length was %lu (failed on pass %lu)", name, (long)valueLength, (long)subdataLen, (long)i);
+                if (error) *error = [self xattrError:errno forPath:path];
+                success = NO;
             }
             [name release];
         }
         
+        if (success) {
+            NSDictionary *wrapper = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:YES], wrapperKey, uniqueValue, uniqueKey, [NSNumber numberWithUnsignedInteger:numberOfFragments], fragmentsKey, [NSNumber numberWithUnsignedInteger:valueLength], fragmentsLengthKey, nil];
+            NSData *wrapperData = [NSPropertyListSerialization dataFromPropertyList:wrapper format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
+            NSParameterAssert([wrapperData length] < MAX_XATTR_LENGTH && [wrapperData length] > 0);
+            
+            // we don't want to split this dictionary (or compress it)
+            if (setxattr(fsPath, attrName, [wrapperData bytes], [wrapperData length], 0, xopts)) {
+                if (error) *error = [self xattrError:errno forPath:path];
+                success = NO;
+            }
+        }
+        
+        // don't leave orphaned fragments behind
+        if (success == NO) {
+            NSUInteger i;
+            for (i = 0; i < numberOfFragments; i++) {
+                NSString *name = [[NSString alloc] initWithFormat:@"%@%@%lu%@", uniqueValue, FRAGMENT_NAME_SEPARATOR, (long)i, suffix];
+                removexattr(fsPath, [name UTF8String], fragmentXopts);
+                [name release];
+            }
+        }
+        
     } else {
         int status = setxattr(fsPath, attrName, [value bytes], [value length], 0, xopts);
         if(status == -1){
@@ -429,9 +549,9 @@ static id sharedNoSplitManager = nil;
         [errorString release];
         success = NO;
     } else {
-        // if we don't split and the data is too long, compress the data using bzip to save space
+        // if we don't split and the data is too long, compress the data to save space
         if (((options & kSKNXattrNoSplitData) != 0 || namePrefix == nil) && (options & kSKNXattrNoCompress) == 0 && [data length] > MAX_XATTR_LENGTH)
-            data = [self bzipData:data];
+            data = [self compressData:data options:options];
         
         success = [self setExtendedAttributeNamed:attr toValue:data atPath:path options:options error:error];
     }
@@ -629,6 +749,30 @@ static id sharedNoSplitManager = nil;
     return [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:[NSDictionary dictionaryWithObjectsAndKeys:path, NSFilePathErrorKey, errMsg, NSLocalizedDescriptionKey, nil]];
 }
 
+- (NSData *)compressData:(NSData *)data options:(SKNXattrFlags)options;
+{
+    NSData *compressed = nil;
+    if (options & kSKNXattrFastCompress)
+        compressed = [self fastCompressData:data];
+    // bzip2 is always available, and readable by older versions
+    if (compressed == nil)
+        compressed = [self bzipData:data];
+    return compressed;
+}
+
+- (NSData *)decompressData:(NSData *)data;
+{
+    if ([self isFastCompressedData:data])
+        return [self fastDecompressData:data];
+    else
+        return [self bunzipData:data];
+}
+
+- (BOOL)isCompressedData:(NSData *)data;
+{
+    return [self isBzipData:data] || [self isFastCompressedData:data];
+}
+
 // 
 // implementation modified after http://www.cocoadev.com/index.pl?NSDataPlusBzip (removed exceptions)
 //
@@ -706,28 +850,74 @@ static id sharedNoSplitManager = nil;
 
 - (BOOL)isBzipData:(NSData *)data;
 {
-    static NSData *bzipHeaderData = nil;
-    static NSUInteger bzipHeaderDataLength = 0;
-    if (nil == bzipHeaderData) {
-        char *h = "BZh";
-        bzipHeaderData = [[NSData alloc] initWithBytes:h length:strlen(h)];
-        bzipHeaderDataLength = [bzipHeaderData length];
+    // no lazily created header data, so this is safe to call from multiple threads
+    static const char *bzipHeader = "BZh";
+    size_t bzipHeaderLength = strlen(bzipHeader);
+    return [data length] >= bzipHeaderLength && memcmp([data bytes], bzipHeader, bzipHeaderLength) == 0;
+}
+
+// LZ4 through the Compression library, which is only available on 10.11 and later, and weakly linked
+- (NSData *)fastCompressData:(NSData *)data;
+{
+    if (&compression_encode_buffer == NULL)
+        return nil;
+    
+    size_t length = [data length];
+    if (length == 0 || length > MAX_UNCOMPRESSED_LENGTH)
+        return nil;
+    
+    // incompressible data can grow slightly, in which case encoding fails and we fall back to bzip2
+    size_t capacity = COMPRESSION_HEADER_LENGTH + length + (length >> 8) + 64;
+    uint8_t *bytes = (uint8_t *)NSZoneMalloc(NSDefaultMallocZone(), capacity);
+    if (bytes == NULL)
+        return nil;
+    
+    uint64_t swappedLength = CFSwapInt64HostToLittle((uint64_t)length);
+    memcpy(bytes, COMPRESSION_MAGIC, COMPRESSION_MAGIC_LENGTH);
+    bytes[COMPRESSION_MAGIC_LENGTH] = SKNCompressionCodecLZ4;
+    memcpy(bytes + COMPRESSION_MAGIC_LENGTH + 1, &swappedLength, sizeof(uint64_t));
+    
+    size_t compressedLength = compression_encode_buffer(bytes + COMPRESSION_HEADER_LENGTH, capacity - COMPRESSION_HEADER_LENGTH, [data bytes], length, NULL, COMPRESSION_LZ4);
+    if (compressedLength == 0) {
+        NSZoneFree(NSDefaultMallocZone(), bytes);
+        return nil;
     }
+    
+    // let NSData worry about freeing the buffer
+    return [[[NSData alloc] initWithBytesNoCopy:bytes length:COMPRESSION_HEADER_LENGTH + compressedLength] autorelease];
+}
+
+- (NSData *)fastDecompressData:(NSData *)data;
+{
+    if ([self isFastCompressedData:data] == NO || &compression_decode_buffer == NULL)
+        return nil;
+    
+    const uint8_t *bytes = [data bytes];
+    uint64_t length;
+    memcpy(&length, bytes + COMPRESSION_MAGIC_LENGTH + 1, sizeof(uint64_t));
+    length = CFSwapInt64LittleToHost(length);
+    
+    if (bytes[COMPRESSION_MAGIC_LENGTH] != SKNCompressionCodecLZ4 || length > MAX_UNCOMPRESSED_LENGTH)
+        return nil;
+    if (length == 0)
+        return [NSData data];
+    
+    NSMutableData *decompressed = [NSMutableData dataWithLength:(NSUInteger)length];
+    size_t decompressedLength = compression_decode_buffer([decompressed mutableBytes], (size_t)length, bytes + COMPRESSION_HEADER_LENGTH, [data length] - COMPRESSION_HEADER_LENGTH, NULL, COMPRESSION_LZ4);
+    
+    return decompressedLength == length ? decompressed : nil;
+}
 
-    return [data length] >= bzipHeaderDataLength && [bzipHeaderData isEqual:[data subdataWithRange:NSMakeRange(0, bzipHeaderDataLength)]];
+- (BOOL)isFastCompressedData:(NSData *)data;
+{
+    return [data length] >= COMPRESSION_HEADER_LENGTH && memcmp([data bytes], COMPRESSION_MAGIC, COMPRESSION_MAGIC_LENGTH) == 0;
 }
 
 - (BOOL)isPlistData:(NSData *)data;
 {
-    static NSData *plistHeaderData = nil;
-    static NSUInteger plistHeaderDataLength = 0;
-    if (nil == plistHeaderData) {
-        char *h = "bplist00";
-        plistHeaderData = [[NSData alloc] initWithBytes:h length:strlen(h)];
-        plistHeaderDataLength = [plistHeaderData length];
-    }
-
-    return [data length] >= plistHeaderDataLength && [plistHeaderData isEqual:[data subdataWithRange:NSMakeRange(0, plistHeaderDataLength)]];
+    static const char *plistHeader = "bplist00";
+    size_t plistHeaderLength = strlen(plistHeader);
+    return [data length] >= plistHeaderLength && memcmp([data bytes], plistHeader, plistHeaderLength) == 0;
 }
 
 @end
@@ -1,10 +1,10 @@
 //
-//  SKPDFSyncRecord.h
-//  Skim
+//  SKNRTFString.h
+//  SkimNotes
 //
-//  Created by Christiaan Hofman on 7/12/08.
+//  Created by Christiaan Hofman on 12/22/20.
 /*
- This software is Copyright (c) 2008-2020
+ This software is Copyright (c) 2020
  Christiaan Hofman. All rights reserved.
 
  Redistribution and use in source and binary forms, with or without
@@ -36,24 +36,9 @@
  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#import <Cocoa/Cocoa.h>
+#import <Foundation/Foundation.h>
 
-
-@interface SKPDFSyncRecord : NSObject {
-    NSInteger recordIndex;
-    NSInteger pageIndex;
-    NSPoint point;
-    NSString *file;
-    NSInteger line;
-}
-
-@property (nonatomic, readonly) NSInteger recordIndex;
-@property (nonatomic) NSInteger pageIndex;
-@property (nonatomic) NSPoint point;
-@property (nonatomic, readonly) CGFloat x, y;
-@property (nonatomic, retain) NSString *file;
-@property (nonatomic) NSInteger line;
-
-- (id)initWithRecordIndex:(NSInteger)aRecordIndex;
-
-@end
+// Extracts the plain text from RTF data without building an attributed string.
+// Returns nil for anything else than plain RTF, such as RTFD, or for malformed RTF.
+// This is also compiled into the QuickLook generator, so it should only depend on Foundation.
+extern NSString *SKNCreateStringFromRTFData(NSData *data) __attribute__((visibility("hidden")));
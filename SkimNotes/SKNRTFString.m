@@ -0,0 +1,287 @@
+//
+//  SKNRTFString.m
+//  SkimNotes
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SKNRTFString.h"
+#include <ctype.h>
+
+#define SKN_RTF_MAX_DEPTH 128
+
+typedef struct _SKNRTFState {
+    BOOL skip;
+    NSUInteger unicodeSkip;
+} SKNRTFState;
+
+typedef struct _SKNRTFTextBuffer {
+    unichar *chars;
+    NSUInteger length;
+    NSUInteger capacity;
+    uint8_t *bytes;
+    NSUInteger byteLength;
+    NSUInteger byteCapacity;
+    CFStringEncoding encoding;
+} SKNRTFTextBuffer;
+
+static void SKNRTFAppendChar(SKNRTFTextBuffer *buffer, unichar ch);
+
+static void SKNRTFFlushBytes(SKNRTFTextBuffer *buffer) {
+    if (buffer->byteLength == 0)
+        return;
+    CFStringRef string = CFStringCreateWithBytes(kCFAllocatorDefault, buffer->bytes, buffer->byteLength, buffer->encoding, false);
+    if (string == NULL)
+        string = CFStringCreateWithBytes(kCFAllocatorDefault, buffer->bytes, buffer->byteLength, kCFStringEncodingWindowsLatin1, false);
+    buffer->byteLength = 0;
+    if (string) {
+        CFIndex i, length = CFStringGetLength(string);
+        for (i = 0; i < length; i++)
+            SKNRTFAppendChar(buffer, CFStringGetCharacterAtIndex(string, i));
+        CFRelease(string);
+    }
+}
+
+static void SKNRTFAppendChar(SKNRTFTextBuffer *buffer, unichar ch) {
+    if (buffer->byteLength)
+        SKNRTFFlushBytes(buffer);
+    if (buffer->length >= buffer->capacity) {
+        buffer->capacity = MAX(2 * buffer->capacity, (NSUInteger)256);
+        buffer->chars = (unichar *)realloc(buffer->chars, buffer->capacity * sizeof(unichar));
+    }
+    buffer->chars[buffer->length++] = ch;
+}
+
+// bytes are collected so multi-byte code pages are converted as a whole
+static void SKNRTFAppendByte(SKNRTFTextBuffer *buffer, uint8_t byte) {
+    if (byte < 0x80 && buffer->byteLength == 0) {
+        SKNRTFAppendChar(buffer, byte);
+        return;
+    }
+    if (buffer->byteLength >= buffer->byteCapacity) {
+        buffer->byteCapacity = MAX(2 * buffer->byteCapacity, (NSUInteger)64);
+        buffer->bytes = (uint8_t *)realloc(buffer->bytes, buffer->byteCapacity);
+    }
+    buffer->bytes[buffer->byteLength++] = byte;
+}
+
+static inline int SKNHexValue(uint8_t ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+static BOOL SKNIsSkippedRTFDestination(const char *word) {
+    static const char *destinations[] = {"fonttbl", "colortbl", "expandedcolortbl", "stylesheet", "info", "pict", "object", "header", "headerl", "headerr", "headerf", "footer", "footerl", "footerr", "footerf", "listtable", "listoverridetable", "NeXTGraphic", "fldinst", "themedata", "generator", NULL};
+    const char **dest;
+    for (dest = destinations; *dest; dest++) {
+        if (strcmp(word, *dest) == 0)
+            return YES;
+    }
+    return NO;
+}
+
+static unichar SKNRTFCharacterForControlWord(const char *word) {
+    switch (word[0]) {
+        case 'p':
+            if (strcmp(word, "par") == 0) return '\n';
+            if (strcmp(word, "page") == 0) return 0x000C;
+            break;
+        case 'l':
+            if (strcmp(word, "line") == 0) return 0x2028;
+            if (strcmp(word, "lquote") == 0) return 0x2018;
+            if (strcmp(word, "ldblquote") == 0) return 0x201C;
+            break;
+        case 'r':
+            if (strcmp(word, "rquote") == 0) return 0x2019;
+            if (strcmp(word, "rdblquote") == 0) return 0x201D;
+            break;
+        case 't':
+            if (strcmp(word, "tab") == 0) return '\t';
+            break;
+        case 'e':
+            if (strcmp(word, "emdash") == 0) return 0x2014;
+            if (strcmp(word, "endash") == 0) return 0x2013;
+            if (strcmp(word, "emspace") == 0) return 0x2003;
+            if (strcmp(word, "enspace") == 0) return 0x2002;
+            break;
+        case 'b':
+            if (strcmp(word, "bullet") == 0) return 0x2022;
+            break;
+        case 's':
+            if (strcmp(word, "sect") == 0) return '\n';
+            break;
+    }
+    return 0;
+}
+
+NSString *SKNCreateStringFromRTFData(NSData *data) {
+    const uint8_t *bytes = (const uint8_t *)[data bytes];
+    NSUInteger length = [data length], i = 0;
+    
+    if (length < 5 || strncmp((const char *)bytes, "{\\rtf", 5) != 0)
+        return nil;
+    
+    SKNRTFState stack[SKN_RTF_MAX_DEPTH];
+    SKNRTFState state = {NO, 1};
+    NSUInteger depth = 0, skipCount = 0;
+    SKNRTFTextBuffer buffer = {NULL, 0, 0, NULL, 0, 0, kCFStringEncodingWindowsLatin1};
+    BOOL failed = NO;
+    
+    while (i < length && failed == NO) {
+        uint8_t ch = bytes[i++];
+        if (ch == '{') {
+            if (depth >= SKN_RTF_MAX_DEPTH) {
+                failed = YES;
+            } else {
+                stack[depth++] = state;
+                skipCount = 0;
+            }
+        } else if (ch == '}') {
+            if (depth == 0)
+                break;
+            state = stack[--depth];
+            skipCount = 0;
+        } else if (ch == '\r' || ch == '\n') {
+            continue;
+        } else if (ch != '\\') {
+            if (skipCount > 0)
+                skipCount--;
+            else if (state.skip == NO)
+                SKNRTFAppendByte(&buffer, ch);
+        } else if (i < length) {
+            ch = bytes[i++];
+            if (isalpha(ch)) {
+                char word[32];
+                NSUInteger wordLength = 0;
+                BOOL hasParam = NO, negative = NO;
+                NSInteger param = 0;
+                NSUInteger digitCount = 0;
+                word[wordLength++] = ch;
+                while (i < length && isalpha(bytes[i])) {
+                    if (wordLength < sizeof(word) - 1)
+                        word[wordLength++] = bytes[i];
+                    i++;
+                }
+                word[wordLength] = 0;
+                if (i < length && bytes[i] == '-') {
+                    negative = YES;
+                    i++;
+                }
+                // parameters have at most 10 digits, skip any more instead of overflowing
+                while (i < length && isdigit(bytes[i])) {
+                    hasParam = YES;
+                    if (digitCount++ < 10)
+                        param = 10 * param + (bytes[i] - '0');
+                    i++;
+                }
+                if (param > INT32_MAX)
+                    param = INT32_MAX;
+                if (negative)
+                    param = -param;
+                if (i < length && bytes[i] == ' ')
+                    i++;
+                
+                if (strcmp(word, "bin") == 0) {
+                    i += MIN((NSUInteger)MAX(param, 0), length - i);
+                } else if (state.skip) {
+                    continue;
+                } else if (strcmp(word, "u") == 0 && hasParam) {
+                    SKNRTFAppendChar(&buffer, (unichar)(param < 0 ? param + 65536 : param));
+                    skipCount = state.unicodeSkip;
+                } else if (strcmp(word, "uc") == 0 && hasParam) {
+                    state.unicodeSkip = MAX(param, 0);
+                } else if (strcmp(word, "ansicpg") == 0 && hasParam) {
+                    CFStringEncoding encoding = CFStringConvertWindowsCodepageToEncoding((UInt32)param);
+                    if (encoding != kCFStringEncodingInvalidId)
+                        buffer.encoding = encoding;
+                } else if (strcmp(word, "mac") == 0) {
+                    buffer.encoding = kCFStringEncodingMacRoman;
+                } else if (strcmp(word, "pc") == 0) {
+                    buffer.encoding = kCFStringEncodingDOSLatinUS;
+                } else if (strcmp(word, "pca") == 0) {
+                    buffer.encoding = kCFStringEncodingDOSLatin1;
+                } else if (SKNIsSkippedRTFDestination(word)) {
+                    state.skip = YES;
+                } else {
+                    unichar uch = SKNRTFCharacterForControlWord(word);
+                    if (uch) {
+                        if (skipCount > 0)
+                            skipCount--;
+                        else
+                            SKNRTFAppendChar(&buffer, uch);
+                    }
+                }
+            } else if (ch == '\'') {
+                int hi = i + 1 < length ? SKNHexValue(bytes[i]) : -1, lo = hi >= 0 ? SKNHexValue(bytes[i + 1]) : -1;
+                if (lo < 0) {
+                    failed = YES;
+                } else {
+                    i += 2;
+                    if (skipCount > 0)
+                        skipCount--;
+                    else if (state.skip == NO)
+                        SKNRTFAppendByte(&buffer, (uint8_t)((hi << 4) | lo));
+                }
+            } else if (ch == '*') {
+                state.skip = YES;
+            } else if (state.skip == NO) {
+                unichar uch = 0;
+                switch (ch) {
+                    case '\\': case '{': case '}': uch = ch; break;
+                    case '~': uch = 0x00A0; break;
+                    case '_': uch = 0x2011; break;
+                    case '\r': case '\n': uch = '\n'; break;
+                    default: break;
+                }
+                if (uch) {
+                    if (skipCount > 0)
+                        skipCount--;
+                    else
+                        SKNRTFAppendChar(&buffer, uch);
+                }
+            }
+        }
+    }
+    
+    NSString *string = nil;
+    if (failed == NO) {
+        SKNRTFFlushBytes(&buffer);
+        string = buffer.length ? [[NSString alloc] initWithCharacters:buffer.chars length:buffer.length] : [[NSString alloc] init];
+    }
+    if (buffer.chars) free(buffer.chars);
+    if (buffer.bytes) free(buffer.bytes);
+    return string;
+}
@@ -43,6 +43,9 @@
     NSString *agentIdentifier;
     NSConnection *connection;
     id agent;
+    BOOL agentSupportsBatchRequests;
+    dispatch_queue_t idleQueue;
+    dispatch_source_t idleTimer;
 }
 
 + (id)sharedReader;
@@ -55,4 +58,9 @@
 - (NSData *)RTFNotesAtURL:(NSURL *)fileURL;
 - (NSString *)textNotesAtURL:(NSURL *)fileURL;
 
+// these read the notes for many files using a few messages to the agent, the results contain NSNull for files without readable notes
+- (NSArray *)SkimNotesAtURLs:(NSArray *)fileURLs;
+- (NSArray *)RTFNotesAtURLs:(NSArray *)fileURLs;
+- (NSArray *)textNotesAtURLs:(NSArray *)fileURLs;
+
 @end
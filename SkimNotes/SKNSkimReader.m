@@ -40,6 +40,16 @@
 #import "SKNAgentListenerProtocol.h"
 
 #define AGENT_TIMEOUT 1.0f
+// the agent is kept running between requests, and is only shut down after this much inactivity
+#define AGENT_IDLE_TIMEOUT 30.0
+// maximum number of files read in a single message to the agent
+#define AGENT_BATCH_SIZE 32
+
+enum {
+    SKNSkimNotesType,
+    SKNRTFNotesType,
+    SKNTextNotesType
+};
 
 @implementation SKNSkimReader
 
@@ -50,10 +60,28 @@
     return sharedReader;
 }
 
+- (id)init {
+    self = [super init];
+    if (self) {
+        idleQueue = dispatch_queue_create("net.sourceforge.skim-app.idleQueue.SKNSkimReader", NULL);
+    }
+    return self;
+}
+
+- (void)cancelIdleTimeout {
+    if (idleTimer) {
+        dispatch_source_cancel(idleTimer);
+        dispatch_release(idleTimer);
+        idleTimer = NULL;
+    }
+}
+
 - (void)destroyConnection {
+    [self cancelIdleTimeout];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:NSConnectionDidDieNotification object:connection];
     [agent release];
     agent = nil;
+    agentSupportsBatchRequests = NO;
     
     [[connection receivePort] invalidate];
     [[connection sendPort] invalidate];
@@ -65,6 +93,7 @@
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
     [self destroyConnection];
+    dispatch_release(idleQueue);
     [agentIdentifier release];
     [super dealloc];
 }
@@ -76,8 +105,8 @@
 - (void)setAgentIdentifier:(NSString *)identifier {
     NSAssert(connection == nil, @"agentIdentifier must be set before connecting");
     if (connection == nil && agentIdentifier != identifier) {
-        [identifier release];
-        identifier = [agentIdentifier retain];
+        [agentIdentifier release];
+        agentIdentifier = [identifier retain];
     }
 }
 
@@ -134,6 +163,27 @@
     return taskLaunched;
 }    
 
+// the timer runs on our own queue, because the reader is often used on threads that do not run their run loop
+- (void)scheduleIdleTimeout {
+    @synchronized(self) {
+        [self cancelIdleTimeout];
+        if (connection) {
+            __block SKNSkimReader *reader = self;
+            __block dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, idleQueue);
+            dispatch_source_set_event_handler(timer, ^{
+                @synchronized(reader) {
+                    // a request may have rescheduled the timeout while we were waiting for it to finish
+                    if (dispatch_source_testcancel(timer) == 0)
+                        [reader destroyConnection];
+                }
+            });
+            dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(AGENT_IDLE_TIMEOUT * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC);
+            dispatch_resume(timer);
+            idleTimer = timer;
+        }
+    }
+}
+
 - (void)establishConnection {
     static int numberOfConnectionAttempts = 0;
     if (numberOfConnectionAttempts++ > 100) {
@@ -171,6 +221,10 @@
                 id server = [connection rootProxy];
                 [server setProtocolForProxy:@protocol(SKNAgentListenerProtocol)];
                 agent = [server retain];
+                // an agent from an older version of the tool may not implement the batch methods
+                agentSupportsBatchRequests = [agent respondsToSelector:@selector(SkimNotesAtPaths:)];
+                // idle timeouts are not failures, so allow reconnecting as often as needed
+                numberOfConnectionAttempts = 0;
             }
             @catch(id exception) {
                 NSLog(@"Error: exception \"%@\" caught when contacting SkimNotesAgent", exception);
@@ -180,10 +234,7 @@
     }
 }    
 
-- (BOOL)connectAndCheckTypeOfFile:(NSURL *)fileURL {
-    if (nil == connection)
-        [self establishConnection];
-    
+- (BOOL)checkTypeOfFile:(NSURL *)fileURL {
     // these checks are client side to avoid connecting to the server unless it's really necessary
     NSWorkspace *ws = [NSWorkspace sharedWorkspace];
     NSString *fileType = [ws typeOfFile:[fileURL path] error:NULL];
@@ -197,49 +248,152 @@
     return NO;
 }
 
+- (BOOL)connectAndCheckTypeOfFile:(NSURL *)fileURL {
+    if (nil == connection)
+        [self establishConnection];
+    
+    return [self checkTypeOfFile:fileURL];
+}
+
 - (NSData *)SkimNotesAtURL:(NSURL *)fileURL {
-    NSData *data = nil;
-    if ([self connectAndCheckTypeOfFile:fileURL]) {
-        @try{
-            data = [agent SkimNotesAtPath:[fileURL path]];
-        }
-        @catch(id exception){
-            data = nil;
-            NSLog(@"-[SKNSkimReader SkimNotesAtURL:] caught %@ while contacting skim agent", exception);
-            [self destroyConnection];
+    // the idle timeout must not close the connection while we use it
+    @synchronized(self) {
+        NSData *data = nil;
+        if ([self connectAndCheckTypeOfFile:fileURL]) {
+            @try{
+                data = [agent SkimNotesAtPath:[fileURL path]];
+            }
+            @catch(id exception){
+                data = nil;
+                NSLog(@"-[SKNSkimReader SkimNotesAtURL:] caught %@ while contacting skim agent", exception);
+                [self destroyConnection];
+            }
         }
+        [self scheduleIdleTimeout];
+        return data;
     }
-    return data;
 }
 
 - (NSData *)RTFNotesAtURL:(NSURL *)fileURL {   
-    NSData *data = nil;
-    if ([self connectAndCheckTypeOfFile:fileURL]) {
-        @try{
-            data = [agent RTFNotesAtPath:[fileURL path]];
-        }
-        @catch(id exception){
-            data = nil;
-            NSLog(@"-[SKNSkimReader RTFNotesAtURL:] caught %@ while contacting skim agent", exception);
-            [self destroyConnection];
+    @synchronized(self) {
+        NSData *data = nil;
+        if ([self connectAndCheckTypeOfFile:fileURL]) {
+            @try{
+                data = [agent RTFNotesAtPath:[fileURL path]];
+            }
+            @catch(id exception){
+                data = nil;
+                NSLog(@"-[SKNSkimReader RTFNotesAtURL:] caught %@ while contacting skim agent", exception);
+                [self destroyConnection];
+            }
         }
+        [self scheduleIdleTimeout];
+        return data;
     }
-    return data;
 }
 
 - (NSString *)textNotesAtURL:(NSURL *)fileURL {   
-    NSData *textData = nil;
-    if ([self connectAndCheckTypeOfFile:fileURL]) {
-        @try{
-            textData = [agent textNotesAtPath:[fileURL path] encoding:NSUnicodeStringEncoding];
+    @synchronized(self) {
+        NSData *textData = nil;
+        if ([self connectAndCheckTypeOfFile:fileURL]) {
+            @try{
+                textData = [agent textNotesAtPath:[fileURL path] encoding:NSUnicodeStringEncoding];
+            }
+            @catch(id exception){
+                textData = nil;
+                NSLog(@"-[SKNSkimReader textNotesAtURL:] caught %@ while contacting skim agent", exception);
+                [self destroyConnection];
+            }
         }
-        @catch(id exception){
-            textData = nil;
-            NSLog(@"-[SKNSkimReader textNotesAtURL:] caught %@ while contacting skim agent", exception);
-            [self destroyConnection];
+        [self scheduleIdleTimeout];
+        return textData ? [[[NSString alloc] initWithData:textData encoding:NSUnicodeStringEncoding] autorelease] : nil;
+    }
+}
+
+- (NSArray *)notesOfType:(NSInteger)type forPaths:(NSArray *)paths {
+    if (agentSupportsBatchRequests) {
+        NSArray *results = nil;
+        // the agent needs time for every file, so scale the timeout
+        [connection setReplyTimeout:AGENT_TIMEOUT * [paths count]];
+        if (type == SKNSkimNotesType)
+            results = [agent SkimNotesAtPaths:paths];
+        else if (type == SKNRTFNotesType)
+            results = [agent RTFNotesAtPaths:paths];
+        else
+            results = [agent textNotesAtPaths:paths encoding:NSUnicodeStringEncoding];
+        [connection setReplyTimeout:AGENT_TIMEOUT];
+        return [results count] == [paths count] ? results : nil;
+    } else {
+        NSMutableArray *results = [NSMutableArray arrayWithCapacity:[paths count]];
+        for (NSString *path in paths) {
+            id result = nil;
+            if (type == SKNSkimNotesType)
+                result = [agent SkimNotesAtPath:path];
+            else if (type == SKNRTFNotesType)
+                result = [agent RTFNotesAtPath:path];
+            else
+                result = [agent textNotesAtPath:path encoding:NSUnicodeStringEncoding];
+            [results addObject:result ?: [NSNull null]];
+        }
+        return results;
+    }
+}
+
+- (NSArray *)notesOfType:(NSInteger)type atURLs:(NSArray *)fileURLs {
+    @synchronized(self) {
+        NSUInteger i, count = [fileURLs count];
+        NSMutableArray *results = [NSMutableArray arrayWithCapacity:count];
+        NSMutableArray *paths = [NSMutableArray array];
+        NSMutableArray *indexes = [NSMutableArray array];
+    
+        for (i = 0; i < count; i++) {
+            NSURL *fileURL = [fileURLs objectAtIndex:i];
+            [results addObject:[NSNull null]];
+            if ([self checkTypeOfFile:fileURL]) {
+                [paths addObject:[fileURL path]];
+                [indexes addObject:[NSNumber numberWithUnsignedInteger:i]];
+            }
+        }
+    
+        if ([paths count] && nil == connection)
+            [self establishConnection];
+    
+        // send the paths in chunks, so a single message does not get too large or slow
+        for (i = 0; agent && i < [paths count]; i += AGENT_BATCH_SIZE) {
+            NSRange range = NSMakeRange(i, MIN((NSUInteger)AGENT_BATCH_SIZE, [paths count] - i));
+            NSArray *chunkResults = nil;
+            @try{
+                chunkResults = [self notesOfType:type forPaths:[paths subarrayWithRange:range]];
+            }
+            @catch(id exception){
+                chunkResults = nil;
+                NSLog(@"-[SKNSkimReader notesOfType:atURLs:] caught %@ while contacting skim agent", exception);
+                [self destroyConnection];
+            }
+            NSUInteger j;
+            for (j = 0; j < [chunkResults count]; j++) {
+                id result = [chunkResults objectAtIndex:j];
+                if (type == SKNTextNotesType && [result isKindOfClass:[NSData class]])
+                    result = [[[NSString alloc] initWithData:result encoding:NSUnicodeStringEncoding] autorelease] ?: [NSNull null];
+                [results replaceObjectAtIndex:[[indexes objectAtIndex:range.location + j] unsignedIntegerValue] withObject:result];
+            }
         }
+    
+        [self scheduleIdleTimeout];
+        return results;
     }
-    return textData ? [[[NSString alloc] initWithData:textData encoding:NSUnicodeStringEncoding] autorelease] : nil;
+}
+
+- (NSArray *)SkimNotesAtURLs:(NSArray *)fileURLs {
+    return [self notesOfType:SKNSkimNotesType atURLs:fileURLs];
+}
+
+- (NSArray *)RTFNotesAtURLs:(NSArray *)fileURLs {
+    return [self notesOfType:SKNRTFNotesType atURLs:fileURLs];
+}
+
+- (NSArray *)textNotesAtURLs:(NSArray *)fileURLs {
+    return [self notesOfType:SKNTextNotesType atURLs:fileURLs];
 }
 
 
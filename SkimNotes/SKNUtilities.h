@@ -52,6 +52,11 @@
 
 extern NSString *SKNSkimTextNotes(NSArray *noteDicts);
 extern NSData *SKNSkimRTFNotes(NSArray *noteDicts);
+extern void SKNSkimTextAndRTFNotes(NSArray *noteDicts, NSString **textNotes, NSData **rtfNotes);
+extern NSString *SKNStringFromSkimNoteText(id text);
 
 extern NSArray *SKNSkimNotesFromData(NSData *data);
 extern NSData *SKNDataFromSkimNotes(NSArray *noteDicts, BOOL asPlist);
+extern NSData *SKNBinaryDataFromSkimNotes(NSArray *noteDicts);
+extern NSData *SKNBinaryChunkFromSkimNote(NSDictionary *noteDict);
+extern NSData *SKNBinaryDataFromSkimNoteChunks(NSArray *chunks);
@@ -37,6 +37,7 @@
  */
 
 #import "SKNUtilities.h"
+#import "SKNRTFString.h"
 #import <AppKit/AppKit.h>
 
 #define NOTE_PAGE_INDEX_KEY @"pageIndex"
@@ -53,12 +54,14 @@
 
 #define NOTE_WIDGET_TYPE @"Widget"
 
-NSString *SKNSkimTextNotes(NSArray *noteDicts) {
-    NSMutableString *textString = [NSMutableString string];
-    NSEnumerator *dictEnum = [noteDicts objectEnumerator];
-    NSDictionary *dict;
+// walks the notes once, decoding the rich text of each note at most once, either output can be nil
+static void SKNAppendSkimNotes(NSArray *noteDicts, NSMutableString *textString, NSMutableAttributedString *attrString) {
+    // plain text for the RTF is collected and appended in a single edit before the next rich text
+    NSMutableString *pendingString = attrString ? [NSMutableString stringWithCapacity:256] : nil;
+    
+    [attrString beginEditing];
     
-    while (dict = [dictEnum nextObject]) {
+    for (NSDictionary *dict in noteDicts) {
         NSString *type = [dict objectForKey:NOTE_TYPE_KEY];
         
         if ([type isEqualToString:NOTE_WIDGET_TYPE])
@@ -66,61 +69,79 @@ NSString *SKNSkimTextNotes(NSArray *noteDicts) {
         
         NSUInteger pageIndex = [[dict objectForKey:NOTE_PAGE_INDEX_KEY] unsignedIntegerValue];
         NSString *string = [dict objectForKey:NOTE_CONTENTS_KEY];
-        NSAttributedString *text = [dict objectForKey:NOTE_TEXT_KEY];
+        id text = [dict objectForKey:NOTE_TEXT_KEY];
+        NSAttributedString *attrText = nil;
+        NSString *plainText = nil;
         
         if (pageIndex == NSNotFound || pageIndex == INT_MAX)
             pageIndex = 0;
         
-        if ([text isKindOfClass:[NSData class]])
-            text = [[[NSAttributedString alloc] initWithData:(NSData *)text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease];
+        if (attrString) {
+            if ([text isKindOfClass:[NSAttributedString class]])
+                attrText = text;
+            else if ([text isKindOfClass:[NSData class]])
+                attrText = [[[NSAttributedString alloc] initWithData:text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease];
+            plainText = [attrText string];
+        } else {
+            plainText = SKNStringFromSkimNoteText(text);
+        }
         
-        [textString appendFormat:@"* %@, page %lu\n\n", type, (long)pageIndex + 1];
+        NSString *header = [NSString stringWithFormat:@"* %@, page %lu\n\n", type, (long)pageIndex + 1];
+        [textString appendString:header];
+        [pendingString appendString:header];
         if ([string length]) {
             [textString appendString:string];
             [textString appendString:@" \n\n"];
+            [pendingString appendString:string];
+            [pendingString appendString:@" \n\n"];
         }
-        if ([text length]) {
-            [textString appendString:[text string]];
+        if ([plainText length]) {
+            [textString appendString:plainText];
             [textString appendString:@" \n\n"];
+            if (attrString) {
+                [attrString replaceCharactersInRange:NSMakeRange([attrString length], 0) withString:pendingString];
+                [pendingString setString:@" \n\n"];
+                [attrString appendAttributedString:attrText];
+            }
         }
     }
+    
+    if ([pendingString length])
+        [attrString replaceCharactersInRange:NSMakeRange([attrString length], 0) withString:pendingString];
+    [attrString fixAttributesInRange:NSMakeRange(0, [attrString length])];
+    
+    [attrString endEditing];
+}
+
+static inline NSMutableString *SKNCreateTextNotesString(NSArray *noteDicts) {
+    // a rough estimate of the size, to avoid most reallocations
+    return [[NSMutableString alloc] initWithCapacity:128 * [noteDicts count]];
+}
+
+static inline NSData *SKNRTFDataFromAttributedString(NSAttributedString *attrString) {
+    return [attrString RTFFromRange:NSMakeRange(0, [attrString length]) documentAttributes:[NSDictionary dictionaryWithObjectsAndKeys:NSRTFTextDocumentType, NSDocumentTypeDocumentAttribute, nil]];
+}
+
+NSString *SKNSkimTextNotes(NSArray *noteDicts) {
+    NSMutableString *textString = [SKNCreateTextNotesString(noteDicts) autorelease];
+    SKNAppendSkimNotes(noteDicts, textString, nil);
     return textString;
 }
 
 NSData *SKNSkimRTFNotes(NSArray *noteDicts) {
     NSMutableAttributedString *attrString = [[[NSMutableAttributedString alloc] init] autorelease];
-    NSEnumerator *dictEnum = [noteDicts objectEnumerator];
-    NSDictionary *dict;
-    
-    while (dict = [dictEnum nextObject]) {
-        NSString *type = [dict objectForKey:NOTE_TYPE_KEY];
-        
-        if ([type isEqualToString:NOTE_WIDGET_TYPE])
-            continue;
-        
-        NSUInteger pageIndex = [[dict objectForKey:NOTE_PAGE_INDEX_KEY] unsignedIntegerValue];
-        NSString *string = [dict objectForKey:NOTE_CONTENTS_KEY];
-        NSAttributedString *text = [dict objectForKey:NOTE_TEXT_KEY];
-        
-        if (pageIndex == NSNotFound || pageIndex == INT_MAX)
-            pageIndex = 0;
-        
-        if ([text isKindOfClass:[NSData class]])
-            text = [[[NSAttributedString alloc] initWithData:(NSData *)text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease];
-        
-        [attrString replaceCharactersInRange:NSMakeRange([attrString length], 0) withString:[NSString stringWithFormat:@"* %@, page %lu\n\n", type, (long)pageIndex + 1]];
-        if ([string length]) {
-            [attrString replaceCharactersInRange:NSMakeRange([attrString length], 0) withString:string];
-            [attrString replaceCharactersInRange:NSMakeRange([attrString length], 0) withString:@" \n\n"];
-        }
-        if ([text length]) {
-            [attrString appendAttributedString:text];
-            [attrString replaceCharactersInRange:NSMakeRange([attrString length], 0) withString:@" \n\n"];
-            
-        }
-    }
-    [attrString fixAttributesInRange:NSMakeRange(0, [attrString length])];
-    return [attrString RTFFromRange:NSMakeRange(0, [attrString length]) documentAttributes:[NSDictionary dictionaryWithObjectsAndKeys:NSRTFTextDocumentType, NSDocumentTypeDocumentAttribute, nil]];
+    SKNAppendSkimNotes(noteDicts, nil, attrString);
+    return SKNRTFDataFromAttributedString(attrString);
+}
+
+void SKNSkimTextAndRTFNotes(NSArray *noteDicts, NSString **textNotes, NSData **rtfNotes) {
+    NSMutableString *textString = textNotes ? [SKNCreateTextNotesString(noteDicts) autorelease] : nil;
+    NSMutableAttributedString *attrString = rtfNotes ? [[[NSMutableAttributedString alloc] init] autorelease] : nil;
+    SKNAppendSkimNotes(noteDicts, textString, attrString);
+    if (textNotes)
+        *textNotes = textString;
+    if (rtfNotes)
+        *rtfNotes = SKNRTFDataFromAttributedString(attrString);
 }
 
 #pragma mark -
@@ -176,10 +197,694 @@ static NSColor *SKNColorFromArray(NSArray *array) {
     }
 }
 
+#pragma mark Lazy values
+
+// decodes the RTF or RTFD data only when the contents are first needed
+@interface SKNLazyAttributedString : NSAttributedString {
+    NSData *data;
+    NSAttributedString *attributedString;
+    NSString *plainString;
+}
+- (id)initWithData:(NSData *)aData;
+@property (nonatomic, readonly) NSData *data;
+@property (nonatomic, readonly) NSAttributedString *attributedString;
+@property (nonatomic, readonly) NSString *plainString;
+@property (nonatomic, readonly, getter=isDecoded) BOOL decoded;
+@end
+
+@implementation SKNLazyAttributedString
+
+@synthesize data;
+@dynamic attributedString, plainString, decoded;
+
+- (id)initWithData:(NSData *)aData {
+    self = [super init];
+    if (self) {
+        data = [aData retain];
+        attributedString = nil;
+        plainString = nil;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [data release];
+    [attributedString release];
+    [plainString release];
+    [super dealloc];
+}
+
+- (NSAttributedString *)attributedString {
+    if (attributedString == nil) {
+        attributedString = [[NSAttributedString alloc] initWithData:data options:[NSDictionary dictionary] documentAttributes:NULL error:NULL];
+        if (attributedString == nil)
+            attributedString = [[NSAttributedString alloc] init];
+    }
+    return attributedString;
+}
+
+// the text without decoding the attributes, which may differ in minor details from the string of the decoded attributed string
+- (NSString *)plainString {
+    if (attributedString)
+        return [attributedString string];
+    if (plainString == nil)
+        plainString = SKNCreateStringFromRTFData(data);
+    return plainString ?: [[self attributedString] string];
+}
+
+- (BOOL)isDecoded {
+    return attributedString != nil;
+}
+
+- (NSString *)string {
+    return [[self attributedString] string];
+}
+
+- (NSUInteger)length {
+    return [[self attributedString] length];
+}
+
+- (NSDictionary *)attributesAtIndex:(NSUInteger)location effectiveRange:(NSRangePointer)range {
+    return [[self attributedString] attributesAtIndex:location effectiveRange:range];
+}
+
+- (id)replacementObjectForCoder:(NSCoder *)aCoder {
+    return [self attributedString];
+}
+
+- (id)replacementObjectForPortCoder:(NSPortCoder *)aCoder {
+    return [self attributedString];
+}
+
+@end
+
+// draws an image from the encoded data, which is only decoded when the image is first drawn
+@interface SKNLazyImageRep : NSImageRep {
+    NSData *data;
+    NSImageRep *imageRep;
+}
+- (id)initWithData:(NSData *)aData size:(NSSize)aSize;
+@property (nonatomic, readonly) NSData *data;
+@property (nonatomic, readonly) NSImageRep *imageRep;
+@end
+
+@implementation SKNLazyImageRep
+
+@synthesize data;
+@dynamic imageRep;
+
+- (id)initWithData:(NSData *)aData size:(NSSize)aSize {
+    self = [super init];
+    if (self) {
+        data = [aData retain];
+        imageRep = nil;
+        [self setSize:aSize];
+        [self setPixelsWide:NSImageRepMatchesDevice];
+        [self setPixelsHigh:NSImageRepMatchesDevice];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [data release];
+    [imageRep release];
+    [super dealloc];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    SKNLazyImageRep *copy = [super copyWithZone:zone];
+    copy->data = [data retain];
+    copy->imageRep = [imageRep retain];
+    return copy;
+}
+
+- (NSImageRep *)imageRep {
+    if (imageRep == nil)
+        imageRep = [[(id)[NSImageRep imageRepClassForData:data] imageRepWithData:data] retain];
+    return imageRep;
+}
+
+- (BOOL)draw {
+    NSSize size = [self size];
+    return [[self imageRep] drawInRect:NSMakeRect(0.0, 0.0, size.width, size.height)];
+}
+
+- (id)replacementObjectForCoder:(NSCoder *)aCoder {
+    return [self imageRep] ?: (id)self;
+}
+
+@end
+
+static NSData *SKNDataFromImage(NSImage *image) {
+    id imageRep = [[image representations] count] == 1 ? [[image representations] objectAtIndex:0] : nil;
+    if ([imageRep isKindOfClass:[SKNLazyImageRep class]])
+        return [imageRep data];
+    else if ([imageRep isKindOfClass:[NSPDFImageRep class]])
+        return [imageRep PDFRepresentation];
+    else if ([imageRep isKindOfClass:[NSEPSImageRep class]])
+        return [imageRep EPSRepresentation];
+    else
+        return [image TIFFRepresentation];
+}
+
+static NSData *SKNDataFromAttributedString(NSAttributedString *attrString) {
+    if ([attrString isKindOfClass:[SKNLazyAttributedString class]] && [(SKNLazyAttributedString *)attrString isDecoded] == NO)
+        return [(SKNLazyAttributedString *)attrString data];
+    else if ([attrString containsAttachments])
+        return [attrString RTFDFromRange:NSMakeRange(0, [attrString length]) documentAttributes:[NSDictionary dictionary]];
+    else
+        return [attrString RTFFromRange:NSMakeRange(0, [attrString length]) documentAttributes:[NSDictionary dictionary]];
+}
+
+NSString *SKNStringFromSkimNoteText(id text) {
+    if ([text isKindOfClass:[SKNLazyAttributedString class]]) {
+        return [(SKNLazyAttributedString *)text plainString];
+    } else if ([text isKindOfClass:[NSAttributedString class]]) {
+        return [(NSAttributedString *)text string];
+    } else if ([text isKindOfClass:[NSString class]]) {
+        return text;
+    } else if ([text isKindOfClass:[NSData class]]) {
+        NSString *string = [SKNCreateStringFromRTFData(text) autorelease];
+        if (string == nil)
+            string = [[[[NSAttributedString alloc] initWithData:text options:[NSDictionary dictionary] documentAttributes:NULL error:NULL] autorelease] string];
+        return string;
+    }
+    return nil;
+}
+
+#pragma mark Binary format
+
+/*
+ The binary format starts with the magic bytes and a version byte, followed by the array of notes as a single value.
+ A value is a tag byte followed by its payload. Arrays and dictionaries list their values and are closed by an end tag.
+ Dictionary values are preceded by their key. Keys are written once, later occurrences refer to their index in the order they were written.
+ A chunk is a length prefixed value with its own keys, so notes can be encoded separately and the encoded data reused when they did not change.
+ Integers are written as varints, signed integers zigzag encoded, and reals as little endian doubles.
+ Text and image data is only decoded when it is first used.
+*/
+
+#define SKN_BINARY_MAGIC "SKNB"
+#define SKN_BINARY_MAGIC_LENGTH 4
+#define SKN_BINARY_VERSION 1
+#define SKN_BINARY_MAX_DEPTH 32
+
+enum {
+    SKNBinaryTagEnd,
+    SKNBinaryTagString,
+    SKNBinaryTagInteger,
+    SKNBinaryTagReal,
+    SKNBinaryTagTrue,
+    SKNBinaryTagFalse,
+    SKNBinaryTagDate,
+    SKNBinaryTagColor,
+    SKNBinaryTagFont,
+    SKNBinaryTagText,
+    SKNBinaryTagImage,
+    SKNBinaryTagData,
+    SKNBinaryTagArray,
+    SKNBinaryTagDictionary,
+    SKNBinaryTagChunk
+};
+
+typedef struct _SKNBinaryWriter {
+    NSMutableData *data;
+    NSMapTable *keys;
+    NSUInteger keyCount;
+} SKNBinaryWriter;
+
+typedef struct _SKNBinaryReader {
+    NSData *source;
+    const uint8_t *bytes;
+    const uint8_t *end;
+    NSMutableArray *keys;
+    NSMutableDictionary *fonts;
+} SKNBinaryReader;
+
+static inline void SKNWriteByte(SKNBinaryWriter *writer, uint8_t byte) {
+    [writer->data appendBytes:&byte length:1];
+}
+
+static inline void SKNWriteVarint(SKNBinaryWriter *writer, uint64_t value) {
+    uint8_t buffer[10];
+    NSUInteger length = 0;
+    while (value >= 0x80) {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    [writer->data appendBytes:buffer length:length];
+}
+
+static inline void SKNWriteReal(SKNBinaryWriter *writer, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(uint64_t));
+    bits = CFSwapInt64HostToLittle(bits);
+    [writer->data appendBytes:&bits length:sizeof(uint64_t)];
+}
+
+static inline void SKNWriteBytes(SKNBinaryWriter *writer, NSData *data) {
+    SKNWriteVarint(writer, [data length]);
+    [writer->data appendData:data];
+}
+
+static void SKNWriteString(SKNBinaryWriter *writer, NSString *string) {
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    NSUInteger offset;
+    SKNWriteVarint(writer, length);
+    offset = [writer->data length];
+    [writer->data increaseLengthBy:length];
+    [string getBytes:(char *)[writer->data mutableBytes] + offset maxLength:length usedLength:NULL encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [string length]) remainingRange:NULL];
+}
+
+static void SKNWriteKey(SKNBinaryWriter *writer, NSString *key) {
+    // keys are written as their index plus one, or 0 followed by the key when it is new
+    NSUInteger keyIndex = (NSUInteger)NSMapGet(writer->keys, key);
+    SKNWriteVarint(writer, keyIndex);
+    if (keyIndex == 0) {
+        SKNWriteString(writer, key);
+        NSMapInsert(writer->keys, key, (void *)++writer->keyCount);
+    }
+}
+
+static uint8_t SKNBinaryTagForValue(id value, NSString *key) {
+    if ([value isKindOfClass:[NSString class]])
+        return SKNBinaryTagString;
+    else if ([value isKindOfClass:[NSNumber class]]) {
+        if (CFGetTypeID((CFTypeRef)value) == CFBooleanGetTypeID())
+            return [value boolValue] ? SKNBinaryTagTrue : SKNBinaryTagFalse;
+        const char *type = [value objCType];
+        return (type[0] == 'f' || type[0] == 'd') ? SKNBinaryTagReal : SKNBinaryTagInteger;
+    } else if ([value isKindOfClass:[NSDate class]])
+        return SKNBinaryTagDate;
+    else if ([value isKindOfClass:[NSColor class]])
+        return SKNBinaryTagColor;
+    else if ([value isKindOfClass:[NSFont class]])
+        return SKNBinaryTagFont;
+    else if ([value isKindOfClass:[NSAttributedString class]])
+        return SKNBinaryTagText;
+    else if ([value isKindOfClass:[NSImage class]])
+        return SKNBinaryTagImage;
+    else if ([value isKindOfClass:[NSData class]])
+        return [key isEqualToString:NOTE_TEXT_KEY] ? SKNBinaryTagText : [key isEqualToString:NOTE_IMAGE_KEY] ? SKNBinaryTagImage : SKNBinaryTagData;
+    else if ([value isKindOfClass:[NSArray class]])
+        return SKNBinaryTagArray;
+    else if ([value isKindOfClass:[NSDictionary class]])
+        return SKNBinaryTagDictionary;
+    else
+        return SKNBinaryTagEnd;
+}
+
+static void SKNWriteValue(SKNBinaryWriter *writer, id value, uint8_t tag) {
+    switch (tag) {
+        case SKNBinaryTagString:
+            SKNWriteString(writer, value);
+            break;
+        case SKNBinaryTagInteger:
+        {
+            int64_t integer = [value longLongValue];
+            SKNWriteVarint(writer, ((uint64_t)integer << 1) ^ (uint64_t)(integer >> 63));
+            break;
+        }
+        case SKNBinaryTagReal:
+            SKNWriteReal(writer, [value doubleValue]);
+            break;
+        case SKNBinaryTagDate:
+            SKNWriteReal(writer, [value timeIntervalSinceReferenceDate]);
+            break;
+        case SKNBinaryTagColor:
+        {
+            CGFloat r = 0.0, g = 0.0, b = 0.0, a = 1.0;
+            [[value colorUsingColorSpace:[NSColorSpace sRGBColorSpace]] getRed:&r green:&g blue:&b alpha:&a];
+            SKNWriteReal(writer, r);
+            SKNWriteReal(writer, g);
+            SKNWriteReal(writer, b);
+            SKNWriteReal(writer, a);
+            break;
+        }
+        case SKNBinaryTagFont:
+            SKNWriteString(writer, [value fontName]);
+            SKNWriteReal(writer, [value pointSize]);
+            break;
+        case SKNBinaryTagText:
+            SKNWriteBytes(writer, [value isKindOfClass:[NSData class]] ? value : SKNDataFromAttributedString(value));
+            break;
+        case SKNBinaryTagImage:
+        {
+            // the size is stored so the image can be set up without decoding the data
+            NSSize size = [value isKindOfClass:[NSImage class]] ? [value size] : NSZeroSize;
+            SKNWriteReal(writer, size.width);
+            SKNWriteReal(writer, size.height);
+            SKNWriteBytes(writer, [value isKindOfClass:[NSData class]] ? value : SKNDataFromImage(value));
+            break;
+        }
+        case SKNBinaryTagData:
+            SKNWriteBytes(writer, value);
+            break;
+        case SKNBinaryTagArray:
+            for (id item in value) {
+                uint8_t itemTag = SKNBinaryTagForValue(item, nil);
+                if (itemTag != SKNBinaryTagEnd) {
+                    SKNWriteByte(writer, itemTag);
+                    SKNWriteValue(writer, item, itemTag);
+                }
+            }
+            SKNWriteByte(writer, SKNBinaryTagEnd);
+            break;
+        case SKNBinaryTagDictionary:
+            for (NSString *key in value) {
+                if ([key isKindOfClass:[NSString class]] == NO)
+                    continue;
+                id item = [value objectForKey:key];
+                uint8_t itemTag = SKNBinaryTagForValue(item, key);
+                if (itemTag != SKNBinaryTagEnd) {
+                    SKNWriteByte(writer, itemTag);
+                    SKNWriteKey(writer, key);
+                    SKNWriteValue(writer, item, itemTag);
+                }
+            }
+            SKNWriteByte(writer, SKNBinaryTagEnd);
+            break;
+        default:
+            break;
+    }
+}
+
+static inline BOOL SKNReadByte(SKNBinaryReader *reader, uint8_t *byte) {
+    if (reader->bytes >= reader->end)
+        return NO;
+    *byte = *reader->bytes++;
+    return YES;
+}
+
+static inline BOOL SKNReadVarint(SKNBinaryReader *reader, uint64_t *value) {
+    uint64_t result = 0;
+    NSUInteger shift = 0;
+    while (reader->bytes < reader->end && shift < 64) {
+        uint8_t byte = *reader->bytes++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return YES;
+        }
+        shift += 7;
+    }
+    return NO;
+}
+
+static inline BOOL SKNReadReal(SKNBinaryReader *reader, double *value) {
+    if (reader->end - reader->bytes < (ptrdiff_t)sizeof(uint64_t))
+        return NO;
+    uint64_t bits;
+    memcpy(&bits, reader->bytes, sizeof(uint64_t));
+    bits = CFSwapInt64LittleToHost(bits);
+    memcpy(value, &bits, sizeof(uint64_t));
+    reader->bytes += sizeof(uint64_t);
+    return YES;
+}
+
+static const uint8_t *SKNReadBytes(SKNBinaryReader *reader, NSUInteger *lengthPtr) {
+    uint64_t length = 0;
+    if (SKNReadVarint(reader, &length) == NO || length > (uint64_t)(reader->end - reader->bytes))
+        return NULL;
+    const uint8_t *bytes = reader->bytes;
+    reader->bytes += length;
+    *lengthPtr = (NSUInteger)length;
+    return bytes;
+}
+
+static NSString *SKNReadString(SKNBinaryReader *reader) {
+    NSUInteger length = 0;
+    const uint8_t *bytes = SKNReadBytes(reader, &length);
+    return bytes ? [[[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding] autorelease] : nil;
+}
+
+// larger data, like images and rich text, points into the source data rather than being copied, which is cheap when the source was mapped from a file
+#define SKN_MIN_SHARED_DATA_LENGTH 16384
+
+static NSData *SKNReadData(SKNBinaryReader *reader) {
+    NSUInteger length = 0;
+    const uint8_t *bytes = SKNReadBytes(reader, &length);
+    if (bytes == NULL)
+        return nil;
+    if (length < SKN_MIN_SHARED_DATA_LENGTH || reader->source == nil)
+        return [NSData dataWithBytes:bytes length:length];
+    // keep the source alive as long as the returned data
+    NSData *source = [reader->source retain];
+    return [[[NSData alloc] initWithBytesNoCopy:(void *)bytes length:length deallocator:^(void *b, NSUInteger l){ [source release]; }] autorelease];
+}
+
+static NSString *SKNReadKey(SKNBinaryReader *reader) {
+    uint64_t keyIndex = 0;
+    if (SKNReadVarint(reader, &keyIndex) == NO)
+        return nil;
+    if (keyIndex > 0)
+        return keyIndex <= [reader->keys count] ? [reader->keys objectAtIndex:(NSUInteger)keyIndex - 1] : nil;
+    NSString *key = SKNReadString(reader);
+    if (key)
+        [reader->keys addObject:key];
+    return key;
+}
+
+static id SKNReadValue(SKNBinaryReader *reader, uint8_t tag, NSUInteger depth);
+
+static id SKNReadChunk(SKNBinaryReader *reader, NSUInteger depth) {
+    NSUInteger length = 0;
+    const uint8_t *bytes = SKNReadBytes(reader, &length);
+    SKNBinaryReader chunkReader;
+    uint8_t tag;
+    
+    if (bytes == NULL)
+        return nil;
+    
+    chunkReader.source = reader->source;
+    chunkReader.bytes = bytes;
+    chunkReader.end = bytes + length;
+    chunkReader.keys = [NSMutableArray array];
+    chunkReader.fonts = reader->fonts;
+    
+    if (SKNReadByte(&chunkReader, &tag) == NO || tag == SKNBinaryTagChunk)
+        return nil;
+    return SKNReadValue(&chunkReader, tag, depth);
+}
+
+static id SKNReadValue(SKNBinaryReader *reader, uint8_t tag, NSUInteger depth) {
+    switch (tag) {
+        case SKNBinaryTagString:
+            return SKNReadString(reader);
+        case SKNBinaryTagInteger:
+        {
+            uint64_t value = 0;
+            if (SKNReadVarint(reader, &value) == NO)
+                return nil;
+            return [NSNumber numberWithLongLong:(int64_t)(value >> 1) ^ -(int64_t)(value & 1)];
+        }
+        case SKNBinaryTagReal:
+        {
+            double value = 0.0;
+            return SKNReadReal(reader, &value) ? [NSNumber numberWithDouble:value] : nil;
+        }
+        case SKNBinaryTagTrue:
+            return [NSNumber numberWithBool:YES];
+        case SKNBinaryTagFalse:
+            return [NSNumber numberWithBool:NO];
+        case SKNBinaryTagDate:
+        {
+            double value = 0.0;
+            return SKNReadReal(reader, &value) ? [NSDate dateWithTimeIntervalSinceReferenceDate:value] : nil;
+        }
+        case SKNBinaryTagColor:
+        {
+            CGFloat c[4];
+            double value = 0.0;
+            NSUInteger i;
+            for (i = 0; i < 4; i++) {
+                if (SKNReadReal(reader, &value) == NO)
+                    return nil;
+                c[i] = value;
+            }
+            return [NSColor colorWithColorSpace:[NSColorSpace sRGBColorSpace] components:c count:4];
+        }
+        case SKNBinaryTagFont:
+        {
+            NSString *fontName = SKNReadString(reader);
+            double pointSize = 0.0;
+            if (fontName == nil || SKNReadReal(reader, &pointSize) == NO)
+                return nil;
+            // notes usually share a few fonts, so don't look them up again
+            NSString *fontKey = [NSString stringWithFormat:@"%@ %f", fontName, pointSize];
+            NSFont *font = [reader->fonts objectForKey:fontKey];
+            if (font == nil) {
+                font = [NSFont fontWithName:fontName size:pointSize] ?: [NSFont userFontOfSize:pointSize];
+                if (font)
+                    [reader->fonts setObject:font forKey:fontKey];
+            }
+            return font;
+        }
+        case SKNBinaryTagText:
+        {
+            NSData *data = SKNReadData(reader);
+            return data ? [[[SKNLazyAttributedString alloc] initWithData:data] autorelease] : nil;
+        }
+        case SKNBinaryTagImage:
+        {
+            double width = 0.0, height = 0.0;
+            if (SKNReadReal(reader, &width) == NO || SKNReadReal(reader, &height) == NO)
+                return nil;
+            NSData *data = SKNReadData(reader);
+            if (data == nil)
+                return nil;
+            if (width <= 0.0 || height <= 0.0)
+                return [[[NSImage alloc] initWithData:data] autorelease];
+            NSImage *image = [[[NSImage alloc] initWithSize:NSMakeSize(width, height)] autorelease];
+            SKNLazyImageRep *imageRep = [[SKNLazyImageRep alloc] initWithData:data size:NSMakeSize(width, height)];
+            [image addRepresentation:imageRep];
+            [imageRep release];
+            return image;
+        }
+        case SKNBinaryTagData:
+            return SKNReadData(reader);
+        case SKNBinaryTagArray:
+        {
+            if (depth >= SKN_BINARY_MAX_DEPTH)
+                return nil;
+            NSMutableArray *array = [NSMutableArray array];
+            uint8_t itemTag;
+            while (SKNReadByte(reader, &itemTag)) {
+                if (itemTag == SKNBinaryTagEnd)
+                    return array;
+                id item = SKNReadValue(reader, itemTag, depth + 1);
+                if (item == nil)
+                    return nil;
+                [array addObject:item];
+            }
+            return nil;
+        }
+        case SKNBinaryTagDictionary:
+        {
+            if (depth >= SKN_BINARY_MAX_DEPTH)
+                return nil;
+            NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+            uint8_t itemTag;
+            while (SKNReadByte(reader, &itemTag)) {
+                if (itemTag == SKNBinaryTagEnd)
+                    return dict;
+                NSString *key = SKNReadKey(reader);
+                id item = key ? SKNReadValue(reader, itemTag, depth + 1) : nil;
+                if (item == nil)
+                    return nil;
+                [dict setObject:item forKey:key];
+            }
+            return nil;
+        }
+        case SKNBinaryTagChunk:
+            return SKNReadChunk(reader, depth);
+        default:
+            return nil;
+    }
+}
+
+static BOOL SKNIsBinaryNotesData(NSData *data) {
+    return [data length] > SKN_BINARY_MAGIC_LENGTH && memcmp([data bytes], SKN_BINARY_MAGIC, SKN_BINARY_MAGIC_LENGTH) == 0;
+}
+
+static NSArray *SKNSkimNotesFromBinaryData(NSData *data) {
+    const uint8_t *bytes = (const uint8_t *)[data bytes];
+    SKNBinaryReader reader;
+    uint8_t tag;
+    
+    // a newer major version may change the layout, so we cannot read it
+    if ([data length] <= SKN_BINARY_MAGIC_LENGTH || bytes[SKN_BINARY_MAGIC_LENGTH] != SKN_BINARY_VERSION)
+        return nil;
+    
+    // mutable data could change under the shared data
+    reader.source = [data isKindOfClass:[NSMutableData class]] ? nil : data;
+    reader.bytes = bytes + SKN_BINARY_MAGIC_LENGTH + 1;
+    reader.end = bytes + [data length];
+    reader.keys = [NSMutableArray array];
+    reader.fonts = [NSMutableDictionary dictionary];
+    
+    if (SKNReadByte(&reader, &tag) == NO || tag != SKNBinaryTagArray)
+        return nil;
+    
+    NSArray *noteDicts = SKNReadValue(&reader, tag, 0);
+    
+    for (id dict in noteDicts) {
+        if ([dict isKindOfClass:[NSDictionary class]] == NO)
+            return nil;
+    }
+    return noteDicts;
+}
+
+NSData *SKNBinaryDataFromSkimNotes(NSArray *noteDicts) {
+    if (noteDicts == nil)
+        return nil;
+    
+    SKNBinaryWriter writer;
+    uint8_t version = SKN_BINARY_VERSION;
+    
+    writer.data = [NSMutableData dataWithCapacity:256 * [noteDicts count] + 16];
+    writer.keys = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPersonality valueOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsIntegerPersonality capacity:32];
+    writer.keyCount = 0;
+    
+    [writer.data appendBytes:SKN_BINARY_MAGIC length:SKN_BINARY_MAGIC_LENGTH];
+    [writer.data appendBytes:&version length:1];
+    SKNWriteByte(&writer, SKNBinaryTagArray);
+    SKNWriteValue(&writer, noteDicts, SKNBinaryTagArray);
+    
+    [writer.keys release];
+    return writer.data;
+}
+
+NSData *SKNBinaryChunkFromSkimNote(NSDictionary *noteDict) {
+    if ([noteDict isKindOfClass:[NSDictionary class]] == NO)
+        return nil;
+    
+    SKNBinaryWriter writer;
+    
+    writer.data = [NSMutableData dataWithCapacity:256];
+    writer.keys = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPersonality valueOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsIntegerPersonality capacity:16];
+    writer.keyCount = 0;
+    
+    SKNWriteByte(&writer, SKNBinaryTagDictionary);
+    SKNWriteValue(&writer, noteDict, SKNBinaryTagDictionary);
+    
+    [writer.keys release];
+    return writer.data;
+}
+
+NSData *SKNBinaryDataFromSkimNoteChunks(NSArray *chunks) {
+    if (chunks == nil)
+        return nil;
+    
+    SKNBinaryWriter writer;
+    uint8_t version = SKN_BINARY_VERSION;
+    NSUInteger length = SKN_BINARY_MAGIC_LENGTH + 3;
+    
+    for (NSData *chunk in chunks)
+        length += [chunk length] + 6;
+    
+    writer.data = [NSMutableData dataWithCapacity:length];
+    writer.keys = nil;
+    writer.keyCount = 0;
+    
+    [writer.data appendBytes:SKN_BINARY_MAGIC length:SKN_BINARY_MAGIC_LENGTH];
+    [writer.data appendBytes:&version length:1];
+    SKNWriteByte(&writer, SKNBinaryTagArray);
+    for (NSData *chunk in chunks) {
+        SKNWriteByte(&writer, SKNBinaryTagChunk);
+        SKNWriteBytes(&writer, chunk);
+    }
+    SKNWriteByte(&writer, SKNBinaryTagEnd);
+    
+    return writer.data;
+}
+
 NSArray *SKNSkimNotesFromData(NSData *data) {
     NSArray *noteDicts = nil;
     
-    if ([data length]) {
+    if (SKNIsBinaryNotesData(data)) {
+        noteDicts = SKNSkimNotesFromBinaryData(data);
+    } else if ([data length]) {
         @try { noteDicts = [NSKeyedUnarchiver unarchiveObjectWithData:data]; }
         @catch (id e) {}
         if (noteDicts == nil) {
@@ -211,13 +916,9 @@ NSArray *SKNSkimNotesFromData(NSData *data) {
                     }
                     if ((value = [dict objectForKey:NOTE_TEXT_KEY])) {
                         if ([value isKindOfClass:[NSData class]]) {
-                            value = [[NSAttributedString alloc] initWithData:value options:[NSDictionary dictionary] documentAttributes:NULL error:NULL];
-                            if (value) {
-                                [dict setObject:value forKey:NOTE_TEXT_KEY];
-                                [value release];
-                            } else {
-                                [dict removeObjectForKey:NOTE_TEXT_KEY];
-                            }
+                            value = [[SKNLazyAttributedString alloc] initWithData:value];
+                            [dict setObject:value forKey:NOTE_TEXT_KEY];
+                            [value release];
                         } else if ([value isKindOfClass:[NSAttributedString class]] == NO) {
                             [dict removeObjectForKey:NOTE_TEXT_KEY];
                         }
@@ -276,28 +977,14 @@ NSData *SKNDataFromSkimNotes(NSArray *noteDicts, BOOL asPlist) {
                 }
                 if ((value = [dict objectForKey:NOTE_TEXT_KEY])) {
                     if ([value isKindOfClass:[NSAttributedString class]]) {
-                        if ([value containsAttachments]) {
-                            value = [value RTFDFromRange:NSMakeRange(0, [value length]) documentAttributes:[NSDictionary dictionary]];
-                        } else {
-                            value = [value RTFFromRange:NSMakeRange(0, [value length]) documentAttributes:[NSDictionary dictionary]];
-                        }
-                        [dict setObject:value forKey:NOTE_TEXT_KEY];
+                        [dict setObject:SKNDataFromAttributedString(value) forKey:NOTE_TEXT_KEY];
                     } else if ([value isKindOfClass:[NSData class]] == NO) {
                         [dict removeObjectForKey:NOTE_TEXT_KEY];
                     }
                 }
                 if ((value = [dict objectForKey:NOTE_IMAGE_KEY])) {
                     if ([value isKindOfClass:[NSImage class]]) {
-                        id imageRep = [[value representations] count] == 1 ? [[value representations] objectAtIndex:0] : nil;
-                        if ([imageRep isKindOfClass:[NSPDFImageRep class]]) {
-                            value = [imageRep PDFRepresentation];
-                        } else if ([imageRep isKindOfClass:[NSEPSImageRep class]]) {
-                            value = [imageRep EPSRepresentation];
-                        } else {
-                            value = [value TIFFRepresentation];
-                        }
-                        [dict setObject:value forKey:NOTE_IMAGE_KEY];
-                        [value release];
+                        [dict setObject:SKNDataFromImage(value) forKey:NOTE_IMAGE_KEY];
                     } else if ([value isKindOfClass:[NSData class]] == NO) {
                         [dict removeObjectForKey:NOTE_IMAGE_KEY];
                     }
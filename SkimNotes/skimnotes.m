@@ -43,6 +43,7 @@
 
 static char *usageStr = "Usage:\n"
                         " skimnotes get [-format skim|text|rtf] PDF_FILE [NOTES_FILE|-]\n"
+                        " skimnotes batch [-format skim|text|rtf] [-jobs N] FILE|DIRECTORY|- ...\n"
                         " skimnotes set [-s|-n] PDF_FILE [SKIM_FILE|-] [TEXT_FILE] [RTF_FILE]\n"
                         " skimnotes remove PDF_FILE\n"
                         " skimnotes test [-s|-n] PDF_FILE\n"
@@ -60,6 +61,13 @@ static char *getHelpStr = "skimnotes get: read Skim notes from a PDF\n"
                           "Reads Skim, Text, or RTF notes from extended attributes of PDF_FILE or the contents of PDF bundle PDF_FILE and writes to NOTES_FILE or standard output.\n"
                           "Uses notes file with same base name as PDF_FILE if SKIM_FILE is not provided.\n"
                           "Reads Skim notes when no format is provided.";
+static char *batchHelpStr = "skimnotes batch: read Skim notes from many files\n"
+                            "Usage: skimnotes batch [-format skim|text|rtf] [-jobs N] FILE|DIRECTORY|- ...\n\n"
+                            "Reads Skim, Text, or RTF notes from each PDF file, PDF bundle, or Skim file FILE, and from those files inside each DIRECTORY, and writes one JSON record per line to standard output.\n"
+                            "Reads the list of files from standard input, one per line, when - is provided.\n"
+                            "Each record has a \"path\" and either a \"notes\" (Base64 encoded Skim notes), \"text\", or \"rtf\" (Base64 encoded) value, or an \"error\" value, in the order in which the files are finished.\n"
+                            "Reads N files at a time when the -jobs option is provided, defaults to the number of processors.\n"
+                            "Reads Skim notes when no format is provided.";
 static char *setHelpStr = "skimnotes set: write Skim notes to a PDF\n"
                           "Usage: skimnotes set [-s|-n] PDF_FILE [SKIM_FILE|-] [TEXT_FILE] [RTF_FILE]\n\n"
                           "Writes notes to extended attributes of PDF_FILE or the contents of PDF bundle PDF_FILE from SKIM_FILE or standard input.\n"
@@ -96,6 +104,9 @@ static char *agentHelpStr = "skimnotes agent: run the Skim Notes agent\n"
                             "- (bycopy NSData *)SkimNotesAtPath:(in bycopy NSString *)aFile;\n"
                             "- (bycopy NSData *)RTFNotesAtPath:(in bycopy NSString *)aFile;\n"
                             "- (bycopy NSData *)textNotesAtPath:(in bycopy NSString *)aFile encoding:(NSStringEncoding)encoding;\n"
+                            "- (bycopy NSArray *)SkimNotesAtPaths:(in bycopy NSArray *)files;\n"
+                            "- (bycopy NSArray *)RTFNotesAtPaths:(in bycopy NSArray *)files;\n"
+                            "- (bycopy NSArray *)textNotesAtPaths:(in bycopy NSArray *)files encoding:(NSStringEncoding)encoding;\n"
                             "@end";
 static char *protocolHelpStr = "skimnotes protocol: write the DO server protocol to standard output\n"
                                "Usage: skimnotes protocol\n\n"
@@ -111,9 +122,13 @@ static char *protocolStr = "@protocol SKNAgentListenerProtocol\n"
                            "- (bycopy NSData *)SkimNotesAtPath:(in bycopy NSString *)aFile;\n"
                            "- (bycopy NSData *)RTFNotesAtPath:(in bycopy NSString *)aFile;\n"
                            "- (bycopy NSData *)textNotesAtPath:(in bycopy NSString *)aFile encoding:(NSStringEncoding)encoding;\n"
+                           "- (bycopy NSArray *)SkimNotesAtPaths:(in bycopy NSArray *)files;\n"
+                           "- (bycopy NSArray *)RTFNotesAtPaths:(in bycopy NSArray *)files;\n"
+                           "- (bycopy NSArray *)textNotesAtPaths:(in bycopy NSArray *)files encoding:(NSStringEncoding)encoding;\n"
                            "@end";
 
 #define ACTION_GET_STRING       @"get"
+#define ACTION_BATCH_STRING     @"batch"
 #define ACTION_SET_STRING       @"set"
 #define ACTION_REMOVE_STRING    @"remove"
 #define ACTION_TEST_STRING      @"test"
@@ -126,6 +141,7 @@ static char *protocolStr = "@protocol SKNAgentListenerProtocol\n"
 #define ACTION_HELP_STRING      @"help"
 
 #define FORMAT_OPTION_STRING        @"-format"
+#define JOBS_OPTION_STRING          @"-jobs"
 #define SYNCABLE_OPTION_STRING      @"-s"
 #define NONSYNCABLE_OPTION_STRING   @"-n"
 
@@ -150,6 +166,7 @@ static char *protocolStr = "@protocol SKNAgentListenerProtocol\n"
 enum {
     SKNActionUnknown,
     SKNActionGet,
+    SKNActionBatch,
     SKNActionSet,
     SKNActionRemove,
     SKNActionTest,
@@ -174,6 +191,8 @@ enum {
 static NSInteger SKNActionForName(NSString *actionString) {
     if ([actionString caseInsensitiveCompare:ACTION_GET_STRING] == NSOrderedSame)
         return SKNActionGet;
+    else if ([actionString caseInsensitiveCompare:ACTION_BATCH_STRING] == NSOrderedSame)
+        return SKNActionBatch;
     else if ([actionString caseInsensitiveCompare:ACTION_SET_STRING] == NSOrderedSame)
         return SKNActionSet;
     else if ([actionString caseInsensitiveCompare:ACTION_REMOVE_STRING] == NSOrderedSame)
@@ -225,6 +244,147 @@ static inline NSString *SKNNormalizedPath(NSString *path) {
     return path;
 }
 
+static NSData *SKNBatchRecordForPath(NSString *path, NSInteger format, BOOL *success) {
+    NSFileManager *fm = [[[NSFileManager alloc] init] autorelease];
+    NSMutableDictionary *record = [NSMutableDictionary dictionaryWithObjectsAndKeys:path, @"path", nil];
+    NSString *extension = [path pathExtension];
+    BOOL isSkimFile = [extension caseInsensitiveCompare:SKIM_EXTENSION] == NSOrderedSame;
+    BOOL isDir = NO;
+    NSError *error = nil;
+    
+    if ([fm fileExistsAtPath:path isDirectory:&isDir] == NO || isDir != ([extension caseInsensitiveCompare:PDFD_EXTENSION] == NSOrderedSame)) {
+        error = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOENT userInfo:[NSDictionary dictionaryWithObjectsAndKeys:@"File does not exist", NSLocalizedDescriptionKey, nil]];
+    } else if (format == SKNFormatText || format == SKNFormatRTF) {
+        NSString *textNotes = nil;
+        NSData *rtfNotes = nil;
+        if (isSkimFile) {
+            // Skim files only contain the notes, so create the requested form from them
+            NSData *data = [fm SkimNotesAtPath:path error:&error];
+            if (data)
+                SKNSkimTextAndRTFNotes(SKNSkimNotesFromData(data), format == SKNFormatText ? &textNotes : NULL, format == SKNFormatRTF ? &rtfNotes : NULL);
+        } else if (format == SKNFormatText) {
+            textNotes = [fm SkimTextNotesAtPath:path error:&error];
+        } else {
+            rtfNotes = [fm SkimRTFNotesAtPath:path error:&error];
+        }
+        if (textNotes)
+            [record setObject:textNotes forKey:@"text"];
+        else if (rtfNotes)
+            [record setObject:[rtfNotes base64EncodedStringWithOptions:0] forKey:@"rtf"];
+    } else {
+        NSData *data = [fm SkimNotesAtPath:path error:&error];
+        if (data)
+            [record setObject:[data base64EncodedStringWithOptions:0] forKey:@"notes"];
+    }
+    
+    if ([record count] == 1) {
+        [record setObject:[error localizedDescription] ?: @"Unable to read notes" forKey:@"error"];
+        *success = NO;
+    }
+    
+    NSData *json = [NSJSONSerialization dataWithJSONObject:record options:0 error:NULL];
+    if (json == nil) {
+        // the notes or the path contain strings JSON cannot represent, such as unpaired surrogates
+        NSDictionary *errorRecord = [NSDictionary dictionaryWithObjectsAndKeys:path, @"path", @"Unable to encode notes as JSON", @"error", nil];
+        json = [NSJSONSerialization dataWithJSONObject:errorRecord options:0 error:NULL] ?: [@"{\"error\":\"Unable to encode path as JSON\"}" dataUsingEncoding:NSUTF8StringEncoding];
+        *success = NO;
+    }
+    
+    NSMutableData *line = [[json mutableCopy] autorelease];
+    [line appendBytes:"\n" length:1];
+    return line;
+}
+
+static BOOL SKNIsBatchFile(NSString *path) {
+    NSString *extension = [path pathExtension];
+    return [extension caseInsensitiveCompare:PDF_EXTENSION] == NSOrderedSame ||
+           [extension caseInsensitiveCompare:PDFD_EXTENSION] == NSOrderedSame ||
+           [extension caseInsensitiveCompare:SKIM_EXTENSION] == NSOrderedSame;
+}
+
+static BOOL SKNReadBatch(NSArray *paths, NSInteger format, NSInteger jobs) {
+    __block BOOL success = YES;
+    dispatch_queue_t workQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    dispatch_queue_t outputQueue = dispatch_queue_create("net.sourceforge.skim-app.skimnotes.batch", DISPATCH_QUEUE_SERIAL);
+    dispatch_group_t group = dispatch_group_create();
+    // the semaphore bounds the number of files in flight, so we don't queue up a whole directory tree at once
+    dispatch_semaphore_t slots = dispatch_semaphore_create(jobs);
+    NSFileHandle *outputHandle = [NSFileHandle fileHandleWithStandardOutput];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    
+    void (^readFile)(NSString *) = ^(NSString *file) {
+        dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+        dispatch_group_async(group, workQueue, ^{
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            BOOL fileSuccess = YES;
+            NSData *line = [SKNBatchRecordForPath(file, format, &fileSuccess) retain];
+            dispatch_async(outputQueue, ^{
+                [outputHandle writeData:line];
+                [line release];
+                if (fileSuccess == NO)
+                    success = NO;
+            });
+            [pool release];
+            dispatch_semaphore_signal(slots);
+        });
+    };
+    
+    void (^readPath)(NSString *) = ^(NSString *path) {
+        BOOL isDir = NO;
+        path = SKNNormalizedPath(path);
+        if ([fm fileExistsAtPath:path isDirectory:&isDir] && isDir && [[path pathExtension] caseInsensitiveCompare:PDFD_EXTENSION] != NSOrderedSame) {
+            NSDirectoryEnumerator *dirEnum = [fm enumeratorAtPath:path];
+            NSString *subpath;
+            while ((subpath = [dirEnum nextObject])) {
+                NSAutoreleasePool *innerPool = [[NSAutoreleasePool alloc] init];
+                if (SKNIsBatchFile(subpath)) {
+                    if ([[subpath pathExtension] caseInsensitiveCompare:PDFD_EXTENSION] == NSOrderedSame)
+                        [dirEnum skipDescendents];
+                    readFile([path stringByAppendingPathComponent:subpath]);
+                }
+                [innerPool release];
+            }
+        } else {
+            readFile(path);
+        }
+    };
+    
+    for (NSString *path in paths) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        if ([path isEqualToString:STD_IN_OUT_FILE]) {
+            // dispatch the paths as they arrive, readFile blocks while all slots are in use so a long list is never held in memory
+            char *buffer = NULL;
+            size_t capacity = 0;
+            ssize_t lineLength;
+            while ((lineLength = getline(&buffer, &capacity, stdin)) > 0) {
+                NSAutoreleasePool *linePool = [[NSAutoreleasePool alloc] init];
+                while (lineLength > 0 && (buffer[lineLength - 1] == '\n' || buffer[lineLength - 1] == '\r'))
+                    lineLength--;
+                if (lineLength > 0) {
+                    NSString *line = [[[NSString alloc] initWithBytes:buffer length:lineLength encoding:NSUTF8StringEncoding] autorelease];
+                    if (line)
+                        readPath(line);
+                }
+                [linePool release];
+            }
+            free(buffer);
+        } else {
+            readPath(path);
+        }
+        [pool release];
+    }
+    
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    // make sure all records have been written
+    dispatch_sync(outputQueue, ^{});
+    
+    dispatch_release(slots);
+    dispatch_release(group);
+    dispatch_release(outputQueue);
+    
+    return success;
+}
+
 int main (int argc, const char * argv[]) {
     NSAutoreleasePool *pool = [NSAutoreleasePool new];
  
@@ -279,6 +439,9 @@ int main (int argc, const char * argv[]) {
             case SKNActionGet:
                 WRITE_OUT(getHelpStr);
                 break;
+            case SKNActionBatch:
+                WRITE_OUT(batchHelpStr);
+                break;
             case SKNActionSet:
                 WRITE_OUT(setHelpStr);
                 break;
@@ -316,6 +479,28 @@ int main (int argc, const char * argv[]) {
         
         WRITE_OUT(versionStr);
         
+    } else if (action == SKNActionBatch) {
+        
+        NSInteger format = SKNFormatSkim;
+        NSInteger jobs = [[NSProcessInfo processInfo] activeProcessorCount];
+        int offset = 2;
+        
+        while (offset + 1 < argc && ([[args objectAtIndex:offset] isEqualToString:FORMAT_OPTION_STRING] || [[args objectAtIndex:offset] isEqualToString:JOBS_OPTION_STRING])) {
+            if ([[args objectAtIndex:offset] isEqualToString:FORMAT_OPTION_STRING])
+                format = SKNFormatForString([args objectAtIndex:offset + 1]);
+            else
+                jobs = [[args objectAtIndex:offset + 1] integerValue];
+            offset += 2;
+        }
+        
+        if (offset >= argc || (format != SKNFormatSkim && format != SKNFormatText && format != SKNFormatRTF) || jobs < 1) {
+            WRITE_ERROR;
+            [pool release];
+            exit(EXIT_FAILURE);
+        }
+        
+        success = SKNReadBatch([args subarrayWithRange:NSMakeRange(offset, argc - offset)], format, jobs);
+        
     } else {
         
         if (argc < 3) {
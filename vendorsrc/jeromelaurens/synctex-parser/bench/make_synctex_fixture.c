@@ -0,0 +1,99 @@
+//
+//  make_synctex_fixture.c
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*  Writes a synthetic gzipped synctex file, to benchmark the synctex parser without a TeX installation.
+ *  Every page has a vertical box with a number of lines, each an horizontal box with kerns and glues,
+ *  alternating between two input files, much like the output of pdflatex for plain text.
+ *
+ *  Usage: make_synctex_fixture output.synctex.gz [pages [lines per page [items per line]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+int main(int argc, char *argv[]) {
+    gzFile file;
+    long pages = 2000, lines = 60, items = 10, page, line, item;
+    
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s output.synctex.gz [pages [lines per page [items per line]]]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2)
+        pages = strtol(argv[2], NULL, 10);
+    if (argc > 3)
+        lines = strtol(argv[3], NULL, 10);
+    if (argc > 4)
+        items = strtol(argv[4], NULL, 10);
+    if (pages < 1 || lines < 1 || items < 0) {
+        fprintf(stderr, "%s: invalid fixture size\n", argv[0]);
+        return 1;
+    }
+    
+    file = gzopen(argv[1], "wb6");
+    if (file == NULL) {
+        fprintf(stderr, "%s: cannot write %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    
+    gzprintf(file, "SyncTeX Version:1\nInput:1:main.tex\nInput:2:chapter.tex\nOutput:pdf\nMagnification:1000\nUnit:1\nX Offset:0\nY Offset:0\nContent:\n");
+    for (page = 1; page <= pages; page++) {
+        gzprintf(file, "!%ld\n{%ld\n[1,%ld:4736286,49361166:30583320,45114153,0\n", 1000 + page, page, page * lines);
+        for (line = 0; line < lines; line++) {
+            int tag = 1 + (int)(line % 2);
+            long texLine = page * lines + line;
+            long v = 1000000 + line * 800000;
+            gzprintf(file, "(%d,%ld:4736286,%ld:30583320,655360,0\n", tag, texLine, v);
+            for (item = 0; item < items; item++) {
+                long h = 4736286 + item * 2000000;
+                gzprintf(file, "x%d,%ld:%ld,%ld\n", tag, texLine, h, v);
+                gzprintf(file, "g%d,%ld:%ld,%ld\n", tag, texLine, h + 100000, v);
+            }
+            gzprintf(file, ")\n");
+        }
+        gzprintf(file, "]\n}%ld\n", page);
+    }
+    gzprintf(file, "Postamble:\nCount:%ld\nPost scriptum:\n", pages * lines * (2 * items + 1));
+    
+    if (gzclose(file) != Z_OK) {
+        fprintf(stderr, "%s: error writing %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+//
+//  synctex_bench.c
+//  Skim
+//
+//  Created by Christiaan Hofman on 12/22/20.
+/*
+ This software is Copyright (c) 2020
+ Christiaan Hofman. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+ - Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in
+    the documentation and/or other materials provided with the
+    distribution.
+
+ - Neither the name of Christiaan Hofman nor the names of any
+    contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*  Times how long the synctex parser takes to build a scanner for a synctex file, and runs a fixed set of
+ *  queries whose checksum should not depend on how the parser was built.
+ *
+ *  Usage: synctex_bench output.pdf [runs]
+ *  The synctex file is looked up next to the output file, as Skim does, e.g. output.synctex.gz.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "synctex_parser.h"
+
+#define MAX_RUNS 100
+
+static double synctex_bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int synctex_bench_compare(const void *p1, const void *p2) {
+    double d1 = *(const double *)p1, d2 = *(const double *)p2;
+    return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+static unsigned long synctex_bench_queries(synctex_scanner_p scanner, int *count) {
+    unsigned long hash = 0;
+    synctex_node_p node;
+    int line, page;
+    *count = 0;
+    for (line = 1; line < 1000000; line += 97) {
+        if (synctex_display_query(scanner, line % 2 ? "main.tex" : "chapter.tex", line, 0, -1) > 0) {
+            while ((node = synctex_scanner_next_result(scanner))) {
+                hash = 31 * hash + 1000 * synctex_node_page(node) + (unsigned long)synctex_node_visible_v(node);
+                (*count)++;
+            }
+        }
+    }
+    for (page = 1; page < 100000; page += 3) {
+        if (synctex_edit_query(scanner, page, 100 + page % 300, 50 + page % 600) <= 0)
+            break;
+        while ((node = synctex_scanner_next_result(scanner))) {
+            hash = 31 * hash + synctex_node_line(node);
+            (*count)++;
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char *argv[]) {
+    double times[MAX_RUNS], queryTime = 0.0;
+    unsigned long hash = 0;
+    int i, runs = 5, count = 0;
+    
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s output.pdf [runs]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2)
+        runs = atoi(argv[2]);
+    if (runs < 1)
+        runs = 1;
+    else if (runs > MAX_RUNS)
+        runs = MAX_RUNS;
+    
+    for (i = 0; i < runs; i++) {
+        double start = synctex_bench_now();
+        synctex_scanner_p scanner = synctex_scanner_new_with_output_file(argv[1], NULL, 1);
+        times[i] = synctex_bench_now() - start;
+        if (scanner == NULL) {
+            fprintf(stderr, "%s: no synctex file for %s\n", argv[0], argv[1]);
+            return 1;
+        }
+        if (i == 0) {
+            start = synctex_bench_now();
+            hash = synctex_bench_queries(scanner, &count);
+            queryTime = synctex_bench_now() - start;
+        }
+        synctex_scanner_free(scanner);
+    }
+    
+    qsort(times, runs, sizeof(double), &synctex_bench_compare);
+    printf("parse: min %.3f s, median %.3f s over %d runs\n", times[0], times[runs / 2], runs);
+    printf("queries: %d results in %.3f s, checksum %lx\n", count, queryTime, hash);
+    return 0;
+}
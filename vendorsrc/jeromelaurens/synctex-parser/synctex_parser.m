@@ -501,6 +501,20 @@ DEFINE_SYNCTEX_TREE_GETSETRESET(target)
 #		include <zlib.h>
 #	endif
 
+/*  Inflating the file in a separate thread lets the parser work while zlib decompresses the next part.
+ *  Define SYNCTEX_USE_PIPELINE to 0 to read the file synchronously.
+ *  Nodes are still built on the parsing thread, see bench/README.txt for why and for a benchmark. */
+#   if !defined(SYNCTEX_USE_PIPELINE)
+#       if defined(_WIN32)
+#           define SYNCTEX_USE_PIPELINE 0
+#       else
+#           define SYNCTEX_USE_PIPELINE 1
+#       endif
+#   endif
+#   if SYNCTEX_USE_PIPELINE
+#       include <pthread.h>
+#   endif
+
 #	ifdef SYNCTEX_NOTHING
 #       pragma mark -
 #       pragma mark STATUS
@@ -536,8 +550,39 @@ DEFINE_SYNCTEX_TREE_GETSETRESET(target)
 #   error BAD BUFFER SIZE(2)
 #endif
 
+#   if SYNCTEX_USE_PIPELINE
+/*  The pipeline inflates the file into a ring of large chunks in a background thread.
+ *  The chunk before the current one is kept, so the parser can seek back a little, see _synctex_match_string. */
+#       define SYNCTEX_PIPELINE_CHUNK_SIZE 1048576
+#       define SYNCTEX_PIPELINE_CHUNK_COUNT 4
+
+#if SYNCTEX_PIPELINE_CHUNK_SIZE <= 2 * SYNCTEX_BUFFER_SIZE
+#   error BAD PIPELINE CHUNK SIZE
+#endif
+
+typedef struct synctex_pipeline_t {
+    gzFile file;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char * chunks[SYNCTEX_PIPELINE_CHUNK_COUNT];
+    int lengths[SYNCTEX_PIPELINE_CHUNK_COUNT];      /*  0 at the end of the file, negative on error */
+    z_off_t offsets[SYNCTEX_PIPELINE_CHUNK_COUNT];  /*  uncompressed offset of the start of the chunk */
+    unsigned long produced;     /*  the number of chunks inflated so far */
+    unsigned long consumed;     /*  the sequence number of the chunk being read */
+    int position;               /*  position in the chunk being read */
+    int errnum;
+    int cancelled;
+} synctex_pipeline_s;
+
+typedef synctex_pipeline_s * synctex_pipeline_p;
+#   endif
+
 typedef struct synctex_reader_t {
     gzFile file;    /*  The (possibly compressed) file */
+#   if SYNCTEX_USE_PIPELINE
+    synctex_pipeline_p pipeline; /*  When not NULL, owns the file */
+#   endif
     char * output;
     char * synctex;
     char * current; /*  current location in the buffer */
@@ -733,12 +778,222 @@ static synctex_open_s _synctex_open_v2(const char * output, const char * build_d
     } /* if (build_directory...) */
     return open;
 }
+#	ifdef SYNCTEX_NOTHING
+#       pragma mark -
+#       pragma mark Pipelined reading
+#   endif
+
+#   if SYNCTEX_USE_PIPELINE
+static void * _synctex_pipeline_run(void * arg) {
+    synctex_pipeline_p pipeline = (synctex_pipeline_p)arg;
+    z_off_t offset = 0;
+    int length = 0;
+    do {
+        unsigned long index = 0;
+        int cancelled = 0;
+        pthread_mutex_lock(&pipeline->mutex);
+        /*  Never overwrite the current chunk or the one before it. */
+        while (!pipeline->cancelled && pipeline->produced + 2 > pipeline->consumed + SYNCTEX_PIPELINE_CHUNK_COUNT) {
+            pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+        }
+        index = pipeline->produced % SYNCTEX_PIPELINE_CHUNK_COUNT;
+        cancelled = pipeline->cancelled;
+        pthread_mutex_unlock(&pipeline->mutex);
+        if (cancelled) {
+            break;
+        }
+        length = gzread(pipeline->file, pipeline->chunks[index], SYNCTEX_PIPELINE_CHUNK_SIZE);
+        pthread_mutex_lock(&pipeline->mutex);
+        if (length < 0) {
+            gzerror(pipeline->file, &pipeline->errnum);
+            if (Z_ERRNO == pipeline->errnum) {
+                pipeline->errnum = errno;
+            }
+        }
+        pipeline->lengths[index] = length;
+        pipeline->offsets[index] = offset;
+        ++pipeline->produced;
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->mutex);
+        offset += length > 0 ? length : 0;
+    } while (length > 0);
+    return NULL;
+}
+
+/*  Falls back to synchronous reading when the pipeline cannot be set up. */
+static void _synctex_reader_start_pipeline(synctex_reader_p reader) {
+    synctex_pipeline_p pipeline = NULL;
+    int i = 0;
+    if (NULL == reader->file || reader->pipeline) {
+        return;
+    }
+    if (NULL == (pipeline = (synctex_pipeline_p)_synctex_malloc(sizeof(synctex_pipeline_s)))) {
+        return;
+    }
+    for (i = 0; i < SYNCTEX_PIPELINE_CHUNK_COUNT; ++i) {
+        if (NULL == (pipeline->chunks[i] = (char *)malloc(SYNCTEX_PIPELINE_CHUNK_SIZE))) {
+            goto bail;
+        }
+    }
+    pipeline->file = reader->file;
+    if (pthread_mutex_init(&pipeline->mutex, NULL)) {
+        goto bail;
+    }
+    if (pthread_cond_init(&pipeline->cond, NULL)) {
+        pthread_mutex_destroy(&pipeline->mutex);
+        goto bail;
+    }
+    if (pthread_create(&pipeline->thread, NULL, &_synctex_pipeline_run, pipeline)) {
+        pthread_cond_destroy(&pipeline->cond);
+        pthread_mutex_destroy(&pipeline->mutex);
+        goto bail;
+    }
+    reader->pipeline = pipeline;
+    return;
+bail:
+    for (i = 0; i < SYNCTEX_PIPELINE_CHUNK_COUNT; ++i) {
+        free(pipeline->chunks[i]);
+    }
+    _synctex_free(pipeline);
+}
+
+static void _synctex_pipeline_stop(synctex_pipeline_p pipeline) {
+    int i = 0;
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->cancelled = 1;
+    pthread_cond_broadcast(&pipeline->cond);
+    pthread_mutex_unlock(&pipeline->mutex);
+    pthread_join(pipeline->thread, NULL);
+    pthread_cond_destroy(&pipeline->cond);
+    pthread_mutex_destroy(&pipeline->mutex);
+    for (i = 0; i < SYNCTEX_PIPELINE_CHUNK_COUNT; ++i) {
+        free(pipeline->chunks[i]);
+    }
+    _synctex_free(pipeline);
+}
+
+/*  Waits for the chunk with the given sequence number, returns its index in the ring. */
+static unsigned long _synctex_pipeline_wait(synctex_pipeline_p pipeline, unsigned long sequence) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->produced <= sequence) {
+        pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return sequence % SYNCTEX_PIPELINE_CHUNK_COUNT;
+}
+#   endif
+
+/*  Replacements for gzread, gztell, gzseek and gzclose that go through the pipeline when there is one. */
+static int _synctex_reader_read(synctex_reader_p reader, char * buffer, int size) {
+#   if SYNCTEX_USE_PIPELINE
+    synctex_pipeline_p pipeline = reader->pipeline;
+    if (pipeline) {
+        int read = 0;
+        while (read < size) {
+            unsigned long index = _synctex_pipeline_wait(pipeline, pipeline->consumed);
+            int length = pipeline->lengths[index];
+            if (length <= 0) {
+                /*  report an error only when nothing could be read */
+                return read > 0 ? read : length;
+            }
+            if (pipeline->position < length) {
+                int count = length - pipeline->position;
+                if (count > size - read) {
+                    count = size - read;
+                }
+                memcpy(buffer + read, pipeline->chunks[index] + pipeline->position, count);
+                pipeline->position += count;
+                read += count;
+            } else {
+                /*  move to the next chunk, which frees the one before the current one */
+                pthread_mutex_lock(&pipeline->mutex);
+                ++pipeline->consumed;
+                pipeline->position = 0;
+                pthread_cond_broadcast(&pipeline->cond);
+                pthread_mutex_unlock(&pipeline->mutex);
+            }
+        }
+        return read;
+    }
+#   endif
+    return gzread(reader->file, (void *)buffer, size);
+}
+
+static const char * _synctex_reader_error(synctex_reader_p reader, int * errnum) {
+#   if SYNCTEX_USE_PIPELINE
+    if (reader->pipeline) {
+        if (reader->pipeline->errnum > 0) {
+            /*  a file system error, errno was saved by the pipeline thread */
+            errno = reader->pipeline->errnum;
+            *errnum = Z_ERRNO;
+            return strerror(errno);
+        }
+        *errnum = reader->pipeline->errnum;
+        return zError(*errnum);
+    }
+#   endif
+    return gzerror(reader->file, errnum);
+}
+
+static z_off_t _synctex_reader_tell(synctex_reader_p reader) {
+#   if SYNCTEX_USE_PIPELINE
+    synctex_pipeline_p pipeline = reader->pipeline;
+    if (pipeline) {
+        unsigned long index = _synctex_pipeline_wait(pipeline, pipeline->consumed);
+        return pipeline->offsets[index] + pipeline->position;
+    }
+#   endif
+    return gztell(reader->file);
+}
+
+/*  Only seeking back into the current or the previous chunk is supported by the pipeline. */
+static z_off_t _synctex_reader_seek(synctex_reader_p reader, z_off_t offset) {
+#   if SYNCTEX_USE_PIPELINE
+    synctex_pipeline_p pipeline = reader->pipeline;
+    if (pipeline) {
+        unsigned long index = _synctex_pipeline_wait(pipeline, pipeline->consumed);
+        if (offset >= pipeline->offsets[index] && offset <= pipeline->offsets[index] + (pipeline->lengths[index] > 0 ? pipeline->lengths[index] : 0)) {
+            pipeline->position = (int)(offset - pipeline->offsets[index]);
+            return offset;
+        }
+        if (pipeline->consumed > 0 && offset < pipeline->offsets[index]) {
+            unsigned long previous = (pipeline->consumed - 1) % SYNCTEX_PIPELINE_CHUNK_COUNT;
+            /*  the previous chunk is still there as long as the pipeline did not wrap around it */
+            pthread_mutex_lock(&pipeline->mutex);
+            if (pipeline->produced + 1 < pipeline->consumed + SYNCTEX_PIPELINE_CHUNK_COUNT &&
+                offset >= pipeline->offsets[previous]) {
+                --pipeline->consumed;
+                pipeline->position = (int)(offset - pipeline->offsets[previous]);
+                pthread_mutex_unlock(&pipeline->mutex);
+                return offset;
+            }
+            pthread_mutex_unlock(&pipeline->mutex);
+        }
+        return -1;
+    }
+#   endif
+    return gzseek(reader->file, offset, SEEK_SET);
+}
+
+static void _synctex_reader_close(synctex_reader_p reader) {
+#   if SYNCTEX_USE_PIPELINE
+    if (reader->pipeline) {
+        _synctex_pipeline_stop(reader->pipeline);
+        reader->pipeline = NULL;
+    }
+#   endif
+    if (reader->file) {
+        gzclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
 static void synctex_reader_free(synctex_reader_p reader) {
     if (reader) {
         _synctex_free(reader->output);
         _synctex_free(reader->synctex);
         _synctex_free(reader->start);
-        gzclose(reader->file);
+        _synctex_reader_close(reader);
         _synctex_free(reader);
     }
 }
@@ -3880,7 +4135,7 @@ static synctex_zs_s _synctex_buffer_get_available_size(synctex_scanner_p scanner
         }
         SYNCTEX_CUR = SYNCTEX_START + size; /*  the next character after the move, will change. */
         /*  Fill the buffer up to its end */
-        already_read = gzread(SYNCTEX_FILE,(void *)SYNCTEX_CUR,(int)(SYNCTEX_BUFFER_SIZE - size));
+        already_read = _synctex_reader_read(scanner->reader,SYNCTEX_CUR,(int)(SYNCTEX_BUFFER_SIZE - size));
         if (already_read>0) {
             /*  We assume that 0<already_read<=SYNCTEX_BUFFER_SIZE - size, such that
              *  SYNCTEX_CUR + already_read = SYNCTEX_START + size  + already_read <= SYNCTEX_START + SYNCTEX_BUFFER_SIZE */
@@ -3895,7 +4150,7 @@ static synctex_zs_s _synctex_buffer_get_available_size(synctex_scanner_p scanner
         } else if (0>already_read) {
             /*  There is a possible error in reading the file */
             int errnum = 0;
-            const char * error_string = gzerror(SYNCTEX_FILE, &errnum);
+            const char * error_string = _synctex_reader_error(scanner->reader, &errnum);
             if (Z_ERRNO == errnum) {
                 /*  There is an error in zlib caused by the file system */
                 _synctex_error("gzread error from the file system (%i)",errno);
@@ -3906,8 +4161,7 @@ static synctex_zs_s _synctex_buffer_get_available_size(synctex_scanner_p scanner
             }
         }
         /*  Nothing was read, we are at the end of the file. */
-        gzclose(SYNCTEX_FILE);
-        SYNCTEX_FILE = NULL;
+        _synctex_reader_close(scanner->reader);
         SYNCTEX_END = SYNCTEX_CUR;
         SYNCTEX_CUR = SYNCTEX_START;
         * SYNCTEX_END = '\0';/*  Terminate the string properly.*/
@@ -4010,7 +4264,7 @@ static synctex_status_t _synctex_match_string(synctex_scanner_p scanner, const c
          *  In fact, the states of the buffer before and after this function are in general different
          *  but they are totally equivalent as long as the values of the buffer before SYNCTEX_CUR
          *  can be safely discarded.  */
-        offset = gztell(SYNCTEX_FILE);
+        offset = _synctex_reader_tell(scanner->reader);
         /*  offset now corresponds to the first character of the file that was not buffered. */
         /*  SYNCTEX_CUR - SYNCTEX_START is the number of chars that where already buffered and
          *  that match the head of the_string. If in fine the_string does not match, all these chars must be recovered
@@ -4029,7 +4283,7 @@ static synctex_status_t _synctex_match_string(synctex_scanner_p scanner, const c
         if (zs.size==0) {
             /*  Missing characters: recover the initial state of the file and return. */
         return_NOT_OK:
-            if (offset != gzseek(SYNCTEX_FILE,offset,SEEK_SET)) {
+            if (offset != _synctex_reader_seek(scanner->reader,offset)) {
                 /*  This is a critical error, we could not recover the previous state. */
                 _synctex_error("Can't seek file");
                 return SYNCTEX_STATUS_ERROR;
@@ -6071,9 +6325,8 @@ synctex_scanner_p synctex_scanner_new_with_output_file(const char * output, cons
 int synctex_scanner_free(synctex_scanner_p scanner) {
     int node_count = 0;
     if (scanner) {
-        if (SYNCTEX_FILE) {
-            gzclose(SYNCTEX_FILE);
-            SYNCTEX_FILE = NULL;
+        if (scanner->reader) {
+            _synctex_reader_close(scanner->reader);
         }
         synctex_node_free(scanner->sheet);
         synctex_node_free(scanner->form);
@@ -6126,6 +6379,9 @@ synctex_scanner_p synctex_scanner_parse(synctex_scanner_p scanner) {
     SYNCTEX_CUR = SYNCTEX_END;
 #   if defined(SYNCTEX_USE_CHARINDEX)
     scanner->reader->charindex_offset = -SYNCTEX_BUFFER_SIZE;
+#   endif
+#   if SYNCTEX_USE_PIPELINE
+    _synctex_reader_start_pipeline(scanner->reader);
 #   endif
     status = _synctex_scan_preamble(scanner);
     if (status<SYNCTEX_STATUS_OK) {
@@ -6150,8 +6406,7 @@ synctex_scanner_p synctex_scanner_parse(synctex_scanner_p scanner) {
     /*  Everything is finished, free the buffer, close the file */
     free((void *)SYNCTEX_START);
     SYNCTEX_START = SYNCTEX_CUR = SYNCTEX_END = NULL;
-    gzclose(SYNCTEX_FILE);
-    SYNCTEX_FILE = NULL;
+    _synctex_reader_close(scanner->reader);
     /*  Final tuning: set the default values for various parameters */
     /*  1 pre_unit = (scanner->pre_unit)/65536 pt = (scanner->pre_unit)/65781.76 bp
      * 1 pt = 65536 sp */